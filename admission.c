@@ -0,0 +1,228 @@
+/**
+ * @file admission.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the admission control of the servers. The server's main process
+ * accepts every connection itself and counts the connections being served.
+ * A connection that arrives while every slot is taken waits in a bounded
+ * queue until a slot frees up. When the queue is full too, the client is
+ * told the server is busy and how long to wait, instead of being dropped.
+ * 
+ * Waiting connections are queued per client, and a freed slot goes to the
+ * client whose turn it is, as fairness.c decides. Each client's connections
+ * are served oldest first.
+ * 
+ * Signal handlers wake the main process through a pipe, so it can poll the
+ * pipe along with its listening sockets and never miss a freed slot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "fairness.h"
+#include "admission.h"
+#include "util.h"
+
+bool init_admission(struct Admission *admission, int limit, int queue_depth, struct Clients *clients)
+{
+    admission->limit = limit;
+    admission->n_in_flight = 0;
+    admission->peak_in_flight = 0;
+    admission->queue_depth = queue_depth;
+    admission->n_queued = 0;
+    admission->clients = clients;
+    admission->client = -1;
+    admission->n_admitted = 0;
+    admission->n_delayed = 0;
+    admission->n_rejected = 0;
+
+    // Link every entry of the queue into the list of free entries
+    admission->queue = (struct QueuedConnection *) malloc((queue_depth > 0 ? queue_depth : 1) * sizeof(struct QueuedConnection));
+    for (int i = 0; i < queue_depth; i++)
+    {
+        admission->queue[i].socket_fd = -1;
+        admission->queue[i].next = i + 1 < queue_depth ? i + 1 : -1;
+    }
+    admission->free_entry = queue_depth > 0 ? 0 : -1;
+
+    // Create the wake-up pipe; a full pipe already holds a wake-up, so writes never block
+    if (pipe(admission->wake_fds) < 0 ||
+        fcntl(admission->wake_fds[0], F_SETFL, O_NONBLOCK) < 0 ||
+        fcntl(admission->wake_fds[1], F_SETFL, O_NONBLOCK) < 0)
+    {
+        fprintf(stderr, "Error: failed to create wake-up pipe\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Takes a slot for a connection, keeping the peak number of slots taken
+ * 
+ * @param  admission admission control of the server
+ */
+static void take_slot(struct Admission *admission)
+{
+    admission->n_in_flight++;
+    if (admission->n_in_flight > admission->peak_in_flight)
+        admission->peak_in_flight = admission->n_in_flight;
+}
+
+int admit_connection(struct Admission *admission, int socket_fd)
+{
+    int client = identify_client(admission->clients, socket_fd);
+    long long now_ns = monotonic_ns();
+
+    // Serve the connection now if a slot is free, no one is waiting ahead of it, and its client is within its rate
+    if (admission->n_in_flight < admission->limit && admission->n_queued == 0 &&
+        client_may_run(admission->clients, client, now_ns))
+    {
+        take_slot(admission);
+        admission->client = client;
+        admission->accepted_ns = now_ns;
+        record_client_start(admission->clients, client, 0);
+        admission->n_admitted++;
+        return socket_fd;
+    }
+
+    // Otherwise wait for a slot behind the client's other connections, or turn the client away if the queue is full
+    if (admission->free_entry >= 0)
+    {
+        int index = admission->free_entry;
+        struct QueuedConnection *entry = &admission->queue[index];
+        admission->free_entry = entry->next;
+        entry->socket_fd = socket_fd;
+        entry->client = client;
+        entry->queued_ns = now_ns;
+        entry->next = -1;
+
+        struct Client *owner = &admission->clients->clients[client];
+        if (owner->n_queued == 0)
+            owner->head = index;
+        else
+            admission->queue[owner->tail].next = index;
+        owner->tail = index;
+        owner->n_queued++;
+        admission->n_queued++;
+        admission->n_delayed++;
+    }
+    else
+    {
+        reject_connection(socket_fd, RETRY_AFTER_MS);
+        admission->n_rejected++;
+    }
+    return -1;
+}
+
+int next_connection(struct Admission *admission)
+{
+    if (admission->n_queued == 0 || admission->n_in_flight >= admission->limit)
+        return -1;
+    long long now_ns = monotonic_ns();
+    int client = choose_client(admission->clients, now_ns);
+    if (client < 0)
+        return -1;
+
+    // Take the client's oldest waiting connection off its queue and free the entry
+    struct Client *owner = &admission->clients->clients[client];
+    int index = owner->head;
+    struct QueuedConnection *entry = &admission->queue[index];
+    int socket_fd = entry->socket_fd;
+    owner->head = entry->next;
+    owner->n_queued--;
+    admission->n_queued--;
+    record_client_start(admission->clients, client, now_ns - entry->queued_ns);
+    admission->accepted_ns = entry->queued_ns;
+    entry->socket_fd = -1;
+    entry->next = admission->free_entry;
+    admission->free_entry = index;
+
+    take_slot(admission);
+    admission->client = client;
+    return socket_fd;
+}
+
+int admission_timeout_ms(const struct Admission *admission)
+{
+    // Only a free slot with connections waiting on their clients' rates needs a wake-up
+    if (admission->n_queued == 0 || admission->n_in_flight >= admission->limit)
+        return -1;
+    long long ready_ns = next_client_ready_ns(admission->clients);
+    if (ready_ns == 0)
+        return -1;
+    long long remaining_ns = ready_ns - monotonic_ns();
+    return remaining_ns > 0 ? (int) ((remaining_ns + 999999) / 1000000) : 0;
+}
+
+bool claim_slot(struct Admission *admission)
+{
+    if (admission->n_in_flight >= admission->limit)
+        return false;
+    take_slot(admission);
+    return true;
+}
+
+void finish_connection(struct Admission *admission)
+{
+    if (admission->n_in_flight > 0)
+        admission->n_in_flight--;
+}
+
+void reject_connection(int socket_fd, int retry_after_ms)
+{
+    // Consume the client's identifier if it has arrived, since closing a socket
+    // with unread bytes resets the connection and could discard the reply
+    char identifier[MAX_HEADER_SIZE];
+    while (recv(socket_fd, identifier, sizeof(identifier), MSG_DONTWAIT) > 0)
+        continue;
+
+    // Reply in place of the handshake, then close the connection
+    char reply[MAX_HEADER_SIZE];
+    int n = snprintf(reply, sizeof(reply), "%s %s%d@", BUSY_SIGNAL, RETRY_AFTER_FIELD, retry_after_ms);
+    send(socket_fd, reply, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+    shutdown(socket_fd, SHUT_WR);
+    close(socket_fd);
+}
+
+void wake_admission(struct Admission *admission)
+{
+    char wake = 0;
+    write(admission->wake_fds[1], &wake, 1);
+}
+
+void drain_wakeups(struct Admission *admission)
+{
+    char wakes[64];
+    while (read(admission->wake_fds[0], wakes, sizeof(wakes)) > 0)
+        continue;
+}
+
+void close_admission(struct Admission *admission)
+{
+    // Walk through every entry of the queue, closing the sockets of those in use
+    for (int i = 0; i < admission->queue_depth; i++)
+        if (admission->queue[i].socket_fd >= 0)
+            close(admission->queue[i].socket_fd);
+    close(admission->wake_fds[0]);
+    close(admission->wake_fds[1]);
+}
+
+void print_admission(const struct Admission *admission, const char *name)
+{
+    fprintf(stderr, "%s: %llu connections served at once, %llu after waiting, %llu turned away busy; "
+                    "%d of %d slots in use, at most %d at once; %d waiting\n",
+            name, admission->n_admitted, admission->n_delayed, admission->n_rejected,
+            admission->n_in_flight, admission->limit, admission->peak_in_flight, admission->n_queued);
+}
\ No newline at end of file
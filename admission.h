@@ -0,0 +1,159 @@
+/**
+ * @file admission.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for admission.c
+ */
+
+#ifndef ADMISSION
+#define ADMISSION
+
+// Default number of accepted connections that may wait for a free slot
+#define DEFAULT_QUEUE_DEPTH 16
+
+// Default number of connections the kernel holds before they are accepted
+#define DEFAULT_BACKLOG 64
+
+// Largest queue depth accepted
+#define MAX_QUEUE_DEPTH 4096
+
+// Time a rejected client is told to wait before trying again, in milliseconds
+#define RETRY_AFTER_MS 100
+
+// Connection waiting for a slot, as an entry of the queue
+struct QueuedConnection
+{
+    int socket_fd;                      // connected socket; -1 while the entry is free
+    int client;                         // slot of the connection's client
+    long long queued_ns;                // monotonic time the connection was queued
+    int next;                           // next entry of the client's waiting connections, or of the free entries; -1 for none
+};
+
+// Object to hold the connections a server is serving and those waiting to be served
+struct Admission
+{
+    int limit;                          // most connections served at once
+    int n_in_flight;                    // number of connections being served
+    int peak_in_flight;                 // largest number of connections ever served at once
+    int queue_depth;                    // most connections waiting for a slot
+    struct QueuedConnection *queue;     // entries of waiting connections, linked into a list per client
+    int free_entry;                     // first free entry; -1 if the queue is full
+    int n_queued;                       // number of waiting connections
+    struct Clients *clients;            // clients the server is shared between
+    int client;                         // client of the connection last given a slot
+    long long accepted_ns;              // time the connection last given a slot was accepted
+    int wake_fds[2];                    // pipe written by signal handlers to wake the server
+    unsigned long long n_admitted;      // connections served right away
+    unsigned long long n_delayed;       // connections that waited in the queue
+    unsigned long long n_rejected;      // connections turned away as busy
+};
+
+/**
+ * Sets up admission control and a non-blocking pipe the server can poll to
+ * learn that a slot may have freed up
+ * 
+ * @param  admission object to initialize
+ * @param  limit most connections served at once
+ * @param  queue_depth most connections waiting for a slot
+ * @param  clients clients the server is shared between
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool init_admission(struct Admission *, int, int, struct Clients *);
+
+/**
+ * Admits a newly accepted connection, after identifying its client. If a
+ * slot is free, no connection is waiting, and the client is within its rate,
+ * the connection takes the slot. Otherwise it waits in its client's queue, or
+ * if the queue is full, the client is told the server is busy and the
+ * connection is closed.
+ * 
+ * @param  admission admission control of the server
+ * @param  socket_fd file descriptor for connected socket
+ * 
+ * @return socket_fd if the connection should be served now; -1 if it was queued or rejected
+ */
+int admit_connection(struct Admission *, int);
+
+/**
+ * Gives a slot to the oldest waiting connection of the client chosen by
+ * deficit round-robin, if a slot is free and a waiting client is within its rate
+ * 
+ * @param  admission admission control of the server
+ * 
+ * @return file descriptor of the connection to serve now; -1 if none
+ */
+int next_connection(struct Admission *);
+
+/**
+ * Finds how long the server may wait for a connection or wake-up before a
+ * waiting client held back by its rate may run
+ * 
+ * @param  admission admission control of the server
+ * 
+ * @return timeout for poll(), in milliseconds; -1 to wait indefinitely
+ */
+int admission_timeout_ms(const struct Admission *);
+
+/**
+ * Takes a free slot for a connection that did not come through the queue,
+ * such as one resuming after a worker handed it back
+ * 
+ * @param  admission admission control of the server
+ * 
+ * @return true if a slot was taken; false if none is free
+ */
+bool claim_slot(struct Admission *);
+
+/**
+ * Frees the slot of a connection that has been served
+ * 
+ * @param  admission admission control of the server
+ */
+void finish_connection(struct Admission *);
+
+/**
+ * Tells a client that the server is busy and closes its connection.
+ * The reply takes the place of the server's handshake.
+ * 
+ * @param  socket_fd file descriptor for connected socket
+ * @param  retry_after_ms time the client should wait before trying again, in milliseconds
+ */
+void reject_connection(int, int);
+
+/**
+ * Wakes the server. Only calls write(), so it is safe in a signal handler.
+ * 
+ * @param  admission admission control of the server
+ */
+void wake_admission(struct Admission *);
+
+/**
+ * Consumes every pending wake-up
+ * 
+ * @param  admission admission control of the server
+ */
+void drain_wakeups(struct Admission *);
+
+/**
+ * Closes the sockets of waiting connections and the wake-up pipe in a
+ * process forked to serve one connection, so that only the server holds them
+ * 
+ * @param  admission admission control inherited from the server
+ */
+void close_admission(struct Admission *);
+
+/**
+ * Prints counts of admitted, delayed, and rejected connections to stderr
+ * 
+ * @param  admission admission control of the server
+ * @param  name name of the server
+ */
+void print_admission(const struct Admission *, const char *);
+
+#endif
\ No newline at end of file
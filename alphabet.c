@@ -0,0 +1,92 @@
+/**
+ * @file alphabet.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the alphabets symbols can be drawn from and their transforms.
+ * 
+ * Every alphabet gets its own encrypt and decrypt kernels, compiled against
+ * the constant lookup tables that mkalphabets generates into alphabet_tables.h.
+ * A kernel maps each symbol to its index, adds or subtracts the indices, and
+ * maps the result straight back to a symbol, so it does the same three table
+ * lookups per byte whatever the alphabet, with no branches and no division.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "otp.h"
+#include "alphabet.h"
+#include "alphabet_tables.h"
+
+// Defines the encrypt and decrypt kernels of one entry of ALPHABETS
+#define DEFINE_KERNELS(name, symbols) \
+    static void encrypt_##name(struct Args args, long long length) \
+    { \
+        for (long long i = 0; i < length; i++) \
+            args.ciphertext[i] = ADD_SYMBOLS(name, args.plaintext[i], args.key[i]); \
+    } \
+    \
+    static void decrypt_##name(struct Args args, long long length) \
+    { \
+        for (long long i = 0; i < length; i++) \
+            args.plaintext[i] = SUBTRACT_SYMBOLS(name, args.ciphertext[i], args.key[i]); \
+    }
+
+ALPHABETS(DEFINE_KERNELS)
+
+// Describes one entry of ALPHABETS
+#define DESCRIBE_ALPHABET(name, symbols) \
+    { #name, symbols, sizeof(symbols) - 1, name##_indices, name##_key_symbols, encrypt_##name, decrypt_##name },
+
+const struct Alphabet alphabets[] = { ALPHABETS(DESCRIBE_ALPHABET) };
+
+const struct Alphabet *find_alphabet(const char *name)
+{
+    if (name[0] == '\0')
+        return DEFAULT_ALPHABET;
+
+    // Walk through every alphabet
+    for (int i = 0; i < N_ALPHABETS; i++)
+    {
+        if (strcmp(alphabets[i].name, name) == 0)
+            return &alphabets[i];
+    }
+    return NULL;
+}
+
+const char *find_invalid_symbol(const struct Alphabet *alphabet, const char *symbols, long long length)
+{
+    // Combine the indices of all symbols first, since a valid chunk is the common case
+    unsigned char combined = 0;
+    for (long long i = 0; i < length; i++)
+        combined |= alphabet->indices[(unsigned char) symbols[i]];
+    if (!(combined & ALPHABET_INVALID))
+        return NULL;
+
+    // Walk through the symbols again to find the first invalid one
+    for (long long i = 0; i < length; i++)
+    {
+        if (alphabet->indices[(unsigned char) symbols[i]] == ALPHABET_INVALID)
+            return symbols + i;
+    }
+    return NULL;
+}
+
+const char *list_alphabets()
+{
+    static char names[N_ALPHABETS * MAX_ALPHABET_NAME_SIZE];
+    if (names[0] != '\0')
+        return names;
+
+    // Join the names of every alphabet
+    int n = 0;
+    for (int i = 0; i < N_ALPHABETS; i++)
+        n += snprintf(names + n, sizeof(names) - n, "%s%s", i > 0 ? ", " : "", alphabets[i].name);
+    return names;
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+/**
+ * @file alphabet.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for alphabet.c
+ */
+
+#ifndef ALPHABET
+#define ALPHABET
+
+// Every supported alphabet as X(name, symbols), with symbols listed in index order.
+// The first alphabet is the default; its symbols are A-Z and space, with space as 0.
+// mkalphabets.c generates each alphabet's lookup tables from this list at build time.
+#define ALPHABETS(X) \
+    X(text, " ABCDEFGHIJKLMNOPQRSTUVWXYZ") \
+    X(base32, "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567") \
+    X(base64, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/") \
+    X(printable, " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~")
+
+// Number of supported alphabets
+#define COUNT_ALPHABET(name, symbols) + 1
+#define N_ALPHABETS (0 ALPHABETS(COUNT_ALPHABET))
+
+// Index stored in a symbol-to-index table for bytes that are not symbols of the alphabet
+#define ALPHABET_INVALID 0x80
+
+// Symbol of the sum and of the difference of two symbols, looked up in the tables that
+// mkalphabets generates for an alphabet, as every kernel of the alphabet transforms them
+#define ADD_SYMBOLS(name, a, b) \
+    name##_reduced[name##_indices[(unsigned char) (a)] + name##_indices[(unsigned char) (b)]]
+#define SUBTRACT_SYMBOLS(name, a, b) \
+    name##_reduced[name##_indices[(unsigned char) (a)] + name##_bias - name##_indices[(unsigned char) (b)]]
+
+// Longest alphabet name accepted, including the terminating NULL character
+#define MAX_ALPHABET_NAME_SIZE 16
+
+// Object to hold an alphabet and its transforms
+struct Alphabet
+{
+    const char *name;               // name given on the command line and in request headers
+    const char *symbols;            // symbols in index order
+    int size;                       // number of symbols
+    const unsigned char *indices;   // index of every byte value; ALPHABET_INVALID if it is not a symbol
+    const char *key_symbols;        // symbol every random byte maps to; 0 if the byte is rejected
+    void (*encrypt)(struct Args, long long);    // encrypts a number of symbols
+    void (*decrypt)(struct Args, long long);    // decrypts a number of symbols
+};
+
+// Every supported alphabet, in the order of ALPHABETS
+extern const struct Alphabet alphabets[];
+
+// Alphabet used when none is named: A-Z and space
+#define DEFAULT_ALPHABET (&alphabets[0])
+
+/**
+ * Looks up an alphabet by name
+ * 
+ * @param  name name of the alphabet; empty for the default alphabet
+ * 
+ * @return the matching alphabet; NULL if no alphabet has the name
+ */
+const struct Alphabet *find_alphabet(const char *);
+
+/**
+ * Finds the first byte that is not a symbol of an alphabet
+ * 
+ * @param  alphabet alphabet to check against
+ * @param  symbols symbols to check
+ * @param  length number of symbols to check
+ * 
+ * @return pointer to the first invalid byte; NULL if every byte is a symbol
+ */
+const char *find_invalid_symbol(const struct Alphabet *, const char *, long long);
+
+/**
+ * Lists the names of every supported alphabet, separated by ", "
+ * 
+ * @return static string of alphabet names
+ */
+const char *list_alphabets();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+/**
+ * @file arena.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains a bump allocator for the buffers of a request. Servers allocate
+ * a request's plaintext, key, and ciphertext from the arena and reset it
+ * when the request is done, instead of calling malloc() and free() for
+ * every chunk. The arena's pages stay mapped from one request to the next.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+bool init_arena(struct Arena *arena, long long size)
+{
+    arena->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena->base == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to reserve %lld bytes for buffers\n", size);
+        arena->base = NULL;
+        return false;
+    }
+    arena->size = size;
+    arena->used = 0;
+    arena->high_water = 0;
+    return true;
+}
+
+char *arena_alloc(struct Arena *arena, long long size)
+{
+    long long start = (arena->used + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+    if (size < 0 || start + size > arena->size)
+        return NULL;
+    arena->used = start + size;
+    if (arena->used > arena->high_water)
+        arena->high_water = arena->used;
+    return arena->base + start;
+}
+
+void reset_arena(struct Arena *arena)
+{
+    // Give back the pages of an unusually large request, keeping the rest warm
+    if (arena->high_water > ARENA_RETAINED_SIZE)
+    {
+        madvise(arena->base + ARENA_RETAINED_SIZE, arena->high_water - ARENA_RETAINED_SIZE, MADV_DONTNEED);
+        arena->high_water = ARENA_RETAINED_SIZE;
+    }
+    arena->used = 0;
+}
+
+void free_arena(struct Arena *arena)
+{
+    if (arena->base != NULL)
+        munmap(arena->base, arena->size);
+    arena->base = NULL;
+}
\ No newline at end of file
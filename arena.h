@@ -0,0 +1,72 @@
+/**
+ * @file arena.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for arena.c
+ */
+
+#ifndef ARENA
+#define ARENA
+
+// Alignment of every allocation, one cache line
+#define ARENA_ALIGNMENT 64
+
+// Bytes of address space an arena reserves: room for every buffer of the largest request
+#define ARENA_RESERVED_SIZE (6 * (long long) MAX_CHUNK_SIZE)
+
+// Bytes an arena keeps backed by memory between requests, enough for a few chunks of the
+// default size; pages above are returned to the system
+#define ARENA_RETAINED_SIZE (8 * 1048576LL)
+
+// Object to hold a bump allocator for the buffers of one request at a time
+struct Arena
+{
+    char *base;             // start of the reserved address space
+    long long size;         // number of bytes reserved
+    long long used;         // number of bytes handed out since the last reset
+    long long high_water;   // largest number of bytes in use since pages were last returned
+};
+
+/**
+ * Reserves the address space of an arena. Pages are only backed by memory
+ * once they are first written, and stay backed across requests, so a
+ * process that serves many requests stops taking page faults on its buffers.
+ * 
+ * @param  arena arena to set up
+ * @param  size number of bytes to reserve
+ * 
+ * @return true if the address space was reserved, else false
+ */
+bool init_arena(struct Arena *, long long);
+
+/**
+ * Hands out a buffer from an arena. Buffers live until the arena is reset.
+ * 
+ * @param  arena arena to allocate from
+ * @param  size number of bytes needed
+ * 
+ * @return the buffer, aligned to ARENA_ALIGNMENT; NULL if the arena is full
+ */
+char *arena_alloc(struct Arena *, long long);
+
+/**
+ * Frees every buffer of an arena at once. If more than ARENA_RETAINED_SIZE
+ * bytes were used, the pages above it are returned to the system.
+ * 
+ * @param  arena arena to reset
+ */
+void reset_arena(struct Arena *);
+
+/**
+ * Releases the address space of an arena
+ * 
+ * @param  arena arena to release
+ */
+void free_arena(struct Arena *);
+
+#endif
\ No newline at end of file
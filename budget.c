@@ -0,0 +1,170 @@
+/**
+ * @file budget.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the memory budget of the servers, so that a few large requests
+ * served at once cannot exhaust the host's memory. Before a request
+ * allocates its buffers, the process serving it holds as many bytes of the
+ * budget as the buffers need; framed requests know their size from the
+ * header, and the original protocol holds more as its message grows.
+ * 
+ * A request the budget cannot cover waits for others to return memory, for
+ * up to BUDGET_WAIT_MS. A framed request that still does not fit is answered
+ * overloaded, and its client sends it again after a short wait. The original
+ * protocol has no way to report errors, so such a connection is closed.
+ * 
+ * The bytes held live in memory shared by every process, so the budget
+ * covers every connection of the server at once. Each process holds memory
+ * for one request at a time, and keeps what it holds in a slot of its own
+ * beside the counts. A process that dies mid-request cannot return its
+ * memory, so the server reclaims the slot's bytes when it reaps the process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "budget.h"
+#include "util.h"
+
+bool open_budget(struct MemoryBudget *budget, long long limit, int n_slots)
+{
+    // Default to a share of physical memory
+    if (limit < 0)
+        limit = (long long) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / DEFAULT_BUDGET_FRACTION;
+    budget->limit = limit;
+    budget->n_slots = n_slots;
+    budget->slot = 0;
+
+    size_t size = sizeof(struct BudgetCounts) + n_slots * sizeof(long long);
+    budget->counts = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (budget->counts == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map memory budget\n");
+        return false;
+    }
+    memset(budget->counts, 0, size);
+    return true;
+}
+
+void use_budget_slot(struct MemoryBudget *budget, int slot)
+{
+    budget->slot = slot;
+}
+
+void reclaim_memory(struct MemoryBudget *budget, int slot)
+{
+    if (slot < 0 || slot >= budget->n_slots)
+        return;
+    long long held = __atomic_exchange_n(&budget->counts->held[slot], 0, __ATOMIC_RELAXED);
+    if (held > 0)
+        __atomic_sub_fetch(&budget->counts->reserved, held, __ATOMIC_RELAXED);
+}
+
+/**
+ * Takes bytes from the budget if they fit, keeping the peak
+ * 
+ * @param  budget memory budget of the server
+ * @param  n_bytes bytes to take
+ * 
+ * @return true if the bytes were taken, else false
+ */
+static bool take_memory(struct MemoryBudget *budget, long long n_bytes)
+{
+    struct BudgetCounts *counts = budget->counts;
+    long long reserved = __atomic_load_n(&counts->reserved, __ATOMIC_RELAXED);
+    do
+    {
+        if (budget->limit > 0 && reserved + n_bytes > budget->limit)
+            return false;
+    } while (!__atomic_compare_exchange_n(&counts->reserved, &reserved, reserved + n_bytes, false,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    long long peak = __atomic_load_n(&counts->peak_reserved, __ATOMIC_RELAXED);
+    while (reserved + n_bytes > peak &&
+           !__atomic_compare_exchange_n(&counts->peak_reserved, &peak, reserved + n_bytes, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        continue;
+    return true;
+}
+
+bool hold_memory(struct MemoryBudget *budget, long long n_bytes, long long deadline_ns)
+{
+    // Return what the request no longer needs, clearing it from the slot first so the server never reclaims
+    // bytes already returned
+    long long *held = &budget->counts->held[budget->slot];
+    long long n_more = n_bytes - *held;
+    if (n_more <= 0)
+    {
+        __atomic_store_n(held, n_bytes, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&budget->counts->reserved, -n_more, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    // Take the rest now if it fits, unless the request could never fit
+    bool first = *held == 0;
+    bool taken = take_memory(budget, n_more);
+    if (!taken && budget->limit > 0 && n_bytes <= budget->limit)
+    {
+        // Wait for other requests to return memory, checking less often the longer it takes
+        long long wait_end_ns = monotonic_ns() + BUDGET_WAIT_MS * 1000000LL;
+        if (deadline_ns > 0 && deadline_ns < wait_end_ns)
+            wait_end_ns = deadline_ns;
+        int poll_us = BUDGET_MIN_POLL_US;
+        while (!taken && monotonic_ns() + poll_us * 1000LL < wait_end_ns)
+        {
+            usleep(poll_us);
+            if (poll_us < BUDGET_MAX_POLL_US)
+                poll_us *= 2;
+            taken = take_memory(budget, n_more);
+        }
+        if (taken)
+            __atomic_add_fetch(&budget->counts->n_waited, 1, __ATOMIC_RELAXED);
+    }
+    else if (taken && first)
+        __atomic_add_fetch(&budget->counts->n_held, 1, __ATOMIC_RELAXED);
+
+    if (!taken)
+    {
+        __atomic_add_fetch(&budget->counts->n_refused, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "Warning: turned away a request needing %lld bytes; %lld of %lld bytes of the memory budget held\n",
+                n_bytes, __atomic_load_n(&budget->counts->reserved, __ATOMIC_RELAXED), budget->limit);
+        return false;
+    }
+    __atomic_store_n(held, n_bytes, __ATOMIC_RELAXED);
+    return true;
+}
+
+void release_memory(struct MemoryBudget *budget)
+{
+    long long held = __atomic_exchange_n(&budget->counts->held[budget->slot], 0, __ATOMIC_RELAXED);
+    if (held > 0)
+        __atomic_sub_fetch(&budget->counts->reserved, held, __ATOMIC_RELAXED);
+}
+
+bool refuse_request(struct Reader *reader, struct Header *response, long long payload_size)
+{
+    return reject_request(reader, response, STATUS_OVERLOADED, payload_size);
+}
+
+void print_budget(const struct MemoryBudget *budget, const char *name)
+{
+    const struct BudgetCounts *counts = budget->counts;
+    fprintf(stderr, "%s: %lld bytes of a %lld-byte memory budget held, at most %lld at once; "
+                    "%llu requests held memory right away, %llu after waiting, %llu turned away\n",
+            name, __atomic_load_n(&counts->reserved, __ATOMIC_RELAXED), budget->limit,
+            __atomic_load_n(&counts->peak_reserved, __ATOMIC_RELAXED),
+            __atomic_load_n(&counts->n_held, __ATOMIC_RELAXED), __atomic_load_n(&counts->n_waited, __ATOMIC_RELAXED),
+            __atomic_load_n(&counts->n_refused, __ATOMIC_RELAXED));
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+/**
+ * @file budget.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for budget.c
+ */
+
+#ifndef BUDGET
+#define BUDGET
+
+// Default budget, as a fraction of the host's physical memory
+#define DEFAULT_BUDGET_FRACTION 2
+
+// Longest a request waits for memory before it is turned away, in milliseconds
+#define BUDGET_WAIT_MS 1000
+
+// Shortest and longest sleep between checks for memory, in microseconds
+#define BUDGET_MIN_POLL_US 500
+#define BUDGET_MAX_POLL_US 20000
+
+// Counts of a budget, shared by the server and the processes serving connections
+struct BudgetCounts
+{
+    long long reserved;                 // bytes held by requests being served
+    long long peak_reserved;            // largest number of bytes ever held at once
+    unsigned long long n_held;          // requests that held memory right away
+    unsigned long long n_waited;        // requests that waited for memory and got it
+    unsigned long long n_refused;       // requests turned away for lack of memory
+    long long held[];                   // bytes held by the current request of each process, by slot
+};
+
+// Object to hold the memory budget of a server
+struct MemoryBudget
+{
+    long long limit;                    // most bytes requests may hold at once; 0 for no limit
+    struct BudgetCounts *counts;        // counts shared by every process
+    int n_slots;                        // number of processes with a slot of their own
+    int slot;                           // slot of this process
+};
+
+/**
+ * Sets up a memory budget, with counts shared by every process forked from this one
+ * 
+ * @param  budget object to initialize
+ * @param  limit most bytes requests may hold at once; 0 for no limit, -1 for
+ *         1 / DEFAULT_BUDGET_FRACTION of physical memory
+ * @param  n_slots number of processes that hold memory, counting the server as slot 0
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool open_budget(struct MemoryBudget *, long long, int);
+
+/**
+ * Makes this process keep the bytes it holds in a slot of its own, so the
+ * server can reclaim them if the process dies
+ * 
+ * @param  budget memory budget of the server
+ * @param  slot slot of the process, from 1 to n_slots - 1
+ */
+void use_budget_slot(struct MemoryBudget *, int);
+
+/**
+ * Returns the memory held by a process that has exited, for the server to
+ * call once it has reaped the process
+ * 
+ * @param  budget memory budget of the server
+ * @param  slot slot of the process
+ */
+void reclaim_memory(struct MemoryBudget *, int);
+
+/**
+ * Sets the bytes the current request of this process holds, taking more of
+ * the budget or returning some. If the budget cannot cover more, waits for
+ * other requests to return memory, up to BUDGET_WAIT_MS or the deadline.
+ * A request larger than the whole budget never waits.
+ * 
+ * @param  budget memory budget of the server
+ * @param  n_bytes bytes the request needs in all
+ * @param  deadline_ns monotonic time after which the client no longer waits; 0 for none
+ * 
+ * @return true if the request holds n_bytes; false if it was refused, in which case it keeps what it held
+ */
+bool hold_memory(struct MemoryBudget *, long long, long long);
+
+/**
+ * Returns all memory the current request of this process holds
+ * 
+ * @param  budget memory budget of the server
+ */
+void release_memory(struct MemoryBudget *);
+
+/**
+ * Turns a framed request away for lack of memory. Reads and discards its
+ * payload, so the connection stays in step, then answers overloaded so the
+ * client may send it again.
+ * 
+ * @param  reader buffered reader for connected socket
+ * @param  response response to the request, with its offset set
+ * @param  payload_size number of bytes in the request's payload
+ * 
+ * @return true if the connection can carry on; false if the payload could not be read
+ */
+bool refuse_request(struct Reader *, struct Header *, long long);
+
+/**
+ * Prints the bytes held, the peak, and counts of waiting and refused requests to stderr
+ * 
+ * @param  budget memory budget of the server
+ * @param  name name of the server
+ */
+void print_budget(const struct MemoryBudget *, const char *);
+
+#endif
\ No newline at end of file
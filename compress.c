@@ -0,0 +1,411 @@
+/**
+ * @file compress.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the compressor used to spend fewer key symbols on redundant text.
+ * 
+ * Each symbol's index is coded as 5 binary decisions, most significant bit
+ * first, with a binary range coder. Each decision has its own adaptive
+ * probability, chosen by the previous two symbols and the bits of the index
+ * decided so far, so the model learns which symbols follow which pairs.
+ * 
+ * The coded bytes are then written as symbols, 8 bytes to 14 base-27 symbols;
+ * a partial block of n bytes takes the fewest symbols that can hold 256^n values.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "otp.h"
+#include "alphabet.h"
+#include "compress.h"
+
+// Range is renormalized whenever it falls below 2^24
+#define CODER_TOP (1U << 24)
+
+// Symbols taken by a partial block of n bytes, for n from 0 to 7
+static const int tail_symbols[CODER_BLOCK_BYTES] = { 0, 2, 4, 6, 7, 9, 11, 12 };
+
+// Object to hold the state of a range encoder
+struct RangeEncoder
+{
+    unsigned long long low;     // low end of the range; bit 32 holds a pending carry
+    unsigned int range;         // width of the range
+    unsigned char cache;        // last byte not yet written, since a carry may still change it
+    long long n_pending;        // number of bytes held back: the cache and any 0xFF bytes after it
+    unsigned char *bytes;       // buffer to write coded bytes to
+    long long n_bytes;          // number of bytes coded; starts at -1 to drop the leading zero byte
+    long long capacity;         // size of the buffer; bytes past it are counted but not written
+};
+
+// Object to hold the state of a range decoder
+struct RangeDecoder
+{
+    unsigned int range;         // width of the range
+    unsigned int code;          // coded value relative to the low end of the range
+    const unsigned char *bytes; // coded bytes
+    long long n_bytes;          // number of coded bytes; bytes past the end read as zero
+    long long position;         // position of the next byte to read
+};
+
+/**
+ * Moves the top byte of low out of the encoder, holding it back while a carry
+ * could still ripple into it
+ * 
+ * @param  encoder encoder to shift
+ */
+static void shift_low(struct RangeEncoder *encoder)
+{
+    if ((unsigned int) encoder->low < 0xFF000000U || (encoder->low >> 32) != 0)
+    {
+        // Write the held-back bytes, adding the carry to each
+        unsigned char carry = encoder->low >> 32;
+        unsigned char byte = encoder->cache;
+        do
+        {
+            if (encoder->n_bytes >= 0 && encoder->n_bytes < encoder->capacity)
+                encoder->bytes[encoder->n_bytes] = byte + carry;
+            encoder->n_bytes++;
+            byte = 0xFF;
+        }
+        while (--encoder->n_pending != 0);
+        encoder->cache = encoder->low >> 24;
+    }
+    encoder->n_pending++;
+    encoder->low = (encoder->low & 0x00FFFFFFU) << 8;
+}
+
+/**
+ * Codes one binary decision and adapts its probability
+ * 
+ * @param  encoder encoder to code with
+ * @param  probability probability that the bit is 0, out of 2^CODER_PROBABILITY_BITS
+ * @param  bit bit to code
+ */
+static inline void encode_bit(struct RangeEncoder *encoder, unsigned short *probability, int bit)
+{
+    unsigned int bound = (encoder->range >> CODER_PROBABILITY_BITS) * *probability;
+    if (bit == 0)
+    {
+        encoder->range = bound;
+        *probability += ((1 << CODER_PROBABILITY_BITS) - *probability) >> CODER_ADAPT_SHIFT;
+    }
+    else
+    {
+        encoder->low += bound;
+        encoder->range -= bound;
+        *probability -= *probability >> CODER_ADAPT_SHIFT;
+    }
+
+    while (encoder->range < CODER_TOP)
+    {
+        encoder->range <<= 8;
+        shift_low(encoder);
+    }
+}
+
+/**
+ * Decodes one binary decision and adapts its probability
+ * 
+ * @param  decoder decoder to decode with
+ * @param  probability probability that the bit is 0, out of 2^CODER_PROBABILITY_BITS
+ * 
+ * @return the decoded bit
+ */
+static inline int decode_bit(struct RangeDecoder *decoder, unsigned short *probability)
+{
+    int bit;
+    unsigned int bound = (decoder->range >> CODER_PROBABILITY_BITS) * *probability;
+    if (decoder->code < bound)
+    {
+        decoder->range = bound;
+        *probability += ((1 << CODER_PROBABILITY_BITS) - *probability) >> CODER_ADAPT_SHIFT;
+        bit = 0;
+    }
+    else
+    {
+        decoder->code -= bound;
+        decoder->range -= bound;
+        *probability -= *probability >> CODER_ADAPT_SHIFT;
+        bit = 1;
+    }
+
+    if (decoder->range < CODER_TOP)
+    {
+        unsigned char byte = decoder->position < decoder->n_bytes ? decoder->bytes[decoder->position] : 0;
+        decoder->position++;
+        decoder->range <<= 8;
+        decoder->code = (decoder->code << 8) | byte;
+    }
+    return bit;
+}
+
+/**
+ * Creates a model with every probability at one half
+ * 
+ * @return probabilities of every decision in every context
+ */
+static unsigned short *create_model()
+{
+    long long n_probabilities = CODER_CONTEXTS << CODER_SYMBOL_BITS;
+    unsigned short *model = (unsigned short *) malloc(n_probabilities * sizeof(unsigned short));
+    for (long long i = 0; i < n_probabilities; i++)
+        model[i] = 1 << (CODER_PROBABILITY_BITS - 1);
+    return model;
+}
+
+/**
+ * Range codes symbols into bytes
+ * 
+ * @param  symbols symbols to code
+ * @param  length number of symbols
+ * @param  bytes buffer to hold coded bytes
+ * @param  capacity size of the buffer
+ * 
+ * @return number of coded bytes; more than capacity if they did not fit
+ */
+static long long encode_symbols(const char *symbols, long long length, unsigned char *bytes, long long capacity)
+{
+    struct RangeEncoder encoder = { 0, 0xFFFFFFFFU, 0, 1, bytes, -1, capacity };
+    unsigned short *model = create_model();
+    const unsigned char *indices = DEFAULT_ALPHABET->indices;
+
+    int context = 0;
+    for (long long i = 0; i < length; i++)
+    {
+        // Code the index's bits from most to least significant; the bits so far pick the probability.
+        // Callers reject invalid symbols beforehand; masking keeps any that slip through in the model.
+        int index = indices[(unsigned char) symbols[i]] & (ALPHABET_INVALID - 1);
+        unsigned short *probabilities = model + (context << CODER_SYMBOL_BITS);
+        int node = 1;
+        for (int b = CODER_SYMBOL_BITS - 1; b >= 0; b--)
+        {
+            int bit = (index >> b) & 1;
+            encode_bit(&encoder, &probabilities[node], bit);
+            node = (node << 1) | bit;
+        }
+        context = context % 27 * 27 + index;
+    }
+
+    // Flush low, then drop trailing zero bytes, since the decoder reads zeros past the end
+    for (int i = 0; i < 5; i++)
+        shift_low(&encoder);
+    long long n_bytes = encoder.n_bytes;
+    while (n_bytes > 0 && n_bytes <= capacity && bytes[n_bytes - 1] == 0)
+        n_bytes--;
+
+    free(model);
+    return n_bytes;
+}
+
+/**
+ * Decodes range coded bytes into symbols
+ * 
+ * @param  bytes coded bytes
+ * @param  n_bytes number of coded bytes
+ * @param  symbols buffer to hold decoded symbols
+ * @param  length number of symbols to decode
+ * 
+ * @return true if every decoded index was a valid symbol, else false
+ */
+static bool decode_symbols(const unsigned char *bytes, long long n_bytes, char *symbols, long long length)
+{
+    struct RangeDecoder decoder = { 0xFFFFFFFFU, 0, bytes, n_bytes, 0 };
+    for (int i = 0; i < 4; i++)
+    {
+        unsigned char byte = decoder.position < n_bytes ? bytes[decoder.position] : 0;
+        decoder.position++;
+        decoder.code = (decoder.code << 8) | byte;
+    }
+    unsigned short *model = create_model();
+    const char *alphabet = DEFAULT_ALPHABET->symbols;
+
+    bool success = true;
+    int context = 0;
+    for (long long i = 0; i < length && success; i++)
+    {
+        unsigned short *probabilities = model + (context << CODER_SYMBOL_BITS);
+        int node = 1;
+        for (int b = 0; b < CODER_SYMBOL_BITS; b++)
+            node = (node << 1) | decode_bit(&decoder, &probabilities[node]);
+
+        // Nodes past the 27 symbols can only be decoded from a corrupt payload
+        int index = node - (1 << CODER_SYMBOL_BITS);
+        success = index < 27;
+        symbols[i] = alphabet[success ? index : 0];
+        context = context % 27 * 27 + (success ? index : 0);
+    }
+
+    free(model);
+    return success;
+}
+
+/**
+ * Writes bytes as base-27 symbols, one block of up to 8 bytes at a time
+ * 
+ * @param  bytes bytes to write
+ * @param  n_bytes number of bytes
+ * @param  symbols buffer to hold the symbols
+ * 
+ * @return number of symbols written
+ */
+static long long bytes_to_symbols(const unsigned char *bytes, long long n_bytes, char *symbols)
+{
+    const char *alphabet = DEFAULT_ALPHABET->symbols;
+    long long n_symbols = 0;
+    for (long long i = 0; i < n_bytes; i += CODER_BLOCK_BYTES)
+    {
+        int block_bytes = n_bytes - i < CODER_BLOCK_BYTES ? n_bytes - i : CODER_BLOCK_BYTES;
+        int block_symbols = block_bytes == CODER_BLOCK_BYTES ? CODER_BLOCK_SYMBOLS : tail_symbols[block_bytes];
+
+        // Write the block's value least significant digit first
+        unsigned long long value = 0;
+        memcpy(&value, bytes + i, block_bytes);
+        for (int d = 0; d < block_symbols; d++)
+        {
+            symbols[n_symbols++] = alphabet[value % 27];
+            value /= 27;
+        }
+    }
+    return n_symbols;
+}
+
+/**
+ * Reads bytes written as base-27 symbols by bytes_to_symbols()
+ * 
+ * @param  symbols symbols to read
+ * @param  n_symbols number of symbols
+ * @param  bytes buffer to hold the bytes
+ * 
+ * @return number of bytes read; -1 if the symbols are not a valid encoding
+ */
+static long long symbols_to_bytes(const char *symbols, long long n_symbols, unsigned char *bytes)
+{
+    // Find the size of the partial block from its number of symbols
+    int tail_bytes = 0;
+    while (tail_bytes < CODER_BLOCK_BYTES && tail_symbols[tail_bytes] != n_symbols % CODER_BLOCK_SYMBOLS)
+        tail_bytes++;
+    if (tail_bytes == CODER_BLOCK_BYTES)
+        return -1;
+
+    const unsigned char *indices = DEFAULT_ALPHABET->indices;
+    long long n_bytes = 0;
+    for (long long i = 0; i < n_symbols; i += CODER_BLOCK_SYMBOLS)
+    {
+        int block_symbols = n_symbols - i < CODER_BLOCK_SYMBOLS ? n_symbols - i : CODER_BLOCK_SYMBOLS;
+        int block_bytes = block_symbols == CODER_BLOCK_SYMBOLS ? CODER_BLOCK_BYTES : tail_bytes;
+
+        // Read the block's value most significant digit first, rejecting values too large for the block
+        unsigned long long value = 0;
+        for (int d = block_symbols - 1; d >= 0; d--)
+        {
+            int index = indices[(unsigned char) symbols[i + d]];
+            if (index == ALPHABET_INVALID || __builtin_mul_overflow(value, 27, &value) ||
+                __builtin_add_overflow(value, index, &value))
+                return -1;
+        }
+        if (block_bytes < CODER_BLOCK_BYTES && value >> (8 * block_bytes) != 0)
+            return -1;
+
+        memcpy(bytes + n_bytes, &value, block_bytes);
+        n_bytes += block_bytes;
+    }
+    return n_bytes;
+}
+
+/**
+ * Writes a length as RECORD_LENGTH_DIGITS base-27 symbols, most significant first
+ * 
+ * @param  length length to write
+ * @param  symbols buffer to hold the symbols
+ */
+static void write_length(long long length, char *symbols)
+{
+    for (int d = RECORD_LENGTH_DIGITS - 1; d >= 0; d--)
+    {
+        symbols[d] = DEFAULT_ALPHABET->symbols[length % 27];
+        length /= 27;
+    }
+}
+
+/**
+ * Reads a length written by write_length()
+ * 
+ * @param  symbols symbols to read
+ * 
+ * @return the length; -1 if a symbol is invalid
+ */
+static long long read_length(const char *symbols)
+{
+    long long length = 0;
+    for (int d = 0; d < RECORD_LENGTH_DIGITS; d++)
+    {
+        int index = DEFAULT_ALPHABET->indices[(unsigned char) symbols[d]];
+        if (index == ALPHABET_INVALID)
+            return -1;
+        length = length * 27 + index;
+    }
+    return length;
+}
+
+long long compress_record(const char *symbols, long long length, char *record)
+{
+    // Code the symbols, giving up once the bytes could not be written in fewer symbols than the input
+    long long capacity = length / CODER_BLOCK_SYMBOLS * CODER_BLOCK_BYTES + CODER_BLOCK_BYTES;
+    unsigned char *bytes = (unsigned char *) malloc(capacity);
+    long long n_bytes = encode_symbols(symbols, length, bytes, capacity);
+
+    // Write the coded bytes as symbols if that is smaller, otherwise store the symbols
+    long long payload_length = length;
+    char method = RECORD_STORED;
+    if (n_bytes <= capacity &&
+        n_bytes / CODER_BLOCK_BYTES * CODER_BLOCK_SYMBOLS + tail_symbols[n_bytes % CODER_BLOCK_BYTES] < length)
+    {
+        method = RECORD_CODED;
+        payload_length = bytes_to_symbols(bytes, n_bytes, record + RECORD_HEADER_SIZE);
+    }
+    else
+        memcpy(record + RECORD_HEADER_SIZE, symbols, length);
+    free(bytes);
+
+    // Write the header
+    record[0] = method;
+    write_length(length, record + 1);
+    write_length(payload_length, record + 1 + RECORD_LENGTH_DIGITS);
+    return RECORD_HEADER_SIZE + payload_length;
+}
+
+bool parse_record_header(const char *header, char *method, long long *length, long long *payload_length)
+{
+    *method = header[0];
+    *length = read_length(header + 1);
+    *payload_length = read_length(header + 1 + RECORD_LENGTH_DIGITS);
+
+    // A stored payload is the symbols themselves; a coded payload is smaller
+    if (*method == RECORD_STORED)
+        return *length >= 0 && *payload_length == *length;
+    return *method == RECORD_CODED && *length >= 0 && *payload_length >= 0 && *payload_length < *length;
+}
+
+bool expand_record(char method, const char *payload, long long payload_length, char *symbols, long long length)
+{
+    if (method == RECORD_STORED)
+    {
+        memcpy(symbols, payload, length);
+        return true;
+    }
+
+    // Read the coded bytes back from the payload, then decode them
+    unsigned char *bytes = (unsigned char *) malloc(payload_length / CODER_BLOCK_SYMBOLS * CODER_BLOCK_BYTES + CODER_BLOCK_BYTES);
+    long long n_bytes = symbols_to_bytes(payload, payload_length, bytes);
+    bool success = n_bytes >= 0 && decode_symbols(bytes, n_bytes, symbols, length);
+    free(bytes);
+    return success;
+}
\ No newline at end of file
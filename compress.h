@@ -0,0 +1,80 @@
+/**
+ * @file compress.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for compress.c
+ */
+
+#ifndef COMPRESS
+#define COMPRESS
+
+// Symbols of a record header: the method, then the plaintext and payload lengths
+#define RECORD_HEADER_SIZE 11
+#define RECORD_LENGTH_DIGITS 5
+
+// Record methods: the payload is the plaintext itself, or the plaintext range coded
+#define RECORD_STORED 'S'
+#define RECORD_CODED 'C'
+
+// Bits coded per symbol; each symbol's index (0-26) is coded as 5 binary decisions
+#define CODER_SYMBOL_BITS 5
+
+// Contexts of the model: the indices of the previous two symbols
+#define CODER_CONTEXTS (27 * 27)
+
+// Precision of a probability, and how quickly probabilities adapt (higher is slower)
+#define CODER_PROBABILITY_BITS 11
+#define CODER_ADAPT_SHIFT 4
+
+// Bytes coded into one block of symbols: 8 bytes fit in 14 base-27 symbols
+#define CODER_BLOCK_BYTES 8
+#define CODER_BLOCK_SYMBOLS 14
+
+/**
+ * Compresses symbols (A-Z and space) into a record: a header of
+ * RECORD_HEADER_SIZE symbols followed by a payload of symbols. The symbols
+ * are range coded with an adaptive order-2 model, and the coded bytes are
+ * written as base-27 symbols, so the payload can be encrypted like any other
+ * text. If coding does not make the symbols smaller, they are stored as is.
+ * Each record is coded independently.
+ * 
+ * @param  symbols symbols to compress
+ * @param  length number of symbols, below 27^RECORD_LENGTH_DIGITS
+ * @param  record buffer of RECORD_HEADER_SIZE + length symbols to hold the record
+ * 
+ * @return number of symbols in the record
+ */
+long long compress_record(const char *, long long, char *);
+
+/**
+ * Parses a record header
+ * 
+ * @param  header RECORD_HEADER_SIZE symbols of the header
+ * @param  method holds the record's method, RECORD_STORED or RECORD_CODED
+ * @param  length holds the number of symbols the record expands to
+ * @param  payload_length holds the number of symbols in the record's payload
+ * 
+ * @return true if the header is well formed, else false
+ */
+bool parse_record_header(const char *, char *, long long *, long long *);
+
+/**
+ * Expands the payload of a record back to the symbols it was compressed from
+ * 
+ * @param  method method of the record
+ * @param  payload symbols of the record's payload
+ * @param  payload_length number of symbols in the payload
+ * @param  symbols buffer of length symbols to hold the expanded symbols
+ * @param  length number of symbols the record expands to
+ * 
+ * @return true if the payload was expanded; false if it is not a valid coding,
+ *         e.g. because it was decrypted with the wrong key
+ */
+bool expand_record(char, const char *, long long, char *, long long);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,290 @@
+/**
+ * @file csprng.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains a ChaCha20 keystream generator used to create keys. Several blocks
+ * are computed at once, one per lane of a vector, and random bytes are mapped
+ * to key symbols sixteen at a time. Each stream has a 64-bit block counter
+ * and a 64-bit stream number in place of the nonce, as in the original
+ * ChaCha, so threads can draw from separate streams of one seed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+#include "csprng.h"
+
+// Rejection threshold: the largest multiple of 27 that fits in a byte
+#define SYMBOL_LIMIT 243
+
+// Number of symbols to reserve when sizing a staging buffer: every byte may be accepted
+#define STAGING_SIZE CSPRNG_BUFFER_SIZE
+
+// Multiplier that gathers the low bit of each of eight bytes into the top byte
+#define GATHER_MULTIPLIER 0x0102040810204080ULL
+
+// Added to the byte positions of the upper half of a vector
+#define HIGH_HALF_OFFSET 0x0808080808080808ULL
+
+// ChaCha20 state words, one block per lane
+typedef unsigned int Lanes __attribute__((vector_size(4 * CSPRNG_PARALLEL_BLOCKS)));
+
+// Sixteen random bytes, and the same bytes widened so they can be multiplied
+typedef unsigned char Bytes __attribute__((vector_size(16)));
+typedef unsigned short Words __attribute__((vector_size(32)));
+
+// Rotates each lane left by n bits
+#define ROTATE(v, n) ((v) << (n) | (v) >> (32 - (n)))
+
+// Mixes four state words of every block
+#define QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTATE(d, 16); \
+    c += d; b ^= c; b = ROTATE(b, 12); \
+    a += b; d ^= a; d = ROTATE(d, 8); \
+    c += d; b ^= c; b = ROTATE(b, 7);
+
+// Positions of the accepted bytes for each mask of eight accepted bytes
+static unsigned long long compaction_table[256];
+static pthread_once_t compaction_table_once = PTHREAD_ONCE_INIT;
+
+// Object to hold the work of one thread of generate_symbols_parallel()
+struct SymbolRange
+{
+    const unsigned char *seed;
+    char *symbols;
+    long long length;
+    int stream;
+};
+
+/**
+ * Fills compaction_table: entry m lists, in order, the positions of the
+ * set bits of m, one per byte
+ */
+static void build_compaction_table(void)
+{
+    for (int mask = 0; mask < 256; mask++)
+    {
+        unsigned long long positions = 0;
+        int n_set = 0;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            if (mask >> bit & 1)
+                positions |= (unsigned long long) bit << (8 * n_set++);
+        }
+        compaction_table[mask] = positions;
+    }
+}
+
+bool seed_csprng(unsigned char *seed)
+{
+    // Requests of up to 256 bytes are never interrupted or cut short once the pool is ready
+    if (getrandom(seed, CSPRNG_SEED_SIZE, 0) != CSPRNG_SEED_SIZE)
+    {
+        fprintf(stderr, "Error: failed to read random seed\n");
+        return false;
+    }
+    return true;
+}
+
+void init_csprng(struct Csprng *rng, const unsigned char *seed, unsigned long long stream)
+{
+    pthread_once(&compaction_table_once, build_compaction_table);
+    memcpy(rng->key, seed, sizeof(rng->key));
+    rng->stream = stream;
+    rng->counter = 0;
+}
+
+__attribute__((target_clones("avx2", "default")))
+void next_csprng_bytes(struct Csprng *rng, unsigned char *buffer)
+{
+    // Set up the input state of each block; blocks differ only in their counter
+    Lanes input[16];
+    input[0] = (Lanes) {} + 0x61707865;
+    input[1] = (Lanes) {} + 0x3320646e;
+    input[2] = (Lanes) {} + 0x79622d32;
+    input[3] = (Lanes) {} + 0x6b206574;
+    for (int i = 0; i < 8; i++)
+        input[4 + i] = (Lanes) {} + rng->key[i];
+    for (int lane = 0; lane < CSPRNG_PARALLEL_BLOCKS; lane++)
+    {
+        input[12][lane] = (unsigned int) (rng->counter + lane);
+        input[13][lane] = (unsigned int) ((rng->counter + lane) >> 32);
+    }
+    input[14] = (Lanes) {} + (unsigned int) rng->stream;
+    input[15] = (Lanes) {} + (unsigned int) (rng->stream >> 32);
+    rng->counter += CSPRNG_PARALLEL_BLOCKS;
+
+    // Apply 20 rounds, alternating between columns and diagonals
+    Lanes x[16];
+    memcpy(x, input, sizeof(x));
+    for (int i = 0; i < 10; i++)
+    {
+        QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+
+    // Add the input state and write each block out in order
+    unsigned int words[16][CSPRNG_PARALLEL_BLOCKS];
+    for (int i = 0; i < 16; i++)
+    {
+        x[i] += input[i];
+        memcpy(words[i], &x[i], sizeof(Lanes));
+    }
+    for (int lane = 0; lane < CSPRNG_PARALLEL_BLOCKS; lane++)
+    {
+        for (int i = 0; i < 16; i++)
+            memcpy(buffer + lane * 64 + i * 4, &words[i][lane], 4);
+    }
+}
+
+/**
+ * Maps random bytes to key symbols, dropping bytes of SYMBOL_LIMIT and above.
+ * Symbols are computed sixteen at a time with vector arithmetic. Accepted
+ * symbols are then packed together with one shuffle per sixteen, using the
+ * mask of accepted bytes to look up which bytes to keep, so no step branches.
+ * 
+ * @param  bytes CSPRNG_BUFFER_SIZE random bytes
+ * @param  symbols buffer of at least CSPRNG_BUFFER_SIZE to hold symbols
+ * 
+ * @return number of symbols written
+ */
+__attribute__((target_clones("avx2", "default")))
+static int map_bytes_to_symbols(const unsigned char *bytes, char *symbols)
+{
+    int n_symbols = 0;
+    for (int i = 0; i < CSPRNG_BUFFER_SIZE; i += 16)
+    {
+        Bytes b;
+        memcpy(&b, bytes + i, sizeof(b));
+
+        // Divide by 27 with a multiply and shift, which is exact for every byte below SYMBOL_LIMIT
+        Words wide = __builtin_convertvector(b, Words);
+        Words value = wide - (wide * 19 >> 9) * 27;
+
+        // Convert values to symbols: 0 is space, 1-26 are A-Z
+        Bytes symbol = __builtin_convertvector(value, Bytes);
+        Bytes is_space = (Bytes) (symbol == 0);
+        symbol = (is_space & ' ') | (~is_space & (symbol + 64));
+
+        // Gather one bit per byte into a mask of accepted bytes for each half
+        Bytes accepted = (Bytes) (b < SYMBOL_LIMIT) & 1;
+        unsigned long long halves[2];
+        memcpy(halves, &accepted, sizeof(halves));
+        int low_mask = halves[0] * GATHER_MULTIPLIER >> 56;
+        int high_mask = halves[1] * GATHER_MULTIPLIER >> 56;
+
+        // Move each half's accepted symbols to its front, then store the halves back to back
+        unsigned long long positions[2] = { compaction_table[low_mask], compaction_table[high_mask] + HIGH_HALF_OFFSET };
+        Bytes shuffle;
+        memcpy(&shuffle, positions, sizeof(shuffle));
+        Bytes packed = __builtin_shuffle(symbol, shuffle);
+        memcpy(symbols + n_symbols, &packed, 8);
+        n_symbols += __builtin_popcount(low_mask);
+        memcpy(symbols + n_symbols, (char *) &packed + 8, 8);
+        n_symbols += __builtin_popcount(high_mask);
+    }
+    return n_symbols;
+}
+
+void generate_symbols(struct Csprng *rng, char *symbols, long long length)
+{
+    unsigned char bytes[CSPRNG_BUFFER_SIZE];
+    char staged[STAGING_SIZE];
+
+    // Map whole buffers straight into the output while there is room for every byte to be accepted
+    long long n_generated = 0;
+    while (length - n_generated >= STAGING_SIZE)
+    {
+        next_csprng_bytes(rng, bytes);
+        n_generated += map_bytes_to_symbols(bytes, symbols + n_generated);
+    }
+
+    // Stage the last symbols so nothing is written past the end of the output
+    while (n_generated < length)
+    {
+        next_csprng_bytes(rng, bytes);
+        int n_staged = map_bytes_to_symbols(bytes, staged);
+        if (n_staged > length - n_generated)
+            n_staged = length - n_generated;
+        memcpy(symbols + n_generated, staged, n_staged);
+        n_generated += n_staged;
+    }
+}
+
+void generate_bytes(struct Csprng *rng, char *bytes, long long length)
+{
+    // Fill whole buffers in place, then stage the last partial buffer
+    long long n_generated = 0;
+    for (; length - n_generated >= CSPRNG_BUFFER_SIZE; n_generated += CSPRNG_BUFFER_SIZE)
+        next_csprng_bytes(rng, (unsigned char *) bytes + n_generated);
+
+    if (n_generated < length)
+    {
+        unsigned char staged[CSPRNG_BUFFER_SIZE];
+        next_csprng_bytes(rng, staged);
+        memcpy(bytes + n_generated, staged, length - n_generated);
+        memset(staged, 0, sizeof(staged));
+    }
+}
+
+/**
+ * Thread body of generate_symbols_parallel(): fills one range from its own stream
+ * 
+ * @param  arg range to fill
+ * 
+ * @return NULL
+ */
+static void *generate_symbol_range(void *arg)
+{
+    struct SymbolRange *range = (struct SymbolRange *) arg;
+    struct Csprng rng;
+    init_csprng(&rng, range->seed, range->stream);
+    generate_symbols(&rng, range->symbols, range->length);
+    return NULL;
+}
+
+bool generate_symbols_parallel(const unsigned char *seed, char *symbols, long long length, int n_threads)
+{
+    pthread_t *threads = (pthread_t *) malloc(n_threads * sizeof(pthread_t));
+    struct SymbolRange *ranges = (struct SymbolRange *) malloc(n_threads * sizeof(struct SymbolRange));
+
+    // Split the buffer into one contiguous range per thread
+    int n_started = 0;
+    bool success = true;
+    for (int i = 0; i < n_threads; i++)
+    {
+        long long start = length * i / n_threads;
+        long long end = length * (i + 1) / n_threads;
+        ranges[i] = (struct SymbolRange) { seed: seed, symbols: symbols + start, length: end - start, stream: i };
+        if (pthread_create(&threads[i], NULL, generate_symbol_range, &ranges[i]) != 0)
+        {
+            fprintf(stderr, "Error: failed to start thread\n");
+            success = false;
+            break;
+        }
+        n_started++;
+    }
+
+    // Wait for every started thread to finish
+    for (int i = 0; i < n_started; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    free(ranges);
+    return success;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+/**
+ * @file csprng.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for csprng.c
+ */
+
+#ifndef CSPRNG
+#define CSPRNG
+
+// Number of bytes in a seed (a ChaCha20 key)
+#define CSPRNG_SEED_SIZE 32
+
+// Number of ChaCha20 blocks computed side by side
+#define CSPRNG_PARALLEL_BLOCKS 8
+
+// Number of random bytes produced at a time
+#define CSPRNG_BUFFER_SIZE (CSPRNG_PARALLEL_BLOCKS * 64)
+
+// Object to hold one ChaCha20 keystream
+struct Csprng
+{
+    unsigned int key[8];            // key words, taken from the seed
+    unsigned long long stream;      // stream number, used as the nonce
+    unsigned long long counter;     // number of the next block in the stream
+};
+
+/**
+ * Fills a seed with bytes from the kernel's random number generator
+ * 
+ * @param  seed buffer of CSPRNG_SEED_SIZE bytes to fill
+ * 
+ * @return true if the seed was filled, else false
+ */
+bool seed_csprng(unsigned char *);
+
+/**
+ * Sets up a keystream. Streams with the same seed but different
+ * stream numbers never overlap.
+ * 
+ * @param  rng keystream to set up
+ * @param  seed CSPRNG_SEED_SIZE bytes of seed
+ * @param  stream stream number
+ */
+void init_csprng(struct Csprng *, const unsigned char *, unsigned long long);
+
+/**
+ * Produces the next CSPRNG_BUFFER_SIZE bytes of a keystream
+ * 
+ * @param  rng keystream to draw from
+ * @param  buffer buffer of CSPRNG_BUFFER_SIZE bytes to fill
+ */
+void next_csprng_bytes(struct Csprng *, unsigned char *);
+
+/**
+ * Fills a buffer with uniformly distributed key symbols (A-Z and space).
+ * Bytes of 243 and above are rejected so that every symbol is equally
+ * likely; the rest are reduced mod 27.
+ * 
+ * @param  rng keystream to draw from
+ * @param  symbols buffer to fill
+ * @param  length number of symbols to generate
+ */
+void generate_symbols(struct Csprng *, char *, long long);
+
+/**
+ * Fills a buffer with uniformly distributed bytes, for binary keys
+ * 
+ * @param  rng keystream to draw from
+ * @param  bytes buffer to fill
+ * @param  length number of bytes to generate
+ */
+void generate_bytes(struct Csprng *, char *, long long);
+
+/**
+ * Fills a buffer with key symbols using several threads at once. Each thread
+ * fills a disjoint range of the buffer from its own stream of the seed.
+ * 
+ * @param  seed CSPRNG_SEED_SIZE bytes of seed
+ * @param  symbols buffer to fill
+ * @param  length number of symbols to generate
+ * @param  n_threads number of threads to use
+ * 
+ * @return true if every thread ran, else false
+ */
+bool generate_symbols_parallel(const unsigned char *, char *, long long, int);
+
+#endif
\ No newline at end of file
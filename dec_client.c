@@ -11,190 +11,308 @@
  * If dec_server is not running on specified port, connection is refused.
  * After dec_server responds with plaintext, plaintext is written to stdout.
  * 
- * Usage: dec_client <plaintext> <key> <port>
+ * The input is sent in chunks. With --resume, the client checkpoints each
+ * chunk confirmed written to stdout, continuing from the last checkpoint if
+ * there is one; append to the original output with >> when resuming an
+ * interrupted transfer.
+ * 
+ * The key may be given as pad:ID[:OFFSET] to use a pad held by the server,
+ * in which case only the ciphertext is sent.
+ * 
+ * With --packed, payloads are sent packed (5 bits per symbol) if the server
+ * accepts them, and output is written packed. Input and key files may be
+ * packed or not, whether or not --packed is given.
+ * 
+ * With --binary, the ciphertext and key are arbitrary bytes, such as archives
+ * or UTF-8 text, and are combined by XOR. The key must be a file at least as
+ * long as the ciphertext, e.g. from keygen -b.
+ * 
+ * With --alphabet=NAME, the ciphertext and key are drawn from another alphabet,
+ * such as base64 or printable ASCII, instead of A-Z and space. The key must
+ * be a file drawn from the same alphabet, e.g. from keygen -a NAME.
+ * 
+ * With --compress, the ciphertext is read as the records written by
+ * enc_client --compress, and each is expanded after it is decrypted.
+ * 
+ * With --authenticate, the ciphertext is read as the chunks and tags written
+ * by enc_client --authenticate, and the server refuses any chunk whose tag
+ * does not match, so tampered ciphertext is never decrypted.
+ * 
+ * With --deadline=MS, the client gives up once MS milliseconds have passed,
+ * and tells the server how long it will still wait with every request, so
+ * the server abandons chunks the client has stopped waiting for. A transfer
+ * run with --resume and cut short by its deadline can be continued with it.
+ * 
+ * With --trace=FILE, the client times connecting, the handshake, and
+ * reading, sending, waiting for, receiving, and writing each chunk, and
+ * writes the latest phases to FILE in Chrome trace-event format.
+ * 
+ * Usage: dec_client [--resume] [--packed | --binary | --compress] [--authenticate] [--alphabet=NAME]
+ *                   [--deadline=MS] [--trace=FILE] <ciphertext> <key> <port>
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <netdb.h>
 #include <stdbool.h>
 
 #include "dec_client.h"
 #include "socket_io.h"
+#include "protocol.h"
+#include "trace.h"
+#include "transfer.h"
+#include "packed.h"
+#include "otp.h"
+#include "alphabet.h"
 #include "util.h"
 
 int main(int argc, char *argv[])
 {
+    // Separate options from positional arguments
+    bool resume = false;
+    bool compress = false;
+    bool authenticate = false;
+    long long deadline_ms = 0;
+    char *trace_filename = NULL;
+    int format = FORMAT_TEXT;
+    const struct Alphabet *alphabet = DEFAULT_ALPHABET;
+    char *positional[3];
+    int n_positional = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--resume") == 0)
+            resume = true;
+        else if (strcmp(argv[i], "--packed") == 0)
+            format = FORMAT_PACKED;
+        else if (strcmp(argv[i], "--binary") == 0)
+            format = FORMAT_BINARY;
+        else if (strcmp(argv[i], "--compress") == 0)
+            compress = true;
+        else if (strcmp(argv[i], "--authenticate") == 0)
+            authenticate = true;
+        else if (strncmp(argv[i], "--alphabet=", strlen("--alphabet=")) == 0)
+        {
+            alphabet = find_alphabet(argv[i] + strlen("--alphabet="));
+            if (alphabet == NULL)
+            {
+                fprintf(stderr, "Error: unknown alphabet: %s; expected one of %s\n",
+                        argv[i] + strlen("--alphabet="), list_alphabets());
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strncmp(argv[i], "--deadline=", strlen("--deadline=")) == 0)
+        {
+            char *end;
+            deadline_ms = strtoll(argv[i] + strlen("--deadline="), &end, 10);
+            if (*end != '\0' || deadline_ms < 1)
+            {
+                fprintf(stderr, "Error: invalid deadline: %s\n", argv[i] + strlen("--deadline="));
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strncmp(argv[i], "--trace=", strlen("--trace=")) == 0)
+            trace_filename = argv[i] + strlen("--trace=");
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            fprintf(stderr, "Error: unknown option: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        else if (n_positional < 3)
+            positional[n_positional++] = argv[i];
+    }
+
     // Get command line arguments
-    if (argc < 4)
+    if (n_positional < 3)
     {
-        fprintf(stderr, "Error: missing %d arguments\n", 4 - argc);
+        fprintf(stderr, "Error: missing %d arguments\n", 3 - n_positional);
+        fprintf(stderr, "Usage: dec_client [--resume] [--packed | --binary | --compress] [--authenticate] [--alphabet=NAME] [--deadline=MS] [--trace=FILE] $ciphertext $key $port\n");
         return EXIT_FAILURE;
     }
 
     // Store values provided by user
     struct Config cfg = {
-        ciphertext_filename: argv[1],
-        key_filename: argv[2],
-        port: atoi(argv[3]),
+        ciphertext_filename: positional[0],
+        key_filename: positional[1],
+        port: atoi(positional[2]),
+        resume: resume,
+        format: format,
+        alphabet: alphabet,
+        compress: compress,
+        authenticate: authenticate,
+        deadline_ms: deadline_ms,
+        trace_filename: trace_filename,
     };
 
-    // Declare object to hold plaintext, key and ciphertext
-    struct Args args;
+    // Count the deadline from the start of the run, so it covers waiting for a busy server
+    long long deadline_ns = cfg.deadline_ms > 0 ? monotonic_ns() + cfg.deadline_ms * 1000000 : 0;
 
-    // Open ciphertext file
-    FILE *fp_ciphertext = fopen(cfg.ciphertext_filename, "rb");
-    if (fp_ciphertext == 0)
-    {
-        fprintf(stderr, "Error: failed to open ciphertext file \"%s\"\n", cfg.ciphertext_filename);
+    // Open ciphertext and key files
+    struct Transfer transfer;
+    if (!open_transfer(&transfer, "ciphertext", cfg.ciphertext_filename, cfg.key_filename, cfg.format, cfg.alphabet))
         return EXIT_FAILURE;
-    }
 
-    // Determine length of ciphertext
-    fseek(fp_ciphertext, 0, SEEK_END);
-    long f_size = ftell(fp_ciphertext);
-    fseek(fp_ciphertext, 0, SEEK_SET);
+    // Expand records of ciphertext after decryption
+    if (cfg.compress && !enable_compression(&transfer, true))
+        return EXIT_FAILURE;
 
-    // Read ciphertext from file and store in args
-    args.ciphertext = (char *) malloc(f_size + 1);
-    fread(args.ciphertext, f_size, 1, fp_ciphertext);
-    fclose(fp_ciphertext);
+    // Verify the tag after each chunk of ciphertext
+    if (cfg.authenticate && !enable_authentication(&transfer, true))
+        return EXIT_FAILURE;
 
-    // Open key file
-    FILE *fp_key = fopen(cfg.key_filename, "rb");
-    if (fp_key == 0)
+    // Decryption must use the range the plaintext was encrypted with
+    if (transfer.reserve_key)
     {
-        fprintf(stderr, "Error: failed to open key file \"%s\"\n", cfg.key_filename);
+        fprintf(stderr, "Error: dec_client needs the pad offset printed by enc_client, e.g. pad:ID:OFFSET\n");
         return EXIT_FAILURE;
     }
 
-    // Determine key length
-    fseek(fp_key, 0, SEEK_END);
-    f_size = ftell(fp_key);
-    fseek(fp_key, 0, SEEK_SET);
+    // Only the encrypting server generates keys
+    if (transfer.generate_key)
+    {
+        fprintf(stderr, "Error: dec_client needs the key file written by enc_client, not gen:KEYFILE\n");
+        return EXIT_FAILURE;
+    }
 
-    // Read key from file and store in args
-    args.key = (char *) malloc(f_size + 1);
-    fread(args.key, f_size, 1, fp_key);
-    fclose(fp_key);
+    // Time the phases of the connection and each chunk
+    if (cfg.trace_filename != NULL && !enable_tracing(&transfer, "dec_client", cfg.trace_filename))
+        return EXIT_FAILURE;
 
-    // Replace trailing newline with NULL character in ciphertext and key
-    replace_newline(args.ciphertext);
-    replace_newline(args.key);
+    // Continue from the last confirmed offset if resuming
+    if (cfg.resume && !load_checkpoint(&transfer))
+        return EXIT_FAILURE;
 
     // Verify there are no invalid characters in ciphertext
-    char invalid_char = validate_message(args.ciphertext);
+    char invalid_char = validate_input(&transfer);
     if (invalid_char != 0)
     {
-        fprintf(stderr, "Error: invalid character in ciphertext file: %c\n", invalid_char);
+        if (invalid_char != EOF)
+            fprintf(stderr, "Error: invalid character in ciphertext file: %c\n", invalid_char);
         return EXIT_FAILURE;
     }
 
-    // Verify there are no invalid characters in ciphertext
-    if (strlen(args.ciphertext) > strlen(args.key))
+    // Verify key is long enough; the server checks server-resident pads
+    if (transfer.key_length >= 0 && transfer.key_needed > transfer.key_length)
     {
         fprintf(stderr, "Error: ciphertext is longer than key\n");
-        fprintf(stderr, "Ciphertext length: %d\tKey length: %d\n", strlen(args.ciphertext), strlen(args.key));
+        fprintf(stderr, "%s: %lld\tKey length: %lld\n",
+                transfer.key_needed == transfer.input_length ? "Ciphertext length" : "Key needed",
+                transfer.key_needed, transfer.key_length);
         return EXIT_FAILURE;
     }
 
-    // Connect to server at specified port
-    int socket_fd = connect_to_server(cfg.port);
-    
-    // Verify that connection is to dec_server
-    if (!perform_handshake(socket_fd))
-        return EXIT_FAILURE;
-
-    // Send ciphertext and key to dec_server
-    send_string(args.ciphertext, socket_fd);
-    send_string(args.key, socket_fd);
-
-    // Get plaintext from server and write to stdout
-    get_plaintext_from_server(socket_fd, args);
-
-    return EXIT_SUCCESS;
+    // Connect to server at specified port and verify that connection is to dec_server,
+    // backing off and trying again while the server is busy
+    int socket_fd;
+    int wire_format;
+    int retry_after_ms;
+    start_traced_request(&transfer.trace, PHASE_CONNECT, -1, 0);
+    for (int attempt = 1; true; attempt++)
+    {
+        socket_fd = connect_to_server(cfg.port);
+        if (socket_fd < 0)
+        {
+            fprintf(stderr, "Error: failed to connect to server at port %d\n", cfg.port);
+            return EXIT_FAILURE;
+        }
+        mark_phase(&transfer.trace, PHASE_HANDSHAKE);
+
+        // Wait for the server's handshake, which is delayed while the connection is queued, no longer than the deadline
+        set_receive_deadline(socket_fd, deadline_ns);
+        wire_format = cfg.format;
+        if (perform_handshake(socket_fd, &wire_format, &retry_after_ms))
+            break;
+        close(socket_fd);
+        if (retry_after_ms == 0)
+            return EXIT_FAILURE;
+        if (attempt > MAX_BUSY_RETRIES)
+        {
+            fprintf(stderr, "Error: server at port %d is busy\n", cfg.port);
+            return EXIT_FAILURE;
+        }
+        if (deadline_ns > 0 && monotonic_ns() + retry_after_ms * 1000000LL >= deadline_ns)
+        {
+            fprintf(stderr, "Error: deadline passed while server at port %d was busy\n", cfg.port);
+            return EXIT_FAILURE;
+        }
+        wait_to_retry(attempt, retry_after_ms);
+    }
+    finish_traced_request(&transfer.trace);
+    transfer.wire_packed = wire_format == FORMAT_PACKED;
+    set_transfer_deadline(&transfer, deadline_ns);
+
+    // Send ciphertext and key to dec_server one chunk at a time,
+    // writing the result to stdout
+    bool success = run_transfer(&transfer, socket_fd);
+    close_transfer(&transfer);
+    if (cfg.trace_filename != NULL)
+        dump_trace(&transfer.trace);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-bool perform_handshake(int socket_fd)
+bool perform_handshake(int socket_fd, int *format, int *retry_after_ms)
 {
-    // Identify self to server
-    send_string("dec_client", socket_fd);
-    
+    // Identify self to server, asking for packed or binary payloads if requested
+    if (*format == FORMAT_PACKED)
+        send_string("dec_client " PROTOCOL_VERSION " " PACKED_CAPABILITY, socket_fd);
+    else if (*format == FORMAT_BINARY)
+        send_string("dec_client " PROTOCOL_VERSION " " BINARY_CAPABILITY, socket_fd);
+    else
+        send_string("dec_client " PROTOCOL_VERSION, socket_fd);
+
     // Wait for server to identify itself
     char *handshake_response = malloc(BUFFER_SIZE);
     memset(handshake_response, '\0', BUFFER_SIZE);
     int n_read = recv(socket_fd, handshake_response, BUFFER_SIZE, 0);
-    
+    if (n_read <= 0)
+    {
+        fprintf(stderr, "Error: server did not complete the handshake\n");
+        free(handshake_response);
+        *retry_after_ms = 0;
+        return false;
+    }
+
+    // If the server is busy, note how long it asked the client to wait
+    *retry_after_ms = 0;
+    if (parse_busy(handshake_response, retry_after_ms))
+    {
+        free(handshake_response);
+        return false;
+    }
+
     // If connected server is enc_server, refuse connection
-    if ( strcmp(handshake_response, "enc_server@") == 0 )
+    if ( strncmp(handshake_response, "enc_server", strlen("enc_server")) == 0 )
     {
         fprintf(stderr, "Error: connection refused: dec_client cannot connect to enc_server\n");
         return false;
     }
 
+    // Determine which payload format the server accepted
+    int accepted = -1;
+    if (strcmp(handshake_response, "dec_server " PROTOCOL_VERSION "@") == 0)
+        accepted = FORMAT_TEXT;
+    else if (*format == FORMAT_PACKED && strcmp(handshake_response, "dec_server " PROTOCOL_VERSION " " PACKED_CAPABILITY "@") == 0)
+        accepted = FORMAT_PACKED;
+    else if (*format == FORMAT_BINARY && strcmp(handshake_response, "dec_server " PROTOCOL_VERSION " " BINARY_CAPABILITY "@") == 0)
+        accepted = FORMAT_BINARY;
+
     // If connected server is not recognized, refuse connection
-    if ( strcmp(handshake_response, "dec_server@") != 0 )
+    if (accepted < 0)
     {
         fprintf(stderr, "Error: connection refused: unknown server: %s\n", handshake_response);
         return false;
     }
 
-    // Return true if connected to dec_server
-    return true;
-}
-
-void get_plaintext_from_server(int socket_fd, struct Args args)
-{
-    // Create a buffer for reading from socket
-    char *buffer = (char *) malloc(BUFFER_SIZE);
-    memset(buffer, '\0', BUFFER_SIZE);
-
-    // Create a string to store the complete message
-    int full_string_size = BUFFER_SIZE;
-    char *full_recd_string = (char *) malloc(full_string_size);
-    memset(full_recd_string, '\0', full_string_size);
-
-    int n_read = 0;             // Number of characters read in recv()
-    int total_n_read = 0;       // Total number of characters read
-    int stop_idx;               // Index of stop character ('@')
-    do
+    // Binary input cannot be sent as text, but packed payloads can fall back to text
+    if (*format == FORMAT_BINARY && accepted != FORMAT_BINARY)
     {
-        // Read from socket, filling buffer, and check for error
-        n_read = recv(socket_fd, buffer, BUFFER_SIZE, 0);
-        if (n_read < 0)
-            fprintf(stderr, "Error: failed to read from socket\n");
-
-        // Keep track of total number of characters read in current message
-        total_n_read += n_read;
-
-        // If the message is larger than full_recd_string, resize full_recd_string
-        if ((float) total_n_read / (float) full_string_size > 1)
-        {
-            full_string_size *= 2;
-            full_recd_string = (char *) realloc(full_recd_string, full_string_size);
-        }
-        
-        // Add contents of buffer to full_recd_string
-        strcat(full_recd_string, buffer);
-
-        // Zero out buffer for re-use
-        memset(buffer, '\0', BUFFER_SIZE);
-
-        // Search for stop character
-        find_stop_index(full_recd_string, &stop_idx);
-
-    } while (stop_idx == -1); // Iterate until stop character is found
-
-    // Store full received string as plaintext
-    args.plaintext = (char *) malloc(stop_idx + 1);
-    memset(args.plaintext, '\0', stop_idx + 1);
-    strncpy(args.plaintext, full_recd_string, stop_idx);
-
-    // Free allocated memory
-    free(buffer);
-    free(full_recd_string);
+        fprintf(stderr, "Error: server does not accept binary payloads\n");
+        return false;
+    }
+    *format = accepted;
 
-    // Write plaintext to stdout
-    fprintf(stdout, "%s\n", args.plaintext);
+    // Return true if connected to dec_server
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,372 @@
+/**
+ * @file dec_handler.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the decryption side of a server: the handshake with dec_client
+ * and the handling of its requests. Both dec_server and otp_server hand
+ * their dec_client connections here, once the client's identifier is read.
+ * 
+ * The buffers of each framed request come from the process's request arena
+ * and are all freed at once when the request is done.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "pad_store.h"
+#include "otp.h"
+#include "alphabet.h"
+#include "packed.h"
+#include "mac.h"
+#include "arena.h"
+#include "timeouts.h"
+#include "fairness.h"
+#include "budget.h"
+#include "admission.h"
+#include "stats.h"
+#include "trace.h"
+#include "dec_handler.h"
+#include "util.h"
+
+bool handle_dec_connection(struct Reader *reader, const char *identifier, int *format)
+{
+    // Declare object to hold ciphertext, key, and plaintext
+    struct Args args;
+    int socket_fd = reader->socket_fd;
+
+    // Verify that connection is to dec_client
+    bool framed;
+    if (!perform_dec_handshake(reader, identifier, &framed, format))
+        return false;
+    finish_handshake(&trace);
+
+    // Clients that speak the framed protocol send a series of chunk requests
+    if (framed)
+        return handle_dec_requests(reader, *format);
+
+    // The original protocol reads the socket directly, so its reads are limited by the socket itself
+    limit_receives(&timeouts, socket_fd);
+
+    // Create buffer for reading from socket
+    char *buffer = (char *) malloc(BUFFER_SIZE);
+    memset(buffer, '\0', BUFFER_SIZE);
+
+    // Create string to store entire message
+    int full_string_size = BUFFER_SIZE;
+    char *full_recd_string = (char *) malloc(full_string_size);
+    memset(full_recd_string, '\0', full_string_size);
+
+    int n_read = 0;                 // Number of characters read into buffer
+    int total_n_read = 0;           // Total number of characters so far in message
+    int stop_idx_1, stop_idx_2;     // Indices of stop characters
+    do
+    {
+        // Read from socket, filling buffer
+        n_read = recv(socket_fd, buffer, BUFFER_SIZE - 1, 0);
+        if (n_read <= 0)
+            break;
+
+        // Keep track of total number of characters read
+        total_n_read += n_read;
+
+        // If the message is larger than full_recd_string, resize full_recd_string
+        if ((float) total_n_read / (float) full_string_size > 1)
+        {            
+            full_string_size *= 2;
+
+            // Hold memory for the larger message, and the old one while it is copied, within the server's budget
+            if (!hold_memory(&budget, BUFFER_SIZE + full_string_size + full_string_size / 2, 0))
+            {
+                n_read = 0;
+                break;
+            }
+            full_recd_string = (char *) realloc(full_recd_string, full_string_size);
+        }
+
+        // Add contents of buffer to full_recd_string
+        strcat(full_recd_string, buffer);
+
+        // Zero out buffer for re-use
+        memset(buffer, '\0', BUFFER_SIZE);
+
+        // Search for stop characters
+        find_stop_indices(full_recd_string, &stop_idx_1, &stop_idx_2);
+
+    } while (stop_idx_1 == -1 || stop_idx_2 == -1); // Iterate until both stop characters are found
+
+    // Give up if the client closed the connection, stalled before sending the whole message,
+    // or sent more than the memory budget can cover
+    if (n_read <= 0)
+    {
+        if (n_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            count_timeout(&timeouts, TIMEOUT_BODY);
+        else if (n_read < 0)
+            fprintf(stderr, "Error: failed to read from socket\n");
+        free(buffer);
+        free(full_recd_string);
+        return false;
+    }
+
+    // Hold memory for the copies of the message's parts too, or give up on the connection
+    if (!hold_memory(&budget, BUFFER_SIZE + full_string_size + 2LL * stop_idx_1 + stop_idx_2 + 3, 0))
+    {
+        free(buffer);
+        free(full_recd_string);
+        return false;
+    }
+
+    // Extract ciphertext from message
+    args.ciphertext = (char *) malloc(stop_idx_1 + 1);
+    memset(args.ciphertext, '\0', stop_idx_1 + 1);
+    strncpy(args.ciphertext, full_recd_string, stop_idx_1);
+
+    // Extract key from message
+    args.key = (char *) malloc(stop_idx_2 - stop_idx_1 + 1);
+    memset(args.key, '\0', stop_idx_2 - stop_idx_1 + 1);
+    strncpy(args.key, &full_recd_string[stop_idx_1 + 1], stop_idx_2 - stop_idx_1 - 1);
+
+    // Free allocated memory
+    free(buffer);
+    free(full_recd_string);
+    charge_client(&clients, client_slot, strlen(args.ciphertext));
+
+    // Create plaintext
+    args.plaintext = (char *) malloc(strlen(args.ciphertext) + 1);
+    memset(args.plaintext, '\0', strlen(args.ciphertext) + 1);
+    decrypt(args);
+
+    // Send plaintext
+    send_string(args.plaintext, socket_fd);
+
+    // Free memory allocated for args
+    free(args.plaintext);
+    free(args.key);
+    free(args.ciphertext);
+    return false;
+}
+
+bool perform_dec_handshake(struct Reader *reader, const char *identifier, bool *framed, int *format)
+{
+    // dec_client identifiers (expected values)
+    const char *dec_client_signal = "dec_client";
+    const char *dec_client_framed_signal = "dec_client " PROTOCOL_VERSION;
+    const char *dec_client_packed_signal = "dec_client " PROTOCOL_VERSION " " PACKED_CAPABILITY;
+    const char *dec_client_binary_signal = "dec_client " PROTOCOL_VERSION " " BINARY_CAPABILITY;
+
+    // Verify that the client identified itself as dec_client, and note the payload format it asked for
+    bool success = true;
+    *framed = true;
+    *format = FORMAT_TEXT;
+    if (identifier != NULL && strcmp(identifier, dec_client_packed_signal) == 0)
+        *format = FORMAT_PACKED;
+    else if (identifier != NULL && strcmp(identifier, dec_client_binary_signal) == 0)
+        *format = FORMAT_BINARY;
+    else if (identifier == NULL || strcmp(identifier, dec_client_framed_signal) != 0)
+    {
+        *framed = false;
+        success = identifier != NULL && strcmp(identifier, dec_client_signal) == 0;
+    }
+
+    // Identify self as dec_server to client, echoing the protocol version and accepting the payload format
+    if (*format == FORMAT_PACKED)
+        send_string("dec_server " PROTOCOL_VERSION " " PACKED_CAPABILITY, reader->socket_fd);
+    else if (*format == FORMAT_BINARY)
+        send_string("dec_server " PROTOCOL_VERSION " " BINARY_CAPABILITY, reader->socket_fd);
+    else
+        send_string(*framed ? "dec_server " PROTOCOL_VERSION : "dec_server", reader->socket_fd);
+
+    return success;
+}
+
+bool handle_dec_requests(struct Reader *reader, int format)
+{
+    struct Header request;      // Header of the current request
+    struct Header response;     // Header of the current response
+    struct Args args;           // Ciphertext, key, and plaintext of the current request
+
+    // Serve requests until the client closes the connection, or until the server asks for the connection back
+    long long n_served = 0;     // symbols requested since this process took the connection
+    while (true)
+    {
+        finish_request(&stats);
+        finish_traced_request(&trace);
+        pace_client(&clients, client_slot);
+        release_memory(&budget);
+        if (should_yield != NULL && should_yield(reader, n_served))
+            return true;
+        if (!read_request_header(&timeouts, reader, &request))
+            return false;
+        start_request(&stats, &request);
+        start_traced_request(&trace, PHASE_RECEIVE, request.offset, request.length);
+        describe_traced_request(&trace, "dec", &request, format, reader->socket_fd);
+        n_served += request.length;
+        charge_client(&clients, client_slot, request.length);
+        long long deadline_ns = request_deadline(&request);
+        init_header(&response);
+        response.offset = request.offset;
+
+        // A chunk turned away is read past first, so its client gets the status rather than a reset connection.
+        // The payload is the ciphertext, followed by its key and MAC key unless the key is in a pad.
+        long long payload_size = format == FORMAT_PACKED ? packed_size(request.length) : request.length;
+        if (request.pad_id[0] == '\0')
+            payload_size = 2 * payload_size + (request.authenticate ? MAC_KEY_SYMBOLS : 0);
+
+        // Reject chunks larger than the server will buffer
+        if (request.length > MAX_CHUNK_SIZE)
+        {
+            reject_request(reader, &response, STATUS_BAD_REQUEST, payload_size);
+            return false;
+        }
+
+        // Look up the alphabet of the chunk's symbols. Pads, packed payloads, and binary payloads
+        // hold A-Z and space only, so other alphabets can only be used with keys from the payload.
+        const struct Alphabet *alphabet = find_alphabet(request.alphabet);
+        if (alphabet == NULL || (alphabet != DEFAULT_ALPHABET &&
+                                 (format != FORMAT_TEXT || request.pad_id[0] != '\0' || request.operation[0] != '\0')))
+        {
+            reject_request(reader, &response, alphabet == NULL ? STATUS_NO_ALPHABET : STATUS_BAD_REQUEST, payload_size);
+            return false;
+        }
+
+        // Only chunk requests are served; pad ranges are reserved by enc_server
+        if (request.operation[0] != '\0')
+        {
+            reject_request(reader, &response, STATUS_BAD_REQUEST, payload_size);
+            return false;
+        }
+
+        // Only text chunks are authenticated, and an authenticated chunk must carry its tag
+        unsigned char tag[MAC_TAG_SIZE];
+        if (request.authenticate && (format != FORMAT_TEXT || !parse_tag(request.tag, tag)))
+        {
+            reject_request(reader, &response, STATUS_BAD_REQUEST, payload_size);
+            return false;
+        }
+
+        // An authenticated chunk's MAC key follows its key
+        long long key_length = request.length + (request.authenticate ? MAC_KEY_SYMBOLS : 0);
+
+        // If the request names a server-resident pad, verify that it holds the chunk's key
+        const struct Pad *pad = NULL;
+        if (request.pad_id[0] != '\0')
+        {
+            const char *status = NULL;
+            pad = find_pad(&pad_store, request.pad_id);
+            if (pad == NULL)
+                status = STATUS_NO_PAD;
+            else if (format == FORMAT_BINARY)
+                status = STATUS_BAD_REQUEST;
+            else if (request.key_offset > pad->length - key_length)
+                status = STATUS_OUT_OF_RANGE;
+
+            if (status != NULL)
+            {
+                reject_request(reader, &response, status, payload_size);
+                return false;
+            }
+        }
+
+        // Hold memory for the chunk's buffers within the server's budget, or turn the chunk away for now;
+        // packed payloads take fewer bytes than symbols
+        long long size = format == FORMAT_PACKED ? packed_size(request.length) : request.length;
+        long long key_size = size + key_length - request.length;
+        bool key_in_place = pad != NULL && format != FORMAT_PACKED;
+        if (!hold_memory(&budget, 2 * (size + 1) + (key_in_place ? 0 : key_size + 1), deadline_ns))
+        {
+            if (!refuse_request(reader, &response, size + (pad == NULL ? key_size : 0)))
+                return false;
+            continue;
+        }
+
+        // Allocate ciphertext and plaintext for the chunk from the arena
+        args.ciphertext = arena_alloc(&request_arena, size + 1);
+        args.plaintext = arena_alloc(&request_arena, size + 1);
+        args.ciphertext[size] = '\0';
+        args.plaintext[size] = '\0';
+
+        // Read ciphertext from the payload
+        bool success = read_bytes(reader, args.ciphertext, size);
+
+        // Use the key in place if it is server-resident, packing it first if payloads are packed;
+        // otherwise read it from the payload, along with the MAC key of an authenticated chunk
+        if (key_in_place)
+            args.key = (char *) pad->symbols + request.key_offset;
+        else
+        {
+            args.key = arena_alloc(&request_arena, key_size + 1);
+            args.key[key_size] = '\0';
+            if (pad != NULL)
+                pack_symbols(pad->symbols + request.key_offset, request.length, args.key);
+            else
+                success = success && read_bytes(reader, args.key, key_size);
+        }
+        if (!success)
+            report_timeout(&timeouts, reader, TIMEOUT_BODY, request.offset);
+        mark_phase(&trace, PHASE_TRANSFORM);
+
+        // Abandon the chunk if the client stopped waiting while its payload arrived
+        if (success && abandon_expired(&timeouts, reader->socket_fd, &request, deadline_ns))
+        {
+            reset_arena(&request_arena);
+            continue;
+        }
+
+        // Reject chunks containing invalid characters
+        bool valid = format == FORMAT_BINARY ||
+                     (format == FORMAT_PACKED ? validate_packed(args.ciphertext, request.length) :
+                      find_invalid_symbol(alphabet, args.ciphertext, request.length) == NULL);
+        if (success && !valid)
+        {
+            strcpy(response.status, STATUS_BAD_REQUEST);
+            send_header(&response, reader->socket_fd);
+            success = false;
+        }
+
+        // Decrypt an authenticated chunk, rejecting it if its tag does not match
+        if (success && request.authenticate)
+        {
+            unsigned char mac_key[MAC_KEY_SIZE];
+            derive_mac_key(alphabet, args.key + request.length, mac_key);
+            bool authentic = decrypt_verified(alphabet, args, request.length, mac_key, tag);
+            memset(mac_key, 0, sizeof(mac_key));
+            if (!authentic)
+            {
+                strcpy(response.status, STATUS_FORGED);
+                send_header(&response, reader->socket_fd);
+                success = false;
+            }
+        }
+
+        // Decrypt the chunk and send the plaintext back
+        if (success)
+        {
+            if (format == FORMAT_BINARY)
+                decrypt_binary(args, request.length);
+            else if (format == FORMAT_PACKED)
+                decrypt_packed(args, request.length);
+            else if (!request.authenticate)
+                alphabet->decrypt(args, request.length);
+            strcpy(response.status, STATUS_OK);
+            response.length = request.length;
+            success = send_header(&response, reader->socket_fd) &&
+                      send_bytes(args.plaintext, size, reader->socket_fd);
+        }
+
+        // Free every buffer of the chunk at once
+        reset_arena(&request_arena);
+
+        if (!success)
+            return false;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+/**
+ * @file dec_handler.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for dec_handler.c
+ */
+
+#ifndef DEC_HANDLER
+#define DEC_HANDLER
+
+// Pads available to requests that name a server-resident key
+extern struct PadStore pad_store;
+
+// Arena the buffers of each request are allocated from
+extern struct Arena request_arena;
+
+// Deadlines connections are held to
+extern struct Timeouts timeouts;
+
+// Memory budget the buffers of every request are held within
+extern struct MemoryBudget budget;
+
+// Clients the server is shared between, and the slot of the client of the connection being served
+extern struct Clients clients;
+extern int client_slot;
+
+// Statistics the process publishes for otp_stat
+extern struct Stats stats;
+
+// Tracing of the phases of the process's requests
+extern struct Trace trace;
+
+// Asked before each request whether to hand the connection back to the server,
+// given the reader and the symbols served since this process took the connection; NULL never to
+extern bool (*should_yield)(const struct Reader *, long long);
+
+/**
+ * Handles a connection from dec_client once its identifier has been read.
+ * Performs the handshake, then serves framed requests or reads ciphertext and
+ * key from socket, decrypts ciphertext, and writes plaintext to socket.
+ * 
+ * @param  reader buffered reader for connected socket
+ * @param  identifier identifier the client sent; NULL if it sent none
+ * @param  format value to hold the payload format the client asked for, one of the FORMAT_ values
+ * 
+ * @return true if the connection was stopped between framed requests to
+ *         hand it back to the server, as handle_dec_requests() does; false if it is done
+ */
+bool handle_dec_connection(struct Reader *, const char *, int *);
+
+/**
+ * Verifies that connection is to dec_client and determines whether the
+ * client speaks the framed protocol and which payload format it asked for
+ * 
+ * @param  reader buffered reader for connected socket
+ * @param  identifier identifier the client sent; NULL if it sent none
+ * @param  framed value to hold whether the client sends framed requests
+ * @param  format value to hold the payload format, one of the FORMAT_ values
+ * 
+ * @return true if connection is to dec_client, else false
+ */
+bool perform_dec_handshake(struct Reader *, const char *, bool *, int *);
+
+/**
+ * Serves framed requests until the client closes the connection.
+ * Each request carries the offset and length of one chunk of ciphertext
+ * followed by the chunk and its key. If the request names a pad,
+ * the key is read from the pad store instead of the payload. The response echoes the offset
+ * so the client can confirm which chunk the plaintext belongs to.
+ * 
+ * If the client asked for packed payloads, every payload holds packed symbols
+ * and is transformed without unpacking. If it asked for binary payloads,
+ * every payload holds arbitrary bytes and its key must be shipped with it.
+ * 
+ * Before each request, should_yield() is asked whether to stop and hand the
+ * connection back to the server, which may pass it to any worker to continue.
+ * Each request is charged to the connection's client, which waits before its
+ * next request while it is ahead of its rate. A chunk whose buffers the
+ * memory budget cannot cover is answered as overloaded, and the connection
+ * carries on.
+ * 
+ * @param  reader buffered reader for connected socket
+ * @param  format payload format, one of the FORMAT_ values
+ * 
+ * @return true if serving stopped between requests to hand the connection
+ *         back; false if the client closed the connection or an error ended it
+ */
+bool handle_dec_requests(struct Reader *, int);
+
+#endif
\ No newline at end of file
@@ -8,86 +8,324 @@
  * Assignment 5
  * 
  * dec_server listens on specified port for connections from dec_client.
- * Each new connection is run in a separate process. Five processes can run at a time.
+ * Each new connection is run in a separate process. Five processes can run at a time;
+ * further connections wait in a bounded queue (-q) for a process to finish, and
+ * once the queue is full, clients are told the server is busy and when to retry.
  * When ciphertext and key are received, dec_server decrypts the ciphertext using
  * one-time-pad and sends plaintext to dec_client.
  * 
- * Usage: dec_server <port>
+ * If started with a pad directory, requests may name a pad and a key offset
+ * instead of sending the key, so only the ciphertext crosses the network.
+ * 
+ * Clients may ask for packed payloads in the handshake; the server then
+ * decrypts packed chunks directly, without unpacking them. Clients may
+ * instead ask for binary payloads of arbitrary bytes, which are XORed with
+ * key bytes; binary keys are always shipped with the payload.
+ * 
+ * Clients may send a chunk with the tag enc_server returned for it. The
+ * server then verifies the tag as it decrypts, keyed by the key symbols that
+ * follow the chunk's key, and returns no plaintext if the tag does not match.
+ * 
+ * Connections that stall in the handshake, partway through a request, or
+ * between requests for longer than their deadlines (-t) are sent an error
+ * and closed, so they cannot hold one of the five processes.
+ * 
+ * Waiting connections are queued per client, by user for local clients and
+ * by address for remote ones, and clients take turns by deficit round-robin
+ * with the weights given by -f. Clients may be held to a rate in symbols per
+ * second, by default (-l) or per client (-f). The server prints each client's
+ * usage and queue delay to stderr when it receives SIGUSR1.
+ * 
+ * The buffers of the requests served at once are held within a memory budget
+ * (-m), half of physical memory by default. A request that does not fit waits
+ * briefly for memory, then is answered overloaded and sent again.
+ * 
+ * Counters and request latencies are published in shared memory, where
+ * otp_stat reads them while the server runs. Each process also times the
+ * phases of its connection and requests: with -T, the server writes the
+ * latest phases of every process to a Chrome trace file on SIGUSR1, and
+ * with -L, requests slower than -x milliseconds are logged as JSON lines.
+ * With -C, every request's metadata, but never its content, is captured in
+ * the same form for otp_loadgen to replay.
+ * With -P, each phase's cycles per byte, instructions per cycle, and cache
+ * and branch misses per KiB are also counted, by the size of the request,
+ * and printed on SIGUSR1.
+ * 
+ * Usage: dec_server [-p <paddir>] [-q <depth>] [-b <backlog>] [-t <handshake>:<body>:<idle>]
+ *                   [-f <client>=<weight>[,<rate>]] [-l <rate>] [-m <budget>] [-T <tracefile>] [-L <slowlog> [-x <ms>]] [-C <capture>] [-P] <port>
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
 #include <sys/wait.h>
 #include <netinet/in.h>
 #include <stdbool.h>
 
-#include "dec_server.h"
 #include "socket_io.h"
+#include "protocol.h"
+#include "pad_store.h"
+#include "otp.h"
+#include "alphabet.h"
+#include "packed.h"
+#include "mac.h"
+#include "arena.h"
+#include "timeouts.h"
+#include "fairness.h"
+#include "budget.h"
+#include "admission.h"
+#include "stats.h"
+#include "profile.h"
+#include "trace.h"
+#include "dec_handler.h"
+#include "dec_server.h"
 #include "util.h"
 
-// Number of currently running processes
-int n_connections = 0;
+// Connections being served and waiting to be served
+struct Admission admission;
+
+// Pads available to requests that name a server-resident key
+struct PadStore pad_store;
+
+// Arena the buffers of a connection's requests are allocated from
+struct Arena request_arena;
+
+// Deadlines connections are held to
+struct Timeouts timeouts;
+
+// Memory budget the buffers of every request are held within
+struct MemoryBudget budget;
+
+// Clients the server is shared between, and in a connection's process, the slot of its client
+struct Clients clients;
+int client_slot = -1;
+
+// Statistics published for otp_stat, and the process of each connection, by its statistics slot
+struct Stats stats;
+pid_t connection_pids[MAX_CONNECTIONS];
+
+// Tracing of the phases of requests, in a ring per connection process after the server's own
+struct Trace trace;
+
+// Counters of the phases of requests, in a table per process like the trace rings
+struct Profile profile;
+
+// Set when SIGUSR1 asks for the metrics to be printed
+volatile sig_atomic_t metrics_requested = 0;
+
+// Each connection keeps its process until it is done, so connections are never handed back
+bool (*should_yield)(const struct Reader *, long long) = NULL;
 
 int main(int argc, char **argv)
 {
+    // Parse options
+    char *pad_directory = NULL;
+    int queue_depth = DEFAULT_QUEUE_DEPTH;
+    int backlog = DEFAULT_BACKLOG;
+    parse_timeouts(&timeouts, DEFAULT_TIMEOUTS);
+    if (!init_clients(&clients, 0))
+        return EXIT_FAILURE;
+    long long memory_limit = -1;
+    char *trace_path = NULL;
+    char *slow_log_path = NULL;
+    long long slow_ms = DEFAULT_SLOW_MS;
+    char *capture_path = NULL;
+    bool profiling = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:q:b:t:f:l:m:T:L:x:C:P")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p': // Directory of server-resident pads
+                pad_directory = optarg;
+                break;
+
+            case 'q': // Number of connections that may wait for a slot
+                queue_depth = atoi(optarg);
+                if (queue_depth < 0 || queue_depth > MAX_QUEUE_DEPTH)
+                {
+                    fprintf(stderr, "Error: invalid queue depth: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'b': // Number of connections the kernel holds before they are accepted
+                backlog = atoi(optarg);
+                if (backlog < 1)
+                {
+                    fprintf(stderr, "Error: invalid backlog: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 't': // Deadlines for the handshake, each request's body, and idle time, in milliseconds
+                if (!parse_timeouts(&timeouts, optarg))
+                {
+                    fprintf(stderr, "Error: invalid timeouts: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'f': // Weight of a client, and optionally its rate
+                if (!add_client_rule(&clients, optarg))
+                {
+                    fprintf(stderr, "Error: invalid client rule: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'l': // Symbols per second each client may be served, unless its rule says otherwise
+                clients.default_rate = parse_size(optarg);
+                if (clients.default_rate < 0)
+                {
+                    fprintf(stderr, "Error: invalid rate: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'm': // Bytes the buffers of requests served at once may take; 0 for no limit
+                memory_limit = parse_size(optarg);
+                if (memory_limit < 0)
+                {
+                    fprintf(stderr, "Error: invalid memory budget: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'T': // File the phases of recent requests are written to on SIGUSR1
+                trace_path = optarg;
+                break;
+
+            case 'L': // File slow requests are logged to
+                slow_log_path = optarg;
+                break;
+
+            case 'x': // Time in milliseconds from which a request is logged as slow
+                slow_ms = atoll(optarg);
+                if (slow_ms < 0)
+                {
+                    fprintf(stderr, "Error: invalid slow request threshold: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'C': // File the metadata of every request is captured to, for otp_loadgen to replay
+                capture_path = optarg;
+                break;
+
+            case 'P': // Count the cycles and cache misses of each phase of requests
+                profiling = true;
+                break;
+
+            default:
+                fprintf(stderr, "Usage: dec_server [-p $paddir] [-q $depth] [-b $backlog] [-t $handshake:$body:$idle] [-f $client=$weight[,$rate]] [-l $rate] [-m $budget] [-T $tracefile] [-L $slowlog [-x $ms]] [-C $capture] [-P] $port\n");
+                return EXIT_FAILURE;
+        }
+    }
+
     // Validate port and convert it to an integer
     int port = get_port(argc, argv);
     if (port == 0)
         return EXIT_FAILURE;
 
+    // Publish statistics for otp_stat; the server runs without them if the segment cannot be created
+    open_stats(&stats, "dec_server", port);
+
+    // Trace the phases of requests before forking so every process writes into the rings, slow log, and capture
+    if (!open_trace(&trace, "dec_server", MAX_CONNECTIONS + 1, trace_path, slow_log_path, slow_ms))
+        return EXIT_FAILURE;
+    if (capture_path != NULL && !open_capture(&trace, capture_path))
+        return EXIT_FAILURE;
+
+    // Profile with the counters that are permitted; the server runs without profiling if none are
+    if (profiling && open_profile(&profile, "dec_server", MAX_CONNECTIONS + 1))
+        trace.profile = &profile;
+
+    // Open the memory budget before forking so every connection holds memory from it
+    if (!open_budget(&budget, memory_limit, MAX_CONNECTIONS + 1))
+        return EXIT_FAILURE;
+
+    // Load pads before forking so every connection shares their mappings
+    if (pad_directory != NULL && !load_pad_store(&pad_store, pad_directory))
+        return EXIT_FAILURE;
+
+    // Serve MAX_CONNECTIONS connections at once; the rest wait for a slot or are turned away
+    if (!init_admission(&admission, MAX_CONNECTIONS, queue_depth, &clients))
+        return EXIT_FAILURE;
+
     // Set up listening socket
-    int listen_socket_fd = setup_listen_socket(port);
+    int listen_socket_fd = setup_listen_socket(port, backlog);
     if (listen_socket_fd < 0)
         return EXIT_FAILURE;
 
-    // Setup SIGCHLD signal handler to clean up children on termination
+    // Setup SIGCHLD signal handler to wake the server when a connection's process terminates
     if (!catch_SIGCHLD())
         return EXIT_FAILURE;
 
-    // Setup client socket address
-    struct sockaddr_in client_addr;
-    socklen_t client_socklen = sizeof(client_addr);
+    // Setup SIGUSR1 signal handler to print metrics on request
+    if (!catch_SIGUSR1())
+        return EXIT_FAILURE;
+
+    // Ignore SIGPIPE, so a client that disconnects mid-response fails a send instead of killing its process
+    signal(SIGPIPE, SIG_IGN);
+
+    // Wait on the listening socket and the wake-up pipe at once
+    struct pollfd poll_fds[2];
+    poll_fds[0].fd = listen_socket_fd;
+    poll_fds[0].events = POLLIN;
+    poll_fds[1].fd = admission.wake_fds[0];
+    poll_fds[1].events = POLLIN;
 
     // Continuously process connections
     while (true)
     {
-        // Accept new connection and check for error
-        int socket_fd = accept( listen_socket_fd, (struct sockaddr *) &client_addr, &client_socklen );
-        if (socket_fd < 0)
+        // Wake up in time for clients held back by their rates
+        int n_ready = poll(poll_fds, 2, admission_timeout_ms(&admission));
+        if (n_ready < 0 && errno != EINTR)
         {
-            fprintf(stderr, "Error: failed to accept connection");
+            fprintf(stderr, "Error: failed to wait for connections\n");
             return EXIT_FAILURE;
         }
 
-        // Increment the number of connections
-        n_connections++;
-
-        // Create a new process
-        pid_t pid = fork();
-        switch (pid)
+        // Free the slot of every connection whose process has terminated
+        drain_wakeups(&admission);
+        if (metrics_requested)
         {
-            case -1: // Fork failed
-                fprintf(stderr, "Error: fork() failed\n");
-                exit(EXIT_FAILURE);
-
-            case 0: // Child process
-                // Return without handling connection if max connections reached
-                if (n_connections > MAX_CONNECTIONS)
-                    exit(EXIT_SUCCESS);
-
-                // Close the listening socket
-                close(listen_socket_fd);
-
-                // Handle the connection
-                handle_connection(socket_fd);
-                exit(EXIT_SUCCESS);
+            metrics_requested = 0;
+            print_metrics();
+        }
+        pid_t pid;
+        while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+        {
+            finish_connection(&admission);
+            for (int i = 0; i < MAX_CONNECTIONS; i++)
+            {
+                // Take back the memory of a connection whose process died mid-request
+                if (connection_pids[i] == pid)
+                {
+                    reclaim_memory(&budget, i + 1);
+                    connection_pids[i] = 0;
+                }
+            }
+        }
 
-            default: // Parent process
-                // Close the new connection
-                close(socket_fd);
+        // Accept a new connection, then serve it now, queue it, or turn it away
+        if (n_ready > 0 && (poll_fds[0].revents & POLLIN))
+        {
+            int socket_fd = accept(listen_socket_fd, NULL, NULL);
+            if (socket_fd >= 0 && admit_connection(&admission, socket_fd) >= 0)
+                start_connection(socket_fd, listen_socket_fd);
         }
+
+        // Serve waiting connections as slots free up
+        int socket_fd;
+        while ((socket_fd = next_connection(&admission)) >= 0)
+            start_connection(socket_fd, listen_socket_fd);
+        publish_admission(&stats, &admission);
     }
 
     return EXIT_SUCCESS;
@@ -96,15 +334,15 @@ int main(int argc, char **argv)
 int get_port(int argc, char **argv)
 {
     // Verify the correct number of arguments was given
-    if (argc < 2)
+    if (argc <= optind)
     {
         fprintf(stderr, "Error: missing argument\n");
-        fprintf(stderr, "Usage: dec_server $port");
+        fprintf(stderr, "Usage: dec_server [-p $paddir] [-q $depth] [-b $backlog] [-t $handshake:$body:$idle] [-f $client=$weight[,$rate]] [-l $rate] [-m $budget] [-T $tracefile] [-L $slowlog [-x $ms]] [-C $capture] [-P] $port");
         return 0;
     }
 
     // Convert port to an integer
-    int port = atoi(argv[1]);
+    int port = atoi(argv[optind]);
 
     // Verify that specified port is a valid port number
     if (port < 1 || port > MAX_PORT)
@@ -119,11 +357,13 @@ int get_port(int argc, char **argv)
 
 void handle_SIGCHLD(int signo)
 {
-    // Perform non-blocking wait for any child process
-    // When child terminates, decrement the number of connections
-    while (waitpid(-1, NULL, WNOHANG) > 0)
-        continue;
-    n_connections--;
+    (void) signo;
+
+    // Wake the server, which reaps every terminated process and frees their slots.
+    // Preserve errno for the code the signal interrupted.
+    int saved_errno = errno;
+    wake_admission(&admission);
+    errno = saved_errno;
 }
 
 bool catch_SIGCHLD(void)
@@ -150,124 +390,113 @@ bool catch_SIGCHLD(void)
     return true;
 }
 
-void handle_connection(int socket_fd)
+void handle_SIGUSR1(int signo)
 {
-    // Declare object to hold ciphertext, key, and plaintext
-    struct Args args;
-
-    // Verify that connection is to dec_client
-    if (!perform_handshake(socket_fd))
-        return;
-
-    // Create buffer for reading from socket
-    char *buffer = (char *) malloc(BUFFER_SIZE);
-    memset(buffer, '\0', BUFFER_SIZE);
-
-    // Create string to store entire message
-    int full_string_size = BUFFER_SIZE;
-    char *full_recd_string = (char *) malloc(full_string_size);
-    memset(full_recd_string, '\0', full_string_size);
-
-    int n_read = 0;                 // Number of characters read into buffer
-    int total_n_read = 0;           // Total number of characters so far in message
-    int stop_idx_1, stop_idx_2;     // Indices of stop characters
-    do
-    {
-        // Read from socket, filling buffer
-        n_read = recv(socket_fd, buffer, BUFFER_SIZE - 1, 0);
-        if (n_read < 0)
-            fprintf(stderr, "Error: failed to read from socket\n");
-
-        // Keep track of total number of characters read
-        total_n_read += n_read;
-
-        // If the message is larger than full_recd_string, resize full_recd_string
-        if ((float) total_n_read / (float) full_string_size > 1)
-        {            
-            full_string_size *= 2;
-            full_recd_string = (char *) realloc(full_recd_string, full_string_size);
-        }
-
-        // Add contents of buffer to full_recd_string
-        strcat(full_recd_string, buffer);
-
-        // Zero out buffer for re-use
-        memset(buffer, '\0', BUFFER_SIZE);
-
-        // Search for stop characters
-        find_stop_indices(full_recd_string, &stop_idx_1, &stop_idx_2);
-
-    } while (stop_idx_1 == -1 || stop_idx_2 == -1); // Iterate until both stop characters are found
-
-    // Extract ciphertext from message
-    args.ciphertext = (char *) malloc(stop_idx_1 + 1);
-    memset(args.ciphertext, '\0', stop_idx_1 + 1);
-    strncpy(args.ciphertext, full_recd_string, stop_idx_1);
+    (void) signo;
+    int saved_errno = errno;
+    metrics_requested = 1;
+    wake_admission(&admission);
+    errno = saved_errno;
+}
 
-    // Extract key from message
-    args.key = (char *) malloc(stop_idx_2 - stop_idx_1 + 1);
-    memset(args.key, '\0', stop_idx_2 - stop_idx_1 + 1);
-    strncpy(args.key, &full_recd_string[stop_idx_1 + 1], stop_idx_2 - stop_idx_1 - 1);
+bool catch_SIGUSR1(void)
+{
+    // Declare SIGUSR1 action struct
+    struct sigaction sa_SIGUSR1;
 
-    // Free allocated memory
-    free(buffer);
-    free(full_recd_string);
+    // Register handle_SIGUSR1 as signal handler
+    sa_SIGUSR1.sa_handler = handle_SIGUSR1;
 
-    // Create plaintext
-    args.plaintext = (char *) malloc(strlen(args.ciphertext) + 1);
-    memset(args.plaintext, '\0', strlen(args.ciphertext) + 1);
-    decrypt(args);
+    // Initialize signal mask to exclude all signals
+    sigemptyset(&sa_SIGUSR1.sa_mask);
 
-    // Send plaintext
-    send_string(args.plaintext, socket_fd);
+    // Set flag to cause primitive library functions to resume after handler returns
+    sa_SIGUSR1.sa_flags = SA_RESTART;
 
-    // Free memory allocated for args
-    free(args.plaintext);
-    free(args.key);
-    free(args.ciphertext);
+    // Install signal handler and check for error
+    if (sigaction(SIGUSR1, &sa_SIGUSR1, NULL) == -1)
+    {
+        fprintf(stderr, "Error: failed to setup handler for metrics signal\n");
+        return false;
+    }
+    return true;
 }
 
-bool perform_handshake(int socket_fd)
+void print_metrics(void)
 {
-    // dec_client identifier (expected value)
-    const char *dec_client_signal = "dec_client@";
-    int dec_client_sig_len = strlen(dec_client_signal);
-
-    // Create buffer to read from socket
-    char *buffer = (char *) malloc(dec_client_sig_len + 1);
-    memset(buffer, '\0', dec_client_sig_len + 1);
-
-    // Read from socket
-    int n_read = recv(socket_fd, buffer, dec_client_sig_len, 0);
-    
-    // Verify that the client identified itself as dec_client
-    bool success = true;
-    if (n_read < dec_client_sig_len || strcmp(buffer, dec_client_signal) != 0)
-        success = false;
-
-    // Identify self as dec_server to client
-    send_string("dec_server", socket_fd);
-
-    // Free allocated memory
-    free(buffer);
-    return success;
+    print_admission(&admission, "dec_server");
+    print_clients(&clients, "dec_server");
+    print_budget(&budget, "dec_server");
+    if (trace.rings != NULL)
+        dump_trace(&trace);
+    print_traced_profile(&trace);
 }
 
-void decrypt(struct Args args)
+void start_connection(int socket_fd, int listen_socket_fd)
 {
-    // Walk through all characters in ciphertext
-    for (int i = 0; i < strlen(args.ciphertext); i++)
+    // Give the connection's process a statistics slot of its own; one is free for every free connection slot
+    int stats_slot = 0;
+    while (stats_slot < MAX_CONNECTIONS - 1 && connection_pids[stats_slot] > 0)
+        stats_slot++;
+
+    // Create new process
+    pid_t pid = fork();
+    switch (pid)
     {
-        // Convert encrypted character to integer between 0 and 26
-        int cipher_val = args.ciphertext[i] == ' ' ? 0 : args.ciphertext[i] - 64;
-
-        // Convert key character at same index to integer between 0 and 26
-        int key_val = args.key[i] == ' ' ? 0 : args.key[i] - 64;
-
-        // Subtract key value from encrypted value and mod by 27
-        int plain_val = mod(cipher_val - key_val, 27);
-
-        // Convert decrypted value to character and store in plaintext at current index
-        args.plaintext[i] = plain_val == 0 ? ' ' : plain_val + 64;
+        case -1: // Fork failed; turn the client away and free its slot
+            fprintf(stderr, "Error: fork() failed\n");
+            reject_connection(socket_fd, RETRY_AFTER_MS);
+            finish_connection(&admission);
+            break;
+
+        case 0: // Child process
+            // Leave metrics to the server, charge requests to the connection's client, and count and trace them
+            // in a slot of their own
+            signal(SIGUSR1, SIG_IGN);
+            client_slot = admission.client;
+            use_stats_slot(&stats, stats_slot + 1);
+            use_budget_slot(&budget, stats_slot + 1);
+            use_trace_ring(&trace, stats_slot + 1);
+            use_profile_table(&profile, stats_slot + 1);
+            start_traced_connection(&trace, admission.accepted_ns, clients.clients[client_slot].name);
+
+            // Close the listening socket and every other connection's socket
+            close(listen_socket_fd);
+            close_admission(&admission);
+
+            // Handle the connection
+            handle_connection(socket_fd);
+            exit(EXIT_SUCCESS);
+
+        default: // Parent process
+            connection_pids[stats_slot] = pid;
+            close(socket_fd);
     }
+}
+
+void handle_connection(int socket_fd)
+{
+    // Reserve the arena this connection's requests are allocated from
+    if (!init_arena(&request_arena, ARENA_RESERVED_SIZE))
+        return;
+    count_connection(&stats);
+
+    // Read the client's identifier, which must arrive before the handshake deadline,
+    // and hand the connection to the decryption handler
+    struct Reader reader;
+    init_reader(&reader, socket_fd);
+    limit_sends(&timeouts, socket_fd);
+    start_deadline(&timeouts, &reader, TIMEOUT_HANDSHAKE, monotonic_ns());
+    char *identifier = read_field(&reader, MAX_HEADER_SIZE);
+    int format;
+    if (identifier != NULL || !report_timeout(&timeouts, &reader, TIMEOUT_HANDSHAKE, 0))
+        handle_dec_connection(&reader, identifier, &format);
+
+    // Time the last request, then free allocated memory and return the connection's memory to the budget
+    finish_request(&stats);
+    finish_traced_request(&trace);
+    free(identifier);
+    free_reader(&reader);
+    free_arena(&request_arena);
+    release_memory(&budget);
 }
\ No newline at end of file
@@ -13,16 +13,9 @@
 #ifndef DEC_SERVER
 #define DEC_SERVER
 
-// Object to hold ciphertext, key, and plaintext
-struct Args 
-{
-    char *ciphertext;
-    char *key;
-    char *plaintext;
-};
-
 /**
- * Verifies that specified port is valid and returns it as an integer
+ * Verifies that specified port is valid and returns it as an integer.
+ * The port is the first argument following any options.
  * 
  * @param  argc the number of command-line arguments given 
  * @param  argv the given command-line arguments
@@ -33,8 +26,7 @@ int get_port(int, char **);
 
 /**
  * Handler for SIGCHLD signal.
- * Performs a non-blocking wait for any child process.
- * When a child process terminates, decrements the number of connections.
+ * Wakes the server, which reaps terminated child processes and frees their connections' slots.
  * 
  * @param  signo required but not used
  */
@@ -48,28 +40,38 @@ void handle_SIGCHLD(int);
 bool catch_SIGCHLD(void);
 
 /**
- * Handles a single connection. Performs handshake to verify that conneciton
- * is to dec_client, reads ciphertext and key from socket, decrypts ciphertext,
- * and writes plaintext to stdout.
+ * Handler for SIGUSR1 signal. Asks the server to print its metrics and wakes it.
  * 
- * @param  socket_fd file descriptor for connected socket
+ * @param  signo required but not used
  */
-void handle_connection(int);
+void handle_SIGUSR1(int);
 
 /**
- * Verifies that connection is to dec_client
+ * Setup signal handler for SIGUSR1; set handler to handle_SIGUSR1()
  * 
- * @param  socket_fd file descriptor for connected socket
+ * @return true if successful; false if error is encountered
+ */
+bool catch_SIGUSR1(void);
+
+/**
+ * Prints the server's admission counts, the usage of each client, and its memory budget to stderr
+ */
+void print_metrics(void);
+
+/**
+ * Forks a process to handle a connection that has been given a slot
  * 
- * @return true if connection is to dec_client, else false
+ * @param  socket_fd file descriptor for connected socket
+ * @param  listen_socket_fd file descriptor for listening socket, closed in the new process
  */
-bool perform_handshake(int);
+void start_connection(int, int);
 
 /**
- * Decrypts ciphertext using key via one-time-pad, storing plaintext in args
+ * Handles a single connection. Reads the client's identifier and hands the
+ * connection to handle_dec_connection().
  * 
- * @param  args object holding ciphertext, key, and plaintext
+ * @param  socket_fd file descriptor for connected socket
  */
-void decrypt(struct Args);
+void handle_connection(int);
 
 #endif
\ No newline at end of file
@@ -19,33 +19,31 @@ struct Config
     char *plaintext_filename;
     char *key_filename;
     int port;
-};
-
-// Object to store plaintext, key and ciphertext
-struct Args 
-{
-    char *plaintext;
-    char *key;
-    char *ciphertext;
+    bool resume;
+    int format;
+    const struct Alphabet *alphabet;
+    bool compress;
+    bool authenticate;
+    long long deadline_ms;
+    char *trace_filename;
 };
 
 /**
  * Verifies that established connection is to enc_server.
  * Identifies self as enc_client and waits for enc_server to identify itself.
  * If connected server is enc_server, function returns true, otherwise false.
+ * Asks for packed or binary payloads if requested; the server accepts by echoing
+ * the request. If the server does not accept packed payloads, text payloads are used.
+ * If the server replies that it is busy instead, retry_after_ms is set to the
+ * time it asked the client to wait; otherwise it is set to 0.
  * 
  * @param  socket_fd file descriptor for connected socket
+ * @param  format value holding the payload format to ask for, one of the
+ *         FORMAT_ values; set to the format the server accepted
+ * @param  retry_after_ms value to hold the time a busy server asked the client to wait, in milliseconds
  * 
  * @return true if connection is to enc_server, else false
  */
-bool perform_handshake(int);
-
-/**
- * Reads ciphertext from enc_server and writes it to stdout
- * 
- * @param  socket_fd file descriptor for connected socket
- * @param  args object to store plaintext, key, and ciphertext
- */
-void get_ciphertext_from_server(int, struct Args);
+bool perform_handshake(int, int *, int *);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,558 @@
+/**
+ * @file enc_handler.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the encryption side of a server: the handshake with enc_client
+ * and the handling of its requests. Both enc_server and otp_server hand
+ * their enc_client connections here, once the client's identifier is read.
+ * 
+ * The buffers of each framed request come from the process's request arena
+ * and are all freed at once when the request is done.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "pad_store.h"
+#include "otp.h"
+#include "alphabet.h"
+#include "packed.h"
+#include "csprng.h"
+#include "ledger.h"
+#include "reuse.h"
+#include "reservoir.h"
+#include "mac.h"
+#include "arena.h"
+#include "timeouts.h"
+#include "fairness.h"
+#include "budget.h"
+#include "admission.h"
+#include "stats.h"
+#include "trace.h"
+#include "enc_handler.h"
+#include "util.h"
+
+bool handle_enc_connection(struct Reader *reader, const char *identifier, int *format)
+{
+    // Declare object to hold ciphertext, key, and plaintext
+    struct Args args;
+    int socket_fd = reader->socket_fd;
+
+    // Verify that connection is to enc_client
+    bool framed;
+    if (!perform_enc_handshake(reader, identifier, &framed, format))
+        return false;
+    finish_handshake(&trace);
+
+    // Clients that speak the framed protocol send a series of chunk requests
+    if (framed)
+        return handle_enc_requests(reader, *format);
+
+    // The original protocol reads the socket directly, so its reads are limited by the socket itself
+    limit_receives(&timeouts, socket_fd);
+
+    // Create buffer for reading from socket
+    char *buffer = (char *) malloc(BUFFER_SIZE);
+    memset(buffer, '\0', BUFFER_SIZE);
+
+    // Create string to store entire message
+    int full_string_size = BUFFER_SIZE;
+    char *full_recd_string = (char *) malloc(full_string_size);
+    memset(full_recd_string, '\0', full_string_size);
+
+    int n_read = 0;                 // Number of characters read into buffer
+    int total_n_read = 0;           // Total number of characters so far in message
+    int stop_idx_1, stop_idx_2;     // Indices of stop characters
+    do
+    {
+        // Read from socket, filling buffer
+        n_read = recv(socket_fd, buffer, BUFFER_SIZE - 1, 0);
+        if (n_read <= 0)
+            break;
+
+        // Keep track of total number of characters read
+        total_n_read += n_read;
+
+        // If the message is larger than full_recd_string, resize full_recd_string
+        if ((float) total_n_read / (float) full_string_size > 1)
+        {            
+            full_string_size *= 2;
+
+            // Hold memory for the larger message, and the old one while it is copied, within the server's budget
+            if (!hold_memory(&budget, BUFFER_SIZE + full_string_size + full_string_size / 2, 0))
+            {
+                n_read = 0;
+                break;
+            }
+            full_recd_string = (char *) realloc(full_recd_string, full_string_size);
+        }
+
+        // Add contents of buffer to full_recd_string
+        strcat(full_recd_string, buffer);
+
+        // Zero out buffer for re-use
+        memset(buffer, '\0', BUFFER_SIZE);
+
+        // Search for stop characters
+        find_stop_indices(full_recd_string, &stop_idx_1, &stop_idx_2);
+
+    } while (stop_idx_1 == -1 || stop_idx_2 == -1); // Iterate until both stop characters are found
+
+    // Give up if the client closed the connection, stalled before sending the whole message,
+    // or sent more than the memory budget can cover
+    if (n_read <= 0)
+    {
+        if (n_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            count_timeout(&timeouts, TIMEOUT_BODY);
+        else if (n_read < 0)
+            fprintf(stderr, "Error: failed to read from socket\n");
+        free(buffer);
+        free(full_recd_string);
+        return false;
+    }
+    
+    // Hold memory for the copies of the message's parts too, or give up on the connection
+    if (!hold_memory(&budget, BUFFER_SIZE + full_string_size + 2LL * stop_idx_1 + stop_idx_2 + 3, 0))
+    {
+        free(buffer);
+        free(full_recd_string);
+        return false;
+    }
+
+    // Extract plaintext from message
+    args.plaintext = (char *) malloc(stop_idx_1 + 1);
+    memset(args.plaintext, '\0', stop_idx_1 + 1);
+    strncpy(args.plaintext, full_recd_string, stop_idx_1);
+
+    // Extract key from message
+    args.key = (char *) malloc(stop_idx_2 - stop_idx_1 + 1);
+    memset(args.key, '\0', stop_idx_2 - stop_idx_1 + 1);
+    strncpy(args.key, &full_recd_string[stop_idx_1 + 1], stop_idx_2 - stop_idx_1 - 1);
+
+    // Free allocated memory
+    free(buffer);
+    free(full_recd_string);
+    charge_client(&clients, client_slot, strlen(args.plaintext));
+
+    // Create ciphertext
+    args.ciphertext = (char *) malloc(strlen(args.plaintext) + 1);
+    memset(args.ciphertext, '\0', strlen(args.plaintext) + 1);
+
+    // Encrypt and send ciphertext unless the key is rejected as reused;
+    // the original protocol has no way to report an error, so the connection is just closed
+    if (is_key_unused(args, 0, strlen(args.plaintext), NULL, FORMAT_TEXT))
+    {
+        encrypt(args);
+        send_string(args.ciphertext, socket_fd);
+    }
+
+    // Free memory allocated for args
+    free(args.plaintext);
+    free(args.key);
+    free(args.ciphertext);
+    return false;
+}
+
+bool perform_enc_handshake(struct Reader *reader, const char *identifier, bool *framed, int *format)
+{
+    // enc_client identifiers (expected values)
+    const char *enc_client_signal = "enc_client";
+    const char *enc_client_framed_signal = "enc_client " PROTOCOL_VERSION;
+    const char *enc_client_packed_signal = "enc_client " PROTOCOL_VERSION " " PACKED_CAPABILITY;
+    const char *enc_client_binary_signal = "enc_client " PROTOCOL_VERSION " " BINARY_CAPABILITY;
+
+    // Verify that the client identified itself as enc_client, and note the payload format it asked for
+    bool success = true;
+    *framed = true;
+    *format = FORMAT_TEXT;
+    if (identifier != NULL && strcmp(identifier, enc_client_packed_signal) == 0)
+        *format = FORMAT_PACKED;
+    else if (identifier != NULL && strcmp(identifier, enc_client_binary_signal) == 0)
+        *format = FORMAT_BINARY;
+    else if (identifier == NULL || strcmp(identifier, enc_client_framed_signal) != 0)
+    {
+        *framed = false;
+        success = identifier != NULL && strcmp(identifier, enc_client_signal) == 0;
+    }
+
+    // Identify self as enc_server to client, echoing the protocol version and accepting the payload format
+    if (*format == FORMAT_PACKED)
+        send_string("enc_server " PROTOCOL_VERSION " " PACKED_CAPABILITY, reader->socket_fd);
+    else if (*format == FORMAT_BINARY)
+        send_string("enc_server " PROTOCOL_VERSION " " BINARY_CAPABILITY, reader->socket_fd);
+    else
+        send_string(*framed ? "enc_server " PROTOCOL_VERSION : "enc_server", reader->socket_fd);
+
+    return success;
+}
+
+bool handle_enc_requests(struct Reader *reader, int format)
+{
+    struct Header request;      // Header of the current request
+    struct Header response;     // Header of the current response
+    struct Args args;           // Plaintext, key, and ciphertext of the current request
+
+    // Serve requests until the client closes the connection, or until the server asks for the connection back
+    long long n_served = 0;     // symbols requested since this process took the connection
+    while (true)
+    {
+        finish_request(&stats);
+        finish_traced_request(&trace);
+        pace_client(&clients, client_slot);
+        release_memory(&budget);
+        if (should_yield != NULL && should_yield(reader, n_served))
+            return true;
+        if (!read_request_header(&timeouts, reader, &request))
+            return false;
+        start_request(&stats, &request);
+        start_traced_request(&trace, PHASE_RECEIVE, request.offset, request.length);
+        describe_traced_request(&trace, "enc", &request, format, reader->socket_fd);
+        n_served += request.length;
+        charge_client(&clients, client_slot, request.length);
+        long long deadline_ns = request_deadline(&request);
+        init_header(&response);
+        response.offset = request.offset;
+
+        // Requests turned away are read to their end first, so the client is not reset mid-send and reads why
+        long long payload_size = enc_payload_size(&request, format);
+
+        // Reject chunks larger than the server will buffer
+        if (request.length > MAX_CHUNK_SIZE)
+        {
+            reject_request(reader, &response, STATUS_BAD_REQUEST, payload_size);
+            return false;
+        }
+
+        // Look up the alphabet of the chunk's symbols. Pads, generated keys, and packed and binary payloads
+        // hold A-Z and space only, so other alphabets can only be used with keys from the payload.
+        const struct Alphabet *alphabet = find_alphabet(request.alphabet);
+        if (alphabet == NULL || (alphabet != DEFAULT_ALPHABET &&
+                                 (format != FORMAT_TEXT || request.pad_id[0] != '\0' || request.operation[0] != '\0')))
+        {
+            reject_request(reader, &response, alphabet == NULL ? STATUS_NO_ALPHABET : STATUS_BAD_REQUEST, payload_size);
+            return false;
+        }
+
+        // Only text chunks encrypted with a given key are authenticated
+        if (request.authenticate && (format != FORMAT_TEXT || request.operation[0] != '\0'))
+        {
+            reject_request(reader, &response, STATUS_BAD_REQUEST, payload_size);
+            return false;
+        }
+
+        // Reserve a range of a pad for the client's input
+        if (strcmp(request.operation, OP_RESERVE) == 0)
+        {
+            if (!handle_reservation(&request, reader->socket_fd))
+                return false;
+            continue;
+        }
+
+        // Generate a key for the chunk and encrypt with it
+        if (strcmp(request.operation, OP_GENERATE) == 0)
+        {
+            if (!handle_generation(&request, reader, format, deadline_ns))
+                return false;
+            continue;
+        }
+
+        // Reject other operations
+        if (request.operation[0] != '\0')
+        {
+            reject_request(reader, &response, STATUS_BAD_REQUEST, payload_size);
+            return false;
+        }
+
+        // An authenticated chunk's MAC key follows its key
+        long long key_length = request.length + (request.authenticate ? MAC_KEY_SYMBOLS : 0);
+
+        // If the request names a server-resident pad, verify that it holds the chunk's key
+        // and, if pad ranges are reserved, that the key lies within the range the client reserved
+        const struct Pad *pad = NULL;
+        if (request.pad_id[0] != '\0')
+        {
+            const char *status = NULL;
+            pad = find_pad(&pad_store, request.pad_id);
+            if (pad == NULL)
+                status = STATUS_NO_PAD;
+            else if (format == FORMAT_BINARY)
+                status = STATUS_BAD_REQUEST;
+            else if (request.key_offset > pad->length - key_length)
+                status = STATUS_OUT_OF_RANGE;
+            else if (use_ledger && !holds_pad_range(&ledger, pad, request.token, request.key_offset, key_length))
+                status = STATUS_UNRESERVED;
+
+            if (status != NULL)
+            {
+                reject_request(reader, &response, status, payload_size);
+                return false;
+            }
+        }
+
+        // Hold memory for the chunk's buffers within the server's budget, or turn the chunk away for now;
+        // packed payloads take fewer bytes than symbols
+        long long size = format == FORMAT_PACKED ? packed_size(request.length) : request.length;
+        long long key_size = size + key_length - request.length;
+        bool key_in_place = pad != NULL && format != FORMAT_PACKED;
+        if (!hold_memory(&budget, 2 * (size + 1) + (key_in_place ? 0 : key_size + 1), deadline_ns))
+        {
+            if (!refuse_request(reader, &response, size + (pad == NULL ? key_size : 0)))
+                return false;
+            continue;
+        }
+
+        // Allocate plaintext and ciphertext for the chunk from the arena
+        args.plaintext = arena_alloc(&request_arena, size + 1);
+        args.ciphertext = arena_alloc(&request_arena, size + 1);
+        args.plaintext[size] = '\0';
+        args.ciphertext[size] = '\0';
+
+        // Read plaintext from the payload
+        bool success = read_bytes(reader, args.plaintext, size);
+
+        // Use the key in place if it is server-resident, packing it first if payloads are packed;
+        // otherwise read it from the payload, along with the MAC key of an authenticated chunk
+        if (key_in_place)
+            args.key = (char *) pad->symbols + request.key_offset;
+        else
+        {
+            args.key = arena_alloc(&request_arena, key_size + 1);
+            args.key[key_size] = '\0';
+            if (pad != NULL)
+                pack_symbols(pad->symbols + request.key_offset, request.length, args.key);
+            else
+                success = success && read_bytes(reader, args.key, key_size);
+        }
+        if (!success)
+            report_timeout(&timeouts, reader, TIMEOUT_BODY, request.offset);
+        mark_phase(&trace, PHASE_TRANSFORM);
+
+        // Abandon the chunk if the client stopped waiting while its payload arrived
+        if (success && abandon_expired(&timeouts, reader->socket_fd, &request, deadline_ns))
+        {
+            reset_arena(&request_arena);
+            continue;
+        }
+
+        // Reject chunks containing invalid characters
+        bool valid = format == FORMAT_BINARY ||
+                     (format == FORMAT_PACKED ? validate_packed(args.plaintext, request.length) :
+                      find_invalid_symbol(alphabet, args.plaintext, request.length) == NULL);
+        if (success && !valid)
+        {
+            strcpy(response.status, STATUS_BAD_REQUEST);
+            send_header(&response, reader->socket_fd);
+            success = false;
+        }
+
+        // Reject chunks whose key was already used, if the server rejects reuse.
+        // The position of a shipped key within its file is the chunk's offset.
+        long long key_offset = pad != NULL ? request.key_offset : request.offset;
+        if (success && !is_key_unused(args, key_offset, request.length, pad, format))
+        {
+            strcpy(response.status, STATUS_KEY_REUSED);
+            send_header(&response, reader->socket_fd);
+            success = false;
+        }
+
+        // Use the chunk's range of its reservation, refusing a range that was already used
+        if (success && pad != NULL && use_ledger &&
+            !use_pad_range(&ledger, pad, request.token, request.key_offset, key_length, args.plaintext, size))
+        {
+            strcpy(response.status, STATUS_KEY_REUSED);
+            send_header(&response, reader->socket_fd);
+            success = false;
+        }
+
+        // Encrypt the chunk and send the ciphertext back
+        if (success)
+        {
+            if (format == FORMAT_BINARY)
+                encrypt_binary(args, request.length);
+            else if (format == FORMAT_PACKED)
+                encrypt_packed(args, request.length);
+            else if (request.authenticate)
+            {
+                unsigned char mac_key[MAC_KEY_SIZE];
+                unsigned char tag[MAC_TAG_SIZE];
+                derive_mac_key(alphabet, args.key + request.length, mac_key);
+                encrypt_authenticated(alphabet, args, request.length, mac_key, tag);
+                format_tag(tag, response.tag);
+                memset(mac_key, 0, sizeof(mac_key));
+            }
+            else
+                alphabet->encrypt(args, request.length);
+            strcpy(response.status, STATUS_OK);
+            response.length = request.length;
+            success = send_header(&response, reader->socket_fd) &&
+                      send_bytes(args.ciphertext, size, reader->socket_fd);
+        }
+
+        // Free every buffer of the chunk at once
+        reset_arena(&request_arena);
+
+        if (!success)
+            return false;
+    }
+}
+
+long long enc_payload_size(const struct Header *request, int format)
+{
+    if (strcmp(request->operation, OP_RESERVE) == 0)
+        return 0;
+    long long size = format == FORMAT_PACKED ? packed_size(request->length) : request->length;
+    if (request->operation[0] != '\0' || request->pad_id[0] != '\0')
+        return size;
+    return 2 * size + (request->authenticate ? MAC_KEY_SYMBOLS : 0);
+}
+
+bool handle_reservation(struct Header *request, int socket_fd)
+{
+    struct Header response;
+    init_header(&response);
+
+    // Reserve the range, recording the outcome in the response status
+    const struct Pad *pad = find_pad(&pad_store, request->pad_id);
+    long long key_offset = -1, token = 0;
+    if (!use_ledger)
+        strcpy(response.status, STATUS_NO_LEDGER);
+    else if (pad == NULL)
+        strcpy(response.status, STATUS_NO_PAD);
+    else if ((key_offset = reserve_pad_range(&ledger, pad, request->length, &token)) < 0)
+        strcpy(response.status, STATUS_EXHAUSTED);
+    else
+    {
+        strcpy(response.status, STATUS_OK);
+        strcpy(response.pad_id, pad->id);
+        response.key_offset = key_offset;
+        response.token = token;
+        response.length = request->length;
+    }
+
+    // Send the reserved offset to the client
+    return send_header(&response, socket_fd) && strcmp(response.status, STATUS_OK) == 0;
+}
+
+bool handle_generation(struct Header *request, struct Reader *reader, int format, long long deadline_ns)
+{
+    bool packed = format == FORMAT_PACKED;
+    struct Header response;
+    init_header(&response);
+    response.offset = request->offset;
+
+    // Reject generation if the server has no reservoir, if the request also names a pad,
+    // or if payloads are binary, since the reservoir holds symbols
+    long long length = request->length;
+    long long size = packed ? packed_size(length) : length;
+    if (!use_reservoir || request->pad_id[0] != '\0' || format == FORMAT_BINARY)
+    {
+        reject_request(reader, &response, use_reservoir ? STATUS_BAD_REQUEST : STATUS_NO_GENERATOR, size);
+        return false;
+    }
+
+    // Hold memory for the chunk's buffers within the server's budget, or turn the chunk away for now.
+    // Then allocate plaintext, and key and ciphertext together so they can be sent at once;
+    // packed payloads take fewer bytes than symbols.
+    struct Args args;
+    if (!hold_memory(&budget, 3 * size + 2 + (packed ? length : 0), deadline_ns))
+        return refuse_request(reader, &response, size);
+    args.plaintext = arena_alloc(&request_arena, size + 1);
+    char *payload = arena_alloc(&request_arena, 2 * size + 1);
+    args.key = payload;
+    args.ciphertext = payload + size;
+    args.plaintext[size] = '\0';
+    payload[2 * size] = '\0';
+
+    // Read plaintext from the payload and reject it if it contains invalid characters
+    bool success = read_bytes(reader, args.plaintext, size);
+    if (!success)
+        report_timeout(&timeouts, reader, TIMEOUT_BODY, request->offset);
+    mark_phase(&trace, PHASE_TRANSFORM);
+    bool valid = packed ? validate_packed(args.plaintext, length) :
+                 find_invalid_symbol(DEFAULT_ALPHABET, args.plaintext, length) == NULL;
+    if (success && !valid)
+    {
+        strcpy(response.status, STATUS_BAD_REQUEST);
+        send_header(&response, reader->socket_fd);
+        success = false;
+    }
+
+    // Abandon the chunk if the client stopped waiting while its payload arrived, before spending any key on it
+    if (success && abandon_expired(&timeouts, reader->socket_fd, request, deadline_ns))
+    {
+        reset_arena(&request_arena);
+        return true;
+    }
+
+    // Draw fresh key and encrypt with it; fresh key has never been used, so it is not checked for reuse.
+    // A packed key is drawn as symbols into a scratch buffer, then packed into place.
+    char *key_symbols = packed ? arena_alloc(&request_arena, length) : args.key;
+    if (success && draw_key_symbols(&reservoir, key_symbols, length))
+    {
+        if (packed)
+        {
+            pack_symbols(key_symbols, length, args.key);
+            encrypt_packed(args, length);
+        }
+        else
+            encrypt(args);
+    }
+    else if (success)
+    {
+        fprintf(stderr, "Error: failed to generate key\n");
+        success = false;
+    }
+
+    // Send the key followed by the ciphertext
+    if (success)
+    {
+        strcpy(response.status, STATUS_OK);
+        response.length = length;
+        success = send_header(&response, reader->socket_fd) &&
+                  send_bytes(payload, 2 * size, reader->socket_fd);
+    }
+
+    // Free allocated memory, erasing the key first
+    memset(payload, 0, size);
+    if (packed)
+        memset(key_symbols, 0, length);
+    reset_arena(&request_arena);
+    return success;
+}
+
+bool is_key_unused(struct Args args, long long key_offset, long long length, const struct Pad *pad, int format)
+{
+    bool packed = format == FORMAT_PACKED;
+    if (!detect_reuse)
+        return true;
+
+    // The detector fingerprints symbols, so unpack packed plaintext and key first
+    struct Args unpacked = args;
+    if (packed)
+    {
+        unpacked.plaintext = arena_alloc(&request_arena, length);
+        unpacked.key = arena_alloc(&request_arena, length);
+        unpack_symbols(args.plaintext, length, unpacked.plaintext);
+        unpack_symbols(args.key, length, unpacked.key);
+    }
+
+    // Report reuse only once enough blocks match to rule out a false positive
+    int n_suspicious = check_key_reuse(&reuse_detector, unpacked.plaintext, unpacked.key, key_offset, length);
+    if (n_suspicious == 0)
+        return true;
+
+    fprintf(stderr, "Warning: suspected key reuse: %d blocks of %s at offset %lld\n",
+            n_suspicious, pad != NULL ? pad->id : "shipped key", key_offset);
+    return !reject_reuse;
+}
\ No newline at end of file
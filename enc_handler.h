@@ -0,0 +1,161 @@
+/**
+ * @file enc_handler.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for enc_handler.c
+ */
+
+#ifndef ENC_HANDLER
+#define ENC_HANDLER
+
+// Pads available to requests that name a server-resident key
+extern struct PadStore pad_store;
+
+// Ledger of reserved pad ranges, used if the server was started with a journal
+extern struct Ledger ledger;
+extern bool use_ledger;
+
+// Detector of reused key, used if the server was started with a reuse policy
+extern struct ReuseDetector reuse_detector;
+extern bool detect_reuse;
+extern bool reject_reuse;
+
+// Reservoir of generated key, used if the server was started with -g
+extern struct Reservoir reservoir;
+extern bool use_reservoir;
+
+// Arena the buffers of each request are allocated from
+extern struct Arena request_arena;
+
+// Deadlines connections are held to
+extern struct Timeouts timeouts;
+
+// Memory budget the buffers of every request are held within
+extern struct MemoryBudget budget;
+
+// Clients the server is shared between, and the slot of the client of the connection being served
+extern struct Clients clients;
+extern int client_slot;
+
+// Statistics the process publishes for otp_stat
+extern struct Stats stats;
+
+// Tracing of the phases of the process's requests
+extern struct Trace trace;
+
+// Asked before each request whether to hand the connection back to the server,
+// given the reader and the symbols served since this process took the connection; NULL never to
+extern bool (*should_yield)(const struct Reader *, long long);
+
+/**
+ * Handles a connection from enc_client once its identifier has been read.
+ * Performs the handshake, then serves framed requests or reads plaintext and
+ * key from socket, encrypts plaintext, and writes ciphertext to socket.
+ * 
+ * @param  reader buffered reader for connected socket
+ * @param  identifier identifier the client sent; NULL if it sent none
+ * @param  format value to hold the payload format the client asked for, one of the FORMAT_ values
+ * 
+ * @return true if the connection was stopped between framed requests to
+ *         hand it back to the server, as handle_enc_requests() does; false if it is done
+ */
+bool handle_enc_connection(struct Reader *, const char *, int *);
+
+/**
+ * Verifies that connection is to enc_client and determines whether the
+ * client speaks the framed protocol and which payload format it asked for
+ * 
+ * @param  reader buffered reader for connected socket
+ * @param  identifier identifier the client sent; NULL if it sent none
+ * @param  framed value to hold whether the client sends framed requests
+ * @param  format value to hold the payload format, one of the FORMAT_ values
+ * 
+ * @return true if connection is to enc_client, else false
+ */
+bool perform_enc_handshake(struct Reader *, const char *, bool *, int *);
+
+/**
+ * Serves framed requests until the client closes the connection.
+ * Each request carries the offset and length of one chunk of plaintext
+ * followed by the chunk and its key. If the request names a pad,
+ * the key is read from the pad store instead of the payload. The response echoes the offset
+ * so the client can confirm which chunk the ciphertext belongs to.
+ * 
+ * If the client asked for packed payloads, every payload holds packed symbols
+ * and is transformed without unpacking. If it asked for binary payloads,
+ * every payload holds arbitrary bytes and its key must be shipped with it.
+ * 
+ * Before each request, should_yield() is asked whether to stop and hand the
+ * connection back to the server, which may pass it to any worker to continue.
+ * Each request is charged to the connection's client, which waits before its
+ * next request while it is ahead of its rate. A chunk whose buffers the
+ * memory budget cannot cover is answered as overloaded, and the connection
+ * carries on.
+ * 
+ * @param  reader buffered reader for connected socket
+ * @param  format payload format, one of the FORMAT_ values
+ * 
+ * @return true if serving stopped between requests to hand the connection
+ *         back; false if the client closed the connection or an error ended it
+ */
+bool handle_enc_requests(struct Reader *, int);
+
+/**
+ * Works out the size of a request's payload from its header: none for a
+ * reservation, the plaintext alone for generated keys and pads, and the
+ * plaintext followed by its key, and MAC key if authenticated, otherwise
+ * 
+ * @param  request header of the request
+ * @param  format payload format, one of the FORMAT_ values
+ * 
+ * @return number of bytes the client sends after the header
+ */
+long long enc_payload_size(const struct Header *, int);
+
+/**
+ * Reserves a range of a server-resident pad as long as the request's length
+ * and sends the range's offset and token back to the client
+ * 
+ * @param  request header of the reservation request
+ * @param  socket_fd file descriptor for connected socket
+ * 
+ * @return true if the range was reserved and sent, else false
+ */
+bool handle_reservation(struct Header *, int);
+
+/**
+ * Reads a chunk of plaintext, draws a fresh key for it from the reservoir,
+ * and sends back the key followed by the ciphertext, each as long as the chunk.
+ * If the request's deadline passes before the key is drawn, no key is drawn
+ * and the request is answered as expired. If the memory budget cannot cover
+ * the chunk, it is answered as overloaded.
+ * 
+ * @param  request header of the generation request
+ * @param  reader buffered reader for connected socket
+ * @param  format payload format, one of the FORMAT_ values
+ * @param  deadline_ns deadline of the request, as from request_deadline(); 0 for none
+ * 
+ * @return true if the key and ciphertext were sent or the request was abandoned or turned away, else false
+ */
+bool handle_generation(struct Header *, struct Reader *, int, long long);
+
+/**
+ * Checks the key of a chunk for reuse if the server was started with a
+ * reuse policy, printing a warning if reuse is suspected
+ * 
+ * @param  args object holding the chunk's plaintext and key
+ * @param  key_offset position of the key within the key file or pad
+ * @param  length number of symbols in the chunk
+ * @param  pad pad holding the key; NULL if the key was shipped
+ * @param  format format of the plaintext and key, one of the FORMAT_ values
+ * 
+ * @return false if reuse is suspected and the server rejects reuse, else true
+ */
+bool is_key_unused(struct Args, long long, long long, const struct Pad *, int);
+
+#endif
\ No newline at end of file
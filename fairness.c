@@ -0,0 +1,396 @@
+/**
+ * @file fairness.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the fair sharing of a server between its clients, so that one
+ * client opening connection after connection cannot starve the rest. A
+ * client is the user a local peer runs as, or the address of a remote one.
+ * 
+ * Connections waiting for a slot are queued per client, and the queues take
+ * turns by deficit round-robin. A connection's size is not known when it is
+ * admitted, so each client is charged for the symbols its requests ask for as
+ * they are read, and its credit is settled the next time a connection is
+ * chosen. A client that has been served more than its share waits out more
+ * rounds before its next connection is chosen.
+ * 
+ * A client may also be held to a rate, as a token bucket kept in the
+ * generic cell rate algorithm's form: the time by which everything it has
+ * been served is paid for. A connection waits between requests while the
+ * client is more than RATE_BURST_MS ahead of its rate, and its waiting
+ * connections are not chosen until it is within it.
+ * 
+ * The usage of each client lives in memory shared by every process, so the
+ * processes serving connections charge the same counts the server reads.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdbool.h>
+
+#include "fairness.h"
+#include "util.h"
+
+bool init_clients(struct Clients *clients, long long default_rate)
+{
+    memset(clients->clients, 0, sizeof(clients->clients));
+    clients->n_rules = 0;
+    clients->default_rate = default_rate;
+    clients->cursor = 0;
+
+    clients->usage = mmap(NULL, MAX_CLIENTS * sizeof(struct ClientUsage), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (clients->usage == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map client usage\n");
+        return false;
+    }
+    return true;
+}
+
+bool add_client_rule(struct Clients *clients, const char *spec)
+{
+    if (clients->n_rules == MAX_CLIENT_RULES)
+        return false;
+    struct ClientRule *rule = &clients->rules[clients->n_rules];
+
+    // Split the client's name from its weight
+    const char *equals = strchr(spec, '=');
+    if (equals == NULL || equals == spec || equals - spec >= MAX_CLIENT_NAME)
+        return false;
+    memcpy(rule->name, spec, equals - spec);
+    rule->name[equals - spec] = '\0';
+
+    // Read the weight, then the rate if one follows
+    char *end;
+    long weight = strtol(equals + 1, &end, 10);
+    if (end == equals + 1 || weight < 1 || weight > 1000)
+        return false;
+    rule->weight = (int) weight;
+    rule->rate = -1;
+    if (*end == ',')
+    {
+        rule->rate = parse_size(end + 1);
+        if (rule->rate < 0)
+            return false;
+    }
+    else if (*end != '\0')
+        return false;
+
+    clients->n_rules++;
+    return true;
+}
+
+/**
+ * Finds the user that owns the other end of a loopback TCP connection, by
+ * looking for the socket in /proc/net/tcp whose local address is the peer's
+ * 
+ * @param  peer address of the peer
+ * @param  self local address of the connection
+ * @param  uid value to hold the user ID
+ * 
+ * @return true if the peer's socket was found, else false
+ */
+static bool find_loopback_owner(const struct sockaddr_in *peer, const struct sockaddr_in *self, unsigned int *uid)
+{
+    FILE *table = fopen("/proc/net/tcp", "r");
+    if (table == NULL)
+        return false;
+
+    // Addresses appear as the raw 32-bit value in hexadecimal, ports in host order
+    char local[16], remote[16];
+    snprintf(local, sizeof(local), "%08X:%04X", peer->sin_addr.s_addr, ntohs(peer->sin_port));
+    snprintf(remote, sizeof(remote), "%08X:%04X", self->sin_addr.s_addr, ntohs(self->sin_port));
+
+    // Skip the column headings, then compare each socket's addresses
+    char line[256];
+    bool found = false;
+    if (fgets(line, sizeof(line), table) != NULL)
+    {
+        while (!found && fgets(line, sizeof(line), table) != NULL)
+        {
+            char line_local[16], line_remote[16];
+            if (sscanf(line, " %*d: %15s %15s %*x %*s %*s %*s %u", line_local, line_remote, uid) == 3 &&
+                strcmp(line_local, local) == 0 && strcmp(line_remote, remote) == 0)
+                found = true;
+        }
+    }
+    fclose(table);
+    return found;
+}
+
+/**
+ * Names the client at the other end of a connection
+ * 
+ * @param  socket_fd file descriptor for connected socket
+ * @param  name buffer of MAX_CLIENT_NAME characters to hold the name
+ */
+static void name_client(int socket_fd, char *name)
+{
+    // Local sockets carry the credentials of the peer process
+    struct sockaddr_storage peer;
+    socklen_t peer_length = sizeof(peer);
+    if (getpeername(socket_fd, (struct sockaddr *) &peer, &peer_length) < 0)
+    {
+        strcpy(name, "unknown");
+        return;
+    }
+    if (peer.ss_family == AF_UNIX)
+    {
+        struct ucred credentials;
+        socklen_t length = sizeof(credentials);
+        if (getsockopt(socket_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0)
+            snprintf(name, MAX_CLIENT_NAME, "uid:%u", credentials.uid);
+        else
+            strcpy(name, "local");
+        return;
+    }
+    if (peer.ss_family != AF_INET)
+    {
+        strcpy(name, "unknown");
+        return;
+    }
+
+    // A TCP peer on this host is named by its user too, found through the kernel's socket table
+    struct sockaddr_in *peer_in = (struct sockaddr_in *) &peer;
+    struct sockaddr_in self;
+    socklen_t self_length = sizeof(self);
+    unsigned int uid;
+    if ((ntohl(peer_in->sin_addr.s_addr) >> 24) == 127 &&
+        getsockname(socket_fd, (struct sockaddr *) &self, &self_length) == 0 &&
+        find_loopback_owner(peer_in, &self, &uid))
+    {
+        snprintf(name, MAX_CLIENT_NAME, "uid:%u", uid);
+        return;
+    }
+
+    // Any other peer is named by its address
+    inet_ntop(AF_INET, &peer_in->sin_addr, name, MAX_CLIENT_NAME);
+}
+
+int identify_client(struct Clients *clients, int socket_fd)
+{
+    char name[MAX_CLIENT_NAME];
+    name_client(socket_fd, name);
+    long long now_ns = monotonic_ns();
+
+    // Find the client if it is tracked, else a free slot, else the slot of the idle client seen longest ago
+    int free_slot = -1;
+    int idle_slot = -1;
+    int oldest_slot = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        struct Client *client = &clients->clients[i];
+        if (!client->in_use)
+        {
+            if (free_slot < 0)
+                free_slot = i;
+            continue;
+        }
+        if (strcmp(client->name, name) == 0)
+        {
+            client->last_seen_ns = now_ns;
+            return i;
+        }
+        if (client->n_queued == 0 && (idle_slot < 0 || client->last_seen_ns < clients->clients[idle_slot].last_seen_ns))
+            idle_slot = i;
+        if (client->last_seen_ns < clients->clients[oldest_slot].last_seen_ns)
+            oldest_slot = i;
+    }
+    int slot = free_slot >= 0 ? free_slot : idle_slot;
+
+    // Every tracked client has connections waiting; share the slot of the one seen longest ago
+    if (slot < 0)
+    {
+        clients->clients[oldest_slot].last_seen_ns = now_ns;
+        return oldest_slot;
+    }
+
+    // Track the client in the slot, with the weight and rate of its rule if it has one
+    struct Client *client = &clients->clients[slot];
+    client->in_use = true;
+    strcpy(client->name, name);
+    client->weight = 1;
+    client->deficit = 0;
+    client->n_settled = 0;
+    client->last_seen_ns = now_ns;
+    client->head = -1;
+    client->tail = -1;
+    client->n_queued = 0;
+    long long rate = clients->default_rate;
+    for (int i = 0; i < clients->n_rules; i++)
+    {
+        if (strcmp(clients->rules[i].name, name) == 0)
+        {
+            client->weight = clients->rules[i].weight;
+            if (clients->rules[i].rate >= 0)
+                rate = clients->rules[i].rate;
+        }
+    }
+    memset(&clients->usage[slot], 0, sizeof(struct ClientUsage));
+    __atomic_store_n(&clients->usage[slot].rate, rate, __ATOMIC_RELAXED);
+    return slot;
+}
+
+bool client_may_run(const struct Clients *clients, int client, long long now_ns)
+{
+    struct ClientUsage *usage = &clients->usage[client];
+    if (__atomic_load_n(&usage->rate, __ATOMIC_RELAXED) == 0)
+        return true;
+    return __atomic_load_n(&usage->next_free_ns, __ATOMIC_RELAXED) - now_ns <= RATE_BURST_MS * 1000000LL;
+}
+
+int choose_client(struct Clients *clients, long long now_ns)
+{
+    // Take the symbols each client has been served since the last choice from its deficit.
+    // A client with nothing waiting keeps any debt but loses unused credit, as in deficit round-robin.
+    int n_ready = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        struct Client *client = &clients->clients[i];
+        if (!client->in_use)
+            continue;
+        unsigned long long n_symbols = __atomic_load_n(&clients->usage[i].n_symbols, __ATOMIC_RELAXED);
+        client->deficit -= (long long) (n_symbols - client->n_settled);
+        client->n_settled = n_symbols;
+        if (client->n_queued == 0 && client->deficit > 0)
+            client->deficit = 0;
+        if (client->n_queued > 0 && client_may_run(clients, i, now_ns))
+            n_ready++;
+    }
+    if (n_ready == 0)
+        return -1;
+
+    // If no ready client has credit left, run as many rounds as it takes for one to have some
+    long long n_rounds = -1;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        struct Client *client = &clients->clients[i];
+        if (client->in_use && client->n_queued > 0 && client_may_run(clients, i, now_ns))
+        {
+            long long quantum = FAIR_QUANTUM * client->weight;
+            long long needed = client->deficit > 0 ? 0 : (quantum - client->deficit) / quantum;
+            if (n_rounds < 0 || needed < n_rounds)
+                n_rounds = needed;
+        }
+    }
+    if (n_rounds > 0)
+    {
+        for (int i = 0; i < MAX_CLIENTS; i++)
+        {
+            struct Client *client = &clients->clients[i];
+            if (client->in_use && client->n_queued > 0 && client_may_run(clients, i, now_ns))
+                client->deficit += n_rounds * FAIR_QUANTUM * client->weight;
+        }
+    }
+
+    // Take the next ready client with credit, starting after the one chosen last
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        int slot = (clients->cursor + i) % MAX_CLIENTS;
+        struct Client *client = &clients->clients[slot];
+        if (client->in_use && client->n_queued > 0 && client->deficit > 0 && client_may_run(clients, slot, now_ns))
+        {
+            clients->cursor = (slot + 1) % MAX_CLIENTS;
+            return slot;
+        }
+    }
+    return -1;
+}
+
+long long next_client_ready_ns(const struct Clients *clients)
+{
+    long long ready_ns = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        const struct Client *client = &clients->clients[i];
+        if (!client->in_use || client->n_queued == 0 ||
+            __atomic_load_n(&clients->usage[i].rate, __ATOMIC_RELAXED) == 0)
+            continue;
+        long long client_ready_ns = __atomic_load_n(&clients->usage[i].next_free_ns, __ATOMIC_RELAXED) -
+                                    RATE_BURST_MS * 1000000LL;
+        if (ready_ns == 0 || client_ready_ns < ready_ns)
+            ready_ns = client_ready_ns;
+    }
+    return ready_ns;
+}
+
+void record_client_start(struct Clients *clients, int client, long long delay_ns)
+{
+    struct ClientUsage *usage = &clients->usage[client];
+    __atomic_add_fetch(&usage->n_connections, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&usage->queue_delay_ns, delay_ns, __ATOMIC_RELAXED);
+    unsigned long long longest = __atomic_load_n(&usage->max_queue_delay_ns, __ATOMIC_RELAXED);
+    while ((unsigned long long) delay_ns > longest &&
+           !__atomic_compare_exchange_n(&usage->max_queue_delay_ns, &longest, delay_ns, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        continue;
+}
+
+void charge_client(struct Clients *clients, int client, long long n_symbols)
+{
+    if (client < 0)
+        return;
+    struct ClientUsage *usage = &clients->usage[client];
+    __atomic_add_fetch(&usage->n_symbols, n_symbols, __ATOMIC_RELAXED);
+
+    // Push back the time the client's symbols are paid for, starting now if it has fallen behind its rate
+    long long rate = __atomic_load_n(&usage->rate, __ATOMIC_RELAXED);
+    if (rate == 0)
+        return;
+    long long cost_ns = n_symbols / rate * 1000000000LL + n_symbols % rate * 1000000000LL / rate;
+    long long now_ns = monotonic_ns();
+    long long paid_ns = __atomic_load_n(&usage->next_free_ns, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&usage->next_free_ns, &paid_ns, (paid_ns > now_ns ? paid_ns : now_ns) + cost_ns,
+                                        false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        continue;
+}
+
+void pace_client(struct Clients *clients, int client)
+{
+    if (client < 0)
+        return;
+    struct ClientUsage *usage = &clients->usage[client];
+    if (__atomic_load_n(&usage->rate, __ATOMIC_RELAXED) == 0)
+        return;
+
+    // Wait until the client is no more than its burst ahead of its rate
+    long long wait_ns = __atomic_load_n(&usage->next_free_ns, __ATOMIC_RELAXED) - RATE_BURST_MS * 1000000LL - monotonic_ns();
+    if (wait_ns <= 0)
+        return;
+    struct timespec wait = { wait_ns / 1000000000LL, wait_ns % 1000000000LL };
+    nanosleep(&wait, NULL);
+    __atomic_add_fetch(&usage->throttled_ns, wait_ns, __ATOMIC_RELAXED);
+}
+
+void print_clients(const struct Clients *clients, const char *name)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        const struct Client *client = &clients->clients[i];
+        if (!client->in_use)
+            continue;
+        const struct ClientUsage *usage = &clients->usage[i];
+        unsigned long long n_connections = __atomic_load_n(&usage->n_connections, __ATOMIC_RELAXED);
+        unsigned long long queue_delay_ns = __atomic_load_n(&usage->queue_delay_ns, __ATOMIC_RELAXED);
+        fprintf(stderr, "%s: client %s, weight %d, %lld symbols/s allowed (0 for no limit): %llu symbols over %llu connections, "
+                        "%.1f ms mean and %.1f ms longest wait in the queue, %.1f ms held to its rate; %d waiting\n",
+                name, client->name, client->weight, __atomic_load_n(&usage->rate, __ATOMIC_RELAXED),
+                __atomic_load_n(&usage->n_symbols, __ATOMIC_RELAXED), n_connections,
+                n_connections > 0 ? queue_delay_ns / 1e6 / n_connections : 0.0,
+                __atomic_load_n(&usage->max_queue_delay_ns, __ATOMIC_RELAXED) / 1e6,
+                __atomic_load_n(&usage->throttled_ns, __ATOMIC_RELAXED) / 1e6, client->n_queued);
+    }
+}
\ No newline at end of file
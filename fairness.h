@@ -0,0 +1,178 @@
+/**
+ * @file fairness.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for fairness.c
+ */
+
+#ifndef FAIRNESS
+#define FAIRNESS
+
+// Largest number of clients tracked at once, and of weight and rate rules
+#define MAX_CLIENTS 256
+#define MAX_CLIENT_RULES 32
+
+// Largest client name, including the terminating NULL character, e.g. uid:1000 or 10.0.0.5
+#define MAX_CLIENT_NAME 24
+
+// Symbols of credit a client of weight 1 gains each round of deficit round-robin
+#define FAIR_QUANTUM 1048576LL
+
+// Time a rate-limited client may run ahead of its rate, which sets the size of its token bucket
+#define RATE_BURST_MS 1000
+
+// Usage of a client, shared by the server and the processes serving its connections
+struct ClientUsage
+{
+    long long rate;                         // symbols per second the client may be served; 0 for no limit
+    long long next_free_ns;                 // time its served symbols are paid for at its rate, as in GCRA
+    unsigned long long n_symbols;           // symbols requested by its connections
+    unsigned long long n_connections;       // connections served
+    unsigned long long queue_delay_ns;      // total time its connections waited in the queue
+    unsigned long long max_queue_delay_ns;  // longest time one of its connections waited in the queue
+    unsigned long long throttled_ns;        // total time its requests were held back by its rate
+};
+
+// Client as the server tracks it
+struct Client
+{
+    bool in_use;                            // whether the slot holds a client
+    char name[MAX_CLIENT_NAME];             // uid:UID for local clients, else the peer's IPv4 address
+    int weight;                             // share of the server relative to other clients
+    long long deficit;                      // credit, in symbols, for deficit round-robin
+    unsigned long long n_settled;           // symbols already taken from the deficit
+    long long last_seen_ns;                 // time a connection from the client last arrived
+    int head;                               // first queue entry of its waiting connections; -1 if none
+    int tail;                               // last queue entry of its waiting connections
+    int n_queued;                           // number of its connections waiting
+};
+
+// Weight and rate given to a client on the command line
+struct ClientRule
+{
+    char name[MAX_CLIENT_NAME];             // client the rule applies to
+    int weight;                             // weight of the client
+    long long rate;                         // rate of the client; -1 for the default rate
+};
+
+// Object to hold every client of a server
+struct Clients
+{
+    struct Client clients[MAX_CLIENTS];     // tracked clients
+    struct ClientUsage *usage;              // usage of each client, shared by every process
+    struct ClientRule rules[MAX_CLIENT_RULES];  // weights and rates given on the command line
+    int n_rules;                            // number of rules
+    long long default_rate;                 // rate of clients without a rule; 0 for no limit
+    int cursor;                             // next client deficit round-robin considers
+};
+
+/**
+ * Sets up client tracking, with usage shared by every process forked from this one
+ * 
+ * @param  clients object to initialize
+ * @param  default_rate symbols per second each client may be served; 0 for no limit
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool init_clients(struct Clients *, long long);
+
+/**
+ * Adds a rule given as CLIENT=WEIGHT[,RATE], e.g. uid:1000=4 or 10.0.0.5=1,1000000
+ * 
+ * @param  clients clients of the server
+ * @param  spec rule as given on the command line
+ * 
+ * @return true if the rule is valid and there is room for it, else false
+ */
+bool add_client_rule(struct Clients *, const char *);
+
+/**
+ * Identifies the client of a connection: by the user ID of the peer
+ * process if it is local, found with SO_PEERCRED or, for loopback TCP, the
+ * owner of the peer's socket; otherwise by the peer's address. A new client
+ * takes a free slot, or the slot of the client seen longest ago with no
+ * connection waiting.
+ * 
+ * @param  clients clients of the server
+ * @param  socket_fd file descriptor for connected socket
+ * 
+ * @return slot of the client
+ */
+int identify_client(struct Clients *, int);
+
+/**
+ * Determines whether a client's rate lets another of its connections start
+ * 
+ * @param  clients clients of the server
+ * @param  client slot of the client
+ * @param  now_ns current monotonic time
+ * 
+ * @return true if the client is within its rate or has none, else false
+ */
+bool client_may_run(const struct Clients *, int, long long);
+
+/**
+ * Chooses the client whose waiting connection is served next, by deficit
+ * round-robin: clients take turns, skipping those whose deficit is not
+ * positive. Symbols served are taken from a client's deficit as its
+ * connections report them, and each round gives every waiting client
+ * FAIR_QUANTUM symbols of credit per unit of weight.
+ * 
+ * @param  clients clients of the server
+ * @param  now_ns current monotonic time
+ * 
+ * @return slot of the chosen client; -1 if no waiting client is within its rate
+ */
+int choose_client(struct Clients *, long long);
+
+/**
+ * Finds when the next waiting client held back by its rate may run
+ * 
+ * @param  clients clients of the server
+ * 
+ * @return monotonic time the client may run; 0 if no waiting client is held back
+ */
+long long next_client_ready_ns(const struct Clients *);
+
+/**
+ * Records that a client's connection starts being served
+ * 
+ * @param  clients clients of the server
+ * @param  client slot of the client
+ * @param  delay_ns time the connection waited in the queue
+ */
+void record_client_start(struct Clients *, int, long long);
+
+/**
+ * Charges a client for the symbols a request asks for, pushing back the time
+ * they are paid for at its rate. Called by the processes serving connections.
+ * 
+ * @param  clients clients of the server
+ * @param  client slot of the client; -1 for none
+ * @param  n_symbols number of symbols the request asks for
+ */
+void charge_client(struct Clients *, int, long long);
+
+/**
+ * Waits, between requests of a connection, while a client is more than
+ * RATE_BURST_MS ahead of its rate
+ * 
+ * @param  clients clients of the server
+ * @param  client slot of the client; -1 for none
+ */
+void pace_client(struct Clients *, int);
+
+/**
+ * Prints the usage of every client to stderr
+ * 
+ * @param  clients clients of the server
+ * @param  name name of the server
+ */
+void print_clients(const struct Clients *, const char *);
+
+#endif
\ No newline at end of file
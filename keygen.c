@@ -8,71 +8,481 @@
  * Assignment 5
  * 
  * Creates a key file of specified length and writes it to stdout.
- * Characters include A-Z and space.
+ * Characters include A-Z and space. Keys are drawn from a ChaCha20 keystream
+ * seeded by the kernel, one stream per block, so keys are unpredictable
+ * and large keys are generated in parallel.
  * 
- * Usage: keygen $keylength
+ * The key is generated and written in fixed-size blocks, so memory use does
+ * not depend on key length. If the output is a regular file, it is
+ * preallocated and each thread writes its blocks directly into place;
+ * otherwise blocks are generated in parallel and written in order.
+ * 
+ * With -p, the key is written in the packed format, 5 bits per symbol.
+ * With -b, the key is made of arbitrary bytes for binary transfers.
+ * With -a, the key is drawn from the named alphabet, e.g. base64, instead
+ * of A-Z and space.
+ * 
+ * Usage: keygen [-o $file] [-t $threads] [-p | -b | -a $alphabet] $keylength[K|M|G]
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
+#include "csprng.h"
+#include "packed.h"
+#include "otp.h"
+#include "alphabet.h"
 #include "keygen.h"
+#include "util.h"
 
 int main(int argc, char *argv[])
 {
+    // Parse options
+    char *output_path = NULL;
+    int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int format = FORMAT_TEXT;
+    const struct Alphabet *alphabet = DEFAULT_ALPHABET;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:t:pba:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'o': // File to write key to instead of stdout
+                output_path = optarg;
+                break;
+
+            case 't': // Number of threads generating the key
+                n_threads = atoi(optarg);
+                break;
+
+            case 'p': // Write the key packed
+                if (format == FORMAT_BINARY)
+                {
+                    fprintf(stderr, "Error: -p cannot be combined with -b\n");
+                    return EXIT_FAILURE;
+                }
+                format = FORMAT_PACKED;
+                break;
+
+            case 'b': // Write a key of arbitrary bytes
+                if (format == FORMAT_PACKED)
+                {
+                    fprintf(stderr, "Error: -p cannot be combined with -b\n");
+                    return EXIT_FAILURE;
+                }
+                format = FORMAT_BINARY;
+                break;
+
+            case 'a': // Draw the key from another alphabet
+                alphabet = find_alphabet(optarg);
+                if (alphabet == NULL)
+                {
+                    fprintf(stderr, "Error: unknown alphabet: %s; expected one of %s\n", optarg, list_alphabets());
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            default:
+                fprintf(stderr, "Usage: keygen [-o $file] [-t $threads] [-p | -b | -a $alphabet] $keylength\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (alphabet != DEFAULT_ALPHABET && format != FORMAT_TEXT)
+    {
+        fprintf(stderr, "Error: -a cannot be combined with -p or -b\n");
+        return EXIT_FAILURE;
+    }
+    if (n_threads < 1)
+        n_threads = 1;
+
     // Verify key length is valid and convert it to an integer
-    int key_length = get_key_length(argc, argv);
+    long long key_length = get_key_length(argc, argv);
     if (key_length == 0)
         return EXIT_FAILURE;
-    
-    // Generate key of specified length
-    char *key = (char *) malloc(key_length + 2);
-    memset(key, '\0', key_length + 2);
-    generate_key(key, key_length);
-
-    // Write key to stdout
-    fprintf(stdout, "%s", key);
+
+    // Open output file, or write to stdout
+    int fd = STDOUT_FILENO;
+    if (output_path != NULL)
+    {
+        fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0)
+        {
+            fprintf(stderr, "Error: failed to open \"%s\"\n", output_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Generate key of specified length and write it out
+    if (!generate_key(fd, key_length, n_threads, format, alphabet))
+        return EXIT_FAILURE;
+    if (output_path != NULL && close(fd) < 0)
+    {
+        fprintf(stderr, "Error: failed to write \"%s\"\n", output_path);
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
 
-int get_key_length(int argc, char **argv)
+long long get_key_length(int argc, char **argv)
 {
-    // Verify that a key length was specified
-    if (argc != 2)
+    // Verify that exactly one key length was specified
+    if (argc - optind != 1)
     {
-        fprintf(stderr, "Error: key length must be specified\n");
-        fprintf(stderr, "Usage: keygen $keylength\n");
+        if (argc - optind == 0)
+            fprintf(stderr, "Error: key length must be specified\n");
+        else
+            fprintf(stderr, "Error: unexpected argument after key length: %s\n", argv[optind + 1]);
+        fprintf(stderr, "Usage: keygen [-o $file] [-t $threads] [-p | -b | -a $alphabet] $keylength\n");
         return 0;
     }
 
     // Convert key length to integer
-    int key_length = atoi(argv[1]);
+    long long key_length = parse_size(argv[optind]);
 
     // Print error if key length is not valid
-    if (key_length == 0)
+    if (key_length <= 0)
+    {
         fprintf(stderr, "Error: key length argument must be an integer larger than 0\n");
-
+        return 0;
+    }
     return key_length;
 }
 
-void generate_key(char *key, int key_length)
+/**
+ * Writes an entire buffer at the specified offset of a file
+ * 
+ * @param  fd file to write to
+ * @param  buffer bytes to write
+ * @param  length number of bytes to write
+ * @param  offset position in the file to write at
+ * 
+ * @return true if every byte was written, else false
+ */
+static bool pwrite_all(int fd, const char *buffer, long long length, long long offset)
 {
-    // Seed pseudo-random number generater
-    time_t t;
-    srand((unsigned) time(&t));
+    while (length > 0)
+    {
+        ssize_t n_written = pwrite(fd, buffer, length, offset);
+        if (n_written < 0 && errno == EINTR)
+            continue;
+        if (n_written <= 0)
+            return false;
+        buffer += n_written;
+        length -= n_written;
+        offset += n_written;
+    }
+    return true;
+}
 
-    // Iterate key_length times
-    for (int i = 0; i < key_length; i++)
+/**
+ * Writes an entire buffer at the current position of a file
+ * 
+ * @param  fd file to write to
+ * @param  buffer bytes to write
+ * @param  length number of bytes to write
+ * 
+ * @return true if every byte was written, else false
+ */
+static bool write_all(int fd, const char *buffer, long long length)
+{
+    while (length > 0)
     {
-        // Get a pseudo-random number between 0 and 26
-        int r_num = rand() % 27;
+        ssize_t n_written = write(fd, buffer, length);
+        if (n_written < 0 && errno == EINTR)
+            continue;
+        if (n_written <= 0)
+            return false;
+        buffer += n_written;
+        length -= n_written;
+    }
+    return true;
+}
+
+/**
+ * Gets the position of a block within the key's part of the file
+ * 
+ * @param  job key being generated
+ * @param  index index of the block; n_blocks for the end of the key
+ * 
+ * @return position of the block in bytes, relative to the start of the key
+ */
+static long long block_position(struct KeyJob *job, long long index)
+{
+    bool packed = job->format == FORMAT_PACKED;
+    if (index == job->n_blocks)
+        return packed ? PACKED_HEADER_SIZE + packed_size(job->length) : job->length + (job->format == FORMAT_TEXT);
+    return packed ? PACKED_HEADER_SIZE + packed_size(index * KEYGEN_BLOCK_SIZE) : index * KEYGEN_BLOCK_SIZE;
+}
 
-        // Convert r_num to character and store in key
-        key[i] = r_num == 0 ? ' ' : r_num + 64;
+/**
+ * Fills a buffer with symbols of an alphabet other than the default. Each random
+ * byte is mapped through the alphabet's generated table; bytes the table rejects
+ * map to 0 and are overwritten by the next symbol, so every symbol is equally
+ * likely and the loop does not branch on the random bytes.
+ * 
+ * @param  rng keystream to draw from
+ * @param  alphabet alphabet to draw symbols from
+ * @param  symbols buffer to fill
+ * @param  length number of symbols to generate
+ */
+static void generate_alphabet_symbols(struct Csprng *rng, const struct Alphabet *alphabet, char *symbols, long long length)
+{
+    unsigned char bytes[KEYGEN_BYTE_BATCH];
+    long long n = 0;
+    while (n < length)
+    {
+        generate_bytes(rng, (char *) bytes, sizeof(bytes));
+        for (int i = 0; i < (int) sizeof(bytes) && n < length; i++)
+        {
+            char symbol = alphabet->key_symbols[bytes[i]];
+            symbols[n] = symbol;
+            n += symbol != 0;
+        }
+    }
+    memset(bytes, 0, sizeof(bytes));
+}
+
+/**
+ * Generates one block of the key into a buffer. Each block is drawn from its
+ * own stream, so blocks can be generated in any order by any thread.
+ * A packed block is packed in place, a binary block holds raw keystream bytes,
+ * and otherwise the last block ends with the key's newline.
+ * 
+ * @param  job key being generated
+ * @param  index index of the block
+ * @param  buffer buffer of KEYGEN_BLOCK_SIZE + 1 bytes to hold the block
+ * 
+ * @return number of bytes in the block
+ */
+static long long generate_block(struct KeyJob *job, long long index, char *buffer)
+{
+    long long start = index * KEYGEN_BLOCK_SIZE;
+    long long size = job->length - start < KEYGEN_BLOCK_SIZE ? job->length - start : KEYGEN_BLOCK_SIZE;
+
+    struct Csprng rng;
+    init_csprng(&rng, job->seed, index);
+    if (job->format == FORMAT_BINARY)
+    {
+        generate_bytes(&rng, buffer, size);
+        return size;
+    }
+    if (job->alphabet != DEFAULT_ALPHABET)
+        generate_alphabet_symbols(&rng, job->alphabet, buffer, size);
+    else
+        generate_symbols(&rng, buffer, size);
+
+    if (job->format == FORMAT_PACKED)
+    {
+        pack_symbols(buffer, size, buffer);
+        return packed_size(size);
     }
 
     // Add a newline as the last character
-    key[key_length] = '\n';
+    if (start + size == job->length)
+        buffer[size++] = '\n';
+    return size;
+}
+
+/**
+ * Thread body for writing to a regular file: claims blocks until none are
+ * left, writing each directly to its place in the file
+ * 
+ * @param  arg key being generated
+ * 
+ * @return NULL
+ */
+static void *write_blocks_in_place(void *arg)
+{
+    struct KeyJob *job = (struct KeyJob *) arg;
+    char *buffer = (char *) malloc(KEYGEN_BLOCK_SIZE + 1);
+
+    long long index;
+    while ((index = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED)) < job->n_blocks)
+    {
+        long long size = generate_block(job, index, buffer);
+        if (!pwrite_all(job->fd, buffer, size, job->base + block_position(job, index)))
+        {
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Thread body for writing to a pipe or terminal: generates a single block
+ * 
+ * @param  arg slot holding the block's index and buffer
+ * 
+ * @return NULL
+ */
+static void *generate_slot(void *arg)
+{
+    struct KeySlot *slot = (struct KeySlot *) arg;
+    slot->size = generate_block(slot->job, slot->index, slot->buffer);
+    return NULL;
+}
+
+/**
+ * Writes a key to a regular file. The file is preallocated, then every
+ * thread generates blocks and writes them into disjoint regions.
+ * 
+ * @param  job key being generated
+ * @param  n_threads number of threads to use
+ * 
+ * @return true if the key was written, else false
+ */
+static bool write_key_in_place(struct KeyJob *job, int n_threads)
+{
+    // Reserve space for the key and its newline or header so writes do not fragment the file
+    long long key_size = block_position(job, job->n_blocks);
+    if (fallocate(job->fd, 0, job->base, key_size) < 0 && errno == ENOSPC)
+    {
+        // Release whatever part of the key's space was allocated
+        if (ftruncate(job->fd, job->base) < 0)
+            fprintf(stderr, "Error: failed to release space\n");
+        fprintf(stderr, "Error: not enough space for key\n");
+        return false;
+    }
+
+    // Write the header of a packed key
+    char header[PACKED_HEADER_SIZE];
+    build_packed_header(header, job->length);
+    if (job->format == FORMAT_PACKED && !pwrite_all(job->fd, header, PACKED_HEADER_SIZE, job->base))
+        return false;
+
+    // Start threads, using the calling thread as the last one
+    pthread_t *threads = (pthread_t *) malloc(n_threads * sizeof(pthread_t));
+    int n_started = 0;
+    while (n_started < n_threads - 1 && pthread_create(&threads[n_started], NULL, write_blocks_in_place, job) == 0)
+        n_started++;
+    write_blocks_in_place(job);
+
+    // Wait for every started thread to finish
+    for (int i = 0; i < n_started; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    // Leave the file position after the key, as if it had been written sequentially
+    lseek(job->fd, job->base + key_size, SEEK_SET);
+    return !job->failed;
+}
+
+/**
+ * Writes a key to a file that must be written in order. Blocks are generated
+ * one round at a time, one block per thread, and each round is written
+ * while the next is being generated.
+ * 
+ * @param  job key being generated
+ * @param  n_threads number of threads to use
+ * 
+ * @return true if the key was written, else false
+ */
+static bool write_key_in_order(struct KeyJob *job, int n_threads)
+{
+    // Create two rounds of slots: one being generated and one being written
+    struct KeySlot *slots[2];
+    for (int set = 0; set < 2; set++)
+    {
+        slots[set] = (struct KeySlot *) malloc(n_threads * sizeof(struct KeySlot));
+        for (int i = 0; i < n_threads; i++)
+        {
+            slots[set][i].job = job;
+            slots[set][i].buffer = (char *) malloc(KEYGEN_BLOCK_SIZE + 1);
+            slots[set][i].started = false;
+        }
+    }
+
+    // Write the header of a packed key
+    char header[PACKED_HEADER_SIZE];
+    build_packed_header(header, job->length);
+    bool success = job->format != FORMAT_PACKED || write_all(job->fd, header, PACKED_HEADER_SIZE);
+
+    long long n_rounds = (job->n_blocks + n_threads - 1) / n_threads;
+    for (long long round = 0; round <= n_rounds && success; round++)
+    {
+        // Start generating this round's blocks
+        struct KeySlot *generating = slots[round % 2];
+        int n_started = 0;
+        for (int i = 0; i < n_threads && round < n_rounds; i++)
+        {
+            generating[i].index = round * n_threads + i;
+            if (generating[i].index >= job->n_blocks)
+                break;
+            if (pthread_create(&generating[i].thread, NULL, generate_slot, &generating[i]) != 0)
+                generate_slot(&generating[i]);
+            else
+                generating[i].started = true;
+            n_started++;
+        }
+
+        // Write the previous round's blocks in order
+        struct KeySlot *writing = slots[(round + 1) % 2];
+        for (int i = 0; i < n_threads && round > 0 && success; i++)
+        {
+            if (writing[i].index >= job->n_blocks || writing[i].index < (round - 1) * n_threads)
+                break;
+            success = write_all(job->fd, writing[i].buffer, writing[i].size);
+        }
+
+        // Wait for this round's blocks
+        for (int i = 0; i < n_started; i++)
+        {
+            if (generating[i].started)
+                pthread_join(generating[i].thread, NULL);
+            generating[i].started = false;
+        }
+        if (!success)
+            break;
+    }
+
+    for (int set = 0; set < 2; set++)
+    {
+        for (int i = 0; i < n_threads; i++)
+            free(slots[set][i].buffer);
+        free(slots[set]);
+    }
+    return success;
+}
+
+bool generate_key(int fd, long long key_length, int n_threads, int format, const struct Alphabet *alphabet)
+{
+    // Seed from the kernel so no two keys share a keystream
+    unsigned char seed[CSPRNG_SEED_SIZE];
+    if (!seed_csprng(seed))
+        return false;
+
+    struct KeyJob job;
+    job.seed = seed;
+    job.fd = fd;
+    job.length = key_length;
+    job.format = format;
+    job.alphabet = alphabet;
+    job.n_blocks = (key_length + KEYGEN_BLOCK_SIZE - 1) / KEYGEN_BLOCK_SIZE;
+    job.next_block = 0;
+    job.failed = false;
+
+    // Write blocks in place if the output is a regular file that is not opened for appending,
+    // since positioned writes to a file opened for appending all land at its end
+    struct stat st;
+    job.base = lseek(fd, 0, SEEK_CUR);
+    bool in_place = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && job.base >= 0 && !(fcntl(fd, F_GETFL) & O_APPEND);
+    bool success = in_place ? write_key_in_place(&job, n_threads) : write_key_in_order(&job, n_threads);
+    if (!success)
+        fprintf(stderr, "Error: failed to write key\n");
+
+    // Do not leave the seed in memory
+    memset(seed, 0, sizeof(seed));
+    return success;
 }
\ No newline at end of file
@@ -14,24 +14,64 @@
 #ifndef KEYGEN
 #define KEYGEN
 
+// Number of symbols generated and written at a time (4 MiB)
+#define KEYGEN_BLOCK_SIZE 4194304
+
+// Number of random bytes drawn at a time for alphabets other than the default
+#define KEYGEN_BYTE_BATCH 4096
+
+// Object to hold a key being generated and written by several threads
+struct KeyJob
+{
+    const unsigned char *seed;  // seed shared by every block's stream
+    int fd;                     // file the key is written to
+    long long base;             // position of the key within the file
+    long long length;           // number of symbols in the key, excluding trailing newline
+    int format;                 // format of the key, one of the FORMAT_ values
+    const struct Alphabet *alphabet;    // alphabet of the key's symbols
+    long long n_blocks;         // number of blocks in the key
+    long long next_block;       // next block to generate, claimed with an atomic fetch-add
+    bool failed;                // true once a write has failed
+};
+
+// Object to hold one block generated for writing in order
+struct KeySlot
+{
+    struct KeyJob *job;         // key the block belongs to
+    long long index;            // index of the block within the key
+    char *buffer;               // generated block
+    long long size;             // number of bytes in the block, including any newline
+    pthread_t thread;           // thread generating the block
+    bool started;               // true while a thread is generating the block
+};
+
 /**
- * Converts key length to integer and verifies that it is a valid length
+ * Converts key length to a 64-bit integer and verifies that it is a valid length.
+ * The key length is the first argument following any options, and may end
+ * in K, M, or G.
  * 
  * @param  argc the number of command-line arguments given 
  * @param  argv the given command-line arguments
  * 
- * @return true if valid key length was specified, else false
+ * @return the key length if a valid length was specified, else 0
  */
-int get_key_length(int, char **);
+long long get_key_length(int, char **);
 
 /**
- * Generates a key of specified length. 
- * Each character is a pseudo-random character.
- * Characters used are A-Z and space.
+ * Generates a key of specified length and writes it to a file, followed by a newline.
+ * Each character is drawn uniformly from a cryptographically secure keystream.
+ * Characters are drawn from the specified alphabet. A packed key is written after a
+ * packed header, without a newline. A binary key is made of uniformly
+ * distributed bytes, without a newline.
  * 
- * @param  key string to store key in
+ * @param  fd file to write key to
  * @param  key_length length of key to generate
+ * @param  n_threads number of threads to generate key with
+ * @param  format format of the key, one of the FORMAT_ values
+ * @param  alphabet alphabet of the key's symbols; must be the default unless format is FORMAT_TEXT
+ * 
+ * @return true if the key was generated and written, else false
  */
-void generate_key(char *, int);
+bool generate_key(int, long long, int, int, const struct Alphabet *);
 
 #endif
\ No newline at end of file
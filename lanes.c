@@ -0,0 +1,109 @@
+/**
+ * @file lanes.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the lane of large connections, which keeps a few huge transfers
+ * from holding every worker while small ones queue behind them.
+ * 
+ * Transfer sizes are not known when a connection arrives, so connections
+ * are told apart by the work they have received: every connection starts in
+ * the small lane, and one that has been served a slice of symbols while
+ * others wait is handed back between requests and parked here. Parked
+ * connections run their next slice only when no new connection is waiting,
+ * or once they have waited LANE_AGING_MS, and never on the workers kept for
+ * new connections. Small transfers finish within their first slice, so they
+ * only ever wait for a slice rather than a whole transfer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "lanes.h"
+#include "util.h"
+
+bool init_lane(struct LargeLane *lane, int limit, int n_workers, int n_reserved)
+{
+    // Leave room for a connection from every worker, since workers hand connections back
+    // without waiting to learn whether the lane has filled up
+    lane->limit = limit;
+    lane->capacity = limit + n_workers;
+    lane->parked = (struct ParkedConnection *) malloc(lane->capacity * sizeof(struct ParkedConnection));
+    lane->start = 0;
+    lane->n_parked = 0;
+    lane->n_running = 0;
+    lane->max_running = n_workers - n_reserved;
+    lane->n_slices = 0;
+    lane->n_aged = 0;
+    if (lane->parked == NULL)
+    {
+        fprintf(stderr, "Error: failed to allocate lane of large connections\n");
+        return false;
+    }
+    return true;
+}
+
+bool park_connection(struct LargeLane *lane, int socket_fd, int role, int format, int client)
+{
+    if (lane->n_parked == lane->capacity)
+        return false;
+
+    struct ParkedConnection *connection = &lane->parked[(lane->start + lane->n_parked) % lane->capacity];
+    connection->socket_fd = socket_fd;
+    connection->role = role;
+    connection->format = format;
+    connection->client = client;
+    connection->parked_ns = monotonic_ns();
+    lane->n_parked++;
+    lane->n_slices++;
+    return true;
+}
+
+bool lane_may_run(const struct LargeLane *lane)
+{
+    return lane->n_parked > 0 && lane->n_running < lane->max_running;
+}
+
+bool lane_has_aged(const struct LargeLane *lane, long long now_ns)
+{
+    return lane->n_parked > 0 && now_ns - lane->parked[lane->start].parked_ns >= LANE_AGING_MS * 1000000LL;
+}
+
+struct ParkedConnection resume_parked(struct LargeLane *lane)
+{
+    struct ParkedConnection connection = lane->parked[lane->start];
+    lane->start = (lane->start + 1) % lane->capacity;
+    lane->n_parked--;
+    lane->n_running++;
+    return connection;
+}
+
+void finish_slice(struct LargeLane *lane)
+{
+    if (lane->n_running > 0)
+        lane->n_running--;
+}
+
+bool lane_wants_slices(const struct LargeLane *lane, int n_queued)
+{
+    return (n_queued > 0 || lane->n_parked > 0) && lane->n_parked < lane->limit;
+}
+
+void close_lane(struct LargeLane *lane)
+{
+    for (int i = 0; i < lane->n_parked; i++)
+        close(lane->parked[(lane->start + i) % lane->capacity].socket_fd);
+}
+
+void print_lane(const struct LargeLane *lane, const char *name)
+{
+    fprintf(stderr, "%s: %llu slices of large connections handed back, %llu run ahead after waiting; "
+                    "%d large connections running, at most %d at once; %d waiting\n",
+            name, lane->n_slices, lane->n_aged, lane->n_running, lane->max_running, lane->n_parked);
+}
\ No newline at end of file
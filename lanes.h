@@ -0,0 +1,133 @@
+/**
+ * @file lanes.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for lanes.c
+ */
+
+#ifndef LANES
+#define LANES
+
+// Default number of symbols a connection is served before it may be handed back for others to run
+#define DEFAULT_SLICE_SYMBOLS (4 * 1048576LL)
+
+// Time a large connection may wait before it runs ahead of new connections, in milliseconds
+#define LANE_AGING_MS 500
+
+// Connection handed back by a worker between requests, waiting for its next slice
+struct ParkedConnection
+{
+    int socket_fd;          // connected socket
+    int role;               // role the connection is served in
+    int format;             // payload format the client asked for in the handshake
+    int client;             // slot of the connection's client
+    long long parked_ns;    // monotonic time the connection was handed back
+};
+
+// Object to hold the lane of large connections, which run in slices on the workers new connections leave free
+struct LargeLane
+{
+    struct ParkedConnection *parked;    // waiting connections, oldest first, as a ring
+    int capacity;                       // size of the ring
+    int limit;                          // most connections that may be handed back to wait
+    int start;                          // index of the oldest waiting connection
+    int n_parked;                       // number of waiting connections
+    int n_running;                      // number of workers serving a slice of a large connection
+    int max_running;                    // most workers that may serve large connections at once
+    unsigned long long n_slices;        // slices handed back
+    unsigned long long n_aged;          // slices run ahead of new connections because they waited too long
+};
+
+/**
+ * Sets up the lane of large connections
+ * 
+ * @param  lane object to initialize
+ * @param  limit most connections that may wait in the lane
+ * @param  n_workers number of workers
+ * @param  n_reserved number of workers kept for new connections, below n_workers
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool init_lane(struct LargeLane *, int, int, int);
+
+/**
+ * Parks a connection a worker handed back between requests
+ * 
+ * @param  lane lane of large connections
+ * @param  socket_fd connected socket
+ * @param  role role the connection is served in
+ * @param  format payload format of the connection
+ * @param  client slot of the connection's client
+ * 
+ * @return true if the connection was parked; false if the lane is full
+ */
+bool park_connection(struct LargeLane *, int, int, int, int);
+
+/**
+ * Determines whether a large connection may start a slice: one is waiting,
+ * and fewer workers than allowed are serving large connections
+ * 
+ * @param  lane lane of large connections
+ * 
+ * @return true if a large connection may start a slice, else false
+ */
+bool lane_may_run(const struct LargeLane *);
+
+/**
+ * Determines whether the oldest large connection has waited long enough to run ahead of new connections
+ * 
+ * @param  lane lane of large connections
+ * @param  now_ns current monotonic time
+ * 
+ * @return true if the oldest connection has waited LANE_AGING_MS or more, else false
+ */
+bool lane_has_aged(const struct LargeLane *, long long);
+
+/**
+ * Takes the oldest large connection off the lane to run its next slice
+ * 
+ * @param  lane lane of large connections
+ * 
+ * @return the connection
+ */
+struct ParkedConnection resume_parked(struct LargeLane *);
+
+/**
+ * Notes that a worker finished serving a slice of a large connection
+ * 
+ * @param  lane lane of large connections
+ */
+void finish_slice(struct LargeLane *);
+
+/**
+ * Determines whether workers should hand their connections back after a
+ * slice: connections are waiting to run, and the lane has room for another
+ * 
+ * @param  lane lane of large connections
+ * @param  n_queued number of new connections waiting for a worker
+ * 
+ * @return true if workers should hand connections back, else false
+ */
+bool lane_wants_slices(const struct LargeLane *, int);
+
+/**
+ * Closes the sockets of every waiting connection, in a process that does not serve them
+ * 
+ * @param  lane lane of large connections
+ */
+void close_lane(struct LargeLane *);
+
+/**
+ * Prints the lane's counts to stderr
+ * 
+ * @param  lane lane of large connections
+ * @param  name name of the server
+ */
+void print_lane(const struct LargeLane *, const char *);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,488 @@
+/**
+ * @file ledger.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the pad consumption ledger. Each pad has a cursor in shared memory
+ * marking its first unreserved symbol. Reservations advance the cursor with an
+ * atomic compare-and-swap, only as far as the pad's lease goes: the journal
+ * records leases rather than reservations, each running well ahead of the
+ * cursor, so most reservations never wait for the disk. A reservation past
+ * the lease stages the next lease in a shared ring of journal records. The
+ * first process to need its record durable writes every staged record to the
+ * journal with one write() and one fdatasync(), so concurrent leases share
+ * the cost of syncing.
+ * 
+ * Each reservation is also kept in a shared table under a random token that
+ * only its client learns. A chunk is only encrypted with a pad range if it
+ * presents the token of the reservation holding the range, and each range
+ * of a reservation is used once. The table is not journaled: after a restart
+ * every earlier reservation is retired, along with whatever of it was unused.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <netdb.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "pad_store.h"
+#include "csprng.h"
+#include "ledger.h"
+
+// Longest formatted journal record
+#define MAX_RECORD_SIZE (MAX_PAD_ID_SIZE + 48)
+
+// Number of times a waiter yields before checking whether the flushing process died
+#define FLUSH_YIELDS_PER_CHECK 1024
+
+// Multiplier used to mix the words of a digest (2^64 divided by the golden ratio)
+#define DIGEST_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+// Keystream each process draws its tokens from, set up the first time the process draws one
+static struct Csprng token_rng;
+static unsigned char token_bytes[CSPRNG_BUFFER_SIZE];
+static int token_position = CSPRNG_BUFFER_SIZE;
+static pid_t token_pid = 0;
+
+/**
+ * Reads the journal and raises each pad's cursor and lease to the end of
+ * the furthest lease recorded for it. Journals written before leases
+ * record each reservation's range, which is read the same way.
+ * 
+ * @param  ledger ledger whose cursors to recover
+ * 
+ * @return true if the journal was read, else false
+ */
+static bool recover_cursors(struct Ledger *ledger)
+{
+    FILE *fp_journal = fdopen(dup(ledger->journal_fd), "r");
+    if (fp_journal == NULL)
+        return false;
+    rewind(fp_journal);
+
+    long long n_records = 0;
+    char line[MAX_RECORD_SIZE + 2];
+    while (fgets(line, sizeof(line), fp_journal) != NULL)
+    {
+        // Ignore a final record cut short by a crash
+        if (line[strlen(line) - 1] != '\n')
+            break;
+
+        // Parse record
+        char pad_id[MAX_PAD_ID_SIZE];
+        long long offset, length;
+        if (sscanf(line, "%63s %lld %lld", pad_id, &offset, &length) != 3)
+            continue;
+
+        // Raise the pad's cursor to the end of the recorded lease; the rest of the lease is never handed out
+        const struct Pad *pad = find_pad(ledger->store, pad_id);
+        if (pad == NULL)
+            continue;
+        struct LedgerCursor *cursor = &ledger->shared->cursors[pad - ledger->store->pads];
+        if (offset + length > cursor->next_offset)
+        {
+            cursor->next_offset = offset + length;
+            cursor->lease_end = offset + length;
+            cursor->lease_requested = offset + length;
+        }
+        n_records++;
+    }
+    fclose(fp_journal);
+
+    fprintf(stderr, "Recovered %lld leases from journal\n", n_records);
+    return true;
+}
+
+bool open_ledger(struct Ledger *ledger, const struct PadStore *store, const char *journal_path)
+{
+    ledger->store = store;
+
+    // Open journal for appending, creating it if needed
+    ledger->journal_fd = open(journal_path, O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (ledger->journal_fd < 0)
+    {
+        fprintf(stderr, "Error: failed to open journal \"%s\"\n", journal_path);
+        return false;
+    }
+
+    // Create state shared by every process forked from this one
+    size_t shared_size = sizeof(struct LedgerShared) + store->n_pads * sizeof(struct LedgerCursor);
+    ledger->shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ledger->shared == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map ledger\n");
+        close(ledger->journal_fd);
+        return false;
+    }
+
+    // Seed the tokens of every process, each of which draws from a stream of its own
+    if (!seed_csprng(ledger->seed))
+    {
+        fprintf(stderr, "Error: failed to seed reservation tokens\n");
+        close(ledger->journal_fd);
+        return false;
+    }
+
+    // Recover high-water marks from the journal
+    if (!recover_cursors(ledger))
+    {
+        fprintf(stderr, "Error: failed to read journal \"%s\"\n", journal_path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Writes every contiguous staged record to the journal and syncs it.
+ * Only called by the process holding the flushing flag.
+ * 
+ * @param  ledger ledger to flush
+ */
+static void flush_journal(struct Ledger *ledger)
+{
+    // Each process keeps its own buffer for formatting records
+    static char *buffer = NULL;
+    if (buffer == NULL)
+        buffer = (char *) malloc(LEDGER_RING_SIZE * MAX_RECORD_SIZE);
+
+    struct LedgerShared *shared = ledger->shared;
+    long long start = __atomic_load_n(&shared->flushed_sequence, __ATOMIC_ACQUIRE);
+    long long limit = __atomic_load_n(&shared->next_sequence, __ATOMIC_ACQUIRE);
+
+    // Format every record that is ready, stopping at the first that is still being filled in
+    long long end = start;
+    int n = 0;
+    while (end < limit && end - start < LEDGER_RING_SIZE)
+    {
+        struct LedgerRecord *record = &shared->ring[end % LEDGER_RING_SIZE];
+        if (__atomic_load_n(&record->ready, __ATOMIC_ACQUIRE) != end + 1)
+            break;
+        n += snprintf(buffer + n, MAX_RECORD_SIZE, "%s %lld %lld\n",
+                      ledger->store->pads[record->pad_index].id, record->offset, record->length);
+        end++;
+    }
+    if (end == start)
+        return;
+
+    // Write and sync the whole batch at once
+    long long total_written = 0;
+    while (total_written < n)
+    {
+        ssize_t n_written = write(ledger->journal_fd, buffer + total_written, n - total_written);
+        if (n_written < 0 && errno == EINTR)
+            continue;
+        if (n_written < 0)
+            break;
+        total_written += n_written;
+    }
+    if (total_written < n || fdatasync(ledger->journal_fd) < 0)
+    {
+        fprintf(stderr, "Error: failed to write journal\n");
+        __atomic_store_n(&shared->failed, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    // Publish that the batch is durable
+    shared->n_flushes++;
+    __atomic_store_n(&shared->flushed_sequence, end, __ATOMIC_RELEASE);
+}
+
+/**
+ * Waits until the record with the specified sequence number is durable,
+ * flushing the journal if no other process is already doing so
+ * 
+ * @param  ledger ledger to wait on
+ * @param  sequence sequence number of the record
+ * 
+ * @return true once the record is durable; false if the journal has failed
+ */
+static bool wait_for_flush(struct Ledger *ledger, long long sequence)
+{
+    struct LedgerShared *shared = ledger->shared;
+    int n_yields = 0;
+
+    while (__atomic_load_n(&shared->flushed_sequence, __ATOMIC_ACQUIRE) <= sequence)
+    {
+        if (__atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE))
+            return false;
+
+        // Become the flushing process if none is active; the flag holds its pid
+        int flusher = 0;
+        if (__atomic_compare_exchange_n(&shared->flushing, &flusher, getpid(), false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            flush_journal(ledger);
+            __atomic_store_n(&shared->flushing, 0, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        // Let the flushing process run, and take over if it has died
+        sched_yield();
+        if (++n_yields % FLUSH_YIELDS_PER_CHECK == 0 && kill(flusher, 0) < 0 && errno == ESRCH)
+            __atomic_compare_exchange_n(&shared->flushing, &flusher, 0, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+/**
+ * Draws a token for a reservation in the specified slot. The slot is kept
+ * in the token's low bits, and the rest are random and never all zero.
+ * 
+ * @param  ledger ledger whose seed to draw from
+ * @param  slot slot of the reservation
+ * 
+ * @return a positive token
+ */
+static long long draw_token(struct Ledger *ledger, long long slot)
+{
+    // Give each process, forked ones included, a stream no other process draws from
+    if (token_pid != getpid())
+    {
+        token_pid = getpid();
+        init_csprng(&token_rng, ledger->seed, __atomic_fetch_add(&ledger->shared->next_stream, 1, __ATOMIC_RELAXED));
+        token_position = CSPRNG_BUFFER_SIZE;
+    }
+
+    long long token;
+    do
+    {
+        if (token_position == CSPRNG_BUFFER_SIZE)
+        {
+            next_csprng_bytes(&token_rng, token_bytes);
+            token_position = 0;
+        }
+        unsigned long long bits;
+        memcpy(&bits, token_bytes + token_position, sizeof(bits));
+        token_position += sizeof(bits);
+        token = (long long) (bits >> 2) & ~(long long) (LEDGER_RESERVATION_SLOTS - 1);
+    }
+    while (token == 0);
+    return token | slot;
+}
+
+/**
+ * Takes the lock of a reservation, waiting for whichever process holds it.
+ * Processes only hold it for a few loads and stores.
+ * 
+ * @param  reservation reservation to lock
+ */
+static void lock_reservation(struct LedgerReservation *reservation)
+{
+    int unlocked = 0;
+    while (!__atomic_compare_exchange_n(&reservation->lock, &unlocked, 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        unlocked = 0;
+        sched_yield();
+    }
+}
+
+/**
+ * Releases the lock of a reservation
+ * 
+ * @param  reservation reservation to unlock
+ */
+static void unlock_reservation(struct LedgerReservation *reservation)
+{
+    __atomic_store_n(&reservation->lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Finds the reservation a token names, if it is still held
+ * 
+ * @param  ledger ledger to search
+ * @param  pad pad the reservation must be of
+ * @param  token token of the reservation
+ * 
+ * @return the reservation, locked; NULL if the token names no reservation of the pad
+ */
+static struct LedgerReservation *find_reservation(struct Ledger *ledger, const struct Pad *pad, long long token)
+{
+    if (token <= 0)
+        return NULL;
+    struct LedgerReservation *reservation = &ledger->shared->reservations[token & (LEDGER_RESERVATION_SLOTS - 1)];
+    lock_reservation(reservation);
+    if (reservation->token != token || reservation->pad_index != pad - ledger->store->pads)
+    {
+        unlock_reservation(reservation);
+        return NULL;
+    }
+    return reservation;
+}
+
+/**
+ * Computes a digest of a chunk's plaintext, so a chunk sent again can be
+ * told from a different one
+ * 
+ * @param  bytes bytes to digest
+ * @param  size number of bytes
+ * 
+ * @return 64-bit digest of the bytes
+ */
+static unsigned long long digest_bytes(const char *bytes, long long size)
+{
+    unsigned long long digest = size;
+    long long i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        unsigned long long word;
+        memcpy(&word, bytes + i, sizeof(word));
+        digest = (digest ^ word) * DIGEST_MULTIPLIER;
+        digest ^= digest >> 29;
+    }
+    for (; i < size; i++)
+        digest = (digest ^ (unsigned char) bytes[i]) * DIGEST_MULTIPLIER;
+    return digest ^ digest >> 31;
+}
+
+/**
+ * Extends a pad's lease to cover the specified end, journaling the next
+ * lease if no other process is already journaling one that covers it, and
+ * waits until the lease is durable
+ * 
+ * @param  ledger ledger to extend the lease of
+ * @param  pad pad whose lease to extend
+ * @param  needed end the lease must reach
+ * 
+ * @return true once the lease reaches the end; false if the journal has failed
+ */
+static bool extend_lease(struct Ledger *ledger, const struct Pad *pad, long long needed)
+{
+    struct LedgerShared *shared = ledger->shared;
+    int pad_index = pad - ledger->store->pads;
+    struct LedgerCursor *cursor = &shared->cursors[pad_index];
+
+    // Ask for a lease from the end of the last one asked for to well past the range, as far as the pad goes
+    long long requested = __atomic_load_n(&cursor->lease_requested, __ATOMIC_RELAXED);
+    while (requested < needed)
+    {
+        long long end = needed > pad->length - LEDGER_LEASE_SIZE ? pad->length : needed + LEDGER_LEASE_SIZE;
+        if (!__atomic_compare_exchange_n(&cursor->lease_requested, &requested, end, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            continue;
+
+        // Claim a slot in the ring, waiting for it to be flushed if the ring is full
+        long long sequence = __atomic_fetch_add(&shared->next_sequence, 1, __ATOMIC_RELAXED);
+        if (!wait_for_flush(ledger, sequence - LEDGER_RING_SIZE))
+            return false;
+
+        // Stage the record, then publish it as ready
+        struct LedgerRecord *record = &shared->ring[sequence % LEDGER_RING_SIZE];
+        record->pad_index = pad_index;
+        record->offset = requested;
+        record->length = end - requested;
+        __atomic_store_n(&record->ready, sequence + 1, __ATOMIC_RELEASE);
+
+        // Do not hand out ranges of the lease until its record is durable. Recovery raises the cursor to the
+        // furthest lease journaled, so a later lease made durable first also covers this one.
+        if (!wait_for_flush(ledger, sequence))
+            return false;
+        long long published = __atomic_load_n(&cursor->lease_end, __ATOMIC_RELAXED);
+        while (published < end && !__atomic_compare_exchange_n(&cursor->lease_end, &published, end, true,
+                                                               __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+        return true;
+    }
+
+    // Another process is journaling a lease that covers the range; wait until it is durable
+    while (__atomic_load_n(&cursor->lease_end, __ATOMIC_ACQUIRE) < needed)
+    {
+        if (__atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE))
+            return false;
+        sched_yield();
+    }
+    return true;
+}
+
+long long reserve_pad_range(struct Ledger *ledger, const struct Pad *pad, long long length, long long *token)
+{
+    struct LedgerShared *shared = ledger->shared;
+    int pad_index = pad - ledger->store->pads;
+
+    // Claim the range by advancing the pad's cursor, only if the range fits in the pad and its durable lease:
+    // a cursor moved past the end would retire the rest of the pad, and one moved past the lease would hand
+    // out a range a restart could hand out again
+    if (length <= 0 || length > pad->length)
+        return -1;
+    struct LedgerCursor *cursor = &shared->cursors[pad_index];
+    long long offset = __atomic_load_n(&cursor->next_offset, __ATOMIC_RELAXED);
+    while (true)
+    {
+        if (offset > pad->length - length)
+            return -1;
+        if (offset + length > __atomic_load_n(&cursor->lease_end, __ATOMIC_ACQUIRE))
+        {
+            if (!extend_lease(ledger, pad, offset + length))
+                return -1;
+            offset = __atomic_load_n(&cursor->next_offset, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&cursor->next_offset, &offset, offset + length, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+
+    // Hold the range under a fresh token, retiring the reservation that held the slot before
+    long long slot = __atomic_fetch_add(&shared->next_reservation, 1, __ATOMIC_RELAXED) % LEDGER_RESERVATION_SLOTS;
+    struct LedgerReservation *reservation = &shared->reservations[slot];
+    *token = draw_token(ledger, slot);
+    lock_reservation(reservation);
+    reservation->token = *token;
+    reservation->pad_index = pad_index;
+    reservation->offset = offset;
+    reservation->length = length;
+    reservation->used = 0;
+    reservation->last_offset = -1;
+    unlock_reservation(reservation);
+    return offset;
+}
+
+bool holds_pad_range(struct Ledger *ledger, const struct Pad *pad, long long token, long long offset, long long length)
+{
+    struct LedgerReservation *reservation = find_reservation(ledger, pad, token);
+    if (reservation == NULL)
+        return false;
+    bool holds = offset >= reservation->offset && length <= reservation->offset + reservation->length - offset;
+    unlock_reservation(reservation);
+    return holds;
+}
+
+bool use_pad_range(struct Ledger *ledger, const struct Pad *pad, long long token, long long offset, long long length,
+                   const char *plaintext, long long size)
+{
+    unsigned long long digest = digest_bytes(plaintext, size);
+    struct LedgerReservation *reservation = find_reservation(ledger, pad, token);
+    if (reservation == NULL)
+        return false;
+
+    // Use the range after the last one used, or the last one again for the same plaintext
+    long long used_end = reservation->offset + reservation->used;
+    bool usable = false;
+    if (offset == used_end && length <= reservation->offset + reservation->length - offset)
+    {
+        reservation->used += length;
+        reservation->last_offset = offset;
+        reservation->last_digest = digest;
+        usable = true;
+    }
+    else if (offset == reservation->last_offset && offset + length == used_end && digest == reservation->last_digest)
+        usable = true;
+    unlock_reservation(reservation);
+    return usable;
+}
+
+long long get_pad_high_water_mark(struct Ledger *ledger, const struct Pad *pad)
+{
+    return __atomic_load_n(&ledger->shared->cursors[pad - ledger->store->pads].next_offset, __ATOMIC_RELAXED);
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+/**
+ * @file ledger.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for ledger.c
+ */
+
+#ifndef LEDGER
+#define LEDGER
+
+// Number of journal records that can be staged between flushes
+#define LEDGER_RING_SIZE 8192
+
+// Size of a cache line; each pad cursor gets its own to avoid false sharing
+#define CACHE_LINE_SIZE 64
+
+// Number of symbols of a pad journaled ahead of its cursor at once; reservations within
+// the lease need no sync, and a restart retires whatever of the lease was not handed out
+#define LEDGER_LEASE_SIZE (1LL << 20)
+
+// Number of reservations tracked at once, a power of two; a reservation is retired,
+// along with whatever of its range is still unused, once this many newer ones are made
+#define LEDGER_RESERVATION_SLOTS 16384
+
+// Journal record staged in shared memory until it is flushed
+struct LedgerRecord
+{
+    long long ready;            // sequence number + 1 once the record is filled in
+    int pad_index;              // index of the pad in the pad store
+    long long offset;           // first symbol of the lease
+    long long length;           // number of symbols in the lease
+};
+
+// Reservation held by a client, and how much of it the client has used
+struct LedgerReservation
+{
+    long long token;            // token the client presents with each chunk; 0 while the slot is unused
+    int lock;                   // 1 while a process reads or changes the reservation
+    int pad_index;              // index of the pad in the pad store
+    long long offset;           // first reserved symbol
+    long long length;           // number of reserved symbols
+    long long used;             // symbols used so far, from the start of the range
+    long long last_offset;      // key offset of the last chunk encrypted
+    unsigned long long last_digest; // digest of the last chunk's plaintext, so only it may be sent again
+};
+
+// Next unreserved offset of a pad and the lease it is handed out within, padded to a full cache line
+struct LedgerCursor
+{
+    long long next_offset;      // first symbol not yet handed out
+    long long lease_end;        // end of the lease that is durable in the journal
+    long long lease_requested;  // end of the furthest lease asked for, durable or not
+    char padding[CACHE_LINE_SIZE - 3 * sizeof(long long)];
+};
+
+// Ledger state shared by every process forked from the server
+struct LedgerShared
+{
+    long long next_sequence;    // sequence number of the next staged record
+    char padding_1[CACHE_LINE_SIZE - sizeof(long long)];
+    long long flushed_sequence; // every record below this sequence number is durable
+    int flushing;               // 1 while a process is writing and syncing the journal
+    int failed;                 // 1 once a journal write has failed
+    long long n_flushes;        // number of batches written and synced
+    char padding_2[CACHE_LINE_SIZE - 2 * sizeof(long long) - 2 * sizeof(int)];
+    long long next_reservation; // number of reservations made, which picks the next one's slot
+    long long next_stream;      // number of processes that have drawn tokens, which picks the next one's stream
+    char padding_3[CACHE_LINE_SIZE - 2 * sizeof(long long)];
+    struct LedgerRecord ring[LEDGER_RING_SIZE];
+    struct LedgerReservation reservations[LEDGER_RESERVATION_SLOTS];
+    struct LedgerCursor cursors[];
+};
+
+// Object to hold an open ledger
+struct Ledger
+{
+    struct LedgerShared *shared;    // state in memory shared across processes
+    const struct PadStore *store;   // pads the ledger hands out ranges of
+    int journal_fd;                 // append-only journal of leases
+    unsigned char seed[CSPRNG_SEED_SIZE];   // seed of the tokens, drawn once before forking
+};
+
+/**
+ * Opens the journal at the specified path, creating it if needed, and
+ * recovers each pad's high-water mark from the leases it records, so
+ * reservations resume from the end of the last lease. A record cut short
+ * by a crash is ignored, since its lease was never used.
+ * Must be called before forking so every process shares the ledger.
+ * 
+ * @param  ledger ledger to open
+ * @param  store pads the ledger hands out ranges of
+ * @param  journal_path path of the journal file
+ * 
+ * @return true if the ledger was opened, else false
+ */
+bool open_ledger(struct Ledger *, const struct PadStore *, const char *);
+
+/**
+ * Reserves [offset, offset + length) of a pad. Ranges are handed out with an
+ * atomic compare-and-swap on the pad's cursor, so concurrent reservations
+ * never overlap and never take a lock. The cursor only moves within a lease
+ * that is durable in the journal; a reservation that runs past the lease
+ * journals the next one, LEDGER_LEASE_SIZE symbols past the range, and waits
+ * until it is durable. Leases journaled at once are written and synced
+ * together by whichever process flushes first (group commit). A reservation
+ * that does not fit in the rest of the pad fails and leaves the cursor where
+ * it was, so smaller reservations still fit.
+ * 
+ * The reservation is given an unguessable token, which the client presents
+ * with each chunk it encrypts with the range, so no other client can use it.
+ * 
+ * @param  ledger ledger to reserve from
+ * @param  pad pad to reserve a range of
+ * @param  length number of symbols to reserve
+ * @param  token set to the reservation's token
+ * 
+ * @return offset of the reserved range; -1 if the pad is exhausted or the
+ *         reservation could not be journaled
+ */
+long long reserve_pad_range(struct Ledger *, const struct Pad *, long long, long long *);
+
+/**
+ * Checks that a range of a pad lies within the reservation a token names
+ * 
+ * @param  ledger ledger the range was reserved from
+ * @param  pad pad of the range
+ * @param  token token of the reservation
+ * @param  offset first symbol of the range
+ * @param  length number of symbols in the range
+ * 
+ * @return true if the reservation holds the range, else false
+ */
+bool holds_pad_range(struct Ledger *, const struct Pad *, long long, long long, long long);
+
+/**
+ * Marks a range of a reservation used by a chunk. Chunks use a reservation
+ * in order, each starting where the one before it ended, so every range is
+ * used once. The last chunk may be sent again, as a resumed transfer does
+ * after a crash, if its plaintext is the same: its ciphertext is then the
+ * same too, so nothing more is revealed.
+ * 
+ * @param  ledger ledger the range was reserved from
+ * @param  pad pad of the range
+ * @param  token token of the reservation
+ * @param  offset first symbol of the range
+ * @param  length number of symbols in the range
+ * @param  plaintext plaintext of the chunk
+ * @param  size bytes of plaintext
+ * 
+ * @return true if the chunk may be encrypted with the range; false if the
+ *         range was already used, or the reservation is no longer held
+ */
+bool use_pad_range(struct Ledger *, const struct Pad *, long long, long long, long long, const char *, long long);
+
+/**
+ * Gets the high-water mark of a pad: every symbol below it has been reserved
+ * 
+ * @param  ledger ledger to query
+ * @param  pad pad to query
+ * 
+ * @return offset of the first unreserved symbol of the pad
+ */
+long long get_pad_high_water_mark(struct Ledger *, const struct Pad *);
+
+#endif
\ No newline at end of file
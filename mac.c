@@ -0,0 +1,449 @@
+/**
+ * @file mac.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains a one-time MAC for ciphertext. Tags are Poly1305: the ciphertext
+ * is evaluated as a polynomial at r modulo 2^130 - 5, and s is added to the
+ * result, with r and s drawn from pad symbols that are never used again.
+ * The accumulator is kept in three limbs of 44, 44, and 42 bits, so each
+ * block costs nine 64-by-64-bit multiplications, and blocks are absorbed
+ * four at a time with precomputed powers of r so the multiplications overlap.
+ * 
+ * The transform and the hash are fused in authenticated kernels of their own
+ * for each alphabet: every group of four blocks is hashed as soon as it is
+ * transformed, with the accumulator kept in registers, so the table lookups
+ * of the transform and the multiplications of the hash run side by side
+ * instead of one after the other.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "otp.h"
+#include "alphabet.h"
+#include "mac.h"
+#include "alphabet_tables.h"
+
+// Masks of the 44- and 42-bit limbs
+#define LIMB_MASK_44 0xfffffffffffULL
+#define LIMB_MASK_42 0x3ffffffffffULL
+
+// Bit 128 of a whole block, within the top limb
+#define BLOCK_HIGH_BIT (1ULL << 40)
+
+typedef unsigned __int128 Wide;
+
+/**
+ * Reads a little-endian 64-bit integer. Hosts are little-endian, as in
+ * csprng.c, so this is a single unaligned load.
+ * 
+ * @param  bytes 8 bytes to read
+ * 
+ * @return the integer
+ */
+static unsigned long long load_64(const unsigned char *bytes)
+{
+    unsigned long long value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+/**
+ * Writes a little-endian 64-bit integer
+ * 
+ * @param  bytes buffer of 8 bytes to write to
+ * @param  value the integer
+ */
+static void store_64(unsigned char *bytes, unsigned long long value)
+{
+    memcpy(bytes, &value, sizeof(value));
+}
+
+void derive_mac_key(const struct Alphabet *alphabet, const char *symbols, unsigned char *key)
+{
+    // Read each half as a number, wrapping mod 2^128
+    for (int half = 0; half < 2; half++)
+    {
+        Wide value = 0;
+        for (int i = 0; i < MAC_KEY_SYMBOLS / 2; i++)
+            value = value * alphabet->size + alphabet->indices[(unsigned char) symbols[half * MAC_KEY_SYMBOLS / 2 + i]];
+        store_64(key + 16 * half, (unsigned long long) value);
+        store_64(key + 16 * half + 8, (unsigned long long) (value >> 64));
+    }
+}
+
+/**
+ * Splits 16 bytes into limbs
+ * 
+ * @param  bytes 16 bytes to split
+ * @param  high_bit bit to set above the bytes, within the top limb
+ * @param  limbs buffer of 3 limbs to hold the result
+ */
+static inline void split_limbs(const unsigned char *bytes, unsigned long long high_bit, unsigned long long *limbs)
+{
+    unsigned long long t0 = load_64(bytes);
+    unsigned long long t1 = load_64(bytes + 8);
+    limbs[0] = t0 & LIMB_MASK_44;
+    limbs[1] = ((t0 >> 44) | (t1 << 20)) & LIMB_MASK_44;
+    limbs[2] = ((t1 >> 24) & LIMB_MASK_42) | high_bit;
+}
+
+/**
+ * Adds the product of two numbers in limbs to uncarried sums; limbs past
+ * 2^130 wrap around multiplied by 5
+ * 
+ * @param  d 3 uncarried sums to add to
+ * @param  a 3 limbs of the first number
+ * @param  r 3 limbs of the second number
+ */
+static inline void multiply_add(Wide *d, const unsigned long long *a, const unsigned long long *r)
+{
+    unsigned long long s1 = r[1] * (5 << 2), s2 = r[2] * (5 << 2);
+    d[0] += (Wide) a[0] * r[0] + (Wide) a[1] * s2 + (Wide) a[2] * s1;
+    d[1] += (Wide) a[0] * r[1] + (Wide) a[1] * r[0] + (Wide) a[2] * s2;
+    d[2] += (Wide) a[0] * r[2] + (Wide) a[1] * r[1] + (Wide) a[2] * r[0];
+}
+
+/**
+ * Carries uncarried sums back into limbs
+ * 
+ * @param  d 3 uncarried sums
+ * @param  h 3 limbs to hold the result
+ */
+static inline void carry_limbs(Wide *d, unsigned long long *h)
+{
+    unsigned long long c = (unsigned long long) (d[0] >> 44);
+    h[0] = (unsigned long long) d[0] & LIMB_MASK_44;
+    d[1] += c;
+    c = (unsigned long long) (d[1] >> 44);
+    h[1] = (unsigned long long) d[1] & LIMB_MASK_44;
+    d[2] += c;
+    c = (unsigned long long) (d[2] >> 42);
+    h[2] = (unsigned long long) d[2] & LIMB_MASK_42;
+    h[0] += c * 5;
+    c = h[0] >> 44;
+    h[0] &= LIMB_MASK_44;
+    h[1] += c;
+}
+
+void init_mac(struct Mac *mac, const unsigned char *key)
+{
+    // Clamp r and split it into limbs
+    unsigned long long t0 = load_64(key);
+    unsigned long long t1 = load_64(key + 8);
+    mac->r[0][0] = t0 & 0xffc0fffffffULL;
+    mac->r[0][1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    mac->r[0][2] = (t1 >> 24) & 0x00ffffffc0fULL;
+
+    // Compute r^2, r^3, and r^4 so that four blocks can be multiplied at once
+    for (int power = 1; power < MAC_LANES; power++)
+    {
+        Wide d[3] = { 0, 0, 0 };
+        multiply_add(d, mac->r[power - 1], mac->r[0]);
+        carry_limbs(d, mac->r[power]);
+    }
+
+    mac->h[0] = mac->h[1] = mac->h[2] = 0;
+    mac->pad[0] = load_64(key + 16);
+    mac->pad[1] = load_64(key + 24);
+    mac->n_buffered = 0;
+}
+
+/**
+ * Adds a group of MAC_LANES whole blocks to an accumulator as
+ * h = (h + m1) * r^4 + m2 * r^3 + m3 * r^2 + m4 * r mod 2^130 - 5,
+ * so only one of the four multiplications waits for the one before.
+ * It is always inlined, so the kernels keep the accumulator in registers.
+ * 
+ * @param  mac computation holding the powers of r
+ * @param  h 3 limbs of the accumulator to add to
+ * @param  bytes MAC_GROUP_SIZE bytes to add
+ * @param  high_bit bit to set above each block, within the top limb
+ */
+__attribute__((always_inline))
+static inline void absorb_group(const struct Mac *mac, unsigned long long *h, const unsigned char *bytes,
+                                unsigned long long high_bit)
+{
+    Wide d[3] = { 0, 0, 0 };
+    unsigned long long m[3];
+    split_limbs(bytes, high_bit, m);
+    h[0] += m[0];
+    h[1] += m[1];
+    h[2] += m[2];
+    multiply_add(d, h, mac->r[MAC_LANES - 1]);
+    for (int lane = 1; lane < MAC_LANES; lane++)
+    {
+        split_limbs(bytes + 16 * lane, high_bit, m);
+        multiply_add(d, m, mac->r[MAC_LANES - 1 - lane]);
+    }
+    carry_limbs(d, h);
+}
+
+/**
+ * Adds whole 16-byte blocks to the accumulator: h = (h + block) * r mod 2^130 - 5
+ * 
+ * @param  mac computation to add to
+ * @param  bytes blocks to add
+ * @param  length number of bytes to add, a multiple of 16
+ * @param  high_bit BLOCK_HIGH_BIT for whole blocks; 0 for the padded last block
+ */
+static void absorb_blocks(struct Mac *mac, const unsigned char *bytes, long long length, unsigned long long high_bit)
+{
+    unsigned long long h[3] = { mac->h[0], mac->h[1], mac->h[2] };
+    unsigned long long m[3];
+    long long i = 0;
+
+    // Absorb a group of blocks at a time
+    for (; i + MAC_GROUP_SIZE <= length; i += MAC_GROUP_SIZE)
+        absorb_group(mac, h, bytes + i, high_bit);
+
+    // Absorb the remaining blocks one at a time
+    for (; i < length; i += 16)
+    {
+        Wide d[3] = { 0, 0, 0 };
+        split_limbs(bytes + i, high_bit, m);
+        h[0] += m[0];
+        h[1] += m[1];
+        h[2] += m[2];
+        multiply_add(d, h, mac->r[0]);
+        carry_limbs(d, h);
+    }
+
+    mac->h[0] = h[0];
+    mac->h[1] = h[1];
+    mac->h[2] = h[2];
+}
+
+void update_mac(struct Mac *mac, const char *bytes, long long length)
+{
+    const unsigned char *next = (const unsigned char *) bytes;
+
+    // Complete a partly buffered block first
+    if (mac->n_buffered > 0)
+    {
+        long long n = 16 - mac->n_buffered < length ? 16 - mac->n_buffered : length;
+        memcpy(mac->buffer + mac->n_buffered, next, n);
+        mac->n_buffered += n;
+        next += n;
+        length -= n;
+        if (mac->n_buffered < 16)
+            return;
+        absorb_blocks(mac, mac->buffer, 16, BLOCK_HIGH_BIT);
+        mac->n_buffered = 0;
+    }
+
+    // Absorb whole blocks in place and buffer the rest
+    long long whole = length & ~15LL;
+    absorb_blocks(mac, next, whole, BLOCK_HIGH_BIT);
+    memcpy(mac->buffer, next + whole, length - whole);
+    mac->n_buffered = length - whole;
+}
+
+void finish_mac(struct Mac *mac, unsigned char *tag)
+{
+    // Pad the last partial block with a 1 byte and zeros
+    if (mac->n_buffered > 0)
+    {
+        mac->buffer[mac->n_buffered] = 1;
+        memset(mac->buffer + mac->n_buffered + 1, 0, 16 - mac->n_buffered - 1);
+        absorb_blocks(mac, mac->buffer, 16, 0);
+    }
+
+    // Carry the accumulator fully
+    unsigned long long h0 = mac->h[0], h1 = mac->h[1], h2 = mac->h[2];
+    unsigned long long c = h1 >> 44;
+    h1 &= LIMB_MASK_44;
+    h2 += c;
+    c = h2 >> 42;
+    h2 &= LIMB_MASK_42;
+    h0 += c * 5;
+    c = h0 >> 44;
+    h0 &= LIMB_MASK_44;
+    h1 += c;
+    c = h1 >> 44;
+    h1 &= LIMB_MASK_44;
+    h2 += c;
+    c = h2 >> 42;
+    h2 &= LIMB_MASK_42;
+    h0 += c * 5;
+    c = h0 >> 44;
+    h0 &= LIMB_MASK_44;
+    h1 += c;
+
+    // Compute h - p, and keep it instead of h if it did not go negative
+    unsigned long long g0 = h0 + 5;
+    c = g0 >> 44;
+    g0 &= LIMB_MASK_44;
+    unsigned long long g1 = h1 + c;
+    c = g1 >> 44;
+    g1 &= LIMB_MASK_44;
+    unsigned long long g2 = h2 + c - (1ULL << 42);
+    unsigned long long keep_g = (g2 >> 63) - 1;
+    h0 = (h0 & ~keep_g) | (g0 & keep_g);
+    h1 = (h1 & ~keep_g) | (g1 & keep_g);
+    h2 = (h2 & ~keep_g) | (g2 & keep_g);
+
+    // Add s mod 2^128
+    unsigned long long t0 = mac->pad[0], t1 = mac->pad[1];
+    h0 += t0 & LIMB_MASK_44;
+    c = h0 >> 44;
+    h0 &= LIMB_MASK_44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & LIMB_MASK_44) + c;
+    c = h1 >> 44;
+    h1 &= LIMB_MASK_44;
+    h2 += ((t1 >> 24) & LIMB_MASK_42) + c;
+    h2 &= LIMB_MASK_42;
+
+    store_64(tag, h0 | (h1 << 44));
+    store_64(tag + 8, (h1 >> 20) | (h2 << 24));
+
+    // Erase the key
+    memset(mac, 0, sizeof(*mac));
+}
+
+// Defines the authenticated kernels of one entry of ALPHABETS, which transform and hash
+// a number of symbols that is a multiple of MAC_GROUP_SIZE, one group at a time.
+// Each group's transform is unrolled so its lookups are not held up by loop overhead.
+#define DEFINE_AUTHENTICATED_KERNELS(name, symbols) \
+    static void encrypt_authenticated_##name(struct Args args, long long length, struct Mac *mac) \
+    { \
+        unsigned long long h[3] = { mac->h[0], mac->h[1], mac->h[2] }; \
+        for (long long i = 0; i < length; i += MAC_GROUP_SIZE) \
+        { \
+            _Pragma("GCC unroll 64") \
+            for (long long j = i; j < i + MAC_GROUP_SIZE; j++) \
+                args.ciphertext[j] = ADD_SYMBOLS(name, args.plaintext[j], args.key[j]); \
+            absorb_group(mac, h, (const unsigned char *) args.ciphertext + i, BLOCK_HIGH_BIT); \
+        } \
+        mac->h[0] = h[0]; \
+        mac->h[1] = h[1]; \
+        mac->h[2] = h[2]; \
+    } \
+    \
+    static void decrypt_verified_##name(struct Args args, long long length, struct Mac *mac) \
+    { \
+        unsigned long long h[3] = { mac->h[0], mac->h[1], mac->h[2] }; \
+        for (long long i = 0; i < length; i += MAC_GROUP_SIZE) \
+        { \
+            absorb_group(mac, h, (const unsigned char *) args.ciphertext + i, BLOCK_HIGH_BIT); \
+            _Pragma("GCC unroll 64") \
+            for (long long j = i; j < i + MAC_GROUP_SIZE; j++) \
+                args.plaintext[j] = SUBTRACT_SYMBOLS(name, args.ciphertext[j], args.key[j]); \
+        } \
+        mac->h[0] = h[0]; \
+        mac->h[1] = h[1]; \
+        mac->h[2] = h[2]; \
+    }
+
+ALPHABETS(DEFINE_AUTHENTICATED_KERNELS)
+
+// Object to hold the authenticated kernels of one alphabet
+struct AuthenticatedKernels
+{
+    void (*encrypt)(struct Args, long long, struct Mac *);     // encrypts and hashes whole groups
+    void (*decrypt)(struct Args, long long, struct Mac *);     // hashes and decrypts whole groups
+};
+
+// Describes the authenticated kernels of one entry of ALPHABETS
+#define DESCRIBE_AUTHENTICATED_KERNELS(name, symbols) { encrypt_authenticated_##name, decrypt_verified_##name },
+
+// Authenticated kernels of every alphabet, in the order of ALPHABETS
+static const struct AuthenticatedKernels authenticated_kernels[] = { ALPHABETS(DESCRIBE_AUTHENTICATED_KERNELS) };
+
+void encrypt_authenticated(const struct Alphabet *alphabet, struct Args args, long long length,
+                           const unsigned char *key, unsigned char *tag)
+{
+    struct Mac mac;
+    init_mac(&mac, key);
+
+    // Encrypt and hash whole groups together, then the rest one after the other
+    long long whole = length - length % MAC_GROUP_SIZE;
+    authenticated_kernels[alphabet - alphabets].encrypt(args, whole, &mac);
+    struct Args rest = { args.plaintext + whole, args.key + whole, args.ciphertext + whole };
+    alphabet->encrypt(rest, length - whole);
+    update_mac(&mac, rest.ciphertext, length - whole);
+    finish_mac(&mac, tag);
+}
+
+bool decrypt_verified(const struct Alphabet *alphabet, struct Args args, long long length,
+                      const unsigned char *key, const unsigned char *tag)
+{
+    struct Mac mac;
+    init_mac(&mac, key);
+
+    // Hash and decrypt whole groups together, then the rest one after the other
+    long long whole = length - length % MAC_GROUP_SIZE;
+    authenticated_kernels[alphabet - alphabets].decrypt(args, whole, &mac);
+    struct Args rest = { args.plaintext + whole, args.key + whole, args.ciphertext + whole };
+    update_mac(&mac, rest.ciphertext, length - whole);
+    alphabet->decrypt(rest, length - whole);
+
+    // Never hand out plaintext of forged ciphertext
+    unsigned char expected[MAC_TAG_SIZE];
+    finish_mac(&mac, expected);
+    if (tags_equal(expected, tag))
+        return true;
+    memset(args.plaintext, 0, length);
+    return false;
+}
+
+bool tags_equal(const unsigned char *a, const unsigned char *b)
+{
+    unsigned char difference = 0;
+    for (int i = 0; i < MAC_TAG_SIZE; i++)
+        difference |= a[i] ^ b[i];
+    return difference == 0;
+}
+
+void encode_tag(const struct Alphabet *alphabet, const unsigned char *tag, char *symbols)
+{
+    Wide value = (Wide) load_64(tag + 8) << 64 | load_64(tag);
+    for (int i = MAC_TAG_SYMBOLS - 1; i >= 0; i--)
+    {
+        symbols[i] = alphabet->symbols[value % alphabet->size];
+        value /= alphabet->size;
+    }
+}
+
+bool decode_tag(const struct Alphabet *alphabet, const char *symbols, unsigned char *tag)
+{
+    // Read the symbols as a number, rejecting symbols and numbers that no tag is written as
+    Wide value = 0;
+    Wide limit = ~(Wide) 0;
+    for (int i = 0; i < MAC_TAG_SYMBOLS; i++)
+    {
+        unsigned char index = alphabet->indices[(unsigned char) symbols[i]];
+        if (index == ALPHABET_INVALID || value > (limit - index) / alphabet->size)
+            return false;
+        value = value * alphabet->size + index;
+    }
+    store_64(tag, (unsigned long long) value);
+    store_64(tag + 8, (unsigned long long) (value >> 64));
+    return true;
+}
+
+void format_tag(const unsigned char *tag, char *hex)
+{
+    for (int i = 0; i < MAC_TAG_SIZE; i++)
+        sprintf(hex + 2 * i, "%02x", tag[i]);
+}
+
+bool parse_tag(const char *hex, unsigned char *tag)
+{
+    // Accept exactly two lowercase hexadecimal digits per byte
+    if (strlen(hex) != 2 * MAC_TAG_SIZE || strspn(hex, "0123456789abcdef") != 2 * MAC_TAG_SIZE)
+        return false;
+    for (int i = 0; i < MAC_TAG_SIZE; i++)
+    {
+        unsigned int byte;
+        sscanf(hex + 2 * i, "%2x", &byte);
+        tag[i] = byte;
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+/**
+ * @file mac.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for mac.c
+ */
+
+#ifndef MAC
+#define MAC
+
+// Number of bytes in a one-time MAC key: r, then s, as in Poly1305
+#define MAC_KEY_SIZE 32
+
+// Number of bytes in a tag
+#define MAC_TAG_SIZE 16
+
+// Number of key symbols a MAC key is derived from: half for r, half for s.
+// 48 symbols of any alphabet hold well over 128 bits, so each half is uniform to within 2^-100.
+#define MAC_KEY_SYMBOLS 96
+
+// Number of symbols a tag is written as: 27 symbols of 27 or more values hold 128 bits
+#define MAC_TAG_SYMBOLS 27
+
+// Number of blocks absorbed at a time, each multiplied by its own power of r
+#define MAC_LANES 4
+
+// Number of symbols an authenticated kernel transforms and hashes at a time: one block per lane
+#define MAC_GROUP_SIZE (16 * MAC_LANES)
+
+// Object to hold the state of one Poly1305 computation
+struct Mac
+{
+    unsigned long long r[MAC_LANES][3];     // r, r^2, ... in 44-, 44-, and 42-bit limbs; r is clamped
+    unsigned long long h[3];                // accumulator, in the same limbs
+    unsigned long long pad[2];              // s, added to the accumulator at the end
+    unsigned char buffer[16];               // bytes not yet making up a whole block
+    int n_buffered;                         // number of bytes in buffer
+};
+
+/**
+ * Derives a MAC key from key symbols. Each half of the symbols is read as a
+ * number in base alphabet->size and reduced mod 2^128.
+ * 
+ * @param  alphabet alphabet of the key symbols
+ * @param  symbols MAC_KEY_SYMBOLS key symbols
+ * @param  key buffer of MAC_KEY_SIZE bytes to hold the derived key
+ */
+void derive_mac_key(const struct Alphabet *, const char *, unsigned char *);
+
+/**
+ * Starts a MAC computation
+ * 
+ * @param  mac object to initialize
+ * @param  key MAC_KEY_SIZE bytes of one-time key
+ */
+void init_mac(struct Mac *, const unsigned char *);
+
+/**
+ * Adds bytes to a MAC computation
+ * 
+ * @param  mac computation to add to
+ * @param  bytes bytes to add
+ * @param  length number of bytes to add
+ */
+void update_mac(struct Mac *, const char *, long long);
+
+/**
+ * Finishes a MAC computation
+ * 
+ * @param  mac computation to finish
+ * @param  tag buffer of MAC_TAG_SIZE bytes to hold the tag
+ */
+void finish_mac(struct Mac *, unsigned char *);
+
+/**
+ * Encrypts plaintext and computes the tag of the ciphertext in one pass.
+ * Each group of MAC_GROUP_SIZE symbols is hashed as soon as it is encrypted.
+ * 
+ * @param  alphabet alphabet of the symbols
+ * @param  args object holding plaintext, key, and ciphertext
+ * @param  length number of symbols to encrypt
+ * @param  key MAC_KEY_SIZE bytes of MAC key
+ * @param  tag buffer of MAC_TAG_SIZE bytes to hold the tag
+ */
+void encrypt_authenticated(const struct Alphabet *, struct Args, long long, const unsigned char *, unsigned char *);
+
+/**
+ * Decrypts ciphertext and verifies its tag in one pass. Each group of
+ * MAC_GROUP_SIZE symbols is hashed right before it is decrypted. If the tag
+ * does not match, the plaintext is erased.
+ * 
+ * @param  alphabet alphabet of the symbols
+ * @param  args object holding ciphertext, key, and plaintext
+ * @param  length number of symbols to decrypt
+ * @param  key MAC_KEY_SIZE bytes of MAC key
+ * @param  tag MAC_TAG_SIZE bytes of the tag to verify
+ * 
+ * @return true if the tag matches the ciphertext, else false
+ */
+bool decrypt_verified(const struct Alphabet *, struct Args, long long, const unsigned char *, const unsigned char *);
+
+/**
+ * Compares two tags in time that does not depend on where they differ
+ * 
+ * @param  a first tag
+ * @param  b second tag
+ * 
+ * @return true if the tags are equal, else false
+ */
+bool tags_equal(const unsigned char *, const unsigned char *);
+
+/**
+ * Writes a tag as MAC_TAG_SYMBOLS symbols of an alphabet, most significant first
+ * 
+ * @param  alphabet alphabet to write the tag in
+ * @param  tag MAC_TAG_SIZE bytes of tag
+ * @param  symbols buffer of MAC_TAG_SYMBOLS symbols to hold the tag
+ */
+void encode_tag(const struct Alphabet *, const unsigned char *, char *);
+
+/**
+ * Reads a tag written by encode_tag()
+ * 
+ * @param  alphabet alphabet the tag is written in
+ * @param  symbols MAC_TAG_SYMBOLS symbols of the tag
+ * @param  tag buffer of MAC_TAG_SIZE bytes to hold the tag
+ * 
+ * @return true if the symbols hold a tag, else false
+ */
+bool decode_tag(const struct Alphabet *, const char *, unsigned char *);
+
+/**
+ * Writes a tag as hexadecimal, as it is carried in a header
+ * 
+ * @param  tag MAC_TAG_SIZE bytes of tag
+ * @param  hex buffer of 2 * MAC_TAG_SIZE + 1 characters to hold the hexadecimal string
+ */
+void format_tag(const unsigned char *, char *);
+
+/**
+ * Reads a tag written by format_tag()
+ * 
+ * @param  hex hexadecimal string of the tag
+ * @param  tag buffer of MAC_TAG_SIZE bytes to hold the tag
+ * 
+ * @return true if hex holds exactly one tag, else false
+ */
+bool parse_tag(const char *, unsigned char *);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,104 @@
+/**
+ * @file mkalphabets.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Generates the lookup tables of every alphabet in ALPHABETS and writes them
+ * to stdout as C source. compileall runs it to produce alphabet_tables.h,
+ * so the tables are constants that each alphabet's kernels are compiled against.
+ * 
+ * Each alphabet gets three tables and a constant:
+ *   NAME_indices      index of every byte value, or ALPHABET_INVALID
+ *   NAME_reduced      symbols[i % size] for every i in the table, so a sum of
+ *                     two indices looks up the symbol of the sum mod size
+ *   NAME_bias         smallest multiple of size not below ALPHABET_INVALID;
+ *                     a difference of two indices is looked up after adding
+ *                     it, so one table serves both directions
+ *   NAME_key_symbols  symbol of every random byte, or 0 for the bytes above
+ *                     the largest multiple of size, which are rejected so
+ *                     that every symbol is equally likely
+ * The reduced table is large enough that even the indices of invalid bytes
+ * stay within it, so a bad key yields garbage rather than a stray read.
+ * 
+ * Usage: mkalphabets > alphabet_tables.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "otp.h"
+#include "alphabet.h"
+
+// Number of entries in a reduced table: covers the sum of two invalid indices
+#define REDUCED_TABLE_SIZE (4 * ALPHABET_INVALID)
+
+// Number of table entries printed per line
+#define ENTRIES_PER_LINE 16
+
+/**
+ * Prints a table of bytes as a static C array
+ * 
+ * @param  name name of the alphabet the table belongs to
+ * @param  suffix name of the table, appended to the alphabet's name
+ * @param  type element type of the array
+ * @param  values values of the table
+ * @param  n_values number of values
+ */
+static void print_table(const char *name, const char *suffix, const char *type, const unsigned char *values, int n_values)
+{
+    printf("static const %s %s_%s[%d] =\n{", type, name, suffix, n_values);
+    for (int i = 0; i < n_values; i++)
+        printf("%s%3d,", i % ENTRIES_PER_LINE == 0 ? "\n    " : " ", values[i]);
+    printf("\n};\n\n");
+}
+
+/**
+ * Prints the lookup tables of one alphabet
+ * 
+ * @param  name name of the alphabet
+ * @param  symbols symbols of the alphabet in index order
+ */
+static void print_tables(const char *name, const char *symbols)
+{
+    int size = strlen(symbols);
+    unsigned char indices[256];
+    unsigned char reduced[REDUCED_TABLE_SIZE];
+    unsigned char key_symbols[256];
+
+    // Map every byte to its index, marking those that are not symbols
+    memset(indices, ALPHABET_INVALID, sizeof(indices));
+    for (int i = 0; i < size; i++)
+        indices[(unsigned char) symbols[i]] = i;
+
+    // Map every sum of two indices to the symbol of the sum mod size
+    for (int i = 0; i < REDUCED_TABLE_SIZE; i++)
+        reduced[i] = symbols[i % size];
+    int bias = (ALPHABET_INVALID + size - 1) / size * size;
+
+    // Map every random byte below the largest multiple of size to a symbol
+    int limit = 256 - 256 % size;
+    for (int i = 0; i < 256; i++)
+        key_symbols[i] = i < limit ? symbols[i % size] : 0;
+
+    printf("// Alphabet \"%s\": %d symbols\n", name, size);
+    print_table(name, "indices", "unsigned char", indices, 256);
+    print_table(name, "reduced", "char", reduced, REDUCED_TABLE_SIZE);
+    printf("static const int %s_bias = %d;\n\n", name, bias);
+    print_table(name, "key_symbols", "char", key_symbols, 256);
+}
+
+// Prints the tables of one entry of ALPHABETS
+#define PRINT_TABLES(name, symbols) print_tables(#name, symbols);
+
+int main()
+{
+    printf("// Generated by mkalphabets; do not edit\n\n");
+    printf("#ifndef ALPHABET_TABLES\n#define ALPHABET_TABLES\n\n");
+    ALPHABETS(PRINT_TABLES)
+    printf("#endif\n");
+    return 0;
+}
\ No newline at end of file
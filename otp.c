@@ -0,0 +1,153 @@
+/**
+ * @file otp.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the one-time-pad transforms shared by the servers and benchmarks.
+ * 
+ * The text transforms use the kernels of the default alphabet in alphabet.c.
+ * 
+ * The packed transforms add or subtract the 5-bit symbols of a packed group
+ * in place: alternate symbols are spread into 10-bit lanes so that each sum
+ * has room to carry, and sums of 27 or more are reduced without branching.
+ * 
+ * The binary transforms XOR whole vectors of bytes at a time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "otp.h"
+#include "alphabet.h"
+#include "packed.h"
+
+void encrypt(struct Args args)
+{
+    DEFAULT_ALPHABET->encrypt(args, strlen(args.plaintext));
+}
+
+void decrypt(struct Args args)
+{
+    DEFAULT_ALPHABET->decrypt(args, strlen(args.ciphertext));
+}
+
+// Mask of the 5-bit symbols at bits 0, 10, 20, and 30 of a packed group
+#define EVEN_SYMBOLS 0x07C1F07C1FULL
+
+// Lowest bit of each of the symbols in EVEN_SYMBOLS
+#define EVEN_SYMBOL_ONES 0x0040100401ULL
+
+/**
+ * Reduces each 10-bit lane of a word mod 27. Every lane must hold a value
+ * below 59. Adding 5 to a lane carries into its bit 5 only if the lane
+ * is 27 or more, in which case adding 5 and dropping bit 5 subtracts 27.
+ * 
+ * @param  lanes lanes to reduce
+ * 
+ * @return reduced lanes
+ */
+static inline unsigned long long reduce_lanes(unsigned long long lanes)
+{
+    unsigned long long carries = ((lanes + 5 * EVEN_SYMBOL_ONES) >> 5) & EVEN_SYMBOL_ONES;
+    return (lanes + 5 * carries) & EVEN_SYMBOLS;
+}
+
+/**
+ * Applies the one-time pad to packed symbols, one group at a time
+ * 
+ * @param  input packed symbols to transform
+ * @param  key packed key
+ * @param  output buffer to hold transformed packed symbols
+ * @param  length number of symbols to transform
+ * @param  subtract true to subtract the key (decrypt), false to add it (encrypt)
+ */
+static inline void transform_packed(const char *input, const char *key, char *output, long long length, bool subtract)
+{
+    long long size = packed_size(length);
+    for (long long i = 0; i < size; i += PACKED_GROUP_SIZE)
+    {
+        // Load groups with whole-word loads, except for the last, which has no word's worth of bytes after it
+        unsigned long long in = 0, k = 0;
+        if (i + (long long) sizeof(in) <= size)
+        {
+            memcpy(&in, input + i, sizeof(in));
+            memcpy(&k, key + i, sizeof(k));
+        }
+        else
+        {
+            memcpy(&in, input + i, PACKED_GROUP_SIZE);
+            memcpy(&k, key + i, PACKED_GROUP_SIZE);
+        }
+
+        // Combine even and odd symbols separately; subtraction adds 27 first so no lane goes negative.
+        // Masking with EVEN_SYMBOLS drops any bytes loaded past the group.
+        unsigned long long even, odd;
+        if (subtract)
+        {
+            even = (in & EVEN_SYMBOLS) + 27 * EVEN_SYMBOL_ONES - (k & EVEN_SYMBOLS);
+            odd = ((in >> 5) & EVEN_SYMBOLS) + 27 * EVEN_SYMBOL_ONES - ((k >> 5) & EVEN_SYMBOLS);
+        }
+        else
+        {
+            even = (in & EVEN_SYMBOLS) + (k & EVEN_SYMBOLS);
+            odd = ((in >> 5) & EVEN_SYMBOLS) + ((k >> 5) & EVEN_SYMBOLS);
+        }
+
+        unsigned long long out = reduce_lanes(even) | (reduce_lanes(odd) << 5);
+        memcpy(output + i, &out, PACKED_GROUP_SIZE);
+    }
+}
+
+void encrypt_packed(struct Args args, long long length)
+{
+    transform_packed(args.plaintext, args.key, args.ciphertext, length, false);
+}
+
+void decrypt_packed(struct Args args, long long length)
+{
+    transform_packed(args.ciphertext, args.key, args.plaintext, length, true);
+}
+
+// Vector of bytes XORed at once; 32 bytes fills an AVX2 register
+typedef unsigned char ByteVector __attribute__((vector_size(32)));
+
+/**
+ * XORs input bytes with key bytes, a vector at a time
+ * 
+ * @param  input bytes to transform
+ * @param  key key bytes
+ * @param  output buffer to hold transformed bytes
+ * @param  length number of bytes to transform
+ */
+__attribute__((target_clones("avx2", "default")))
+static void xor_bytes(const char *input, const char *key, char *output, long long length)
+{
+    long long i = 0;
+    for (; i + (long long) sizeof(ByteVector) <= length; i += sizeof(ByteVector))
+    {
+        ByteVector in, k;
+        memcpy(&in, input + i, sizeof(in));
+        memcpy(&k, key + i, sizeof(k));
+        in ^= k;
+        memcpy(output + i, &in, sizeof(in));
+    }
+
+    // XOR the bytes left over after the last whole vector
+    for (; i < length; i++)
+        output[i] = input[i] ^ key[i];
+}
+
+void encrypt_binary(struct Args args, long long length)
+{
+    xor_bytes(args.plaintext, args.key, args.ciphertext, length);
+}
+
+void decrypt_binary(struct Args args, long long length)
+{
+    xor_bytes(args.ciphertext, args.key, args.plaintext, length);
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/**
+ * @file otp.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for otp.c
+ */
+
+#ifndef OTP
+#define OTP
+
+// Payload formats a client can ask for in the handshake
+#define FORMAT_TEXT 0           // one byte per symbol (A-Z and space)
+#define FORMAT_PACKED 1         // 5 bits per symbol, as in packed.h
+#define FORMAT_BINARY 2         // arbitrary bytes, combined with key bytes by XOR
+
+// Capability token a client adds to its handshake to ask for binary payloads
+#define BINARY_CAPABILITY "bin"
+
+// Object to hold plaintext, key, and ciphertext
+struct Args 
+{
+    char *plaintext;
+    char *key;
+    char *ciphertext;
+};
+
+/**
+ * Encrypts plaintext using key via one-time-pad, storing ciphertext in args
+ * 
+ * @param  args object holding plaintext, key, and ciphertext
+ */
+void encrypt(struct Args);
+
+/**
+ * Decrypts ciphertext using key via one-time-pad, storing plaintext in args
+ * 
+ * @param  args object holding ciphertext, key, and plaintext
+ */
+void decrypt(struct Args);
+
+/**
+ * Encrypts packed plaintext using packed key, storing packed ciphertext in args.
+ * Works on whole groups of packed symbols without unpacking them.
+ * 
+ * @param  args object holding packed plaintext, key, and ciphertext
+ * @param  length number of symbols to encrypt
+ */
+void encrypt_packed(struct Args, long long);
+
+/**
+ * Decrypts packed ciphertext using packed key, storing packed plaintext in args.
+ * Works on whole groups of packed symbols without unpacking them.
+ * 
+ * @param  args object holding packed ciphertext, key, and plaintext
+ * @param  length number of symbols to decrypt
+ */
+void decrypt_packed(struct Args, long long);
+
+/**
+ * Encrypts arbitrary plaintext bytes by XORing them with key bytes,
+ * storing ciphertext in args
+ * 
+ * @param  args object holding plaintext, key, and ciphertext
+ * @param  length number of bytes to encrypt
+ */
+void encrypt_binary(struct Args, long long);
+
+/**
+ * Decrypts ciphertext bytes by XORing them with key bytes,
+ * storing plaintext in args
+ * 
+ * @param  args object holding ciphertext, key, and plaintext
+ * @param  length number of bytes to decrypt
+ */
+void decrypt_binary(struct Args, long long);
+
+#endif
\ No newline at end of file
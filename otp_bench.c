@@ -0,0 +1,1355 @@
+/**
+ * @file otp_bench.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Benchmarks for the performance-critical parts of the servers.
+ * 
+ * With --profile before the benchmark's name, the packed, binary, and mac
+ * benchmarks also report the cycles per byte, instructions per cycle, and
+ * cache and branch misses per KiB of each transform they time.
+ * 
+ * Usage: otp_bench ledger [-p $processes] [-n $reservations] [-j $journal]
+ *        otp_bench reuse [-s $megabytes] [-n $rounds]
+ *        otp_bench keygen [-s $megabytes] [-t $threads]
+ *        otp_bench [--profile] packed [-s $megabytes] [-n $rounds]
+ *        otp_bench [--profile] binary [-s $megabytes] [-n $rounds]
+ *        otp_bench alphabet [-s $megabytes] [-n $rounds]
+ *        otp_bench compress [-s $megabytes] [-f $plaintext]
+ *        otp_bench [--profile] mac [-s $megabytes] [-n $rounds]
+ *        otp_bench [--profile] kernels [-s $minsize] [-S $maxsize] [-f $factor] [-r $repetitions] [-w $warmups]
+ *                                      [-t $ms] [-l $ms] [-c $cpu] [-k $kernel[,$kernel...]]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "pad_store.h"
+#include "csprng.h"
+#include "ledger.h"
+#include "packed.h"
+#include "otp.h"
+#include "alphabet.h"
+#include "compress.h"
+#include "mac.h"
+#include "reuse.h"
+#include "profile.h"
+#include "otp_bench.h"
+#include "util.h"
+
+// Counters of the sections the benchmarks time, if run with --profile
+struct Profile profile;
+
+// Counters as the section being timed started
+static long long section_counts[N_COUNTERS];
+
+int main(int argc, char **argv)
+{
+    // Profile the sections each benchmark times, if asked; the benchmark runs without profiling if not permitted
+    if (argc >= 2 && strcmp(argv[1], "--profile") == 0)
+    {
+        open_profile(&profile, "otp_bench", 1);
+        argc--;
+        argv++;
+    }
+
+    // Verify that a benchmark was named
+    if (argc < 2)
+    {
+        fprintf(stderr, "Error: missing benchmark name\n");
+        fprintf(stderr, "Usage: otp_bench ledger [-p $processes] [-n $reservations] [-j $journal]\n");
+        fprintf(stderr, "       otp_bench reuse [-s $megabytes] [-n $rounds]\n");
+        fprintf(stderr, "       otp_bench keygen [-s $megabytes] [-t $threads]\n");
+        fprintf(stderr, "       otp_bench [--profile] packed [-s $megabytes] [-n $rounds]\n");
+        fprintf(stderr, "       otp_bench [--profile] binary [-s $megabytes] [-n $rounds]\n");
+        fprintf(stderr, "       otp_bench alphabet [-s $megabytes] [-n $rounds]\n");
+        fprintf(stderr, "       otp_bench compress [-s $megabytes] [-f $plaintext]\n");
+        fprintf(stderr, "       otp_bench [--profile] mac [-s $megabytes] [-n $rounds]\n");
+        fprintf(stderr, "       otp_bench [--profile] kernels [-s $minsize] [-S $maxsize] [-f $factor] [-r $repetitions] "
+                        "[-w $warmups] [-t $ms] [-l $ms] [-c $cpu] [-k $kernel[,$kernel...]]\n");
+        return EXIT_FAILURE;
+    }
+
+    // Run the named benchmark
+    if (strcmp(argv[1], "ledger") == 0)
+        return bench_ledger(argc - 1, argv + 1);
+    if (strcmp(argv[1], "reuse") == 0)
+        return bench_reuse(argc - 1, argv + 1);
+    if (strcmp(argv[1], "keygen") == 0)
+        return bench_keygen(argc - 1, argv + 1);
+    if (strcmp(argv[1], "packed") == 0)
+        return bench_packed(argc - 1, argv + 1);
+    if (strcmp(argv[1], "binary") == 0)
+        return bench_binary(argc - 1, argv + 1);
+    if (strcmp(argv[1], "alphabet") == 0)
+        return bench_alphabet(argc - 1, argv + 1);
+    if (strcmp(argv[1], "compress") == 0)
+        return bench_compress(argc - 1, argv + 1);
+    if (strcmp(argv[1], "mac") == 0)
+        return bench_mac(argc - 1, argv + 1);
+    if (strcmp(argv[1], "kernels") == 0)
+        return bench_kernels(argc - 1, argv + 1);
+
+    fprintf(stderr, "Error: unknown benchmark: %s\n", argv[1]);
+    return EXIT_FAILURE;
+}
+
+/**
+ * Starts timing a section of a benchmark, reading the counters if profiling
+ * 
+ * @return the time the section started
+ */
+static long long start_section(void)
+{
+    read_counters(&profile, section_counts);
+    return monotonic_ns();
+}
+
+/**
+ * Finishes timing a section of a benchmark, adding its counters to the
+ * profile if profiling
+ * 
+ * @param  section index of the section in the benchmark's profile
+ * @param  bytes bytes the section worked on
+ * @param  start_ns time the section started
+ * 
+ * @return the time the section took
+ */
+static long long finish_section(int section, long long bytes, long long start_ns)
+{
+    long long elapsed_ns = monotonic_ns() - start_ns;
+    long long counts[N_COUNTERS];
+    read_counters(&profile, counts);
+    add_profile(&profile, section, bytes, section_counts, counts);
+    return elapsed_ns;
+}
+
+int bench_ledger(int argc, char **argv)
+{
+    int n_processes = 4;
+    long long n_reservations = 250000;
+    char *journal_path = "otp_bench.journal";
+
+    // Parse options
+    int opt;
+    while ((opt = getopt(argc, argv, "p:n:j:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p': n_processes = atoi(optarg); break;
+            case 'n': n_reservations = atoll(optarg); break;
+            case 'j': journal_path = optarg; break;
+            default: return EXIT_FAILURE;
+        }
+    }
+
+    // Create a pad large enough that it is never exhausted
+    struct Pad pad = { id: "bench", symbols: NULL, length: 1LL << 60 };
+    struct PadStore store = { pads: &pad, n_pads: 1 };
+
+    // Start from an empty journal
+    unlink(journal_path);
+    struct Ledger ledger;
+    if (!open_ledger(&ledger, &store, journal_path))
+        return EXIT_FAILURE;
+
+    // Fork processes that each reserve ranges as fast as they can
+    long long start = monotonic_ns();
+    for (int i = 0; i < n_processes; i++)
+    {
+        if (fork() == 0)
+        {
+            long long token;
+            for (long long j = 0; j < n_reservations; j++)
+            {
+                if (reserve_pad_range(&ledger, &pad, 64, &token) < 0)
+                    exit(EXIT_FAILURE);
+            }
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    // Wait for every process to finish
+    bool success = true;
+    int status;
+    while (wait(&status) > 0)
+        success = success && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    double seconds = (monotonic_ns() - start) / 1e9;
+
+    // Report throughput and how well syncs were batched
+    long long total = n_processes * n_reservations;
+    long long n_flushes = ledger.shared->n_flushes;
+    printf("ledger: %d processes, %lld reservations in %.3f s\n", n_processes, total, seconds);
+    printf("ledger: %.0f reservations/s, %lld journal syncs, %.1f reservations per sync\n",
+           total / seconds, n_flushes, n_flushes > 0 ? (double) total / n_flushes : 0.0);
+    printf("ledger: high-water mark %lld (expected %lld)\n", get_pad_high_water_mark(&ledger, &pad), total * 64);
+
+    unlink(journal_path);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Fills a buffer with random symbols
+ * 
+ * @param  buffer buffer to fill
+ * @param  length number of symbols to write
+ */
+static void fill_random_symbols(char *buffer, long long length)
+{
+    for (long long i = 0; i < length; i++)
+    {
+        int value = random() % 27;
+        buffer[i] = value == 0 ? ' ' : value + 64;
+    }
+}
+
+int bench_reuse(int argc, char **argv)
+{
+    long long size = 64;
+    int n_rounds = 4;
+
+    // Parse options
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size = atoll(optarg); break;
+            case 'n': n_rounds = atoi(optarg); break;
+            default: return EXIT_FAILURE;
+        }
+    }
+    size *= 1048576;
+
+    // Create random plaintext and key, encrypted one client chunk at a time
+    struct Args args;
+    args.plaintext = (char *) malloc(size);
+    args.key = (char *) malloc(size);
+    args.ciphertext = NULL;
+    fill_random_symbols(args.plaintext, size);
+    fill_random_symbols(args.key, size);
+    long long n_chunks = size / CHUNK_SIZE;
+
+    struct ReuseDetector detector;
+    if (!open_reuse_detector(&detector))
+        return EXIT_FAILURE;
+
+    // Buffers a chunk is copied into before each measurement, as the server reads a payload
+    struct Args work;
+    work.plaintext = (char *) malloc(CHUNK_SIZE);
+    work.key = (char *) malloc(CHUNK_SIZE);
+    work.ciphertext = (char *) malloc(CHUNK_SIZE);
+
+    // Time each chunk with and without the detector, starting from the same cache state.
+    // After the first round every chunk is a retransmission, which must not be reported.
+    long long encrypt_ns = 0, detect_ns = 0;
+    long long n_reported = 0;
+    for (int round = 0; round < n_rounds; round++)
+    {
+        for (long long i = 0; i < n_chunks; i++)
+        {
+            memcpy(work.plaintext, args.plaintext + i * CHUNK_SIZE, CHUNK_SIZE - 1);
+            memcpy(work.key, args.key + i * CHUNK_SIZE, CHUNK_SIZE - 1);
+            work.plaintext[CHUNK_SIZE - 1] = '\0';
+            long long start = monotonic_ns();
+            encrypt(work);
+            encrypt_ns += monotonic_ns() - start;
+
+            memcpy(work.plaintext, args.plaintext + i * CHUNK_SIZE, CHUNK_SIZE - 1);
+            memcpy(work.key, args.key + i * CHUNK_SIZE, CHUNK_SIZE - 1);
+            start = monotonic_ns();
+            if (check_key_reuse(&detector, work.plaintext, work.key, i * CHUNK_SIZE, CHUNK_SIZE - 1) > 0)
+                n_reported++;
+            encrypt(work);
+            detect_ns += monotonic_ns() - start;
+        }
+    }
+
+    // Encrypt different plaintext with the first chunk's key, which must be reported
+    fill_random_symbols(args.plaintext, CHUNK_SIZE - 1);
+    int n_suspicious = check_key_reuse(&detector, args.plaintext, args.key, 0, CHUNK_SIZE - 1);
+
+    // Report throughput with and without the detector
+    double encrypt_rate = (double) n_rounds * n_chunks * CHUNK_SIZE / encrypt_ns * 1e3;
+    double detect_rate = (double) n_rounds * n_chunks * CHUNK_SIZE / detect_ns * 1e3;
+    printf("reuse: %d rounds of %lld MiB in %d-symbol chunks\n", n_rounds, size / 1048576, CHUNK_SIZE);
+    printf("reuse: encrypt %.1f MB/s, encrypt with detector %.1f MB/s, overhead %.2f%%\n",
+           encrypt_rate, detect_rate, 100.0 * (detect_ns - encrypt_ns) / encrypt_ns);
+    printf("reuse: %lld retransmitted chunks reported (expected 0), reused chunk has %d suspicious blocks (expected %d)\n",
+           n_reported, n_suspicious,
+           REUSE_DENSE_BLOCKS + (CHUNK_SIZE - REUSE_BLOCK_SIZE - 1) / (REUSE_BLOCK_SIZE * REUSE_SAMPLE_INTERVAL));
+
+    free(args.plaintext);
+    free(args.key);
+    free(work.plaintext);
+    free(work.key);
+    free(work.ciphertext);
+    return n_reported == 0 && n_suspicious > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int bench_keygen(int argc, char **argv)
+{
+    long long size = 256;
+    int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // Parse options
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size = atoll(optarg); break;
+            case 't': n_threads = atoi(optarg); break;
+            default: return EXIT_FAILURE;
+        }
+    }
+    size *= 1048576;
+
+    // Touch the buffer first so page faults are not counted
+    char *key = (char *) malloc(size);
+    memset(key, 0, size);
+    unsigned char seed[CSPRNG_SEED_SIZE];
+    if (!seed_csprng(seed))
+        return EXIT_FAILURE;
+
+    long long start = monotonic_ns();
+    bool success = generate_symbols_parallel(seed, key, size, n_threads);
+    double seconds = (monotonic_ns() - start) / 1e9;
+
+    // Check that every symbol is valid and that symbols are evenly distributed
+    long long counts[27] = {0};
+    for (long long i = 0; i < size; i++)
+    {
+        if (key[i] == ' ')
+            counts[0]++;
+        else if (key[i] >= 'A' && key[i] <= 'Z')
+            counts[key[i] - 64]++;
+        else
+            success = false;
+    }
+    double chi_squared = 0;
+    for (int i = 0; i < 27; i++)
+        chi_squared += (counts[i] - size / 27.0) * (counts[i] - size / 27.0) / (size / 27.0);
+
+    printf("keygen: %lld MiB with %d threads in %.3f s, %.1f MB/s\n", size / 1048576, n_threads, seconds, size / seconds / 1e6);
+    printf("keygen: chi-squared %.1f over 26 degrees of freedom (expected about 26)\n", chi_squared);
+
+    free(key);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int bench_packed(int argc, char **argv)
+{
+    long long size = 64;
+    int n_rounds = 4;
+
+    // Parse options
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size = atoll(optarg); break;
+            case 'n': n_rounds = atoi(optarg); break;
+            default: return EXIT_FAILURE;
+        }
+    }
+    size *= 1048576;
+
+    // Create random plaintext and key, and packed copies of them
+    struct Args args;
+    args.plaintext = (char *) malloc(size + 1);
+    args.key = (char *) malloc(size + 1);
+    args.ciphertext = (char *) malloc(size + 1);
+    fill_random_symbols(args.plaintext, size);
+    fill_random_symbols(args.key, size);
+    args.plaintext[size] = '\0';
+
+    struct Args packed;
+    long long packed_bytes = packed_size(size);
+    packed.plaintext = (char *) malloc(packed_bytes);
+    packed.key = (char *) malloc(packed_bytes);
+    packed.ciphertext = (char *) malloc(packed_bytes);
+    pack_symbols(args.plaintext, size, packed.plaintext);
+    pack_symbols(args.key, size, packed.key);
+
+    // Buffers that packing and unpacking write to
+    char *packed_scratch = (char *) malloc(packed_bytes);
+    char *unpacked_scratch = (char *) malloc(size);
+    memset(args.ciphertext, 0, size + 1);
+    memset(packed.ciphertext, 0, packed_bytes);
+    memset(packed_scratch, 0, packed_bytes);
+    memset(unpacked_scratch, 0, size);
+
+    // Time each transform over the whole buffer
+    long long encrypt_ns = 0, packed_ns = 0, pack_ns = 0, unpack_ns = 0;
+    for (int round = 0; round < n_rounds; round++)
+    {
+        long long start = start_section();
+        encrypt(args);
+        encrypt_ns += finish_section(0, size, start);
+
+        start = start_section();
+        encrypt_packed(packed, size);
+        packed_ns += finish_section(1, size, start);
+
+        start = start_section();
+        pack_symbols(args.ciphertext, size, packed_scratch);
+        pack_ns += finish_section(2, size, start);
+
+        start = start_section();
+        unpack_symbols(packed.ciphertext, size, unpacked_scratch);
+        unpack_ns += finish_section(3, size, start);
+    }
+
+    // Check that the packed transforms agree with the unpacked ones
+    bool success = memcmp(unpacked_scratch, args.ciphertext, size) == 0 &&
+                   memcmp(packed_scratch, packed.ciphertext, packed_bytes) == 0 &&
+                   validate_packed(packed.ciphertext, size);
+    decrypt_packed(packed, size);
+    pack_symbols(args.plaintext, size, packed_scratch);
+    success = success && memcmp(packed.plaintext, packed_scratch, packed_bytes) == 0;
+
+    // Report throughput in symbols per second
+    double symbols = (double) n_rounds * size * 1e3;
+    printf("packed: %d rounds of %lld MiB, %lld packed bytes (%.1f%% smaller)\n",
+           n_rounds, size / 1048576, packed_bytes, 100.0 * (size - packed_bytes) / size);
+    printf("packed: encrypt %.1f MB/s, encrypt packed %.1f MB/s, pack %.1f MB/s, unpack %.1f MB/s (symbols)\n",
+           symbols / encrypt_ns, symbols / packed_ns, symbols / pack_ns, symbols / unpack_ns);
+    printf("packed: packed transforms %s unpacked transforms\n", success ? "match" : "DO NOT MATCH");
+    const char *section_names[] = { "encrypt", "encrypt-packed", "pack", "unpack" };
+    print_profile(&profile, section_names, 4);
+
+    free(args.plaintext);
+    free(args.key);
+    free(args.ciphertext);
+    free(packed.plaintext);
+    free(packed.key);
+    free(packed.ciphertext);
+    free(packed_scratch);
+    free(unpacked_scratch);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int bench_binary(int argc, char **argv)
+{
+    long long size = 64;
+    int n_rounds = 4;
+
+    // Parse options
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size = atoll(optarg); break;
+            case 'n': n_rounds = atoi(optarg); break;
+            default: return EXIT_FAILURE;
+        }
+    }
+    size *= 1048576;
+
+    // Create random symbols for the text transform, and random bytes for the binary transform.
+    // The binary length is odd so the bytes after the last whole vector are covered.
+    struct Args text;
+    text.plaintext = (char *) malloc(size + 1);
+    text.key = (char *) malloc(size + 1);
+    text.ciphertext = (char *) malloc(size + 1);
+    fill_random_symbols(text.plaintext, size);
+    fill_random_symbols(text.key, size);
+    text.plaintext[size] = '\0';
+    memset(text.ciphertext, 0, size + 1);
+
+    struct Args binary;
+    long long binary_size = size - 1;
+    binary.plaintext = (char *) malloc(size);
+    binary.key = (char *) malloc(size);
+    binary.ciphertext = (char *) malloc(size);
+    struct Csprng rng;
+    unsigned char seed[CSPRNG_SEED_SIZE];
+    if (!seed_csprng(seed))
+        return EXIT_FAILURE;
+    init_csprng(&rng, seed, 0);
+    generate_bytes(&rng, binary.plaintext, size);
+    generate_bytes(&rng, binary.key, size);
+    memset(binary.ciphertext, 0, size);
+    char *original = (char *) malloc(size);
+    memcpy(original, binary.plaintext, size);
+
+    // Time each transform over the whole buffer
+    long long text_ns = 0, encrypt_ns = 0, decrypt_ns = 0;
+    for (int round = 0; round < n_rounds; round++)
+    {
+        long long start = start_section();
+        encrypt(text);
+        text_ns += finish_section(0, size, start);
+
+        start = start_section();
+        encrypt_binary(binary, binary_size);
+        encrypt_ns += finish_section(1, binary_size, start);
+
+        start = start_section();
+        decrypt_binary(binary, binary_size);
+        decrypt_ns += finish_section(2, binary_size, start);
+    }
+
+    // Check that decryption restored the plaintext and that encryption changed it
+    bool success = memcmp(binary.plaintext, original, binary_size) == 0 &&
+                   memcmp(binary.ciphertext, original, binary_size) != 0;
+
+    // Report throughput in bytes per second
+    double bytes = (double) n_rounds * size * 1e3;
+    printf("binary: %d rounds of %lld MiB\n", n_rounds, size / 1048576);
+    printf("binary: text encrypt %.1f MB/s, binary encrypt %.1f MB/s, binary decrypt %.1f MB/s\n",
+           bytes / text_ns, bytes / encrypt_ns, bytes / decrypt_ns);
+    printf("binary: decryption %s the plaintext\n", success ? "restores" : "DOES NOT RESTORE");
+    const char *section_names[] = { "text-encrypt", "binary-encrypt", "binary-decrypt" };
+    print_profile(&profile, section_names, 3);
+
+    free(text.plaintext);
+    free(text.key);
+    free(text.ciphertext);
+    free(binary.plaintext);
+    free(binary.key);
+    free(binary.ciphertext);
+    free(original);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Encrypts A-Z and space with arithmetic on each character, as the text
+ * transform did before it used the alphabet tables; kept as a reference
+ * 
+ * @param  args object holding plaintext, key, and ciphertext
+ * @param  length number of symbols to encrypt
+ */
+static void encrypt_arithmetic(struct Args args, long long length)
+{
+    for (long long i = 0; i < length; i++)
+    {
+        int plain_val = args.plaintext[i] == ' ' ? 0 : args.plaintext[i] - 64;
+        int key_val = args.key[i] == ' ' ? 0 : args.key[i] - 64;
+        int ciphertext_val = (plain_val + key_val) % 27;
+        args.ciphertext[i] = ciphertext_val == 0 ? ' ' : ciphertext_val + 64;
+    }
+}
+
+int bench_alphabet(int argc, char **argv)
+{
+    long long size = 64;
+    int n_rounds = 4;
+
+    // Parse options
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size = atoll(optarg); break;
+            case 'n': n_rounds = atoi(optarg); break;
+            default: return EXIT_FAILURE;
+        }
+    }
+    size *= 1048576;
+
+    struct Args args;
+    args.plaintext = (char *) malloc(size);
+    args.key = (char *) malloc(size);
+    args.ciphertext = (char *) malloc(size);
+    char *original = (char *) malloc(size);
+    char *expected = (char *) malloc(size);
+
+    struct Csprng rng;
+    unsigned char seed[CSPRNG_SEED_SIZE];
+    if (!seed_csprng(seed))
+        return EXIT_FAILURE;
+    init_csprng(&rng, seed, 0);
+
+    // Time the arithmetic reference first so each alphabet can be compared with it.
+    // The default alphabet is first, so it encrypts the same symbols as the reference.
+    fill_random_symbols(args.plaintext, size);
+    fill_random_symbols(args.key, size);
+    long long reference_ns = 0;
+    for (int round = 0; round < n_rounds; round++)
+    {
+        long long start = monotonic_ns();
+        encrypt_arithmetic(args, size);
+        reference_ns += monotonic_ns() - start;
+    }
+    memcpy(expected, args.ciphertext, size);
+
+    double bytes = (double) n_rounds * size * 1e3;
+    printf("alphabet: %d rounds of %lld MiB\n", n_rounds, size / 1048576);
+    printf("alphabet: arithmetic A-Z and space encrypt %.1f MB/s\n", bytes / reference_ns);
+
+    bool success = true;
+    for (int i = 0; i < N_ALPHABETS; i++)
+    {
+        const struct Alphabet *alphabet = &alphabets[i];
+
+        // Draw plaintext and key from the alphabet; the default alphabet keeps the reference's symbols
+        if (alphabet != DEFAULT_ALPHABET)
+        {
+            generate_bytes(&rng, args.plaintext, size);
+            generate_bytes(&rng, args.key, size);
+            for (long long i = 0; i < size; i++)
+            {
+                args.plaintext[i] = alphabet->symbols[(unsigned char) args.plaintext[i] % alphabet->size];
+                args.key[i] = alphabet->symbols[(unsigned char) args.key[i] % alphabet->size];
+            }
+        }
+        memcpy(original, args.plaintext, size);
+
+        // Time each transform over the whole buffer
+        long long encrypt_ns = 0, decrypt_ns = 0;
+        for (int round = 0; round < n_rounds; round++)
+        {
+            long long start = monotonic_ns();
+            alphabet->encrypt(args, size);
+            encrypt_ns += monotonic_ns() - start;
+
+            start = monotonic_ns();
+            alphabet->decrypt(args, size);
+            decrypt_ns += monotonic_ns() - start;
+        }
+
+        // Check that decryption restored the plaintext and that the default alphabet matches the reference
+        bool correct = memcmp(args.plaintext, original, size) == 0 &&
+                       find_invalid_symbol(alphabet, args.ciphertext, size) == NULL &&
+                       (alphabet != DEFAULT_ALPHABET || memcmp(args.ciphertext, expected, size) == 0);
+        printf("alphabet: %-10s %2d symbols: encrypt %.1f MB/s, decrypt %.1f MB/s, %s\n",
+               alphabet->name, alphabet->size, bytes / encrypt_ns, bytes / decrypt_ns,
+               correct ? "correct" : "INCORRECT");
+        success = success && correct;
+    }
+
+    free(args.plaintext);
+    free(args.key);
+    free(args.ciphertext);
+    free(original);
+    free(expected);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Fills a buffer with words drawn at random from a short list, as a stand-in
+ * for English text
+ * 
+ * @param  rng generator to draw the words with
+ * @param  buffer buffer to fill
+ * @param  length number of symbols to fill
+ */
+static void fill_random_words(struct Csprng *rng, char *buffer, long long length)
+{
+    static const char *words[] = {
+        "THE", "OF", "AND", "TO", "IN", "A", "IS", "THAT", "FOR", "IT", "AS", "WAS", "WITH", "BE", "BY",
+        "ON", "NOT", "HE", "THIS", "ARE", "OR", "HIS", "FROM", "AT", "WHICH", "BUT", "HAVE", "AN", "HAD",
+        "THEY", "YOU", "WERE", "THEIR", "ONE", "ALL", "WE", "CAN", "HER", "HAS", "THERE", "BEEN", "IF",
+        "MORE", "WHEN", "WILL", "WOULD", "WHO", "SO", "NO", "MESSAGE", "KEY", "SECRET", "SERVER", "PAD"
+    };
+    int n_words = sizeof(words) / sizeof(words[0]);
+
+    long long n = 0;
+    unsigned char draw[2];
+    while (n < length)
+    {
+        generate_bytes(rng, (char *) draw, sizeof(draw));
+        const char *word = words[(draw[0] << 8 | draw[1]) % n_words];
+        for (int i = 0; word[i] != '\0' && n < length; i++)
+            buffer[n++] = word[i];
+        if (n < length)
+            buffer[n++] = ' ';
+    }
+}
+
+int bench_compress(int argc, char **argv)
+{
+    long long size = 16;
+    const char *filename = NULL;
+
+    // Parse options
+    int opt;
+    while ((opt = getopt(argc, argv, "s:f:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size = atoll(optarg); break;
+            case 'f': filename = optarg; break;
+            default: return EXIT_FAILURE;
+        }
+    }
+    size *= 1048576;
+
+    // Read the plaintext from the file, or make up words to stand in for it
+    char *plaintext;
+    if (filename != NULL)
+    {
+        FILE *file = fopen(filename, "r");
+        if (file == NULL)
+        {
+            perror("Error: fopen()");
+            return EXIT_FAILURE;
+        }
+        plaintext = (char *) malloc(size);
+        size = fread(plaintext, 1, size, file);
+        fclose(file);
+        while (size > 0 && plaintext[size - 1] == '\n')
+            size--;
+        const char *invalid = find_invalid_symbol(DEFAULT_ALPHABET, plaintext, size);
+        if (invalid != NULL)
+        {
+            fprintf(stderr, "Error: %s contains bad character '%c'\n", filename, *invalid);
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        struct Csprng rng;
+        unsigned char seed[CSPRNG_SEED_SIZE];
+        if (!seed_csprng(seed))
+            return EXIT_FAILURE;
+        init_csprng(&rng, seed, 0);
+        plaintext = (char *) malloc(size);
+        fill_random_words(&rng, plaintext, size);
+    }
+
+    // Compress the plaintext a chunk at a time, as enc_client --compress does
+    long long n_chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    char *records = (char *) malloc(n_chunks * RECORD_HEADER_SIZE + size);
+    long long records_size = 0;
+    long long compress_ns = 0;
+    for (long long offset = 0; offset < size; offset += CHUNK_SIZE)
+    {
+        long long n = size - offset < CHUNK_SIZE ? size - offset : CHUNK_SIZE;
+        long long start = monotonic_ns();
+        records_size += compress_record(plaintext + offset, n, records + records_size);
+        compress_ns += monotonic_ns() - start;
+    }
+    long long key_used = records_size - n_chunks * RECORD_HEADER_SIZE;
+
+    // Time encrypting the payloads against encrypting the plaintext, with an all-space key
+    struct Args args;
+    args.plaintext = plaintext;
+    args.key = (char *) malloc(size);
+    args.ciphertext = (char *) malloc(size);
+    memset(args.key, ' ', size);
+    long long start = monotonic_ns();
+    DEFAULT_ALPHABET->encrypt(args, size);
+    long long encrypt_ns = monotonic_ns() - start;
+
+    // Expand every record again and check that it restores the plaintext
+    char *expanded = (char *) malloc(size);
+    long long expand_ns = 0;
+    long long expanded_size = 0;
+    bool success = true;
+    for (long long offset = 0; success && offset < records_size; )
+    {
+        char method;
+        long long length, payload_length;
+        success = parse_record_header(records + offset, &method, &length, &payload_length) &&
+                  expanded_size + length <= size;
+        start = monotonic_ns();
+        success = success && expand_record(method, records + offset + RECORD_HEADER_SIZE, payload_length,
+                                           expanded + expanded_size, length);
+        expand_ns += monotonic_ns() - start;
+        offset += RECORD_HEADER_SIZE + payload_length;
+        expanded_size += length;
+    }
+    success = success && expanded_size == size && memcmp(expanded, plaintext, size) == 0;
+
+    // Report the key saved and the throughputs in plaintext bytes per second
+    double bytes = (double) size * 1e3;
+    printf("compress: %lld symbols in %lld records\n", size, n_chunks);
+    printf("compress: %lld key symbols used, %lld saved (%.1f%%), ratio %.3f\n",
+           key_used, size - key_used, size > 0 ? 100.0 * (size - key_used) / size : 0.0,
+           size > 0 ? (double) key_used / size : 0.0);
+    printf("compress: compress %.1f MB/s, expand %.1f MB/s, encrypt %.1f MB/s\n",
+           bytes / compress_ns, bytes / expand_ns, bytes / encrypt_ns);
+    printf("compress: expansion %s the plaintext\n", success ? "restores" : "DOES NOT RESTORE");
+
+    free(plaintext);
+    free(records);
+    free(args.key);
+    free(args.ciphertext);
+    free(expanded);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int bench_mac(int argc, char **argv)
+{
+    long long size = 64;
+    int n_rounds = 4;
+
+    // Parse options
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size = atoll(optarg); break;
+            case 'n': n_rounds = atoi(optarg); break;
+            default: return EXIT_FAILURE;
+        }
+    }
+    size *= 1048576;
+
+    // Check the implementation against the test vector of RFC 8439, section 2.5.2
+    const unsigned char vector_key[MAC_KEY_SIZE] = {
+        0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+    };
+    const char *vector_message = "Cryptographic Forum Research Group";
+    unsigned char vector_tag[MAC_TAG_SIZE];
+    char vector_hex[2 * MAC_TAG_SIZE + 1];
+    struct Mac mac;
+    init_mac(&mac, vector_key);
+    update_mac(&mac, vector_message, strlen(vector_message));
+    finish_mac(&mac, vector_tag);
+    format_tag(vector_tag, vector_hex);
+    bool success = strcmp(vector_hex, "a8061dc1305136c6c22b8baf0c0127a9") == 0;
+    printf("mac: RFC 8439 test vector %s\n", success ? "matches" : "DOES NOT MATCH");
+
+    struct Args args;
+    args.plaintext = (char *) malloc(size);
+    args.key = (char *) malloc(size);
+    args.ciphertext = (char *) malloc(size);
+    char *original = (char *) malloc(size);
+    fill_random_symbols(args.plaintext, size);
+    fill_random_symbols(args.key, size);
+    memcpy(original, args.plaintext, size);
+
+    unsigned char key[MAC_KEY_SIZE];
+    char key_symbols[MAC_KEY_SYMBOLS];
+    fill_random_symbols(key_symbols, MAC_KEY_SYMBOLS);
+    derive_mac_key(DEFAULT_ALPHABET, key_symbols, key);
+
+    // Time the plain transforms, the fused ones, and transforming then hashing in a second pass
+    long long encrypt_ns = 0, decrypt_ns = 0, hash_ns = 0, fused_encrypt_ns = 0, fused_decrypt_ns = 0;
+    long long two_pass_encrypt_ns = 0, two_pass_decrypt_ns = 0;
+    unsigned char tag[MAC_TAG_SIZE], second_tag[MAC_TAG_SIZE];
+    for (int round = 0; round < n_rounds; round++)
+    {
+        long long start = start_section();
+        DEFAULT_ALPHABET->encrypt(args, size);
+        encrypt_ns += finish_section(0, size, start);
+
+        start = start_section();
+        DEFAULT_ALPHABET->decrypt(args, size);
+        decrypt_ns += finish_section(1, size, start);
+
+        start = start_section();
+        init_mac(&mac, key);
+        update_mac(&mac, args.ciphertext, size);
+        finish_mac(&mac, second_tag);
+        hash_ns += finish_section(2, size, start);
+
+        start = start_section();
+        encrypt_authenticated(DEFAULT_ALPHABET, args, size, key, tag);
+        fused_encrypt_ns += finish_section(3, size, start);
+
+        start = start_section();
+        DEFAULT_ALPHABET->encrypt(args, size);
+        init_mac(&mac, key);
+        update_mac(&mac, args.ciphertext, size);
+        finish_mac(&mac, second_tag);
+        two_pass_encrypt_ns += finish_section(6, size, start);
+        success = success && tags_equal(tag, second_tag);
+
+        start = start_section();
+        success = decrypt_verified(DEFAULT_ALPHABET, args, size, key, tag) && success;
+        fused_decrypt_ns += finish_section(4, size, start);
+
+        start = start_section();
+        DEFAULT_ALPHABET->decrypt(args, size);
+        init_mac(&mac, key);
+        update_mac(&mac, args.ciphertext, size);
+        finish_mac(&mac, second_tag);
+        two_pass_decrypt_ns += finish_section(5, size, start);
+        success = success && tags_equal(tag, second_tag);
+    }
+
+    success = success && memcmp(args.plaintext, original, size) == 0;
+
+    // A changed symbol must fail verification and leave no plaintext behind
+    args.ciphertext[size / 2] = args.ciphertext[size / 2] == 'A' ? 'B' : 'A';
+    bool forgery_rejected = !decrypt_verified(DEFAULT_ALPHABET, args, size, key, tag) && args.plaintext[0] == '\0';
+    success = success && forgery_rejected;
+
+    // Report throughput in bytes per second
+    double bytes = (double) n_rounds * size * 1e3;
+    printf("mac: %d rounds of %lld MiB\n", n_rounds, size / 1048576);
+    printf("mac: encrypt %.1f MB/s, authenticated encrypt %.1f MB/s, encrypt then hash %.1f MB/s\n",
+           bytes / encrypt_ns, bytes / fused_encrypt_ns, bytes / two_pass_encrypt_ns);
+    printf("mac: decrypt %.1f MB/s, verified decrypt %.1f MB/s, decrypt then hash %.1f MB/s\n",
+           bytes / decrypt_ns, bytes / fused_decrypt_ns, bytes / two_pass_decrypt_ns);
+    printf("mac: hash alone %.1f MB/s\n", bytes / hash_ns);
+    printf("mac: fused is %.1f%% faster than two passes to encrypt and %.1f%% to decrypt, at %.1f%% and %.1f%% of plain\n",
+           100.0 * two_pass_encrypt_ns / fused_encrypt_ns - 100, 100.0 * two_pass_decrypt_ns / fused_decrypt_ns - 100,
+           100.0 * encrypt_ns / fused_encrypt_ns, 100.0 * decrypt_ns / fused_decrypt_ns);
+    printf("mac: tags %s, forgery %s\n", success ? "verify" : "DO NOT VERIFY", forgery_rejected ? "rejected" : "ACCEPTED");
+    const char *section_names[] = { "encrypt", "decrypt", "hash", "authenticated-encrypt", "verified-decrypt",
+                                    "decrypt-then-hash", "encrypt-then-hash" };
+    print_profile(&profile, section_names, 7);
+
+    free(args.plaintext);
+    free(args.key);
+    free(args.ciphertext);
+    free(original);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Names of the kernels, as they appear in the results and after -k
+static const char *kernel_names[N_KERNELS] =
+{
+    "encrypt", "decrypt", "validate", "find_stop_indices", "send_string", "read_field"
+};
+
+// Symbols the kernels run on, cut to each size in turn, and the peer process of the socket kernels
+struct KernelInput
+{
+    struct Args args;       // random plaintext, its key, and its ciphertext, each of the largest size
+    long long size;         // size the kernels run at
+    char *cut;              // where the symbols are cut to the size; NULL if they are whole
+    int n_cut;              // number of symbols the cut replaced
+    char saved[3];          // symbols the cut replaced
+    int socket_fd;          // socket to the peer process; -1 if there is none
+    pid_t peer_pid;         // peer process, which drains or sends messages of the size
+    struct Reader reader;   // reader of the messages the peer sends
+    bool correct;           // whether every run at the size gave the expected result
+};
+
+/**
+ * Cuts the input's symbols to the size a kernel runs at, by writing stop or
+ * null characters over them, until they are restored
+ * 
+ * @param  input symbols to cut
+ * @param  at first symbol to replace
+ * @param  sentinel characters to replace the symbols with
+ * @param  n number of symbols to replace
+ */
+static void cut_input(struct KernelInput *input, char *at, const char *sentinel, int n)
+{
+    input->cut = at;
+    input->n_cut = n;
+    memcpy(input->saved, at, n);
+    memcpy(at, sentinel, n);
+}
+
+/**
+ * Restores the symbols a cut replaced
+ * 
+ * @param  input symbols to restore
+ */
+static void restore_input(struct KernelInput *input)
+{
+    if (input->cut != NULL)
+        memcpy(input->cut, input->saved, input->n_cut);
+    input->cut = NULL;
+}
+
+/**
+ * Serves a socket kernel as its peer. For send_string, drains each message
+ * and answers with a byte once it is whole; for read_field, answers each
+ * byte it is sent with a field of key symbols and a stop character.
+ * Returns once the kernel closes its socket.
+ * 
+ * @param  input symbols inherited from the benchmark, cut to the size
+ * @param  kernel kernel served
+ * @param  socket_fd socket to the kernel
+ */
+static void run_peer(struct KernelInput *input, int kernel, int socket_fd)
+{
+    char *buffer = (char *) malloc(BUFFER_SIZE);
+    char *field = input->args.key;
+    field[input->size - 1] = '@';
+    long long n_received = 0;
+    char answer = 0;
+    while (true)
+    {
+        ssize_t n_read = recv(socket_fd, buffer, BUFFER_SIZE, 0);
+        if (n_read <= 0)
+            break;
+        if (kernel == KERNEL_SEND_STRING)
+        {
+            n_received += n_read;
+            if (n_received >= input->size)
+            {
+                n_received -= input->size;
+                if (send(socket_fd, &answer, 1, 0) != 1)
+                    break;
+            }
+        }
+        else
+        {
+            for (ssize_t i = 0; i < n_read; i++)
+            {
+                if (!send_bytes(field, input->size, socket_fd))
+                    break;
+            }
+        }
+    }
+    free(buffer);
+}
+
+/**
+ * Starts the peer process of a socket kernel at the input's size
+ * 
+ * @param  input symbols to share with the peer, cut to the size
+ * @param  kernel kernel the peer serves
+ * 
+ * @return true if the peer was started, else false
+ */
+static bool start_peer(struct KernelInput *input, int kernel)
+{
+    int socket_fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socket_fds) < 0)
+    {
+        fprintf(stderr, "Error: failed to create socket pair\n");
+        return false;
+    }
+    input->peer_pid = fork();
+    if (input->peer_pid < 0)
+    {
+        fprintf(stderr, "Error: fork() failed\n");
+        close(socket_fds[0]);
+        close(socket_fds[1]);
+        return false;
+    }
+    if (input->peer_pid == 0)
+    {
+        close(socket_fds[0]);
+        run_peer(input, kernel, socket_fds[1]);
+        exit(EXIT_SUCCESS);
+    }
+    close(socket_fds[1]);
+    input->socket_fd = socket_fds[0];
+    init_reader(&input->reader, input->socket_fd);
+    return true;
+}
+
+/**
+ * Stops the peer process of a socket kernel, if there is one
+ * 
+ * @param  input input whose peer to stop
+ */
+static void stop_peer(struct KernelInput *input)
+{
+    if (input->socket_fd < 0)
+        return;
+    close(input->socket_fd);
+    free_reader(&input->reader);
+    waitpid(input->peer_pid, NULL, 0);
+    input->socket_fd = -1;
+}
+
+/**
+ * Prepares a kernel to run at the input's size: cuts the symbols it runs
+ * on to the size, and starts its peer if it has one
+ * 
+ * @param  input symbols the kernel runs on
+ * @param  kernel kernel to prepare
+ * 
+ * @return true if the kernel is ready, else false
+ */
+static bool prepare_kernel(struct KernelInput *input, int kernel)
+{
+    struct Args args = input->args;
+    long long size = input->size;
+    switch (kernel)
+    {
+        case KERNEL_ENCRYPT: cut_input(input, args.plaintext + size, "", 1); break;
+        case KERNEL_DECRYPT: cut_input(input, args.ciphertext + size, "", 1); break;
+        case KERNEL_FIND_STOPS: cut_input(input, args.key + size - 2, "@@", 3); break;
+        case KERNEL_SEND_STRING: cut_input(input, args.plaintext + size - 1, "", 1); return start_peer(input, kernel);
+        case KERNEL_READ_FIELD: return start_peer(input, kernel);
+    }
+    return true;
+}
+
+/**
+ * Runs a kernel once at the input's size, noting whether it gave the
+ * expected result
+ * 
+ * @param  input symbols the kernel runs on, prepared for it
+ * @param  kernel kernel to run
+ */
+static void run_kernel(struct KernelInput *input, int kernel)
+{
+    struct Args args = input->args;
+    long long size = input->size;
+    int stop_idx_1, stop_idx_2;
+    char byte = 0;
+    char *field;
+    switch (kernel)
+    {
+        case KERNEL_ENCRYPT:
+            encrypt(args);
+            break;
+
+        case KERNEL_DECRYPT:
+            decrypt(args);
+            break;
+
+        case KERNEL_VALIDATE:
+            input->correct = find_invalid_symbol(DEFAULT_ALPHABET, args.plaintext, size) == NULL && input->correct;
+            break;
+
+        case KERNEL_FIND_STOPS:
+            find_stop_indices(args.key, &stop_idx_1, &stop_idx_2);
+            input->correct = stop_idx_1 == size - 2 && stop_idx_2 == size - 1 && input->correct;
+            break;
+
+        case KERNEL_SEND_STRING:
+            send_string(args.plaintext, input->socket_fd);
+            input->correct = recv(input->socket_fd, &byte, 1, MSG_WAITALL) == 1 && input->correct;
+            break;
+
+        case KERNEL_READ_FIELD:
+            field = send(input->socket_fd, &byte, 1, 0) == 1 ? read_field(&input->reader, size) : NULL;
+            input->correct = field != NULL && strlen(field) == (size_t) (size - 1) && input->correct;
+            free(field);
+            break;
+    }
+}
+
+/**
+ * Computes the mean and sample standard deviation of a set of values
+ * 
+ * @param  values values to summarize
+ * @param  n number of values
+ * @param  stddev value to hold the standard deviation; 0 if there is one value
+ * 
+ * @return the mean
+ */
+static double mean_and_stddev(const double *values, int n, double *stddev)
+{
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += values[i];
+    double mean = sum / n;
+    double squares = 0;
+    for (int i = 0; i < n; i++)
+        squares += (values[i] - mean) * (values[i] - mean);
+    *stddev = n > 1 ? sqrt(squares / (n - 1)) : 0;
+    return mean;
+}
+
+int bench_kernels(int argc, char **argv)
+{
+    long long min_size = DEFAULT_MIN_SIZE;
+    long long max_size = DEFAULT_MAX_SIZE;
+    int factor = DEFAULT_SIZE_FACTOR;
+    int n_repetitions = DEFAULT_REPETITIONS;
+    int n_warmups = DEFAULT_WARMUPS;
+    long long repetition_ns = DEFAULT_REPETITION_MS * 1000000LL;
+    long long op_limit_ns = DEFAULT_OP_LIMIT_MS * 1000000LL;
+    int cpu = sched_getcpu();
+    bool selected[N_KERNELS];
+    for (int i = 0; i < N_KERNELS; i++)
+        selected[i] = true;
+
+    // Parse options
+    int opt;
+    while ((opt = getopt(argc, argv, "s:S:f:r:w:t:l:c:k:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': min_size = parse_size(optarg); break;
+            case 'S': max_size = parse_size(optarg); break;
+            case 'f': factor = atoi(optarg); break;
+            case 'r': n_repetitions = atoi(optarg); break;
+            case 'w': n_warmups = atoi(optarg); break;
+            case 't': repetition_ns = atoll(optarg) * 1000000LL; break;
+            case 'l': op_limit_ns = atoll(optarg) * 1000000LL; break;
+            case 'c': cpu = atoi(optarg); break;
+            case 'k':
+                // Run only the kernels named
+                for (int i = 0; i < N_KERNELS; i++)
+                    selected[i] = false;
+                for (char *name = strtok(optarg, ","); name != NULL; name = strtok(NULL, ","))
+                {
+                    int i = 0;
+                    while (i < N_KERNELS && strcmp(name, kernel_names[i]) != 0)
+                        i++;
+                    if (i == N_KERNELS)
+                    {
+                        fprintf(stderr, "Error: unknown kernel: %s\n", name);
+                        return EXIT_FAILURE;
+                    }
+                    selected[i] = true;
+                }
+                break;
+            default: return EXIT_FAILURE;
+        }
+    }
+
+    // Every kernel needs room for its stop characters, and sizes must grow
+    if (min_size < 3 || max_size < min_size || max_size >= (1LL << 31) || factor < 2 || n_repetitions < 1 ||
+        n_warmups < 1)
+    {
+        fprintf(stderr, "Error: sizes must be from 3 bytes to under 2G, with a factor of at least 2, "
+                        "and at least one repetition and warmup\n");
+        return EXIT_FAILURE;
+    }
+
+    // Pin to one CPU so that runs are not moved between CPUs and their caches
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+            fprintf(stderr, "Warning: failed to pin to CPU %d\n", cpu);
+    }
+
+    // Create random plaintext and key of the largest size, and their ciphertext
+    struct KernelInput input;
+    input.args.plaintext = (char *) malloc(max_size + 1);
+    input.args.key = (char *) malloc(max_size + 1);
+    input.args.ciphertext = (char *) malloc(max_size + 1);
+    if (input.args.plaintext == NULL || input.args.key == NULL || input.args.ciphertext == NULL)
+    {
+        fprintf(stderr, "Error: failed to allocate %lld-byte messages\n", max_size);
+        return EXIT_FAILURE;
+    }
+    struct Csprng rng;
+    unsigned char seed[CSPRNG_SEED_SIZE];
+    if (!seed_csprng(seed))
+        return EXIT_FAILURE;
+    init_csprng(&rng, seed, 0);
+    generate_bytes(&rng, input.args.plaintext, max_size);
+    generate_bytes(&rng, input.args.key, max_size);
+    for (long long i = 0; i < max_size; i++)
+    {
+        input.args.plaintext[i] = DEFAULT_ALPHABET->symbols[(unsigned char) input.args.plaintext[i] % DEFAULT_ALPHABET->size];
+        input.args.key[i] = DEFAULT_ALPHABET->symbols[(unsigned char) input.args.key[i] % DEFAULT_ALPHABET->size];
+    }
+    DEFAULT_ALPHABET->encrypt(input.args, max_size);
+    input.args.plaintext[max_size] = '\0';
+    input.args.key[max_size] = '\0';
+    input.args.ciphertext[max_size] = '\0';
+    input.cut = NULL;
+    input.socket_fd = -1;
+
+    // Time each kernel at each size, printing a row as soon as it is timed
+    double *ns_per_run = (double *) malloc(n_repetitions * sizeof(double));
+    double *gb_per_s = (double *) malloc(n_repetitions * sizeof(double));
+    bool success = true;
+    printf("kernel,bytes,runs_per_repetition,repetitions,ns_per_run,ns_per_run_stddev,ns_per_run_min,"
+           "gb_per_s,gb_per_s_stddev\n");
+    for (int kernel = 0; kernel < N_KERNELS; kernel++)
+    {
+        if (!selected[kernel])
+            continue;
+        long long previous_ns = 0;
+        for (long long size = min_size; size <= max_size; size *= factor)
+        {
+            input.size = size;
+            input.correct = true;
+            if (!prepare_kernel(&input, kernel))
+            {
+                restore_input(&input);
+                free(ns_per_run);
+                free(gb_per_s);
+                return EXIT_FAILURE;
+            }
+
+            // Warm up, keeping the fastest run to size the repetitions by
+            long long warm_ns = 0;
+            for (int i = 0; i < n_warmups; i++)
+            {
+                long long start = monotonic_ns();
+                run_kernel(&input, kernel);
+                long long elapsed_ns = monotonic_ns() - start;
+                if (i == 0 || elapsed_ns < warm_ns)
+                    warm_ns = elapsed_ns;
+                if (elapsed_ns > op_limit_ns)
+                    break;
+            }
+
+            // A kernel that takes longer than the limit is timed by its warmup alone, and not run at larger sizes
+            int n_timed = n_repetitions;
+            long long n_runs = warm_ns > 0 ? repetition_ns / warm_ns : repetition_ns;
+            if (n_runs < 1)
+                n_runs = 1;
+            if (warm_ns > op_limit_ns)
+            {
+                n_timed = 1;
+                ns_per_run[0] = warm_ns;
+            }
+
+            // Time the repetitions, profiling the average run of each
+            for (int i = 0; i < n_repetitions && warm_ns <= op_limit_ns; i++)
+            {
+                long long start_counts[N_COUNTERS], counts[N_COUNTERS], zero[N_COUNTERS] = { 0 };
+                read_counters(&profile, start_counts);
+                long long start = monotonic_ns();
+                for (long long j = 0; j < n_runs; j++)
+                    run_kernel(&input, kernel);
+                ns_per_run[i] = (double) (monotonic_ns() - start) / n_runs;
+                read_counters(&profile, counts);
+                for (int j = 0; j < N_COUNTERS; j++)
+                    counts[j] = (counts[j] - start_counts[j]) / n_runs;
+                add_profile(&profile, kernel, size, zero, counts);
+            }
+            restore_input(&input);
+            stop_peer(&input);
+
+            // Report the time per run and the throughput
+            double min_ns = ns_per_run[0];
+            for (int i = 0; i < n_timed; i++)
+            {
+                gb_per_s[i] = size / ns_per_run[i];
+                if (ns_per_run[i] < min_ns)
+                    min_ns = ns_per_run[i];
+            }
+            double ns_stddev, gb_stddev;
+            double mean_ns = mean_and_stddev(ns_per_run, n_timed, &ns_stddev);
+            double mean_gb = mean_and_stddev(gb_per_s, n_timed, &gb_stddev);
+            printf("%s,%lld,%lld,%d,%.1f,%.1f,%.1f,%.4f,%.4f\n", kernel_names[kernel], size,
+                   n_timed == 1 && warm_ns > op_limit_ns ? 1LL : n_runs, n_timed, mean_ns, ns_stddev, min_ns,
+                   mean_gb, gb_stddev);
+            fflush(stdout);
+            if (!input.correct)
+            {
+                fprintf(stderr, "kernels: %s gave a wrong result at %lld bytes\n", kernel_names[kernel], size);
+                success = false;
+            }
+
+            // Skip larger sizes once a run would take longer than the limit, judging by how its time grew,
+            // so kernels that grow faster than the size stop before a size that would take minutes
+            double next_ns = previous_ns > 0 ? (double) warm_ns * warm_ns / previous_ns : (double) warm_ns * factor;
+            if (size * factor <= max_size && (warm_ns > op_limit_ns || next_ns > op_limit_ns))
+            {
+                fprintf(stderr, "kernels: %s took %.1f ms at %lld bytes; larger sizes are skipped\n",
+                        kernel_names[kernel], warm_ns / 1e6, size);
+                break;
+            }
+            previous_ns = warm_ns;
+        }
+    }
+    print_profile(&profile, kernel_names, N_KERNELS);
+
+    free(ns_per_run);
+    free(gb_per_s);
+    free(input.args.plaintext);
+    free(input.args.key);
+    free(input.args.ciphertext);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
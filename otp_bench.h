@@ -0,0 +1,151 @@
+/**
+ * @file otp_bench.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for otp_bench.c
+ */
+
+#ifndef OTP_BENCH
+#define OTP_BENCH
+
+// Kernels the kernels benchmark sweeps over message sizes
+#define KERNEL_ENCRYPT 0        // encrypt() of a text message
+#define KERNEL_DECRYPT 1        // decrypt() of a text message
+#define KERNEL_VALIDATE 2       // find_invalid_symbol(), as the handlers validate a message
+#define KERNEL_FIND_STOPS 3     // find_stop_indices() on a message of the original protocol
+#define KERNEL_SEND_STRING 4    // send_string() framing a message to a peer process
+#define KERNEL_READ_FIELD 5     // read_field() growing its buffer to a message from a peer process
+#define N_KERNELS 6
+
+// Defaults of the kernels benchmark
+#define DEFAULT_MIN_SIZE 16                 // smallest message, in bytes
+#define DEFAULT_MAX_SIZE (1LL << 30)        // largest message, in bytes
+#define DEFAULT_SIZE_FACTOR 4               // each size is this many times the one before
+#define DEFAULT_REPETITIONS 10              // timed repetitions of each kernel at each size
+#define DEFAULT_WARMUPS 2                   // untimed runs before the repetitions
+#define DEFAULT_REPETITION_MS 20            // least time a repetition runs the kernel for
+#define DEFAULT_OP_LIMIT_MS 5000            // a kernel is not run at sizes where one run would take longer
+
+/**
+ * Measures pad range reservation throughput. Forks the requested number of
+ * processes, each of which makes the requested number of reservations from
+ * one shared pad, and reports reservations per second and journal batches.
+ * 
+ * @param  argc the number of benchmark arguments
+ * @param  argv the benchmark arguments, starting with the benchmark name
+ * 
+ * @return EXIT_SUCCESS if the benchmark ran, else EXIT_FAILURE
+ */
+int bench_ledger(int, char **);
+
+/**
+ * Measures the cost of key reuse detection. Encrypts random plaintext one
+ * client chunk at a time with and without checking the key for reuse, and
+ * reports both throughputs. Also verifies that retransmitted chunks are not
+ * reported and that a chunk of key used with different plaintext is.
+ * 
+ * @param  argc the number of benchmark arguments
+ * @param  argv the benchmark arguments, starting with the benchmark name
+ * 
+ * @return EXIT_SUCCESS if the benchmark ran and detection was correct, else EXIT_FAILURE
+ */
+int bench_reuse(int, char **);
+
+/**
+ * Measures key generation throughput. Fills a buffer with key symbols using
+ * the requested number of threads, reports symbols per second, and checks
+ * that every symbol is valid and that symbols are evenly distributed.
+ * 
+ * @param  argc the number of benchmark arguments
+ * @param  argv the benchmark arguments, starting with the benchmark name
+ * 
+ * @return EXIT_SUCCESS if the benchmark ran and the key was valid, else EXIT_FAILURE
+ */
+int bench_keygen(int, char **);
+
+/**
+ * Measures the packed transforms. Encrypts random plaintext with and without
+ * packing, times packing and unpacking, and checks that packed encryption
+ * and decryption agree with the unpacked transforms.
+ * 
+ * @param  argc the number of benchmark arguments
+ * @param  argv the benchmark arguments, starting with the benchmark name
+ * 
+ * @return EXIT_SUCCESS if the benchmark ran and the transforms agree, else EXIT_FAILURE
+ */
+int bench_packed(int, char **);
+
+/**
+ * Measures the binary transforms. Encrypts random symbols with the text
+ * transform and random bytes with the XOR transform, reports both
+ * throughputs, and checks that decryption restores the plaintext.
+ * 
+ * @param  argc the number of benchmark arguments
+ * @param  argv the benchmark arguments, starting with the benchmark name
+ * 
+ * @return EXIT_SUCCESS if the benchmark ran and decryption was correct, else EXIT_FAILURE
+ */
+int bench_binary(int, char **);
+
+/**
+ * Measures the transforms of every alphabet. Times the arithmetic A-Z and
+ * space transform the alphabet tables replaced, then encrypts and decrypts
+ * random symbols of each alphabet, reports the throughputs, and checks that
+ * decryption restores the plaintext and that the default alphabet agrees
+ * with the arithmetic transform.
+ * 
+ * @param  argc the number of benchmark arguments
+ * @param  argv the benchmark arguments, starting with the benchmark name
+ * 
+ * @return EXIT_SUCCESS if the benchmark ran and every transform was correct, else EXIT_FAILURE
+ */
+int bench_alphabet(int, char **);
+
+/**
+ * Measures compression. Compresses a file of plaintext, or made-up words,
+ * into records a chunk at a time, reports the key symbols saved and the
+ * compress and expand throughputs next to the encrypt throughput, and checks
+ * that expanding the records restores the plaintext.
+ * 
+ * @param  argc the number of benchmark arguments
+ * @param  argv the benchmark arguments, starting with the benchmark name
+ * 
+ * @return EXIT_SUCCESS if the benchmark ran and expansion was correct, else EXIT_FAILURE
+ */
+int bench_compress(int, char **);
+
+/**
+ * Measures the one-time MAC. Checks it against the RFC 8439 test vector,
+ * then times the plain transforms, the authenticated transforms that hash
+ * each group of blocks as it is transformed, and transforming before hashing
+ * in a second pass, and checks that tags verify and that a changed symbol is
+ * rejected.
+ * 
+ * @param  argc the number of benchmark arguments
+ * @param  argv the benchmark arguments, starting with the benchmark name
+ * 
+ * @return EXIT_SUCCESS if the benchmark ran and every check passed, else EXIT_FAILURE
+ */
+int bench_mac(int, char **);
+
+/**
+ * Measures the kernels of the original protocol and the transforms across
+ * message sizes. Pins itself to a CPU, then for each kernel and size runs
+ * warmups, calibrates how many runs a repetition takes, and times the
+ * repetitions. Prints a CSV row per kernel and size with the mean, standard
+ * deviation, and least time per run, and the mean and standard deviation of
+ * the throughput in GB/s.
+ * 
+ * @param  argc the number of benchmark arguments
+ * @param  argv the benchmark arguments, starting with the benchmark name
+ * 
+ * @return EXIT_SUCCESS if the benchmark ran and every kernel was correct, else EXIT_FAILURE
+ */
+int bench_kernels(int, char **);
+
+#endif
\ No newline at end of file
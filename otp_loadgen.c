@@ -0,0 +1,529 @@
+/**
+ * @file otp_loadgen.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Generates load on a local enc_server and dec_server, or an otp_server
+ * serving both, and reports the throughput and latency the servers give.
+ * Each of the connections (-c) is a process holding one encryption and one
+ * decryption connection. It sends random plaintext of sizes drawn from a
+ * distribution (-s), then decrypts the ciphertext and checks that the
+ * plaintext comes back.
+ * 
+ * In closed loop, the default, each connection sends its next request as
+ * soon as the last one returns. In open loop, requests are due at a
+ * constant rate (-r) spread over the connections, and each request's
+ * latency is counted from the time it was due rather than the time it was
+ * sent, so the requests that queue behind a slow one are not left out.
+ * 
+ * With -R, the requests a server captured with its -C option are replayed
+ * instead, with payloads of the same sizes, on as many connections, at the
+ * times they arrived, sped up by -x times. Each request's latency is counted
+ * from the time it was due, as in open loop. -R may be given once per
+ * server, such as once for enc_server's capture and once for dec_server's.
+ * 
+ * Latencies are kept in histograms with 8 buckets per power of two, as the
+ * servers keep them, and reported as percentiles up to the 99.99th. Only
+ * requests due after the warmup (-w) are recorded.
+ * 
+ * Usage: otp_loadgen [-c <connections>] [-d <seconds>] [-w <seconds>] [-r <rate>] [-s <size>[:<weight>][,...]]
+ *                    [-R <capture> [-x <speed>]] <encport> [<decport>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "fairness.h"
+#include "admission.h"
+#include "stats.h"
+#include "otp_loadgen.h"
+#include "replay.h"
+#include "util.h"
+
+// Names of the latencies, as they are reported
+static const char *latency_names[N_LATENCIES] = { "encrypt", "decrypt" };
+
+int main(int argc, char **argv)
+{
+    // Parse options
+    struct LoadConfig config;
+    config.n_connections = DEFAULT_LOAD_CONNECTIONS;
+    config.seconds = DEFAULT_LOAD_SECONDS;
+    config.warmup_seconds = 0;
+    config.rate = 0;
+    config.replay = NULL;
+    parse_sizes(DEFAULT_LOAD_SIZES, &config);
+    const char *captures[MAX_CAPTURES];
+    int n_captures = 0;
+    double speed = 1.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:w:r:s:R:x:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': // Number of connections sending requests at once
+                config.n_connections = atoi(optarg);
+                if (config.n_connections <= 0)
+                {
+                    fprintf(stderr, "Error: invalid connection count: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'd': // Time requests are recorded for, in seconds
+                config.seconds = atof(optarg);
+                if (config.seconds <= 0)
+                {
+                    fprintf(stderr, "Error: invalid duration: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'w': // Time requests are sent before they are recorded, in seconds
+                config.warmup_seconds = atof(optarg);
+                if (config.warmup_seconds < 0)
+                {
+                    fprintf(stderr, "Error: invalid warmup: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'r': // Requests per second over every connection, for open loop
+                config.rate = atof(optarg);
+                if (config.rate <= 0)
+                {
+                    fprintf(stderr, "Error: invalid rate: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 's': // Sizes of the messages, with their weights
+                if (!parse_sizes(optarg, &config))
+                    return EXIT_FAILURE;
+                break;
+
+            case 'R': // Capture of a server's requests to replay
+                if (n_captures == MAX_CAPTURES)
+                {
+                    fprintf(stderr, "Error: at most %d captures can be replayed\n", MAX_CAPTURES);
+                    return EXIT_FAILURE;
+                }
+                captures[n_captures++] = optarg;
+                break;
+
+            case 'x': // How many times faster than captured requests are replayed
+                speed = atof(optarg);
+                if (speed <= 0)
+                {
+                    fprintf(stderr, "Error: invalid speed: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            default:
+                fprintf(stderr, "Usage: otp_loadgen [-c $connections] [-d $seconds] [-w $seconds] [-r $rate] "
+                                "[-s $size[:$weight][,...]] [-R $capture [-x $speed]] $encport [$decport]\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    // Validate ports; an otp_server serves both roles on one port
+    if (argc <= optind)
+    {
+        fprintf(stderr, "Error: missing argument\n");
+        fprintf(stderr, "Usage: otp_loadgen [-c $connections] [-d $seconds] [-w $seconds] [-r $rate] "
+                        "[-s $size[:$weight][,...]] [-R $capture [-x $speed]] $encport [$decport]\n");
+        return EXIT_FAILURE;
+    }
+    config.enc_port = atoi(argv[optind]);
+    config.dec_port = argc > optind + 1 ? atoi(argv[optind + 1]) : config.enc_port;
+    if (config.enc_port < 1 || config.enc_port > MAX_PORT || config.dec_port < 1 || config.dec_port > MAX_PORT)
+    {
+        fprintf(stderr, "Error: invalid port\n");
+        return EXIT_FAILURE;
+    }
+
+    // Read the captures to replay, and spread their connections over as many processes as overlap
+    struct Replay replay;
+    memset(&replay, 0, sizeof(replay));
+    if (n_captures > 0)
+    {
+        for (int i = 0; i < n_captures; i++)
+        {
+            if (!load_capture(&replay, captures[i]))
+                return EXIT_FAILURE;
+        }
+        if (!plan_replay(&replay))
+            return EXIT_FAILURE;
+        replay.speed = speed;
+        config.replay = &replay;
+        config.n_connections = replay.n_processes;
+        config.max_size = replay.max_size;
+    }
+
+    // Create random plaintext and key to draw messages from; each message starts at a random offset.
+    // A replay draws the same symbols every time.
+    char *plaintext = (char *) malloc(2 * config.max_size);
+    char *key = (char *) malloc(2 * config.max_size);
+    srandom(config.replay != NULL ? REPLAY_SEED : getpid());
+    for (long long i = 0; i < 2 * config.max_size; i++)
+    {
+        int value = random() % 27;
+        plaintext[i] = value == 0 ? ' ' : value + 64;
+        value = random() % 27;
+        key[i] = value == 0 ? ' ' : value + 64;
+    }
+
+    // Keep the results of each connection in memory shared with its process
+    struct LoadSlot *slots = mmap(NULL, config.n_connections * sizeof(struct LoadSlot), PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (slots == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map results\n");
+        return EXIT_FAILURE;
+    }
+
+    // Start every connection, giving them time to connect before they all start sending together
+    signal(SIGPIPE, SIG_IGN);
+    long long start_ns = monotonic_ns() + 200000000LL;
+    for (int i = 0; i < config.n_connections; i++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            fprintf(stderr, "Error: fork() failed\n");
+            break;
+        }
+        if (pid == 0)
+        {
+            srandom(getpid());
+            if (config.replay != NULL)
+                run_replay(&replay, &config, i, plaintext, key, start_ns, &slots[i]);
+            else
+                run_connection(&config, i, plaintext, key, start_ns, &slots[i]);
+            exit(EXIT_SUCCESS);
+        }
+    }
+    while (wait(NULL) > 0)
+        ;
+
+    // A replay lasts as long as its requests take; its throughput is over the time after the warmup
+    double seconds = config.seconds;
+    if (config.replay != NULL)
+        seconds = (monotonic_ns() - start_ns) / 1e9 - config.warmup_seconds;
+
+    // Sum the results of every connection
+    struct LoadSlot total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < config.n_connections; i++)
+    {
+        total.n_requests += slots[i].n_requests;
+        total.n_symbols += slots[i].n_symbols;
+        total.n_errors += slots[i].n_errors;
+        total.n_mismatches += slots[i].n_mismatches;
+        total.n_busy += slots[i].n_busy;
+        total.n_unsent += slots[i].n_unsent;
+        for (int j = 0; j < N_LATENCIES; j++)
+        {
+            if (slots[i].max_ns[j] > total.max_ns[j])
+                total.max_ns[j] = slots[i].max_ns[j];
+            for (int k = 0; k < STATS_BUCKETS; k++)
+                total.latency[j][k] += slots[i].latency[j][k];
+        }
+    }
+    print_results(&config, &total, seconds > 0 ? seconds : 1e-3);
+
+    free(plaintext);
+    free(key);
+    return total.n_errors == 0 && total.n_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bool parse_sizes(const char *spec, struct LoadConfig *config)
+{
+    config->n_sizes = 0;
+    config->total_weight = 0;
+    config->max_size = 0;
+
+    // Read each size and its weight, which is 1 unless given
+    char *copy = strdup(spec);
+    bool valid = true;
+    for (char *item = strtok(copy, ","); item != NULL && valid; item = strtok(NULL, ","))
+    {
+        char *weight = strchr(item, ':');
+        if (weight != NULL)
+            *weight++ = '\0';
+        struct SizeClass size_class = { size: parse_size(item), weight: weight != NULL ? atoi(weight) : 1 };
+        valid = config->n_sizes < MAX_SIZE_CLASSES && size_class.size > 0 && size_class.size <= MAX_CHUNK_SIZE &&
+                size_class.weight > 0;
+        if (!valid)
+            break;
+        config->sizes[config->n_sizes++] = size_class;
+        config->total_weight += size_class.weight;
+        if (size_class.size > config->max_size)
+            config->max_size = size_class.size;
+    }
+    free(copy);
+    if (!valid || config->n_sizes == 0)
+    {
+        fprintf(stderr, "Error: invalid sizes: %s; give up to %d sizes of 1 to %d symbols, such as 1K:90,1M:10\n",
+                spec, MAX_SIZE_CLASSES, MAX_CHUNK_SIZE);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Draws the size of a message from the distribution
+ * 
+ * @param  config load holding the distribution
+ * 
+ * @return symbols in the message
+ */
+static long long draw_size(const struct LoadConfig *config)
+{
+    int draw = random() % config->total_weight;
+    int i = 0;
+    while (draw >= config->sizes[i].weight)
+        draw -= config->sizes[i++].weight;
+    return config->sizes[i].size;
+}
+
+int connect_role(int port, const char *role, struct LoadSlot *slot)
+{
+    char greeting[32];
+    char expected[32];
+    snprintf(greeting, sizeof(greeting), "%s_client " PROTOCOL_VERSION, role);
+    snprintf(expected, sizeof(expected), "%s_server " PROTOCOL_VERSION "@", role);
+
+    for (int attempt = 1; ; attempt++)
+    {
+        int socket_fd = connect_to_server(port);
+        if (socket_fd < 0)
+        {
+            fprintf(stderr, "Error: could not contact %s_server on port %d\n", role, port);
+            return -1;
+        }
+
+        // Identify as the role's client and wait for the server to identify itself
+        send_string(greeting, socket_fd);
+        char reply[MAX_HEADER_SIZE];
+        int n_read = recv(socket_fd, reply, sizeof(reply) - 1, 0);
+        reply[n_read > 0 ? n_read : 0] = '\0';
+
+        // If the server is busy, wait as it asks and try again
+        int retry_after_ms;
+        if (n_read > 0 && parse_busy(reply, &retry_after_ms))
+        {
+            close(socket_fd);
+            slot->n_busy++;
+            if (attempt > MAX_BUSY_RETRIES)
+            {
+                fprintf(stderr, "Error: %s_server on port %d stayed busy\n", role, port);
+                return -1;
+            }
+            wait_to_retry(attempt, retry_after_ms);
+            continue;
+        }
+        if (strcmp(reply, expected) != 0)
+        {
+            fprintf(stderr, "Error: %s_server on port %d did not complete the handshake\n", role, port);
+            close(socket_fd);
+            return -1;
+        }
+
+        // Send each request's header and payload at once, so the load measures the server rather than
+        // the 40 ms a small write waits on the server's delayed acknowledgment
+        int no_delay = 1;
+        setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        return socket_fd;
+    }
+}
+
+bool transform_chunk(int socket_fd, struct Reader *reader, const char *input, const char *key, long long length,
+                     char *output)
+{
+    struct Header request;
+    init_header(&request);
+    request.length = length;
+    if (!send_header(&request, socket_fd) || !send_bytes(input, length, socket_fd) ||
+        !send_bytes(key, length, socket_fd))
+        return false;
+
+    struct Header response;
+    return read_header(reader, &response) && strcmp(response.status, STATUS_OK) == 0 &&
+           response.length == length && read_bytes(reader, output, length);
+}
+
+void record_latency(struct LoadSlot *slot, int kind, long long ns)
+{
+    slot->latency[kind][latency_bucket(ns)]++;
+    if (ns > slot->max_ns[kind])
+        slot->max_ns[kind] = ns;
+}
+
+void sleep_until(long long ns)
+{
+    struct timespec wake = { tv_sec: ns / 1000000000LL, tv_nsec: ns % 1000000000LL };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) != 0)
+        ;
+}
+
+void run_connection(const struct LoadConfig *config, int index, const char *plaintext, const char *key,
+                    long long start_ns, struct LoadSlot *slot)
+{
+    long long record_ns = start_ns + (long long) (config->warmup_seconds * 1e9);
+    long long end_ns = record_ns + (long long) (config->seconds * 1e9);
+
+    // In open loop, each connection's requests are due at its share of the rate,
+    // offset so that the connections' requests interleave
+    long long interval_ns = config->rate > 0 ? (long long) (config->n_connections * 1e9 / config->rate) : 0;
+    long long due_ns = start_ns + interval_ns * index / config->n_connections;
+
+    char *ciphertext = (char *) malloc(config->max_size);
+    char *decrypted = (char *) malloc(config->max_size);
+    int enc_fd = -1, dec_fd = -1;
+    struct Reader enc_reader, dec_reader;
+    while (true)
+    {
+        // Connect, or connect again after a failed request, before taking the next request's time
+        if (enc_fd < 0)
+        {
+            enc_fd = connect_role(config->enc_port, "enc", slot);
+            dec_fd = enc_fd < 0 ? -1 : connect_role(config->dec_port, "dec", slot);
+            if (dec_fd < 0)
+            {
+                // Close the enc connection if only it was made, so the cleanup below has nothing to free
+                if (enc_fd >= 0)
+                    close(enc_fd);
+                enc_fd = -1;
+                slot->n_errors++;
+                break;
+            }
+            init_reader(&enc_reader, enc_fd);
+            init_reader(&dec_reader, dec_fd);
+            if (monotonic_ns() < start_ns)
+                sleep_until(start_ns);
+        }
+
+        // Take the time the request is due: on schedule in open loop, or now in closed loop
+        long long now_ns = monotonic_ns();
+        if (interval_ns > 0)
+        {
+            if (now_ns >= end_ns)
+            {
+                // Requests still due could not be sent in time; count them rather than leave them out
+                if (due_ns < end_ns)
+                    slot->n_unsent += (end_ns - due_ns + interval_ns - 1) / interval_ns;
+                break;
+            }
+            if (due_ns >= end_ns)
+                break;
+            if (now_ns < due_ns)
+                sleep_until(due_ns);
+        }
+        else if (now_ns >= end_ns)
+            break;
+        long long request_ns = interval_ns > 0 ? due_ns : now_ns;
+        due_ns += interval_ns;
+
+        // Encrypt a message drawn at random, then decrypt its ciphertext
+        long long length = draw_size(config);
+        long long offset = random() % config->max_size;
+        bool success = transform_chunk(enc_fd, &enc_reader, plaintext + offset, key + offset, length, ciphertext);
+        long long encrypted_ns = monotonic_ns();
+        success = success && transform_chunk(dec_fd, &dec_reader, ciphertext, key + offset, length, decrypted);
+        long long decrypted_ns = monotonic_ns();
+
+        // Start over with new connections after a failure, since the servers may have closed them
+        if (!success)
+        {
+            slot->n_errors++;
+            free_reader(&enc_reader);
+            free_reader(&dec_reader);
+            close(enc_fd);
+            close(dec_fd);
+            enc_fd = -1;
+            continue;
+        }
+        if (memcmp(decrypted, plaintext + offset, length) != 0)
+            slot->n_mismatches++;
+        if (request_ns >= record_ns)
+        {
+            slot->n_requests++;
+            slot->n_symbols += length;
+            record_latency(slot, LATENCY_ENCRYPT, encrypted_ns - request_ns);
+            record_latency(slot, LATENCY_DECRYPT, decrypted_ns - encrypted_ns);
+        }
+    }
+
+    if (enc_fd >= 0)
+    {
+        free_reader(&enc_reader);
+        free_reader(&dec_reader);
+        close(enc_fd);
+        close(dec_fd);
+    }
+    free(ciphertext);
+    free(decrypted);
+}
+
+void print_results(const struct LoadConfig *config, const struct LoadSlot *total, double seconds)
+{
+    // Describe the load
+    const struct Replay *replay = config->replay;
+    if (replay != NULL)
+    {
+        printf("otp_loadgen: replay of %lld captured requests on %d connections over %d processes at %.2fx speed, "
+               "%.1f s recorded after %.1f s of warmup\n", replay->n_requests, replay->n_streams, replay->n_processes,
+               replay->speed, seconds, config->warmup_seconds);
+        if (replay->n_skipped > 0 || replay->n_adapted > 0)
+            printf("otp_loadgen: %lld captured lines skipped; %lld requests with pads, packed or binary payloads, "
+                   "or authentication replayed as text with keys in the payload\n", replay->n_skipped,
+                   replay->n_adapted);
+    }
+    else if (config->rate > 0)
+        printf("otp_loadgen: %d connections, open loop at %.1f requests/s, %.1f s recorded after %.1f s of warmup\n",
+               config->n_connections, config->rate, seconds, config->warmup_seconds);
+    else
+        printf("otp_loadgen: %d connections, closed loop, %.1f s recorded after %.1f s of warmup\n",
+               config->n_connections, seconds, config->warmup_seconds);
+
+    // Report throughput and failures
+    printf("otp_loadgen: %llu requests, %.1f requests/s, %.2f MB/s of plaintext\n",
+           total->n_requests, total->n_requests / seconds, total->n_symbols / seconds / 1e6);
+    printf("otp_loadgen: %llu errors, %llu mismatched decryptions, %llu busy replies, %llu requests not sent in time\n",
+           total->n_errors, total->n_mismatches, total->n_busy, total->n_unsent);
+
+    // Report the percentiles of each latency, each to within an eighth
+    const double fractions[] = { 0.5, 0.9, 0.99, 0.999, 0.9999 };
+    const char *labels[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+    for (int kind = 0; kind < N_LATENCIES; kind++)
+    {
+        printf("otp_loadgen: %s latency", latency_names[kind]);
+        char latency[16];
+        for (int i = 0; i < 5; i++)
+        {
+            // A percentile is the top of its bucket, which may be above the longest latency
+            long long ns = find_percentile(total->latency[kind], fractions[i]);
+            format_latency(ns > total->max_ns[kind] ? total->max_ns[kind] : ns, latency);
+            printf(" %s %s", labels[i], latency);
+        }
+        format_latency(total->n_requests > 0 ? total->max_ns[kind] : -1, latency);
+        printf(" max %s\n", latency);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+/**
+ * @file otp_loadgen.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for otp_loadgen.c
+ */
+
+#ifndef OTP_LOADGEN
+#define OTP_LOADGEN
+
+// Defaults of the load
+#define DEFAULT_LOAD_CONNECTIONS 4      // connections, each a process with an encryption and a decryption connection
+#define DEFAULT_LOAD_SECONDS 10         // time requests are sent for, after the warmup
+#define DEFAULT_LOAD_SIZES "1K"         // sizes of the messages, with their weights
+
+// Most sizes a distribution of message sizes holds
+#define MAX_SIZE_CLASSES 16
+
+// Latencies recorded for each request
+#define LATENCY_ENCRYPT 0       // from the time the request was due to the ciphertext's arrival
+#define LATENCY_DECRYPT 1       // from sending the ciphertext to the plaintext's arrival
+#define N_LATENCIES 2
+
+// Size of message sent, and how often it is sent relative to the others
+struct SizeClass
+{
+    long long size;             // symbols in the message
+    int weight;                 // relative frequency of the size
+};
+
+// Load to generate
+struct LoadConfig
+{
+    int n_connections;          // connections sending requests at once
+    double seconds;             // time requests are recorded for
+    double warmup_seconds;      // time requests are sent before they are recorded
+    double rate;                // requests per second over every connection; 0 to send each once the last returns
+    struct SizeClass sizes[MAX_SIZE_CLASSES];   // distribution of message sizes
+    int n_sizes;                // number of sizes in the distribution
+    int total_weight;           // sum of the sizes' weights
+    long long max_size;         // largest size in the distribution
+    int enc_port;               // port of the encryption server
+    int dec_port;               // port of the decryption server
+    const struct Replay *replay;    // captured requests to replay instead; NULL to generate load
+};
+
+// Results of one connection, shared with the load generator's main process
+struct LoadSlot
+{
+    unsigned long long n_requests;          // requests recorded
+    unsigned long long n_symbols;           // symbols of the requests recorded
+    unsigned long long n_errors;            // requests that failed or were answered with an error
+    unsigned long long n_mismatches;        // requests whose decrypted ciphertext was not the plaintext
+    unsigned long long n_busy;              // times the server turned a connection away as busy
+    unsigned long long n_unsent;            // requests due before the end that could not be sent in time
+    long long max_ns[N_LATENCIES];          // longest latency of each kind
+    unsigned long long latency[N_LATENCIES][STATS_BUCKETS];    // histogram of each kind of latency
+} __attribute__((aligned(64)));
+
+/**
+ * Reads a distribution of message sizes, given as a comma-separated list
+ * of sizes with optional weights, such as 1K:90,1M:10
+ * 
+ * @param  spec sizes to read
+ * @param  config load to hold the distribution
+ * 
+ * @return true if the distribution is valid, else false
+ */
+bool parse_sizes(const char *, struct LoadConfig *);
+
+/**
+ * Connects to a server in a role and performs the handshake, trying again
+ * while the server is busy
+ * 
+ * @param  port port of the server
+ * @param  role "enc" or "dec"
+ * @param  slot results to count busy replies in
+ * 
+ * @return the connected socket, or -1 if the connection could not be made
+ */
+int connect_role(int, const char *, struct LoadSlot *);
+
+/**
+ * Sends requests over one encryption and one decryption connection until
+ * the load ends, decrypting every ciphertext to check it, and records the
+ * results. In open loop, each request is due at a fixed time, and its
+ * latency is counted from then, so a request held up behind a slow one is
+ * not left out of the latencies.
+ * 
+ * @param  config load to generate
+ * @param  index index of the connection, which spreads the due times of connections apart
+ * @param  plaintext random symbols to send, of twice the largest size
+ * @param  key random key symbols, of twice the largest size
+ * @param  start_ns time every connection starts sending
+ * @param  slot results of the connection
+ */
+void run_connection(const struct LoadConfig *, int, const char *, const char *, long long, struct LoadSlot *);
+
+/**
+ * Sends one chunk and its key to a server and reads the transformed chunk
+ * 
+ * @param  socket_fd socket to the server
+ * @param  reader reader of the socket
+ * @param  input symbols to transform
+ * @param  key key symbols
+ * @param  length number of symbols
+ * @param  output buffer to hold the transformed symbols
+ * 
+ * @return true if the server answered with the transformed chunk, else false
+ */
+bool transform_chunk(int, struct Reader *, const char *, const char *, long long, char *);
+
+/**
+ * Records a latency in a connection's results
+ * 
+ * @param  slot results of the connection
+ * @param  kind kind of latency, as the LATENCY_ values
+ * @param  ns latency in nanoseconds
+ */
+void record_latency(struct LoadSlot *, int, long long);
+
+/**
+ * Sleeps until a monotonic time
+ * 
+ * @param  ns time to wake at
+ */
+void sleep_until(long long);
+
+/**
+ * Prints the throughput, error counts, and latency percentiles of a load
+ * 
+ * @param  config load generated
+ * @param  total sums of the results of every connection
+ * @param  seconds time the requests were recorded over
+ */
+void print_results(const struct LoadConfig *, const struct LoadSlot *, double);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,947 @@
+/**
+ * @file otp_server.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * otp_server serves both enc_client and dec_client from one pool of worker
+ * processes, so capacity is shared by encryption and decryption instead of
+ * one server idling while the other is saturated. Each connection is routed
+ * on the identifier the client sends in the handshake and handled exactly as
+ * enc_server or dec_server would handle it.
+ * 
+ * The workers are forked once, when the server starts. The server accepts
+ * every connection itself and passes it to an idle worker over a UNIX socket.
+ * While every worker is busy, connections wait in a bounded queue, and once
+ * the queue is full, clients are told the server is busy and when to retry.
+ * Each worker serves one connection at a time, allocating the buffers of
+ * every request from an arena it keeps for its whole life. The server
+ * re-forks workers that die.
+ * 
+ * So that a few huge transfers cannot hold every worker while small ones
+ * queue behind them, a worker hands a connection back between requests
+ * once it has been served a slice of symbols (-s) and others are waiting.
+ * The server parks it in a lane of large connections, which take turns on
+ * the workers that new connections leave idle. Some workers (-k) are kept
+ * for new connections alone, and a large connection that has waited too
+ * long runs ahead of new ones.
+ * 
+ * Besides the shared port, the server can listen on a port per role, so
+ * clients configured with the old enc_server and dec_server ports keep working.
+ * Connections on such a port are only served in its role.
+ * 
+ * Waiting connections are queued per client and clients take turns, as in
+ * enc_server and dec_server, with the weights and rates given by -f and -l.
+ * The buffers of requests are held within a memory budget (-m), as there too.
+ * 
+ * The server counts connections per role, the connections it admitted,
+ * queued, and turned away, the connections closed for missing a deadline,
+ * and each client's usage, and prints the counts to stderr when it receives
+ * SIGUSR1. Counters and request latencies are also published in shared
+ * memory, where otp_stat reads them while the server runs. Request phases
+ * are traced, profiled, and captured as in enc_server and dec_server, with a
+ * ring and a profile table per worker.
+ * 
+ * Takes the options of enc_server and dec_server.
+ * 
+ * Usage: otp_server [-p <paddir> [-j <journal>]] [-r flag|reject] [-g] [-w <workers>]
+ *                   [-e <encport>] [-d <decport>] [-q <depth>] [-b <backlog>]
+ *                   [-t <handshake>:<body>:<idle>] [-s <slice>] [-k <reserved>]
+ *                   [-f <client>=<weight>[,<rate>]] [-l <rate>] [-m <budget>]
+ *                   [-T <tracefile>] [-L <slowlog> [-x <ms>]] [-C <capture>] [-P] <port>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "pad_store.h"
+#include "otp.h"
+#include "csprng.h"
+#include "ledger.h"
+#include "reuse.h"
+#include "reservoir.h"
+#include "arena.h"
+#include "timeouts.h"
+#include "lanes.h"
+#include "fairness.h"
+#include "budget.h"
+#include "admission.h"
+#include "stats.h"
+#include "profile.h"
+#include "trace.h"
+#include "enc_handler.h"
+#include "dec_handler.h"
+#include "otp_server.h"
+#include "util.h"
+
+// Pads available to requests that name a server-resident key
+struct PadStore pad_store;
+
+// Ledger of reserved pad ranges, used if the server was started with a journal
+struct Ledger ledger;
+bool use_ledger = false;
+
+// Detector of reused key, used if the server was started with a reuse policy
+struct ReuseDetector reuse_detector;
+bool detect_reuse = false;
+bool reject_reuse = false;
+
+// Reservoir of generated key, used if the server was started with -g
+struct Reservoir reservoir;
+bool use_reservoir = false;
+
+// Arena the buffers of a worker's requests are allocated from
+struct Arena request_arena;
+
+// Deadlines connections are held to
+struct Timeouts timeouts;
+
+// Memory budget the buffers of every request are held within
+struct MemoryBudget budget;
+
+// Clients the server is shared between, and in a worker, the slot of the client of its connection
+struct Clients clients;
+int client_slot = -1;
+
+// Statistics published for otp_stat; each worker counts its own in the slot after its index
+struct Stats stats;
+
+// Tracing of the phases of requests, in a ring per worker after the server's own
+struct Trace trace;
+
+// Counters of the phases of requests, in a table per worker after the server's own
+struct Profile profile;
+
+// Asked by a worker's handlers before each request whether to hand the connection back; set in workers
+bool (*should_yield)(const struct Reader *, long long) = NULL;
+
+// Listening sockets, their ports, and the role of the connections accepted on each
+int listen_socket_fds[MAX_LISTENERS];
+int listener_ports[MAX_LISTENERS];
+int listener_roles[MAX_LISTENERS];
+int n_listeners = 0;
+
+// Pool of workers
+struct Worker workers[MAX_WORKERS];
+int n_workers = MAX_CONNECTIONS;
+
+// Connections being served and waiting to be served
+struct Admission admission;
+
+// Large connections waiting for their next slice, the symbols in a slice, and the workers kept for new connections
+struct LargeLane lane;
+long long slice_symbols = DEFAULT_SLICE_SYMBOLS;
+int n_reserved = -1;
+
+// Metrics shared with every worker
+struct ServerMetrics *metrics;
+
+// Set when SIGUSR1 asks for the metrics to be printed
+volatile sig_atomic_t metrics_requested = 0;
+
+int main(int argc, char **argv)
+{
+    // Parse options
+    char *pad_directory = NULL;
+    char *journal_path = NULL;
+    int enc_port = 0;
+    int dec_port = 0;
+    int queue_depth = DEFAULT_QUEUE_DEPTH;
+    int backlog = DEFAULT_BACKLOG;
+    parse_timeouts(&timeouts, DEFAULT_TIMEOUTS);
+    if (!init_clients(&clients, 0))
+        return EXIT_FAILURE;
+    long long memory_limit = -1;
+    char *trace_path = NULL;
+    char *slow_log_path = NULL;
+    long long slow_ms = DEFAULT_SLOW_MS;
+    char *capture_path = NULL;
+    bool profiling = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:j:r:gw:e:d:q:b:t:s:k:f:l:m:T:L:x:C:P")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p': // Directory of server-resident pads
+                pad_directory = optarg;
+                break;
+
+            case 'j': // Journal of reserved pad ranges
+                journal_path = optarg;
+                break;
+
+            case 'r': // Policy for suspected key reuse
+                detect_reuse = true;
+                if (strcmp(optarg, "reject") == 0)
+                    reject_reuse = true;
+                else if (strcmp(optarg, "flag") != 0)
+                {
+                    fprintf(stderr, "Error: invalid reuse policy: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'g': // Generate keys for clients that ask
+                use_reservoir = true;
+                break;
+
+            case 'w': // Number of worker processes
+                n_workers = atoi(optarg);
+                if (n_workers < 1 || n_workers > MAX_WORKERS)
+                {
+                    fprintf(stderr, "Error: invalid number of workers: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'e': // Port that only serves enc_client
+                if ((enc_port = parse_port(optarg)) == 0)
+                    return EXIT_FAILURE;
+                break;
+
+            case 'd': // Port that only serves dec_client
+                if ((dec_port = parse_port(optarg)) == 0)
+                    return EXIT_FAILURE;
+                break;
+
+            case 'q': // Number of connections that may wait for a worker
+                queue_depth = atoi(optarg);
+                if (queue_depth < 0 || queue_depth > MAX_QUEUE_DEPTH)
+                {
+                    fprintf(stderr, "Error: invalid queue depth: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'b': // Number of connections the kernel holds before they are accepted
+                backlog = atoi(optarg);
+                if (backlog < 1)
+                {
+                    fprintf(stderr, "Error: invalid backlog: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 't': // Deadlines for the handshake, each request's body, and idle time, in milliseconds
+                if (!parse_timeouts(&timeouts, optarg))
+                {
+                    fprintf(stderr, "Error: invalid timeouts: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 's': // Number of symbols a connection is served before it may be handed back; 0 never to
+                slice_symbols = atoll(optarg);
+                if (slice_symbols < 0)
+                {
+                    fprintf(stderr, "Error: invalid slice: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'k': // Number of workers kept for new connections
+                n_reserved = atoi(optarg);
+                if (n_reserved < 0)
+                {
+                    fprintf(stderr, "Error: invalid number of reserved workers: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'f': // Weight of a client, and optionally its rate
+                if (!add_client_rule(&clients, optarg))
+                {
+                    fprintf(stderr, "Error: invalid client rule: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'l': // Symbols per second each client may be served, unless its rule says otherwise
+                clients.default_rate = parse_size(optarg);
+                if (clients.default_rate < 0)
+                {
+                    fprintf(stderr, "Error: invalid rate: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'm': // Bytes the buffers of requests served at once may take; 0 for no limit
+                memory_limit = parse_size(optarg);
+                if (memory_limit < 0)
+                {
+                    fprintf(stderr, "Error: invalid memory budget: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'T': // File the phases of recent requests are written to on SIGUSR1
+                trace_path = optarg;
+                break;
+
+            case 'L': // File slow requests are logged to
+                slow_log_path = optarg;
+                break;
+
+            case 'x': // Time in milliseconds from which a request is logged as slow
+                slow_ms = atoll(optarg);
+                if (slow_ms < 0)
+                {
+                    fprintf(stderr, "Error: invalid slow request threshold: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'C': // File the metadata of every request is captured to, for otp_loadgen to replay
+                capture_path = optarg;
+                break;
+
+            case 'P': // Count the cycles and cache misses of each phase of requests
+                profiling = true;
+                break;
+
+            default:
+                fprintf(stderr, "Usage: otp_server [-p $paddir [-j $journal]] [-r flag|reject] [-g] [-w $workers] "
+                                "[-e $encport] [-d $decport] [-q $depth] [-b $backlog] [-t $handshake:$body:$idle] "
+                                "[-s $slice] [-k $reserved] [-f $client=$weight[,$rate]] [-l $rate] [-m $budget] "
+                                "[-T $tracefile] [-L $slowlog [-x $ms]] [-C $capture] [-P] $port\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    // Validate port and convert it to an integer
+    if (argc <= optind)
+    {
+        fprintf(stderr, "Error: missing argument\n");
+        fprintf(stderr, "Usage: otp_server [-p $paddir [-j $journal]] [-r flag|reject] [-g] [-w $workers] "
+                        "[-e $encport] [-d $decport] [-q $depth] [-b $backlog] [-t $handshake:$body:$idle] "
+                        "[-s $slice] [-k $reserved] [-f $client=$weight[,$rate]] [-l $rate] [-m $budget] "
+                        "[-T $tracefile] [-L $slowlog [-x $ms]] [-C $capture] [-P] $port\n");
+        return EXIT_FAILURE;
+    }
+    int port = parse_port(argv[optind]);
+    if (port == 0)
+        return EXIT_FAILURE;
+
+    // Publish statistics for otp_stat; the server runs without them if the segment cannot be created
+    open_stats(&stats, "otp_server", port);
+
+    // Trace the phases of requests before forking so every process writes into the rings, slow log, and capture
+    if (!open_trace(&trace, "otp_server", n_workers + 1, trace_path, slow_log_path, slow_ms))
+        return EXIT_FAILURE;
+    if (capture_path != NULL && !open_capture(&trace, capture_path))
+        return EXIT_FAILURE;
+
+    // Profile with the counters that are permitted; the server runs without profiling if none are
+    if (profiling && open_profile(&profile, "otp_server", n_workers + 1))
+        trace.profile = &profile;
+
+    // Serve as many connections at once as there are workers; the rest wait for a worker or are turned away
+    if (!init_admission(&admission, n_workers, queue_depth, &clients))
+        return EXIT_FAILURE;
+
+    // Keep some workers for new connections, but let large connections run on at least one
+    if (n_reserved < 0)
+        n_reserved = n_workers / DEFAULT_RESERVED_FRACTION;
+    if (n_reserved >= n_workers)
+    {
+        fprintf(stderr, "Error: %d reserved workers leave none of %d for large connections\n", n_reserved, n_workers);
+        return EXIT_FAILURE;
+    }
+    if (!init_lane(&lane, queue_depth > n_workers ? queue_depth : n_workers, n_workers, n_reserved))
+        return EXIT_FAILURE;
+
+    // Setup SIGUSR1 signal handler to print metrics on request, before any process is forked
+    if (!catch_SIGUSR1())
+        return EXIT_FAILURE;
+
+    // Ignore SIGPIPE, so a client that disconnects mid-response fails a send instead of killing its process
+    signal(SIGPIPE, SIG_IGN);
+
+    // Open the memory budget before forking so every worker holds memory from it
+    if (!open_budget(&budget, memory_limit, n_workers + 1))
+        return EXIT_FAILURE;
+
+    // Load pads before forking so every worker shares their mappings
+    if (pad_directory != NULL && !load_pad_store(&pad_store, pad_directory))
+        return EXIT_FAILURE;
+
+    // Open the ledger before forking so every worker shares its cursors
+    if (journal_path != NULL)
+    {
+        if (pad_directory == NULL)
+        {
+            fprintf(stderr, "Error: a journal requires a pad directory\n");
+            return EXIT_FAILURE;
+        }
+        if (!open_ledger(&ledger, &pad_store, journal_path))
+            return EXIT_FAILURE;
+        use_ledger = true;
+    }
+
+    // Create the reuse filter before forking so every worker records into it
+    if (detect_reuse && !open_reuse_detector(&reuse_detector))
+        return EXIT_FAILURE;
+
+    // Start filling the key reservoir before forking so every worker draws from it
+    if (use_reservoir && !open_reservoir(&reservoir))
+        return EXIT_FAILURE;
+
+    // Create metrics shared by every worker
+    if (!open_timeouts(&timeouts))
+        return EXIT_FAILURE;
+    metrics = mmap(NULL, sizeof(struct ServerMetrics), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (metrics == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map server metrics\n");
+        return EXIT_FAILURE;
+    }
+
+    // Set up listening sockets: the shared port, then any port per role
+    if (!add_listener(port, ROLE_ANY, backlog) ||
+        (enc_port != 0 && !add_listener(enc_port, ROLE_ENC, backlog)) ||
+        (dec_port != 0 && !add_listener(dec_port, ROLE_DEC, backlog)))
+        return EXIT_FAILURE;
+
+    // Setup SIGCHLD signal handler to wake the server when a worker terminates
+    if (!catch_SIGCHLD())
+        return EXIT_FAILURE;
+
+    // Fork the pool of workers
+    for (int i = 0; i < n_workers; i++)
+    {
+        if (!start_worker(i))
+            return EXIT_FAILURE;
+    }
+
+    // Continuously process connections
+    struct pollfd poll_fds[MAX_LISTENERS + 1 + MAX_WORKERS];
+    while (true)
+    {
+        // Wait on the listening sockets, the wake-up pipe, and every busy worker at once
+        int n_fds = 0;
+        for (int i = 0; i < n_listeners; i++)
+        {
+            poll_fds[n_fds].fd = listen_socket_fds[i];
+            poll_fds[n_fds++].events = POLLIN;
+        }
+        poll_fds[n_fds].fd = admission.wake_fds[0];
+        poll_fds[n_fds++].events = POLLIN;
+        for (int i = 0; i < n_workers; i++)
+        {
+            poll_fds[n_fds].fd = workers[i].busy ? workers[i].channel_fd : -1;
+            poll_fds[n_fds++].events = POLLIN;
+        }
+        int n_ready = poll(poll_fds, n_fds, admission_timeout_ms(&admission));
+        if (n_ready < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "Error: failed to wait for connections\n");
+            return EXIT_FAILURE;
+        }
+
+        // Print metrics if asked, and replace workers that died
+        drain_wakeups(&admission);
+        if (metrics_requested)
+        {
+            metrics_requested = 0;
+            print_metrics();
+        }
+        if (!replace_workers())
+            return EXIT_FAILURE;
+
+        // After a signal, the ready events are not set; after a timeout there are none, but clients held back
+        // by their rates and connections waiting in the lanes may be due to be served
+        if (n_ready < 0)
+            continue;
+
+        // Free the slots of workers that finished their connections, parking those handed back
+        for (int i = 0; i < n_workers; i++)
+        {
+            struct Handoff report;
+            int socket_fd;
+            if (!workers[i].busy || !(poll_fds[n_listeners + 1 + i].revents & POLLIN) ||
+                !receive_handoff(workers[i].channel_fd, &report, &socket_fd))
+                continue;
+            workers[i].busy = false;
+            finish_connection(&admission);
+            if (workers[i].large)
+                finish_slice(&lane);
+            if (socket_fd >= 0 && !park_connection(&lane, socket_fd, report.role, report.format, report.client))
+                close(socket_fd);
+        }
+
+        // Accept a new connection from each ready socket, then serve it now, queue it, or turn it away
+        for (int i = 0; i < n_listeners; i++)
+        {
+            if (!(poll_fds[i].revents & POLLIN))
+                continue;
+            int socket_fd = accept(listen_socket_fds[i], NULL, NULL);
+            if (socket_fd >= 0 && admit_connection(&admission, socket_fd) >= 0)
+            {
+                struct Handoff new_connection = {
+                    resumed: false,
+                    role: ROLE_ANY,
+                    format: FORMAT_TEXT,
+                    client: admission.client,
+                    accepted_ns: admission.accepted_ns,
+                };
+                dispatch_connection(socket_fd, &new_connection);
+            }
+        }
+
+        // Serve waiting connections as workers free up
+        schedule_connections();
+        publish_admission(&stats, &admission);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int parse_port(const char *string)
+{
+    // Convert port to an integer
+    int port = atoi(string);
+
+    // Verify that specified port is a valid port number
+    if (port < 1 || port > MAX_PORT)
+    {
+        fprintf(stderr, "Error: invalid port: %d\n", port);
+        return 0;
+    }
+    return port;
+}
+
+bool add_listener(int port, int role, int backlog)
+{
+    int listen_socket_fd = setup_listen_socket(port, backlog);
+    if (listen_socket_fd < 0)
+        return false;
+
+    // Never block in accept(), even if a client gives up between poll() and accept()
+    if (fcntl(listen_socket_fd, F_SETFL, fcntl(listen_socket_fd, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        fprintf(stderr, "Error: failed to make listening socket non-blocking\n");
+        return false;
+    }
+
+    listen_socket_fds[n_listeners] = listen_socket_fd;
+    listener_ports[n_listeners] = port;
+    listener_roles[n_listeners] = role;
+    n_listeners++;
+    return true;
+}
+
+bool start_worker(int slot)
+{
+    // Create the channel connections are passed to the worker over
+    int channel_fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, channel_fds) < 0)
+    {
+        fprintf(stderr, "Error: failed to create worker channel\n");
+        return false;
+    }
+
+    pid_t pid = fork();
+    switch (pid)
+    {
+        case -1: // Fork failed
+            fprintf(stderr, "Error: fork() failed\n");
+            close(channel_fds[0]);
+            close(channel_fds[1]);
+            return false;
+
+        case 0: // Child process
+            // Exit along with the server, and leave its signals to it
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            signal(SIGUSR1, SIG_IGN);
+            signal(SIGCHLD, SIG_DFL);
+
+            // Close every socket but this worker's end of its channel
+            close(channel_fds[0]);
+            for (int i = 0; i < n_listeners; i++)
+                close(listen_socket_fds[i]);
+            for (int i = 0; i < n_workers; i++)
+            {
+                if (i != slot && workers[i].pid > 0)
+                    close(workers[i].channel_fd);
+            }
+            close_admission(&admission);
+            close_lane(&lane);
+
+            use_stats_slot(&stats, slot + 1);
+            use_budget_slot(&budget, slot + 1);
+            use_trace_ring(&trace, slot + 1);
+            use_profile_table(&profile, slot + 1);
+            run_worker(channel_fds[1]);
+            exit(EXIT_SUCCESS);
+
+        default: // Parent process
+            close(channel_fds[1]);
+            workers[slot].pid = pid;
+            workers[slot].channel_fd = channel_fds[0];
+            workers[slot].busy = false;
+            workers[slot].large = false;
+            return true;
+    }
+}
+
+bool replace_workers(void)
+{
+    // Reap every terminated child; others, such as the reservoir's refilling process, are not replaced
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+    {
+        for (int i = 0; i < n_workers; i++)
+        {
+            if (workers[i].pid != pid)
+                continue;
+            fprintf(stderr, "Warning: worker %d exited; starting another\n", i);
+
+            // Free the slot of the connection the worker was serving, and the memory its request held
+            if (workers[i].busy)
+                finish_connection(&admission);
+            if (workers[i].busy && workers[i].large)
+                finish_slice(&lane);
+            reclaim_memory(&budget, i + 1);
+            close(workers[i].channel_fd);
+            workers[i].pid = -1;
+            if (!start_worker(i))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool send_handoff(int channel_fd, int socket_fd, const struct Handoff *handoff)
+{
+    // The handoff is the message's data; the socket, if any, rides along as ancillary data
+    struct iovec iov = { (void *) handoff, sizeof(*handoff) };
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (socket_fd >= 0)
+    {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &socket_fd, sizeof(int));
+    }
+    return sendmsg(channel_fd, &message, MSG_NOSIGNAL) == sizeof(*handoff);
+}
+
+bool receive_handoff(int channel_fd, struct Handoff *handoff, int *socket_fd)
+{
+    struct iovec iov = { handoff, sizeof(*handoff) };
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    // Wait for a handoff, retrying if interrupted by a signal
+    ssize_t n_read;
+    while ((n_read = recvmsg(channel_fd, &message, 0)) < 0 && errno == EINTR)
+        continue;
+    if (n_read != sizeof(*handoff))
+        return false;
+
+    // Take the socket sent with it, if any
+    *socket_fd = -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        memcpy(socket_fd, CMSG_DATA(cmsg), sizeof(int));
+    return true;
+}
+
+void dispatch_connection(int socket_fd, const struct Handoff *handoff)
+{
+    // Find an idle worker; there is one for every free slot
+    int slot = 0;
+    while (slot < n_workers && workers[slot].busy)
+        slot++;
+
+    // Name the connection's client for the worker, which was forked before the client was seen
+    struct Handoff named = *handoff;
+    snprintf(named.client_name, sizeof(named.client_name), "%s", clients.clients[handoff->client].name);
+
+    // Turn a new client away if no worker could take the connection. A resumed
+    // connection is past its handshake, so it is closed; the client can resume the transfer.
+    if (slot == n_workers || !send_handoff(workers[slot].channel_fd, socket_fd, &named))
+    {
+        if (handoff->resumed)
+        {
+            close(socket_fd);
+            finish_slice(&lane);
+        }
+        else
+            reject_connection(socket_fd, RETRY_AFTER_MS);
+        finish_connection(&admission);
+        return;
+    }
+    workers[slot].busy = true;
+    workers[slot].large = handoff->resumed;
+    close(socket_fd);
+}
+
+/**
+ * Resumes the oldest large connection on an idle worker for its next slice
+ */
+static void resume_large_connection(void)
+{
+    struct ParkedConnection connection = resume_parked(&lane);
+    struct Handoff handoff = {
+        resumed: true,
+        role: connection.role,
+        format: connection.format,
+        client: connection.client,
+        accepted_ns: connection.parked_ns,
+    };
+    dispatch_connection(connection.socket_fd, &handoff);
+}
+
+void schedule_connections(void)
+{
+    while (true)
+    {
+        // A large connection that has waited too long goes first
+        if (lane_may_run(&lane) && lane_has_aged(&lane, monotonic_ns()) && claim_slot(&admission))
+        {
+            lane.n_aged++;
+            resume_large_connection();
+            continue;
+        }
+
+        // Then new connections, from each client in turn
+        int socket_fd = next_connection(&admission);
+        if (socket_fd >= 0)
+        {
+            struct Handoff new_connection = {
+                resumed: false,
+                role: ROLE_ANY,
+                format: FORMAT_TEXT,
+                client: admission.client,
+                accepted_ns: admission.accepted_ns,
+            };
+            dispatch_connection(socket_fd, &new_connection);
+            continue;
+        }
+
+        // Then large connections, on the workers new connections leave idle
+        if (lane_may_run(&lane) && claim_slot(&admission))
+        {
+            resume_large_connection();
+            continue;
+        }
+        break;
+    }
+
+    // Ask workers to hand connections back after a slice only while connections are waiting for them
+    __atomic_store_n(&metrics->slices_wanted, lane_wants_slices(&lane, admission.n_queued), __ATOMIC_RELAXED);
+}
+
+void run_worker(int channel_fd)
+{
+    // Reserve the arena once; its pages stay mapped from one connection to the next
+    if (!init_arena(&request_arena, ARENA_RESERVED_SIZE))
+        exit(EXIT_FAILURE);
+    should_yield = yield_between_requests;
+
+    // Serve connections the server passes until it closes the channel
+    struct Handoff handoff;
+    int socket_fd;
+    while (receive_handoff(channel_fd, &handoff, &socket_fd))
+    {
+        client_slot = handoff.client;
+        start_traced_connection(&trace, handoff.accepted_ns, handoff.client_name);
+        bool yielded = socket_fd >= 0 && serve_connection(socket_fd, &handoff);
+        finish_request(&stats);
+        finish_traced_request(&trace);
+        release_memory(&budget);
+
+        // Tell the server the worker is free, handing the connection back if it is not done
+        handoff.resumed = yielded;
+        bool sent = send_handoff(channel_fd, yielded ? socket_fd : -1, &handoff);
+        if (socket_fd >= 0)
+            close(socket_fd);
+        if (!sent)
+            break;
+    }
+}
+
+bool yield_between_requests(const struct Reader *reader, long long n_served)
+{
+    // Bytes read ahead would be lost with the reader, so only hand back a connection with none
+    return slice_symbols > 0 && n_served >= slice_symbols && reader->start == reader->end &&
+           __atomic_load_n(&metrics->slices_wanted, __ATOMIC_RELAXED);
+}
+
+int find_role(int socket_fd)
+{
+    // Find the listener whose port the connection arrived on
+    struct sockaddr_in address;
+    socklen_t address_size = sizeof(address);
+    if (getsockname(socket_fd, (struct sockaddr *) &address, &address_size) == 0)
+    {
+        for (int i = 0; i < n_listeners; i++)
+        {
+            if (listener_ports[i] == ntohs(address.sin_port))
+                return listener_roles[i];
+        }
+    }
+    return ROLE_ANY;
+}
+
+bool serve_connection(int socket_fd, struct Handoff *handoff)
+{
+    struct Reader reader;
+    init_reader(&reader, socket_fd);
+    limit_sends(&timeouts, socket_fd);
+
+    // Continue a connection another worker handed back, where it left off between requests
+    bool yielded;
+    if (handoff->resumed)
+    {
+        yielded = handoff->role == ROLE_DEC ? handle_dec_requests(&reader, handoff->format) :
+                                              handle_enc_requests(&reader, handoff->format);
+        free_reader(&reader);
+        return yielded;
+    }
+
+    // Read the client's identifier, which must arrive before the handshake deadline
+    int role = find_role(socket_fd);
+    start_deadline(&timeouts, &reader, TIMEOUT_HANDSHAKE, monotonic_ns());
+    char *identifier = read_field(&reader, MAX_HEADER_SIZE);
+    if (identifier == NULL && report_timeout(&timeouts, &reader, TIMEOUT_HANDSHAKE, 0))
+    {
+        free_reader(&reader);
+        return false;
+    }
+
+    // Route the connection on the identifier, unless the listener has a role
+    if (role == ROLE_ANY)
+    {
+        bool is_dec_client = identifier != NULL &&
+                             strncmp(identifier, DEC_CLIENT_PREFIX, strlen(DEC_CLIENT_PREFIX)) == 0;
+        role = is_dec_client ? ROLE_DEC : ROLE_ENC;
+    }
+    __atomic_add_fetch(&metrics->n_connections[role], 1, __ATOMIC_RELAXED);
+    count_connection(&stats);
+
+    // Hand the connection to the handler of its role; each rejects clients of the other role
+    handoff->role = role;
+    if (role == ROLE_DEC)
+        yielded = handle_dec_connection(&reader, identifier, &handoff->format);
+    else
+        yielded = handle_enc_connection(&reader, identifier, &handoff->format);
+
+    // Free allocated memory
+    free(identifier);
+    free_reader(&reader);
+    return yielded;
+}
+
+void handle_SIGCHLD(int signo)
+{
+    (void) signo;
+
+    // Wake the server, which reaps terminated workers and replaces them.
+    // Preserve errno for the code the signal interrupted.
+    int saved_errno = errno;
+    wake_admission(&admission);
+    errno = saved_errno;
+}
+
+bool catch_SIGCHLD(void)
+{
+    // Declare SIGCHLD action struct
+    struct sigaction sa_SIGCHLD;
+
+    // Register handle_SIGCHLD as signal handler
+    sa_SIGCHLD.sa_handler = handle_SIGCHLD;
+
+    // Initialize signal mask to exclude all signals
+    sigemptyset(&sa_SIGCHLD.sa_mask);
+
+    // Set flag to cause primitive library functions to resume after handler returns
+    // See https://www.gnu.org/software/libc/manual/html_node/Flags-for-Sigaction.html
+    sa_SIGCHLD.sa_flags = SA_RESTART;
+
+    // Install signal handler and check for error
+    if (sigaction(SIGCHLD, &sa_SIGCHLD, NULL) == -1)
+    {
+        fprintf(stderr, "Error: failed to setup handler for child termination signal\n");
+        return false;
+    }
+    return true;
+}
+
+void handle_SIGUSR1(int signo)
+{
+    (void) signo;
+    int saved_errno = errno;
+    metrics_requested = 1;
+    wake_admission(&admission);
+    errno = saved_errno;
+}
+
+bool catch_SIGUSR1(void)
+{
+    // Declare SIGUSR1 action struct
+    struct sigaction sa_SIGUSR1;
+
+    // Register handle_SIGUSR1 as signal handler
+    sa_SIGUSR1.sa_handler = handle_SIGUSR1;
+
+    // Initialize signal mask to exclude all signals
+    sigemptyset(&sa_SIGUSR1.sa_mask);
+
+    // Set flag to cause primitive library functions to resume after handler returns
+    sa_SIGUSR1.sa_flags = SA_RESTART;
+
+    // Install signal handler and check for error
+    if (sigaction(SIGUSR1, &sa_SIGUSR1, NULL) == -1)
+    {
+        fprintf(stderr, "Error: failed to setup handler for metrics signal\n");
+        return false;
+    }
+    return true;
+}
+
+void print_metrics(void)
+{
+    fprintf(stderr, "otp_server: %llu encryption and %llu decryption connections\n",
+            __atomic_load_n(&metrics->n_connections[ROLE_ENC], __ATOMIC_RELAXED),
+            __atomic_load_n(&metrics->n_connections[ROLE_DEC], __ATOMIC_RELAXED));
+    print_admission(&admission, "otp_server");
+    print_timeouts(&timeouts, "otp_server");
+    print_lane(&lane, "otp_server");
+    print_clients(&clients, "otp_server");
+    print_budget(&budget, "otp_server");
+    if (trace.rings != NULL)
+        dump_trace(&trace);
+    print_traced_profile(&trace);
+}
\ No newline at end of file
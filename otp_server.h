@@ -0,0 +1,216 @@
+/**
+ * @file otp_server.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for otp_server.c
+ */
+
+#ifndef OTP_SERVER
+#define OTP_SERVER
+
+// Largest number of worker processes
+#define MAX_WORKERS 256
+
+// Largest number of listening sockets: the shared port and one port per role
+#define MAX_LISTENERS 3
+
+// Roles a connection can be served in, and the role of a listener that serves both
+#define ROLE_ENC 0
+#define ROLE_DEC 1
+#define N_ROLES 2
+#define ROLE_ANY -1
+
+// Prefix of the identifiers dec_client sends; every other client is routed to encryption
+#define DEC_CLIENT_PREFIX "dec_client"
+
+// By default, one worker in this many is kept for new connections, which large connections never run on
+#define DEFAULT_RESERVED_FRACTION 4
+
+// Worker of the pool, as the server sees it
+struct Worker
+{
+    pid_t pid;          // process ID; -1 while the worker is not running
+    int channel_fd;     // server's end of the UNIX socket connections are passed over
+    bool busy;          // whether the worker is serving a connection
+    bool large;         // whether the connection is a large one, resumed from the lane of large connections
+};
+
+// Connection passed between the server and a worker along with its socket
+struct Handoff
+{
+    bool resumed;       // whether the connection is between framed requests, its handshake done
+    int role;           // role the connection is served in, if resumed
+    int format;         // payload format the client asked for, if resumed
+    int client;         // slot of the connection's client
+    long long accepted_ns;  // time the connection was accepted, or handed back if resumed
+    char client_name[MAX_CLIENT_NAME];  // name of the connection's client
+};
+
+// Metrics shared by the server and all of its workers
+struct ServerMetrics
+{
+    unsigned long long n_connections[N_ROLES];  // connections served in each role
+    int slices_wanted;                          // set while workers should hand connections back after a slice
+};
+
+/**
+ * Converts a port to an integer, verifying that it is valid
+ * 
+ * @param  string port as given on the command line
+ * 
+ * @return the port, or 0 if it is not valid
+ */
+int parse_port(const char *);
+
+/**
+ * Opens a listening socket on a port and makes it non-blocking
+ * 
+ * @param  port port to listen on
+ * @param  role role of the connections accepted on it, one of the ROLE_ values
+ * @param  backlog number of connections the kernel holds before they are accepted
+ * 
+ * @return true if the socket was opened, else false
+ */
+bool add_listener(int, int, int);
+
+/**
+ * Forks a worker process into a slot of the pool, connected to the server by a UNIX socket
+ * 
+ * @param  slot index of the worker within the pool
+ * 
+ * @return true if the worker was started, else false
+ */
+bool start_worker(int);
+
+/**
+ * Reaps terminated child processes, freeing the slots of the connections
+ * any workers among them were serving, and starts a worker in place of each
+ * 
+ * @return true if every worker was replaced, else false
+ */
+bool replace_workers(void);
+
+/**
+ * Sends a handoff over a worker's channel, along with a socket if there is one
+ * 
+ * @param  channel_fd either end of a worker's UNIX socket
+ * @param  socket_fd file descriptor for connected socket; -1 for none
+ * @param  handoff handoff to send
+ * 
+ * @return true if the handoff was sent, else false
+ */
+bool send_handoff(int, int, const struct Handoff *);
+
+/**
+ * Waits for a handoff over a worker's channel
+ * 
+ * @param  channel_fd either end of a worker's UNIX socket
+ * @param  handoff handoff to hold the one received
+ * @param  socket_fd value to hold the file descriptor of the socket sent with it; -1 if none was sent
+ * 
+ * @return true if a handoff was received; false if the other end closed the channel
+ */
+bool receive_handoff(int, struct Handoff *, int *);
+
+/**
+ * Passes a connection that has been given a slot to an idle worker and
+ * closes the server's copy of its socket. If no worker takes it, a new
+ * client is told the server is busy, and a resumed connection is closed.
+ * 
+ * @param  socket_fd file descriptor for connected socket
+ * @param  handoff connection to pass, new or resumed from the lane of large connections
+ */
+void dispatch_connection(int, const struct Handoff *);
+
+/**
+ * Hands free workers the connections waiting for them. New connections go
+ * first, unless the oldest large connection has waited LANE_AGING_MS, and
+ * large connections only run on the workers not kept for new ones. Then
+ * tells workers whether to hand their connections back after a slice.
+ */
+void schedule_connections(void);
+
+/**
+ * Serves the connections the server passes, one at a time, telling the
+ * server after each one that the worker is free and handing the connection
+ * back if it stopped between requests
+ * 
+ * @param  channel_fd worker's end of its UNIX socket to the server
+ */
+void run_worker(int);
+
+/**
+ * Decides, in a worker, whether to hand a connection back between requests:
+ * the connection has been served a slice of symbols, others are waiting,
+ * and no bytes of the next request have been read ahead
+ * 
+ * @param  reader buffered reader for connected socket
+ * @param  n_served symbols served since the worker took the connection
+ * 
+ * @return true if the connection should be handed back, else false
+ */
+bool yield_between_requests(const struct Reader *, long long);
+
+/**
+ * Finds the role of the listener a connection arrived on, by its local port
+ * 
+ * @param  socket_fd file descriptor for connected socket
+ * 
+ * @return role of the listener, one of the ROLE_ values
+ */
+int find_role(int);
+
+/**
+ * Serves a single connection. Reads the client's identifier and hands the
+ * connection to the handler of its role: the listener's role if it has one,
+ * otherwise decryption for dec_client and encryption for every other client.
+ * A resumed connection goes straight to the requests handler of its role.
+ * 
+ * @param  socket_fd file descriptor for connected socket
+ * @param  handoff connection as passed by the server; updated to describe it
+ *         if it is to be handed back
+ * 
+ * @return true if the connection stopped between requests to be handed back, else false
+ */
+bool serve_connection(int, struct Handoff *);
+
+/**
+ * Handler for SIGCHLD signal.
+ * Wakes the server, which reaps terminated workers and replaces them.
+ * 
+ * @param  signo required but not used
+ */
+void handle_SIGCHLD(int);
+
+/**
+ * Setup signal handler for SIGCHLD; set handler to handle_SIGCHLD()
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool catch_SIGCHLD(void);
+
+/**
+ * Handler for SIGUSR1 signal. Asks the server to print its metrics and wakes it.
+ * 
+ * @param  signo required but not used
+ */
+void handle_SIGUSR1(int);
+
+/**
+ * Setup signal handler for SIGUSR1; set handler to handle_SIGUSR1()
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool catch_SIGUSR1(void);
+
+/**
+ * Prints the server's metrics to stderr
+ */
+void print_metrics(void);
+
+#endif
\ No newline at end of file
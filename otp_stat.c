@@ -0,0 +1,189 @@
+/**
+ * @file otp_stat.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Reports the statistics of a running enc_server, dec_server, or otp_server,
+ * in the manner of vmstat. The first line covers the server's lifetime and
+ * each later line the interval (-i) before it: connections, requests, and
+ * symbols in and out per second, errors per second, the connections queued
+ * and in flight, and the 50th, 99th, and 99.9th percentile request latency.
+ * 
+ * A request's latency runs from the moment its header is read to the
+ * moment the server is ready for the next one, and is measured to within
+ * an eighth. Only framed requests are timed.
+ * 
+ * The statistics are read from the server's shared-memory segment without
+ * writing to it, so watching a server does not slow it down. After the last
+ * report (-n), the counts of admissions and of responses by error status
+ * are printed.
+ * 
+ * Usage: otp_stat [-i <interval>] [-n <count>] <server> <port>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "fairness.h"
+#include "admission.h"
+#include "stats.h"
+#include "otp_stat.h"
+#include "util.h"
+
+int main(int argc, char **argv)
+{
+    // Parse options
+    int interval_ms = DEFAULT_INTERVAL_MS;
+    int n_reports = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'i': // Time between reports, in milliseconds
+                interval_ms = atoi(optarg);
+                if (interval_ms <= 0)
+                {
+                    fprintf(stderr, "Error: invalid interval: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'n': // Number of reports; 0 to report until interrupted
+                n_reports = atoi(optarg);
+                if (n_reports < 0)
+                {
+                    fprintf(stderr, "Error: invalid number of reports: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            default:
+                fprintf(stderr, "Usage: otp_stat [-i $interval] [-n $count] $server $port\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        fprintf(stderr, "Usage: otp_stat [-i $interval] [-n $count] $server $port\n");
+        return EXIT_FAILURE;
+    }
+    const char *name = argv[optind];
+    int port = atoi(argv[optind + 1]);
+
+    // Map the server's segment, warning if the server is gone and its last statistics are all there is
+    const struct StatsSegment *segment = attach_stats(name, port);
+    if (segment == NULL)
+    {
+        fprintf(stderr, "Error: no statistics for %s on port %d\n", name, port);
+        return EXIT_FAILURE;
+    }
+    if (kill(segment->pid, 0) < 0 && errno == ESRCH)
+        fprintf(stderr, "Warning: %s (pid %d) is not running; its last statistics follow\n", segment->name, segment->pid);
+
+    // Report the server's lifetime, then each interval
+    static struct StatsSlot before;
+    static struct StatsSlot after;
+    long long before_ns = segment->start_ns;
+    for (int n = 0; n_reports == 0 || n < n_reports; n++)
+    {
+        if (n > 0)
+            usleep(interval_ms * 1000);
+        long long after_ns = monotonic_ns();
+        if (sum_slots(segment, &after) > 0)
+            fprintf(stderr, "Warning: skipped the statistics of a process that died updating them\n");
+
+        // Label each line with the time it ends
+        if (n % ROWS_PER_HEADING == 0)
+            printf("%-8s %8s %8s %10s %10s %8s %6s %6s %8s %8s %8s\n", "time", "conn/s", "req/s", "in/s", "out/s",
+                   "err/s", "queued", "busy", "p50", "p99", "p999");
+        char label[16];
+        time_t now = time(NULL);
+        strftime(label, sizeof(label), "%H:%M:%S", localtime(&now));
+        print_report(label, &before, &after, (after_ns - before_ns) / 1e9);
+        fflush(stdout);
+
+        before = after;
+        before_ns = after_ns;
+    }
+    print_totals(&after);
+
+    return EXIT_SUCCESS;
+}
+
+int sum_slots(const struct StatsSegment *segment, struct StatsSlot *total)
+{
+    memset(total, 0, sizeof(*total));
+    int n_skipped = 0;
+    for (int slot = 0; slot < segment->n_slots; slot++)
+    {
+        struct StatsSlot copy;
+        if (!read_stats_slot(&segment->slots[slot], &copy))
+        {
+            n_skipped++;
+            continue;
+        }
+        for (int i = 0; i < N_STAT_COUNTERS; i++)
+            total->counters[i] += copy.counters[i];
+        for (int i = 0; i < N_STAT_ERRORS; i++)
+            total->errors[i] += copy.errors[i];
+        for (int i = 0; i < STATS_BUCKETS; i++)
+            total->latency[i] += copy.latency[i];
+    }
+    return n_skipped;
+}
+
+void print_report(const char *label, const struct StatsSlot *before, const struct StatsSlot *after, double seconds)
+{
+    if (seconds <= 0)
+        seconds = 1;
+
+    // Rates of the counters over the interval
+    double rates[N_STAT_COUNTERS];
+    for (int i = 0; i < N_STAT_COUNTERS; i++)
+        rates[i] = (after->counters[i] - before->counters[i]) / seconds;
+    unsigned long long n_errors = 0;
+    for (int i = 0; i < N_STAT_ERRORS; i++)
+        n_errors += after->errors[i] - before->errors[i];
+
+    // Percentiles of the requests finished in the interval
+    unsigned long long latency[STATS_BUCKETS];
+    for (int i = 0; i < STATS_BUCKETS; i++)
+        latency[i] = after->latency[i] - before->latency[i];
+    char p50[16];
+    char p99[16];
+    char p999[16];
+    format_latency(find_percentile(latency, 0.5), p50);
+    format_latency(find_percentile(latency, 0.99), p99);
+    format_latency(find_percentile(latency, 0.999), p999);
+
+    printf("%-8s %8.1f %8.1f %10.0f %10.0f %8.1f %6llu %6llu %8s %8s %8s\n", label, rates[STAT_CONNECTIONS],
+           rates[STAT_REQUESTS], rates[STAT_SYMBOLS_IN], rates[STAT_SYMBOLS_OUT], n_errors / seconds,
+           after->counters[STAT_QUEUED], after->counters[STAT_IN_FLIGHT], p50, p99, p999);
+}
+
+void print_totals(const struct StatsSlot *total)
+{
+    printf("connections: %llu served right away, %llu after waiting, %llu turned away\n",
+           total->counters[STAT_ADMITTED], total->counters[STAT_DELAYED], total->counters[STAT_REJECTED]);
+    printf("requests: %llu, %llu symbols in, %llu symbols out\n", total->counters[STAT_REQUESTS],
+           total->counters[STAT_SYMBOLS_IN], total->counters[STAT_SYMBOLS_OUT]);
+    for (int i = 0; i < N_STAT_ERRORS; i++)
+    {
+        if (total->errors[i] > 0)
+            printf("errors: %llu %s\n", total->errors[i], stats_error_name(i));
+    }
+}
\ No newline at end of file
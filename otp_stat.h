@@ -0,0 +1,52 @@
+/**
+ * @file otp_stat.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for otp_stat.c
+ */
+
+#ifndef OTP_STAT
+#define OTP_STAT
+
+// Default time between reports, in milliseconds
+#define DEFAULT_INTERVAL_MS 1000
+
+// Reports between repeats of the column headings
+#define ROWS_PER_HEADING 20
+
+/**
+ * Adds up the slots of every process of a server
+ * 
+ * @param  segment statistics segment of the server
+ * @param  total slot to hold the sums; the sequence is unused
+ * 
+ * @return number of slots skipped because they stayed mid-update
+ */
+int sum_slots(const struct StatsSegment *, struct StatsSlot *);
+
+/**
+ * Prints one line of a report: rates of the counters between two sums of
+ * the slots, the current queue depth and connections in flight, and the
+ * latency percentiles of the requests finished in between
+ * 
+ * @param  label label of the line, such as the time it ends
+ * @param  before sums of the slots at the start of the interval; all zeroes for the server's lifetime
+ * @param  after sums of the slots at the end of the interval
+ * @param  seconds length of the interval
+ */
+void print_report(const char *, const struct StatsSlot *, const struct StatsSlot *, double);
+
+/**
+ * Prints the counts of the server's lifetime that a report leaves out:
+ * admissions, and responses by error status
+ * 
+ * @param  total sums of the slots
+ */
+void print_totals(const struct StatsSlot *);
+
+#endif
\ No newline at end of file
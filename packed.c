@@ -0,0 +1,158 @@
+/**
+ * @file packed.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains functions for the packed symbol format. There are only 27 symbols,
+ * so each fits in 5 bits; 8 symbols are packed little-endian into 5 bytes,
+ * which is 37.5% smaller than one byte per symbol. Groups are packed and
+ * unpacked a 64-bit word at a time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "packed.h"
+
+// A byte's low 5 bits in each byte of a word
+#define LOW_5_BITS 0x1F1F1F1F1F1F1F1FULL
+
+// The high bit of each byte of a word
+#define HIGH_BITS 0x8080808080808080ULL
+
+// Mask of the 5-bit fields at bits 0, 10, 20, and 30 of a group
+#define EVEN_FIELDS 0x07C1F07C1FULL
+
+// Lowest bit of each of the fields in EVEN_FIELDS
+#define EVEN_FIELD_ONES 0x0040100401ULL
+
+// The 40 bits of a packed group
+#define GROUP_BITS 0xFFFFFFFFFFULL
+
+long long packed_size(long long length)
+{
+    return (length + PACKED_GROUP_SYMBOLS - 1) / PACKED_GROUP_SYMBOLS * PACKED_GROUP_SIZE;
+}
+
+/**
+ * Packs 8 symbols into the low 40 bits of a word. Masking a symbol's low
+ * 5 bits maps space to 0 and A-Z to 1-26; the fields are then moved
+ * together in pairs, then quads, then the whole group.
+ * 
+ * @param  symbols 8 symbols to pack
+ * 
+ * @return packed group
+ */
+static unsigned long long pack_group(const char *symbols)
+{
+    unsigned long long word;
+    memcpy(&word, symbols, sizeof(word));
+    word &= LOW_5_BITS;
+    word = (word & 0x001F001F001F001FULL) | ((word & 0x1F001F001F001F00ULL) >> 3);
+    word = (word & 0x000003FF000003FFULL) | ((word & 0x03FF000003FF0000ULL) >> 6);
+    word = (word & 0x00000000000FFFFFULL) | ((word & 0x000FFFFF00000000ULL) >> 12);
+    return word;
+}
+
+/**
+ * Unpacks the low 40 bits of a word into 8 symbols, reversing pack_group()
+ * 
+ * @param  word packed group
+ * @param  symbols buffer of 8 bytes to hold the symbols
+ */
+static void unpack_group(unsigned long long word, char *symbols)
+{
+    word = (word & 0x00000000000FFFFFULL) | ((word & 0x000000FFFFF00000ULL) << 12);
+    word = (word & 0x000003FF000003FFULL) | ((word & 0x000FFC00000FFC00ULL) << 6);
+    word = (word & 0x001F001F001F001FULL) | ((word & 0x03E003E003E003E0ULL) << 3);
+
+    // Add 64 to every byte, then turn the bytes that were 0 from '@' into space
+    unsigned long long zero_bytes = ~(word + 0x7F7F7F7F7F7F7F7FULL) & HIGH_BITS;
+    word = (word | 0x4040404040404040ULL) - (zero_bytes >> 2);
+    memcpy(symbols, &word, sizeof(word));
+}
+
+void pack_symbols(const char *symbols, long long length, char *packed)
+{
+    // Pack every full group
+    long long i = 0;
+    for (; i + PACKED_GROUP_SYMBOLS <= length; i += PACKED_GROUP_SYMBOLS)
+    {
+        unsigned long long word = pack_group(symbols + i);
+        memcpy(packed + i / PACKED_GROUP_SYMBOLS * PACKED_GROUP_SIZE, &word, PACKED_GROUP_SIZE);
+    }
+
+    // Pack a partial final group, filling unused symbols with space
+    if (i < length)
+    {
+        char group[PACKED_GROUP_SYMBOLS];
+        memset(group, ' ', sizeof(group));
+        memcpy(group, symbols + i, length - i);
+        unsigned long long word = pack_group(group);
+        memcpy(packed + i / PACKED_GROUP_SYMBOLS * PACKED_GROUP_SIZE, &word, PACKED_GROUP_SIZE);
+    }
+}
+
+void unpack_symbols(const char *packed, long long length, char *symbols)
+{
+    // Unpack every full group but the last with a whole-word load; the extra bytes are masked off
+    long long i = 0;
+    for (; i + 2 * PACKED_GROUP_SYMBOLS <= length; i += PACKED_GROUP_SYMBOLS)
+    {
+        unsigned long long word;
+        memcpy(&word, packed + i / PACKED_GROUP_SYMBOLS * PACKED_GROUP_SIZE, sizeof(word));
+        unpack_group(word & GROUP_BITS, symbols + i);
+    }
+
+    // Unpack the rest a group at a time; a partial final group is unpacked into a scratch buffer
+    for (; i < length; i += PACKED_GROUP_SYMBOLS)
+    {
+        unsigned long long word = 0;
+        memcpy(&word, packed + i / PACKED_GROUP_SYMBOLS * PACKED_GROUP_SIZE, PACKED_GROUP_SIZE);
+        char group[PACKED_GROUP_SYMBOLS];
+        unpack_group(word, group);
+        memcpy(symbols + i, group, length - i < PACKED_GROUP_SYMBOLS ? length - i : PACKED_GROUP_SYMBOLS);
+    }
+}
+
+bool validate_packed(const char *packed, long long length)
+{
+    // Adding 5 to a field carries into its bit 5 only if the field is 27 or more;
+    // fields are checked in two passes so each has room for the carry
+    unsigned long long invalid = 0;
+    for (long long i = 0; i < length; i += PACKED_GROUP_SYMBOLS)
+    {
+        unsigned long long word = 0;
+        memcpy(&word, packed + i / PACKED_GROUP_SYMBOLS * PACKED_GROUP_SIZE, PACKED_GROUP_SIZE);
+
+        // Ignore unused symbols of a partial final group
+        if (length - i < PACKED_GROUP_SYMBOLS)
+            word &= (1ULL << (5 * (length - i))) - 1;
+
+        invalid |= ((word & EVEN_FIELDS) + 5 * EVEN_FIELD_ONES) | (((word >> 5) & EVEN_FIELDS) + 5 * EVEN_FIELD_ONES);
+    }
+    return (invalid & (EVEN_FIELD_ONES << 5)) == 0;
+}
+
+void build_packed_header(char *header, long long length)
+{
+    memcpy(header, PACKED_MAGIC, 8);
+    for (int i = 0; i < 8; i++)
+        header[8 + i] = (char) ((unsigned long long) length >> (8 * i));
+}
+
+long long parse_packed_header(const char *header)
+{
+    if (memcmp(header, PACKED_MAGIC, 8) != 0)
+        return -1;
+
+    unsigned long long length = 0;
+    for (int i = 0; i < 8; i++)
+        length |= (unsigned long long) (unsigned char) header[8 + i] << (8 * i);
+    return length > (1ULL << 62) ? -1 : (long long) length;
+}
\ No newline at end of file
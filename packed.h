@@ -0,0 +1,86 @@
+/**
+ * @file packed.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for packed.c
+ */
+
+#ifndef PACKED
+#define PACKED
+
+// Capability token a client adds to its handshake to ask for packed payloads
+#define PACKED_CAPABILITY "p5"
+
+// Magic bytes at the start of a packed file
+#define PACKED_MAGIC "OTP27P5\n"
+
+// Size of a packed file's header: the magic bytes and a 64-bit symbol count
+#define PACKED_HEADER_SIZE 16
+
+// Symbols per group; each group of 8 five-bit symbols fills 5 bytes
+#define PACKED_GROUP_SYMBOLS 8
+#define PACKED_GROUP_SIZE 5
+
+/**
+ * Gets the number of bytes that hold a number of packed symbols.
+ * A partial final group takes a whole group's bytes.
+ * 
+ * @param  length number of symbols
+ * 
+ * @return number of packed bytes
+ */
+long long packed_size(long long);
+
+/**
+ * Packs symbols (A-Z and space) into 5 bits each, storing space as 0 and
+ * A-Z as 1-26. Unused symbols of a partial final group are packed as 0.
+ * Symbols may be packed in place, since each group is read before it is written.
+ * 
+ * @param  symbols symbols to pack
+ * @param  length number of symbols to pack
+ * @param  packed buffer of packed_size(length) bytes to hold packed symbols
+ */
+void pack_symbols(const char *, long long, char *);
+
+/**
+ * Unpacks symbols packed by pack_symbols()
+ * 
+ * @param  packed packed symbols
+ * @param  length number of symbols to unpack
+ * @param  symbols buffer of length bytes to hold the symbols
+ */
+void unpack_symbols(const char *, long long, char *);
+
+/**
+ * Checks that every packed symbol is between 0 and 26
+ * 
+ * @param  packed packed symbols to check
+ * @param  length number of symbols to check
+ * 
+ * @return true if every symbol is valid, else false
+ */
+bool validate_packed(const char *, long long);
+
+/**
+ * Builds the header of a packed file
+ * 
+ * @param  header buffer of PACKED_HEADER_SIZE bytes to hold the header
+ * @param  length number of symbols in the file
+ */
+void build_packed_header(char *, long long);
+
+/**
+ * Parses the header of a packed file
+ * 
+ * @param  header first PACKED_HEADER_SIZE bytes of a file
+ * 
+ * @return number of symbols in the file; -1 if the file is not packed
+ */
+long long parse_packed_header(const char *);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,138 @@
+/**
+ * @file pad_store.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains functions for loading pads from a directory and looking them up by ID.
+ * Servers use the store to encrypt and decrypt with key material that never
+ * crosses the network.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netdb.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "pad_store.h"
+
+bool is_valid_pad_id(const char *id)
+{
+    int id_len = strlen(id);
+    if (id_len == 0 || id_len >= MAX_PAD_ID_SIZE)
+        return false;
+
+    // Walk through every character in ID
+    for (int i = 0; i < id_len; i++)
+    {
+        if (!isalnum((unsigned char) id[i]) && id[i] != '.' && id[i] != '_' && id[i] != '-')
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Maps a single pad file into memory and adds it to the store
+ * 
+ * @param  store store to add pad to
+ * @param  path path of pad file
+ * @param  id ID to register pad under
+ * 
+ * @return true if pad was added, else false
+ */
+static bool add_pad(struct PadStore *store, const char *path, const char *id)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    // Skip anything that is not a non-empty regular file
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // Map pad into memory; the mapping remains valid after the file is closed
+    char *symbols = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (symbols == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map pad \"%s\"\n", path);
+        return false;
+    }
+
+    // Pads are read sequentially
+    madvise(symbols, st.st_size, MADV_SEQUENTIAL);
+
+    // Add pad to store
+    store->pads = (struct Pad *) realloc(store->pads, (store->n_pads + 1) * sizeof(struct Pad));
+    struct Pad *pad = &store->pads[store->n_pads++];
+    snprintf(pad->id, sizeof(pad->id), "%s", id);
+    pad->symbols = symbols;
+    pad->length = st.st_size;
+
+    // Do not count a trailing newline
+    if (symbols[pad->length - 1] == '\n')
+        pad->length--;
+
+    return true;
+}
+
+bool load_pad_store(struct PadStore *store, const char *directory)
+{
+    store->pads = NULL;
+    store->n_pads = 0;
+
+    DIR *dir = opendir(directory);
+    if (dir == NULL)
+    {
+        fprintf(stderr, "Error: failed to open pad directory \"%s\"\n", directory);
+        return false;
+    }
+
+    // Walk through every entry in the directory
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        // Skip hidden files and names that are not valid pad IDs
+        if (entry->d_name[0] == '.' || !is_valid_pad_id(entry->d_name))
+            continue;
+
+        // Create path to pad file
+        int path_len = strlen(directory) + strlen(entry->d_name) + 2;
+        char *path = (char *) malloc(path_len);
+        snprintf(path, path_len, "%s/%s", directory, entry->d_name);
+
+        add_pad(store, path, entry->d_name);
+        free(path);
+    }
+    closedir(dir);
+
+    fprintf(stderr, "Loaded %d pads from \"%s\"\n", store->n_pads, directory);
+    return true;
+}
+
+const struct Pad *find_pad(const struct PadStore *store, const char *id)
+{
+    // Walk through every pad in store
+    for (int i = 0; i < store->n_pads; i++)
+    {
+        if (strcmp(store->pads[i].id, id) == 0)
+            return &store->pads[i];
+    }
+    return NULL;
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+/**
+ * @file pad_store.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for pad_store.c
+ */
+
+#ifndef PAD_STORE
+#define PAD_STORE
+
+// Object to hold a pad mapped into memory
+struct Pad
+{
+    char id[MAX_PAD_ID_SIZE];   // name the pad is registered under
+    const char *symbols;        // pad contents
+    long long length;           // number of symbols in the pad, excluding trailing newline
+};
+
+// Object to hold every pad loaded by the server
+struct PadStore
+{
+    struct Pad *pads;
+    int n_pads;
+};
+
+/**
+ * Checks that a pad ID is non-empty, fits in MAX_PAD_ID_SIZE, and contains
+ * only letters, digits, '.', '_', and '-'
+ * 
+ * @param  id pad ID to check
+ * 
+ * @return true if the ID is valid, else false
+ */
+bool is_valid_pad_id(const char *);
+
+/**
+ * Maps every regular file in the specified directory into memory and registers
+ * it under its filename. Files whose names are not valid pad IDs are skipped.
+ * Mappings are read-only and shared, so processes forked after loading
+ * use the same pages.
+ * 
+ * @param  store store to load pads into
+ * @param  directory directory holding pad files
+ * 
+ * @return true if the directory was read, else false
+ */
+bool load_pad_store(struct PadStore *, const char *);
+
+/**
+ * Looks up a pad by ID
+ * 
+ * @param  store store to search
+ * @param  id pad ID to search for
+ * 
+ * @return the matching pad; NULL if no pad is registered under the ID
+ */
+const struct Pad *find_pad(const struct PadStore *, const char *);
+
+#endif
\ No newline at end of file
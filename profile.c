@@ -0,0 +1,303 @@
+/**
+ * @file profile.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the profiling of work with the CPU's performance counters. Each
+ * process opens cycle, instruction, last-level cache miss, and branch miss
+ * counters as a group, so they are always read together, plus its CPU time.
+ * The counters are read as each section of work starts and ends, and their
+ * increase is added to a table of the process's own, by section and by the
+ * size of the message worked on. The tables live in memory shared with the
+ * server, which sums them on request into cycles per byte, instructions per
+ * cycle, and misses per KiB: work with few instructions per cycle and many
+ * cache misses per KiB is bound by memory, not by computation.
+ * 
+ * Hardware counters are often not permitted, in containers and virtual
+ * machines or by perf_event_paranoid. Those that cannot be opened are left
+ * out and only CPU time is profiled; the kernel's share of the work is left
+ * out if counting it is not permitted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <stdbool.h>
+
+#include "profile.h"
+
+// Hardware events counted, as the COUNTER_ values
+static const unsigned long long hardware_events[N_HARDWARE_COUNTERS] =
+{
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// Names of the counters, as they appear in warnings
+static const char *counter_names[N_COUNTERS] =
+{
+    "cycles", "instructions", "LLC misses", "branch misses", "CPU time"
+};
+
+// Names of the size buckets
+static const char *bucket_names[N_SIZE_BUCKETS] =
+{
+    "<=1K", "<=16K", "<=256K", "<=4M", "<=64M", ">64M"
+};
+
+/**
+ * Opens a counter of this process
+ * 
+ * @param  type type of the event counted
+ * @param  config event counted
+ * @param  group_fd counter leading the group the counter joins; -1 to lead a group of its own
+ * @param  user_only whether to leave out the kernel's work
+ * 
+ * @return the counter's descriptor, or -1 if it could not be opened
+ */
+static int open_counter(unsigned int type, unsigned long long config, int group_fd, bool user_only)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = user_only;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * Opens every counter of this process that is permitted
+ * 
+ * @param  profile profile of the process
+ * 
+ * @return the number of counters opened
+ */
+static int open_counters(struct Profile *profile)
+{
+    // Count the kernel's work too, such as copying data to be sent, unless it is not permitted
+    profile->user_only = false;
+    profile->fds[COUNTER_CPU_NS] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1, false);
+    if (profile->fds[COUNTER_CPU_NS] < 0 && (errno == EACCES || errno == EPERM))
+    {
+        profile->user_only = true;
+        profile->fds[COUNTER_CPU_NS] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1, true);
+    }
+    int n_opened = profile->fds[COUNTER_CPU_NS] >= 0 ? 1 : 0;
+
+    // Open the hardware counters as a group, led by the first that opens
+    profile->n_group = 0;
+    int group_fd = -1;
+    for (int i = 0; i < N_HARDWARE_COUNTERS; i++)
+    {
+        profile->fds[i] = open_counter(PERF_TYPE_HARDWARE, hardware_events[i], group_fd, profile->user_only);
+        profile->group_index[i] = -1;
+        if (profile->fds[i] < 0)
+            continue;
+        if (group_fd < 0)
+            group_fd = profile->fds[i];
+        profile->group_index[i] = profile->n_group++;
+        n_opened++;
+    }
+    profile->group_index[COUNTER_CPU_NS] = -1;
+    return n_opened;
+}
+
+/**
+ * Closes every counter of this process
+ * 
+ * @param  profile profile of the process
+ */
+static void close_counters(struct Profile *profile)
+{
+    for (int i = 0; i < N_COUNTERS; i++)
+    {
+        if (profile->fds[i] >= 0)
+            close(profile->fds[i]);
+        profile->fds[i] = -1;
+    }
+}
+
+bool open_profile(struct Profile *profile, const char *name, int n_processes)
+{
+    memset(profile, 0, sizeof(*profile));
+    profile->name = name;
+    for (int i = 0; i < N_COUNTERS; i++)
+        profile->fds[i] = -1;
+
+    // Open the counters first, to find which are permitted
+    if (open_counters(profile) == 0)
+    {
+        fprintf(stderr, "Warning: %s: performance counters are not permitted; profiling is off\n", name);
+        return false;
+    }
+    // Name the counters left out in one warning
+    char missing[128] = "";
+    for (int i = 0; i < N_HARDWARE_COUNTERS; i++)
+    {
+        if (profile->fds[i] < 0)
+            snprintf(missing + strlen(missing), sizeof(missing) - strlen(missing), "%s%s",
+                     missing[0] == '\0' ? "" : ", ", counter_names[i]);
+    }
+    if (missing[0] != '\0')
+        fprintf(stderr, "Warning: %s: %s cannot be counted here and are left out of the profile\n", name, missing);
+    if (profile->user_only)
+        fprintf(stderr, "Warning: %s: only user space is counted, as counting the kernel is not permitted\n", name);
+
+    // Keep the work of each process in tables every process shares
+    profile->tables = mmap(NULL, n_processes * sizeof(struct ProfileTable), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (profile->tables == MAP_FAILED)
+    {
+        fprintf(stderr, "Warning: %s: failed to map profile tables; profiling is off\n", name);
+        profile->tables = NULL;
+        close_counters(profile);
+        return false;
+    }
+    profile->n_tables = n_processes;
+    profile->table = &profile->tables[0];
+    return true;
+}
+
+void use_profile_table(struct Profile *profile, int table)
+{
+    if (profile->tables == NULL)
+        return;
+    close_counters(profile);
+    open_counters(profile);
+    profile->table = &profile->tables[table];
+}
+
+/**
+ * Reads a group of counters, scaled up if they shared the hardware with
+ * other groups and ran only part of the time
+ * 
+ * @param  fd counter leading the group
+ * @param  n number of counters in the group
+ * @param  values array to fill with the group's counts
+ * 
+ * @return true if the counters were read, else false
+ */
+static bool read_group(int fd, int n, long long *values)
+{
+    // The group reads as its size, time enabled, time running, then each count
+    unsigned long long buffer[3 + N_COUNTERS];
+    ssize_t size = (3 + n) * sizeof(unsigned long long);
+    if (read(fd, buffer, size) != size)
+        return false;
+    double scale = buffer[2] > 0 && buffer[2] < buffer[1] ? (double) buffer[1] / buffer[2] : 1.0;
+    for (int i = 0; i < n; i++)
+        values[i] = (long long) (buffer[3 + i] * scale);
+    return true;
+}
+
+void read_counters(const struct Profile *profile, long long *values)
+{
+    for (int i = 0; i < N_COUNTERS; i++)
+        values[i] = 0;
+    if (profile->tables == NULL)
+        return;
+
+    // Read the hardware counters in one call through their leader
+    long long group[N_HARDWARE_COUNTERS];
+    if (profile->n_group > 0)
+    {
+        int leader = 0;
+        while (profile->group_index[leader] != 0)
+            leader++;
+        if (read_group(profile->fds[leader], profile->n_group, group))
+        {
+            for (int i = 0; i < N_HARDWARE_COUNTERS; i++)
+            {
+                if (profile->group_index[i] >= 0)
+                    values[i] = group[profile->group_index[i]];
+            }
+        }
+    }
+    if (profile->fds[COUNTER_CPU_NS] >= 0)
+        read_group(profile->fds[COUNTER_CPU_NS], 1, &values[COUNTER_CPU_NS]);
+}
+
+/**
+ * Finds the size bucket of a message
+ * 
+ * @param  bytes size of the message
+ * 
+ * @return the bucket, from 0 for messages up to 1 KiB
+ */
+static int size_bucket(long long bytes)
+{
+    int bucket = 0;
+    long long limit = 1024;
+    while (bucket < N_SIZE_BUCKETS - 1 && bytes > limit)
+    {
+        bucket++;
+        limit *= 16;
+    }
+    return bucket;
+}
+
+void add_profile(struct Profile *profile, int section, long long bytes, const long long *start, const long long *end)
+{
+    if (profile->table == NULL || section < 0 || section >= MAX_PROFILE_SECTIONS)
+        return;
+
+    // Only this process writes its table; a report may see a run partly added, which it tolerates
+    struct ProfileCell *cell = &profile->table->cells[section][size_bucket(bytes)];
+    cell->n_samples++;
+    cell->bytes += bytes;
+    for (int i = 0; i < N_COUNTERS; i++)
+        cell->counts[i] += end[i] - start[i];
+}
+
+void print_profile(const struct Profile *profile, const char **section_names, int n_sections)
+{
+    if (profile->tables == NULL)
+        return;
+    for (int section = 0; section < n_sections && section < MAX_PROFILE_SECTIONS; section++)
+    {
+        for (int bucket = 0; bucket < N_SIZE_BUCKETS; bucket++)
+        {
+            // Sum the section's work on the bucket's messages over every process
+            struct ProfileCell sum;
+            memset(&sum, 0, sizeof(sum));
+            for (int i = 0; i < profile->n_tables; i++)
+            {
+                const struct ProfileCell *cell = &profile->tables[i].cells[section][bucket];
+                sum.n_samples += cell->n_samples;
+                sum.bytes += cell->bytes;
+                for (int j = 0; j < N_COUNTERS; j++)
+                    sum.counts[j] += cell->counts[j];
+            }
+            if (sum.n_samples == 0)
+                continue;
+
+            // Report the counters that were open per byte, per cycle, or per KiB
+            double bytes = sum.bytes > 0 ? (double) sum.bytes : 1.0;
+            fprintf(stderr, "%s: profile %s %s: %lld runs, %.1f MB", profile->name, section_names[section],
+                    bucket_names[bucket], sum.n_samples, sum.bytes / 1e6);
+            if (profile->fds[COUNTER_CYCLES] >= 0)
+                fprintf(stderr, ", %.2f cycles/B", sum.counts[COUNTER_CYCLES] / bytes);
+            if (profile->fds[COUNTER_CYCLES] >= 0 && profile->fds[COUNTER_INSTRUCTIONS] >= 0)
+                fprintf(stderr, ", IPC %.2f", sum.counts[COUNTER_CYCLES] > 0 ?
+                        (double) sum.counts[COUNTER_INSTRUCTIONS] / sum.counts[COUNTER_CYCLES] : 0.0);
+            if (profile->fds[COUNTER_LLC_MISSES] >= 0)
+                fprintf(stderr, ", %.2f LLC misses/KB", sum.counts[COUNTER_LLC_MISSES] * 1024.0 / bytes);
+            if (profile->fds[COUNTER_BRANCH_MISSES] >= 0)
+                fprintf(stderr, ", %.2f branch misses/KB", sum.counts[COUNTER_BRANCH_MISSES] * 1024.0 / bytes);
+            if (profile->fds[COUNTER_CPU_NS] >= 0)
+                fprintf(stderr, ", %.2f CPU ns/B", sum.counts[COUNTER_CPU_NS] / bytes);
+            fprintf(stderr, "\n");
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+/**
+ * @file profile.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for profile.c
+ */
+
+#ifndef PROFILE
+#define PROFILE
+
+// Counters read around each section of work. The first four are hardware counters, which may not be
+// permitted; the last is the CPU time of the process.
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_LLC_MISSES 2    // misses in the last-level cache
+#define COUNTER_BRANCH_MISSES 3
+#define COUNTER_CPU_NS 4
+#define N_HARDWARE_COUNTERS 4
+#define N_COUNTERS 5
+
+// Most sections of work a profile tells apart
+#define MAX_PROFILE_SECTIONS 16
+
+// Work is bucketed by the size of its message: up to 1 KiB, 16 KiB, 256 KiB, 4 MiB, 64 MiB, and larger
+#define N_SIZE_BUCKETS 6
+
+// Work done in one section on messages of one size bucket
+struct ProfileCell
+{
+    long long n_samples;            // times the section was run
+    long long bytes;                // bytes of the messages it was run on
+    long long counts[N_COUNTERS];   // counters' increase while it ran, as the COUNTER_ values
+};
+
+// Work done by one process, shared so the server can report it while the process adds to it
+struct ProfileTable
+{
+    struct ProfileCell cells[MAX_PROFILE_SECTIONS][N_SIZE_BUCKETS];
+} __attribute__((aligned(64)));
+
+// Object to hold the counters of a process, and the work of every process of a server or benchmark
+struct Profile
+{
+    const char *name;                   // name of the server or benchmark
+    struct ProfileTable *tables;        // table of each process; NULL if not profiling
+    int n_tables;                       // number of tables
+    struct ProfileTable *table;         // table this process adds to
+    int fds[N_COUNTERS];                // descriptor of each counter; -1 if it could not be opened
+    int group_index[N_COUNTERS];        // position of each hardware counter in the group's reads; -1 if not counted
+    int n_group;                        // hardware counters opened as a group, led by the first
+    bool user_only;                     // whether only user space is counted, as the kernel was not permitted
+    long long readings[MAX_PROFILE_SECTIONS][N_COUNTERS];  // counters as each section of the work being profiled started
+};
+
+/**
+ * Opens this process's counters and the tables every process adds to.
+ * Counters that are not permitted are left out with a warning; if none can
+ * be opened, profiling is off.
+ * 
+ * @param  profile object to initialize
+ * @param  name name of the server or benchmark
+ * @param  n_processes number of processes that add to the profile, each to a table of its own
+ * 
+ * @return true if any counter could be opened; false if profiling is off
+ */
+bool open_profile(struct Profile *, const char *, int);
+
+/**
+ * Makes this process count its own work into one of the tables, after it is
+ * forked: counters count only the process that opened them, so they are
+ * opened again.
+ * 
+ * @param  profile profile inherited from the server
+ * @param  table table of the process, from 1 to the number of processes - 1
+ */
+void use_profile_table(struct Profile *, int);
+
+/**
+ * Reads every counter of this process. Counters that are not open read 0.
+ * 
+ * @param  profile profile of the process
+ * @param  values array of N_COUNTERS to fill
+ */
+void read_counters(const struct Profile *, long long *);
+
+/**
+ * Adds a run of a section of work to this process's table. Does nothing if
+ * profiling is off.
+ * 
+ * @param  profile profile of the process
+ * @param  section section of work, below MAX_PROFILE_SECTIONS
+ * @param  bytes size of the message the section was run on
+ * @param  start counters read as the section started
+ * @param  end counters read as the section ended
+ */
+void add_profile(struct Profile *, int, long long, const long long *, const long long *);
+
+/**
+ * Prints to stderr, per section and size bucket, the cycles per byte,
+ * instructions per cycle, cache and branch misses per KiB, and CPU time per
+ * byte of the work of every process
+ * 
+ * @param  profile profile of the server or benchmark
+ * @param  section_names name of each section
+ * @param  n_sections number of sections
+ */
+void print_profile(const struct Profile *, const char **, int);
+
+#endif
\ No newline at end of file
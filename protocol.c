@@ -0,0 +1,261 @@
+/**
+ * @file protocol.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains functions for building, sending, and parsing the headers
+ * of framed requests and responses, and for backing off from a busy server.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <netdb.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "util.h"
+
+void (*header_sent)(const struct Header *) = NULL;
+
+void init_header(struct Header *header)
+{
+    memset(header, '\0', sizeof(*header));
+}
+
+/**
+ * Converts a header value to a non-negative 64-bit integer
+ * 
+ * @param  value string to convert
+ * @param  result value to hold converted integer
+ * 
+ * @return true if value is a valid non-negative integer, else false
+ */
+static bool parse_count(const char *value, long long *result)
+{
+    char *end;
+    *result = strtoll(value, &end, 10);
+    return end != value && *end == '\0' && *result >= 0;
+}
+
+bool parse_header(const char *string, struct Header *header)
+{
+    init_header(header);
+
+    // Copy the header so it can be split into fields
+    char *copy = strdup(string);
+    char *save_ptr;
+    bool success = true;
+
+    // Walk through every name=value field
+    for (char *field = strtok_r(copy, " ", &save_ptr); field != NULL; field = strtok_r(NULL, " ", &save_ptr))
+    {
+        // Split the field at its '='
+        char *value = strchr(field, '=');
+        if (value == NULL)
+        {
+            success = false;
+            break;
+        }
+        *value++ = '\0';
+
+        // Store the value of each known field
+        if (strcmp(field, "st") == 0)
+            snprintf(header->status, sizeof(header->status), "%s", value);
+        else if (strcmp(field, "op") == 0)
+            snprintf(header->operation, sizeof(header->operation), "%s", value);
+        else if (strcmp(field, "off") == 0)
+            success = parse_count(value, &header->offset);
+        else if (strcmp(field, "len") == 0)
+            success = parse_count(value, &header->length);
+        else if (strcmp(field, "pad") == 0)
+            success = snprintf(header->pad_id, sizeof(header->pad_id), "%s", value) < (int) sizeof(header->pad_id);
+        else if (strcmp(field, "kof") == 0)
+            success = parse_count(value, &header->key_offset);
+        else if (strcmp(field, "tok") == 0)
+            success = parse_count(value, &header->token);
+        else if (strcmp(field, "ab") == 0)
+            success = snprintf(header->alphabet, sizeof(header->alphabet), "%s", value) < (int) sizeof(header->alphabet);
+        else if (strcmp(field, "mac") == 0)
+            header->authenticate = strcmp(value, "1") == 0;
+        else if (strcmp(field, "tag") == 0)
+            success = snprintf(header->tag, sizeof(header->tag), "%s", value) < (int) sizeof(header->tag);
+        else if (strcmp(field, "ttl") == 0)
+        {
+            success = parse_count(value, &header->ttl_ms);
+            if (header->ttl_ms > MAX_TTL_MS)
+                header->ttl_ms = MAX_TTL_MS;
+        }
+
+        if (!success)
+            break;
+    }
+
+    free(copy);
+    return success;
+}
+
+const char *describe_status(const char *status)
+{
+    if (strcmp(status, STATUS_OK) == 0)
+        return "success";
+    if (strcmp(status, STATUS_BAD_REQUEST) == 0)
+        return "malformed request";
+    if (strcmp(status, STATUS_NO_PAD) == 0)
+        return "no such pad";
+    if (strcmp(status, STATUS_OUT_OF_RANGE) == 0)
+        return "key extends past end of pad";
+    if (strcmp(status, STATUS_NO_LEDGER) == 0)
+        return "server does not reserve pad ranges";
+    if (strcmp(status, STATUS_EXHAUSTED) == 0)
+        return "pad does not have enough unreserved key";
+    if (strcmp(status, STATUS_UNRESERVED) == 0)
+        return "key range has not been reserved";
+    if (strcmp(status, STATUS_KEY_REUSED) == 0)
+        return "key was already used to encrypt different plaintext";
+    if (strcmp(status, STATUS_NO_GENERATOR) == 0)
+        return "server does not generate keys";
+    if (strcmp(status, STATUS_NO_ALPHABET) == 0)
+        return "server does not support alphabet";
+    if (strcmp(status, STATUS_FORGED) == 0)
+        return "ciphertext failed authentication";
+    if (strcmp(status, STATUS_TIMEOUT) == 0)
+        return "connection exceeded a server deadline";
+    if (strcmp(status, STATUS_EXPIRED) == 0)
+        return "deadline passed before the server finished the request";
+    if (strcmp(status, STATUS_OVERLOADED) == 0)
+        return "server is short of memory";
+    return status;
+}
+
+bool send_header(const struct Header *header, int socket_fd)
+{
+    char string[MAX_HEADER_SIZE];
+    int n = 0;
+
+    // Responses lead with their status
+    if (header->status[0] != '\0')
+        n += snprintf(string + n, sizeof(string) - n, "st=%s ", header->status);
+
+    // Requests other than chunk requests lead with their operation
+    if (header->operation[0] != '\0')
+        n += snprintf(string + n, sizeof(string) - n, "op=%s ", header->operation);
+
+    // Add the chunk's position and size
+    n += snprintf(string + n, sizeof(string) - n, "off=%lld len=%lld", header->offset, header->length);
+
+    // Add the pad and the key's position within it
+    if (header->pad_id[0] != '\0')
+        n += snprintf(string + n, sizeof(string) - n, " pad=%s kof=%lld", header->pad_id, header->key_offset);
+    if (header->token > 0)
+        n += snprintf(string + n, sizeof(string) - n, " tok=%lld", header->token);
+
+    // Name the chunk's alphabet unless it is the default
+    if (header->alphabet[0] != '\0')
+        n += snprintf(string + n, sizeof(string) - n, " ab=%s", header->alphabet);
+
+    // Ask for authentication, and add the chunk's tag
+    if (header->authenticate)
+        n += snprintf(string + n, sizeof(string) - n, " mac=1");
+    if (header->tag[0] != '\0')
+        n += snprintf(string + n, sizeof(string) - n, " tag=%s", header->tag);
+
+    // Add the time the client still waits for the response
+    if (header->ttl_ms > 0)
+        n += snprintf(string + n, sizeof(string) - n, " ttl=%lld", header->ttl_ms);
+
+    n += snprintf(string + n, sizeof(string) - n, "@");
+
+    if (!send_bytes(string, n, socket_fd))
+        return false;
+    if (header_sent != NULL)
+        header_sent(header);
+    return true;
+}
+
+bool read_header(struct Reader *reader, struct Header *header)
+{
+    // Read the header string from the socket, rejecting headers that are too long
+    char *string = read_field(reader, MAX_HEADER_SIZE);
+    if (string == NULL)
+        return false;
+
+    // Reject malformed headers
+    bool success = parse_header(string, header);
+    if (!success)
+        fprintf(stderr, "Error: malformed header: %.64s\n", string);
+
+    free(string);
+    return success;
+}
+
+bool reject_request(struct Reader *reader, struct Header *response, const char *status, long long payload_size)
+{
+    // Discard the payload a piece at a time
+    char piece[16384];
+    while (payload_size > 0)
+    {
+        long long n = payload_size < (long long) sizeof(piece) ? payload_size : (long long) sizeof(piece);
+        if (!read_bytes(reader, piece, n))
+            return false;
+        payload_size -= n;
+    }
+
+    snprintf(response->status, sizeof(response->status), "%s", status);
+    return send_header(response, reader->socket_fd);
+}
+
+bool stamp_deadline(struct Header *header, long long deadline_ns)
+{
+    if (deadline_ns == 0)
+        return true;
+
+    // Round the time left up to a whole millisecond, so a request sent in time never arrives expired
+    long long remaining_ns = deadline_ns - monotonic_ns();
+    if (remaining_ns <= 0)
+        return false;
+    header->ttl_ms = (remaining_ns + 999999) / 1000000;
+    return true;
+}
+
+long long request_deadline(const struct Header *header)
+{
+    return header->ttl_ms > 0 ? monotonic_ns() + header->ttl_ms * 1000000 : 0;
+}
+
+bool parse_busy(const char *reply, int *retry_after_ms)
+{
+    // Busy replies name the time to wait after the busy signal
+    const char *prefix = BUSY_SIGNAL " " RETRY_AFTER_FIELD;
+    if (strncmp(reply, prefix, strlen(prefix)) != 0)
+        return false;
+    *retry_after_ms = atoi(reply + strlen(prefix));
+    if (*retry_after_ms < 1)
+        *retry_after_ms = 1;
+    return true;
+}
+
+void wait_to_retry(int attempt, int retry_after_ms)
+{
+    // Seed the jitter once per process, so clients started together draw different waits
+    static unsigned int seed = 0;
+    if (seed == 0)
+        seed = (unsigned int) getpid() ^ (unsigned int) monotonic_ns();
+
+    // Double the wait with every attempt, up to the cap
+    long long delay_ms = retry_after_ms;
+    for (int i = 1; i < attempt && delay_ms < MAX_BACKOFF_MS; i++)
+        delay_ms *= 2;
+    if (delay_ms > MAX_BACKOFF_MS)
+        delay_ms = MAX_BACKOFF_MS;
+
+    // Sleep for a random time in the upper half of the wait
+    long long jittered_ms = delay_ms / 2 + rand_r(&seed) % (delay_ms / 2 + 1);
+    usleep(jittered_ms * 1000);
+}
\ No newline at end of file
@@ -0,0 +1,194 @@
+/**
+ * @file protocol.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for protocol.c
+ */
+
+#ifndef PROTOCOL
+#define PROTOCOL
+
+// Version token appended to the handshake identity by clients and servers
+// that speak the framed protocol
+#define PROTOCOL_VERSION "v2"
+
+// Number of symbols a client sends per request
+#define CHUNK_SIZE 1048576
+
+// Largest number of symbols a server accepts in one request
+#define MAX_CHUNK_SIZE (64 * CHUNK_SIZE)
+
+// Largest header accepted, including the terminating NULL character
+#define MAX_HEADER_SIZE 320
+
+// Largest pad ID accepted, including the terminating NULL character
+#define MAX_PAD_ID_SIZE 64
+
+// Largest tag accepted, in hexadecimal, including the terminating NULL character
+#define MAX_TAG_SIZE 40
+
+// Response statuses
+#define STATUS_OK "ok"
+#define STATUS_BAD_REQUEST "bad"
+#define STATUS_NO_PAD "nopad"
+#define STATUS_OUT_OF_RANGE "range"
+#define STATUS_NO_LEDGER "noledger"
+#define STATUS_EXHAUSTED "exhausted"
+#define STATUS_UNRESERVED "unreserved"
+#define STATUS_KEY_REUSED "reused"
+#define STATUS_NO_GENERATOR "nogen"
+#define STATUS_NO_ALPHABET "noalpha"
+#define STATUS_FORGED "forged"
+#define STATUS_TIMEOUT "timeout"
+#define STATUS_EXPIRED "expired"
+#define STATUS_OVERLOADED "overloaded"
+
+// Reply a server sends in place of its handshake when it is too busy to serve a client,
+// followed by the time the client should wait before trying again
+#define BUSY_SIGNAL "busy"
+#define RETRY_AFTER_FIELD "retry="
+
+// Number of times a client retries a busy server, and the longest it waits between tries
+#define MAX_BUSY_RETRIES 8
+#define MAX_BACKOFF_MS 5000
+
+// Time a client waits before sending a request the server turned away as overloaded, in milliseconds
+#define OVERLOADED_RETRY_MS 100
+
+// Longest time to live a server honors, in milliseconds; longer ones are cut to it so deadlines cannot overflow
+#define MAX_TTL_MS (24LL * 60 * 60 * 1000)
+
+// Request operations; a request without an operation transforms a chunk
+#define OP_RESERVE "reserve"
+#define OP_GENERATE "gen"
+
+// Fields carried in the header of a request or response frame.
+// A header is sent as space-separated name=value pairs terminated by
+// the stop character, and is followed by the frame's payload.
+struct Header
+{
+    char status[16];        // response status; empty in requests
+    char operation[16];     // request operation; empty for chunk requests
+    long long offset;       // offset of the chunk within the input
+    long long length;       // number of symbols in the chunk
+    char pad_id[MAX_PAD_ID_SIZE];   // server-resident pad to use as key; empty if the key is in the payload
+    long long key_offset;   // offset of the chunk's key within the pad
+    long long token;        // token of the reservation holding the chunk's key; 0 if none
+    char alphabet[16];      // alphabet of the chunk's symbols; empty for A-Z and space
+    bool authenticate;      // whether the chunk's ciphertext is authenticated with a tag
+    char tag[MAX_TAG_SIZE]; // tag of the chunk's ciphertext in hexadecimal; empty if none
+    long long ttl_ms;       // time the client still waits for the response, in milliseconds; 0 for no limit
+};
+
+// Function called with each header once it is sent, so a server can count its responses; NULL for none
+extern void (*header_sent)(const struct Header *);
+
+/**
+ * Resets all header fields to their defaults
+ * 
+ * @param  header header to reset
+ */
+void init_header(struct Header *);
+
+/**
+ * Parses a header string into its fields. Unknown fields are ignored
+ * so that newer peers can add fields without breaking older ones.
+ * 
+ * @param  string header string without its stop character
+ * @param  header header to store parsed fields in
+ * 
+ * @return true if the header is well formed, else false
+ */
+bool parse_header(const char *, struct Header *);
+
+/**
+ * Describes a response status for error messages
+ * 
+ * @param  status response status
+ * 
+ * @return human-readable description of the status
+ */
+const char *describe_status(const char *);
+
+/**
+ * Writes a header and its stop character to the specified socket
+ * 
+ * @param  header header to send
+ * @param  socket_fd socket to write header to
+ * 
+ * @return true if the header was sent, else false
+ */
+bool send_header(const struct Header *, int);
+
+/**
+ * Reads and parses the next header from the specified reader
+ * 
+ * @param  reader reader to read header from
+ * @param  header header to store parsed fields in
+ * 
+ * @return true if a well-formed header was read; false if the connection
+ *         was closed or the header is malformed
+ */
+bool read_header(struct Reader *, struct Header *);
+
+/**
+ * Answers a request with an error once its payload has been read and
+ * discarded in small pieces, so the client reads the error rather than a
+ * connection reset while it was still sending
+ * 
+ * @param  reader buffered reader for connected socket
+ * @param  response response to the request, with its offset set
+ * @param  status status to answer with
+ * @param  payload_size number of bytes in the request's payload
+ * 
+ * @return true if the payload was read and the response sent, else false
+ */
+bool reject_request(struct Reader *, struct Header *, const char *, long long);
+
+/**
+ * Gives a request the time left before a client's deadline, so the server
+ * can abandon the request once the client has stopped waiting for it
+ * 
+ * @param  header request to stamp
+ * @param  deadline_ns monotonic time by which the client needs the response; 0 for none
+ * 
+ * @return true if time is left, or there is no deadline; false if the deadline has passed
+ */
+bool stamp_deadline(struct Header *, long long);
+
+/**
+ * Converts the time left on a request, as received, into a deadline on the server's clock
+ * 
+ * @param  header request as received
+ * 
+ * @return monotonic time after which the client no longer waits for the response; 0 for none
+ */
+long long request_deadline(const struct Header *);
+
+/**
+ * Reads a busy reply sent in place of a server's handshake
+ * 
+ * @param  reply the server's reply, including its stop character
+ * @param  retry_after_ms value to hold the time the server asked the client to wait, in milliseconds
+ * 
+ * @return true if the reply says the server is busy, else false
+ */
+bool parse_busy(const char *, int *);
+
+/**
+ * Sleeps before trying a busy server again. The wait doubles with every
+ * attempt, starting from the time the server asked for and capped at
+ * MAX_BACKOFF_MS, and is drawn at random from its upper half so that
+ * clients turned away together do not all come back together.
+ * 
+ * @param  attempt number of times the server has been busy, starting at 1
+ * @param  retry_after_ms time the server asked the client to wait, in milliseconds
+ */
+void wait_to_retry(int, int);
+
+#endif
\ No newline at end of file
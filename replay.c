@@ -0,0 +1,302 @@
+/**
+ * @file replay.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the replay of captured requests for otp_loadgen. A server's
+ * capture holds a line of JSON per request with its role, operation, size,
+ * the monotonic time it arrived, and the port of the client's connection,
+ * but none of its content. The replay regenerates payloads and keys of the
+ * same sizes and sends each request on a connection of its own client
+ * connection's, at the time it arrived relative to the first, divided by
+ * the replay's speed.
+ * 
+ * Each replayed connection belongs to one process. Connections that do not
+ * overlap in time share a process, so a capture of many short connections
+ * does not need as many processes; connections that overlap each get one,
+ * up to MAX_REPLAY_PROCESSES.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "fairness.h"
+#include "admission.h"
+#include "stats.h"
+#include "otp_loadgen.h"
+#include "replay.h"
+#include "util.h"
+
+/**
+ * Finds the value of a field in a line of JSON
+ * 
+ * @param  line line to search
+ * @param  name name of the field
+ * 
+ * @return the start of the field's value, or NULL if the line has no such field
+ */
+static const char *find_field(const char *line, const char *name)
+{
+    char key[32];
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    const char *field = strstr(line, key);
+    return field == NULL ? NULL : field + strlen(key);
+}
+
+bool load_capture(struct Replay *replay, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: failed to open capture \"%s\"\n", path);
+        return false;
+    }
+
+    char line[MAX_CAPTURE_LINE];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        // Only requests the server described can be replayed, and of those, only chunks and generated keys
+        const char *role = find_field(line, "role");
+        const char *operation = find_field(line, "op");
+        const char *arrival = find_field(line, "arrival_ns");
+        const char *length = find_field(line, "length");
+        const char *port = find_field(line, "conn");
+        const char *new_connection = find_field(line, "new");
+        if (role == NULL || operation == NULL || arrival == NULL || length == NULL || port == NULL ||
+            new_connection == NULL)
+        {
+            replay->n_skipped++;
+            continue;
+        }
+        struct ReplayedRequest request =
+        {
+            arrival_ns: atoll(arrival),
+            length: atoll(length),
+            role: strncmp(role, "\"dec\"", 5) == 0 ? LATENCY_DECRYPT : LATENCY_ENCRYPT,
+            generate: strncmp(operation, "\"gen\"", 5) == 0,
+            port: atoi(port),
+            new_connection: strncmp(new_connection, "true", 4) == 0,
+            stream: -1
+        };
+        if ((!request.generate && strncmp(operation, "\"chunk\"", 7) != 0) ||
+            (request.generate && request.role == LATENCY_DECRYPT) ||
+            request.length <= 0 || request.length > MAX_CHUNK_SIZE || request.port < 0 || request.port > MAX_PORT)
+        {
+            replay->n_skipped++;
+            continue;
+        }
+
+        // Pads, packed and binary payloads, and authentication are not replayed; their requests are sent as text
+        const char *format = find_field(line, "format");
+        const char *key = find_field(line, "key");
+        const char *authenticate = find_field(line, "auth");
+        if ((format != NULL && strncmp(format, "\"text\"", 6) != 0) || (key != NULL && strncmp(key, "\"pad\"", 5) == 0) ||
+            (authenticate != NULL && strncmp(authenticate, "true", 4) == 0))
+            replay->n_adapted++;
+
+        // Add the request, making room for more as needed
+        if (replay->n_requests == replay->n_capacity)
+        {
+            replay->n_capacity = replay->n_capacity == 0 ? 1024 : 2 * replay->n_capacity;
+            replay->requests = realloc(replay->requests, replay->n_capacity * sizeof(struct ReplayedRequest));
+        }
+        replay->requests[replay->n_requests++] = request;
+        if (request.length > replay->max_size)
+            replay->max_size = request.length;
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Orders requests by the time they arrived
+ * 
+ * @param  a first request
+ * @param  b second request
+ * 
+ * @return negative if a arrived first, positive if b did, else 0
+ */
+static int compare_arrivals(const void *a, const void *b)
+{
+    long long a_ns = ((const struct ReplayedRequest *) a)->arrival_ns;
+    long long b_ns = ((const struct ReplayedRequest *) b)->arrival_ns;
+    return a_ns < b_ns ? -1 : a_ns > b_ns;
+}
+
+bool plan_replay(struct Replay *replay)
+{
+    if (replay->n_requests == 0)
+    {
+        fprintf(stderr, "Error: the captures hold no requests that can be replayed\n");
+        return false;
+    }
+    qsort(replay->requests, replay->n_requests, sizeof(struct ReplayedRequest), compare_arrivals);
+
+    // Group requests into connections: a request continues the connection open on its role and port,
+    // unless it was the first on a new one. otp_server may hand a connection to another worker midway,
+    // which does not start a new one.
+    int *open_streams = malloc(N_LATENCIES * (MAX_PORT + 1) * sizeof(int));
+    for (int i = 0; i < N_LATENCIES * (MAX_PORT + 1); i++)
+        open_streams[i] = -1;
+    int n_capacity = 0;
+    replay->n_streams = 0;
+    for (long long i = 0; i < replay->n_requests; i++)
+    {
+        struct ReplayedRequest *request = &replay->requests[i];
+        int *stream = &open_streams[request->role * (MAX_PORT + 1) + request->port];
+        if (*stream < 0 || request->new_connection)
+        {
+            if (replay->n_streams == n_capacity)
+            {
+                n_capacity = n_capacity == 0 ? 256 : 2 * n_capacity;
+                replay->streams = realloc(replay->streams, n_capacity * sizeof(struct ReplayedStream));
+            }
+            *stream = replay->n_streams++;
+            replay->streams[*stream].first_ns = request->arrival_ns;
+            replay->streams[*stream].role = request->role;
+        }
+        request->stream = *stream;
+        replay->streams[*stream].last_ns = request->arrival_ns;
+        replay->streams[*stream].last_request = i;
+    }
+    free(open_streams);
+
+    // Give each connection to the first process free by the time it starts, or to a new process,
+    // or if there are no more, to the process free soonest
+    long long busy_until[MAX_REPLAY_PROCESSES];
+    replay->n_processes = 0;
+    for (int i = 0; i < replay->n_streams; i++)
+    {
+        struct ReplayedStream *stream = &replay->streams[i];
+        int chosen = -1;
+        for (int process = 0; process < replay->n_processes && chosen < 0; process++)
+        {
+            if (busy_until[process] < stream->first_ns)
+                chosen = process;
+        }
+        if (chosen < 0 && replay->n_processes < MAX_REPLAY_PROCESSES)
+        {
+            chosen = replay->n_processes++;
+            busy_until[chosen] = 0;
+        }
+        if (chosen < 0)
+        {
+            chosen = 0;
+            for (int process = 1; process < replay->n_processes; process++)
+            {
+                if (busy_until[process] < busy_until[chosen])
+                    chosen = process;
+            }
+        }
+        stream->process = chosen;
+        if (busy_until[chosen] < stream->last_ns)
+            busy_until[chosen] = stream->last_ns;
+    }
+    return true;
+}
+
+/**
+ * Sends one chunk to enc_server to be encrypted with a key the server
+ * generates, and reads the key and ciphertext
+ * 
+ * @param  socket_fd socket to the server
+ * @param  reader reader of the socket
+ * @param  plaintext symbols to encrypt
+ * @param  length number of symbols
+ * @param  output buffer to hold the key and ciphertext, of twice the length
+ * 
+ * @return true if the server answered with the key and ciphertext, else false
+ */
+static bool generate_chunk(int socket_fd, struct Reader *reader, const char *plaintext, long long length,
+                           char *output)
+{
+    struct Header request;
+    init_header(&request);
+    strcpy(request.operation, OP_GENERATE);
+    request.length = length;
+    if (!send_header(&request, socket_fd) || !send_bytes(plaintext, length, socket_fd))
+        return false;
+
+    struct Header response;
+    return read_header(reader, &response) && strcmp(response.status, STATUS_OK) == 0 &&
+           response.length == length && read_bytes(reader, output, 2 * length);
+}
+
+void run_replay(const struct Replay *replay, const struct LoadConfig *config, int process, const char *plaintext,
+                const char *key, long long start_ns, struct LoadSlot *slot)
+{
+    long long record_ns = start_ns + (long long) (config->warmup_seconds * 1e9);
+    long long first_ns = replay->requests[0].arrival_ns;
+    char *output = (char *) malloc(2 * replay->max_size);
+
+    // A process replays its connections side by side if they overlap, so each keeps a socket of its own
+    int *socket_fds = (int *) malloc(replay->n_streams * sizeof(int));
+    struct Reader *readers = (struct Reader *) malloc(replay->n_streams * sizeof(struct Reader));
+    for (int i = 0; i < replay->n_streams; i++)
+        socket_fds[i] = -1;
+
+    for (long long i = 0; i < replay->n_requests; i++)
+    {
+        const struct ReplayedRequest *request = &replay->requests[i];
+        const struct ReplayedStream *stream = &replay->streams[request->stream];
+        if (stream->process != process)
+            continue;
+
+        // Send the request when it is due, or now if the last one made it late
+        long long due_ns = start_ns + (long long) ((request->arrival_ns - first_ns) / replay->speed);
+        if (monotonic_ns() < due_ns)
+            sleep_until(due_ns);
+        int *socket_fd = &socket_fds[request->stream];
+        struct Reader *reader = &readers[request->stream];
+        if (*socket_fd < 0)
+        {
+            bool is_dec = stream->role == LATENCY_DECRYPT;
+            *socket_fd = connect_role(is_dec ? config->dec_port : config->enc_port, is_dec ? "dec" : "enc", slot);
+            if (*socket_fd < 0)
+            {
+                slot->n_errors++;
+                continue;
+            }
+            init_reader(reader, *socket_fd);
+        }
+
+        // Send symbols from the same place for the same request in every replay; random symbols decrypt as well
+        // as ciphertext does
+        long long offset = (long long) ((i * 2654435761ULL) % replay->max_size);
+        bool success = request->generate ?
+                       generate_chunk(*socket_fd, reader, plaintext + offset, request->length, output) :
+                       transform_chunk(*socket_fd, reader, plaintext + offset, key + offset, request->length, output);
+        long long done_ns = monotonic_ns();
+        if (success && due_ns >= record_ns)
+        {
+            slot->n_requests++;
+            slot->n_symbols += request->length;
+            record_latency(slot, request->role, done_ns - due_ns);
+        }
+
+        // Close the connection after its last request, or after a failure, since the server may have closed it;
+        // its next request connects again
+        if (!success)
+            slot->n_errors++;
+        if (!success || i == stream->last_request)
+        {
+            free_reader(reader);
+            close(*socket_fd);
+            *socket_fd = -1;
+        }
+    }
+
+    free(socket_fds);
+    free(readers);
+    free(output);
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+/**
+ * @file replay.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for replay.c
+ */
+
+#ifndef REPLAY
+#define REPLAY
+
+// Most captures replayed together, such as one of enc_server and one of dec_server
+#define MAX_CAPTURES 8
+
+// Most processes replaying connections at once; connections that overlap beyond this wait their turn
+#define MAX_REPLAY_PROCESSES 256
+
+// Largest line read from a capture
+#define MAX_CAPTURE_LINE 1024
+
+// Seed of the symbols replayed, so every replay sends the same payloads
+#define REPLAY_SEED 1
+
+// Request read from a capture
+struct ReplayedRequest
+{
+    long long arrival_ns;       // monotonic time the server read the request's header
+    long long length;           // symbols in the request's chunk
+    int role;                   // LATENCY_ENCRYPT or LATENCY_DECRYPT
+    bool generate;              // whether the server generated the request's key
+    int port;                   // port of the client's connection, which tells it from others
+    bool new_connection;        // whether the request was the first on its connection
+    int stream;                 // connection the request is replayed on
+};
+
+// Connection replayed, holding the requests captured on one client connection
+struct ReplayedStream
+{
+    long long first_ns;         // arrival of the connection's first request
+    long long last_ns;          // arrival of the connection's last request
+    long long last_request;     // index of the connection's last request
+    int role;                   // LATENCY_ENCRYPT or LATENCY_DECRYPT
+    int process;                // process that replays the connection
+};
+
+// Object to hold the requests of the captures, and how they are spread over connections and processes
+struct Replay
+{
+    struct ReplayedRequest *requests;   // requests in order of arrival
+    long long n_requests;               // number of requests
+    long long n_capacity;               // requests the array has room for
+    long long n_skipped;                // lines that are not requests that can be replayed
+    long long n_adapted;                // requests replayed as text chunks with keys in the payload
+    struct ReplayedStream *streams;     // connections in order of their first request
+    int n_streams;                      // number of connections
+    int n_processes;                    // processes the connections are spread over
+    long long max_size;                 // largest request
+    double speed;                       // how many times faster than captured the requests are sent
+};
+
+/**
+ * Reads the requests of a capture, adding them to those of earlier
+ * captures. Requests with server-resident pads, packed or binary payloads,
+ * or authentication are replayed as text chunks of the same size with their
+ * keys in the payload; pad reservations are skipped.
+ * 
+ * @param  replay object to add the requests to; zeroed before the first capture
+ * @param  path capture written by a server's -C option
+ * 
+ * @return true if the capture was read, else false
+ */
+bool load_capture(struct Replay *, const char *);
+
+/**
+ * Orders the requests by arrival, groups them into the connections they
+ * arrived on, and spreads the connections over processes, giving each
+ * process connections that do not overlap in time while processes are
+ * left
+ * 
+ * @param  replay requests of every capture
+ * 
+ * @return true if there are requests to replay, else false
+ */
+bool plan_replay(struct Replay *);
+
+/**
+ * Replays the connections of one process, sending each request when it is
+ * due at the replay's speed and recording its latency from then, so a
+ * request held up behind a slow one counts the time it waited
+ * 
+ * @param  replay planned replay
+ * @param  config load generated, with the servers' ports and the warmup
+ * @param  process process to replay the connections of
+ * @param  plaintext random symbols to send, of twice the largest request
+ * @param  key random key symbols, of twice the largest request
+ * @param  start_ns time the first request is due
+ * @param  slot results of the process
+ */
+void run_replay(const struct Replay *, const struct LoadConfig *, int, const char *, const char *, long long,
+                struct LoadSlot *);
+
+#endif
\ No newline at end of file
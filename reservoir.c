@@ -0,0 +1,166 @@
+/**
+ * @file reservoir.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the key reservoir used to generate keys for clients. A background
+ * process keeps a ring of blocks filled with symbols from the CSPRNG, so a
+ * connection that needs a fresh key only copies it out. A connection takes
+ * sole ownership of a block with a compare-and-swap while it copies, so two
+ * connections never receive the same symbols.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#include "csprng.h"
+#include "reservoir.h"
+
+/**
+ * Body of the refilling process: fills every empty block, then sleeps
+ * briefly whenever all blocks are full. Never returns.
+ * 
+ * @param  shared reservoir to keep full
+ */
+static void refill_blocks(struct ReservoirShared *shared)
+{
+    // Seed a keystream of this process's own; each block gets a new stream of it
+    unsigned char seed[CSPRNG_SEED_SIZE];
+    if (!seed_csprng(seed))
+        exit(EXIT_FAILURE);
+
+    while (true)
+    {
+        // Exit if the server has exited
+        if (getppid() == 1)
+            exit(EXIT_SUCCESS);
+
+        // Walk through every block, filling those that are empty
+        bool refilled = false;
+        for (int i = 0; i < RESERVOIR_BLOCKS; i++)
+        {
+            struct ReservoirBlock *block = &shared->blocks[i];
+            int expected = BLOCK_EMPTY;
+            if (!__atomic_compare_exchange_n(&block->state, &expected, BLOCK_FILLING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                continue;
+
+            struct Csprng rng;
+            init_csprng(&rng, seed, shared->n_refills++);
+            generate_symbols(&rng, shared->symbols[i], RESERVOIR_BLOCK_SIZE);
+            block->used = 0;
+            __atomic_store_n(&block->state, BLOCK_FULL, __ATOMIC_RELEASE);
+            refilled = true;
+        }
+
+        if (!refilled)
+            usleep(RESERVOIR_IDLE_US);
+    }
+}
+
+bool open_reservoir(struct Reservoir *reservoir)
+{
+    // Create reservoir shared by every process forked from this one; every block starts empty
+    reservoir->shared = mmap(NULL, sizeof(struct ReservoirShared), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (reservoir->shared == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map key reservoir\n");
+        return false;
+    }
+
+    // Start refilling process
+    reservoir->refill_pid = fork();
+    switch (reservoir->refill_pid)
+    {
+        case -1: // Fork failed
+            fprintf(stderr, "Error: fork() failed\n");
+            return false;
+
+        case 0: // Child process
+            // Exit along with the server
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            refill_blocks(reservoir->shared);
+    }
+    return true;
+}
+
+/**
+ * Generates key symbols in the calling process, for when the reservoir is empty
+ * 
+ * @param  key buffer to hold the key
+ * @param  length number of symbols to generate
+ * 
+ * @return true if the key was generated, else false
+ */
+static bool generate_fallback_symbols(char *key, long long length)
+{
+    // Each connection process seeds its own keystream the first time it needs one
+    static struct Csprng rng;
+    static bool seeded = false;
+    if (!seeded)
+    {
+        unsigned char seed[CSPRNG_SEED_SIZE];
+        if (!seed_csprng(seed))
+            return false;
+        init_csprng(&rng, seed, 0);
+        memset(seed, 0, sizeof(seed));
+        seeded = true;
+    }
+
+    generate_symbols(&rng, key, length);
+    return true;
+}
+
+bool draw_key_symbols(struct Reservoir *reservoir, char *key, long long length)
+{
+    struct ReservoirShared *shared = reservoir->shared;
+    long long n_drawn = 0;
+
+    // Walk around the ring until the key is filled or a full lap finds nothing to take
+    int i = __atomic_load_n(&shared->next_block, __ATOMIC_RELAXED);
+    for (int n_checked = 0; n_drawn < length && n_checked < RESERVOIR_BLOCKS; i = (i + 1) % RESERVOIR_BLOCKS)
+    {
+        // Take sole ownership of the block if it holds unused symbols
+        struct ReservoirBlock *block = &shared->blocks[i];
+        int expected = BLOCK_FULL;
+        if (!__atomic_compare_exchange_n(&block->state, &expected, BLOCK_TAKEN, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            n_checked++;
+            continue;
+        }
+        n_checked = 0;
+
+        // Copy out as many symbols as are needed, erasing them from the reservoir
+        long long n = RESERVOIR_BLOCK_SIZE - block->used;
+        if (n > length - n_drawn)
+            n = length - n_drawn;
+        memcpy(key + n_drawn, shared->symbols[i] + block->used, n);
+        memset(shared->symbols[i] + block->used, 0, n);
+        block->used += n;
+        n_drawn += n;
+
+        // Hand the block back, or to the refilling process once it is used up
+        __atomic_store_n(&block->state, block->used == RESERVOIR_BLOCK_SIZE ? BLOCK_EMPTY : BLOCK_FULL, __ATOMIC_RELEASE);
+        if (block->used < RESERVOIR_BLOCK_SIZE)
+            break;
+    }
+    __atomic_store_n(&shared->next_block, i, __ATOMIC_RELAXED);
+
+    // Generate whatever the reservoir could not supply
+    if (n_drawn < length)
+    {
+        __atomic_fetch_add(&shared->n_fallbacks, 1, __ATOMIC_RELAXED);
+        return generate_fallback_symbols(key + n_drawn, length - n_drawn);
+    }
+    return true;
+}
\ No newline at end of file
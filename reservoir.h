@@ -0,0 +1,82 @@
+/**
+ * @file reservoir.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for reservoir.c
+ */
+
+#ifndef RESERVOIR
+#define RESERVOIR
+
+// Number of symbols in each block of the reservoir (256 KiB)
+#define RESERVOIR_BLOCK_SIZE 262144
+
+// Number of blocks in the reservoir (16 MiB of symbols)
+#define RESERVOIR_BLOCKS 64
+
+// Number of microseconds the refilling process sleeps when every block is full
+#define RESERVOIR_IDLE_US 1000
+
+// States of a reservoir block
+#define BLOCK_EMPTY 0       // waiting to be refilled
+#define BLOCK_FILLING 1     // being refilled
+#define BLOCK_FULL 2        // holds unused symbols from offset used onward
+#define BLOCK_TAKEN 3       // symbols are being copied out by a connection
+
+// State of one reservoir block, padded to a full cache line
+struct ReservoirBlock
+{
+    int state;              // one of the BLOCK_ states
+    int used;               // number of symbols already handed out
+    char padding[64 - 2 * sizeof(int)];
+};
+
+// Reservoir state shared by the server, its connections, and the refilling process
+struct ReservoirShared
+{
+    long long n_refills;        // number of blocks generated
+    long long n_fallbacks;      // number of draws that found the reservoir empty
+    int next_block;             // block the next draw starts looking at
+    char padding[64 - 2 * sizeof(long long) - sizeof(int)];
+    struct ReservoirBlock blocks[RESERVOIR_BLOCKS];
+    char symbols[RESERVOIR_BLOCKS][RESERVOIR_BLOCK_SIZE];
+};
+
+// Object to hold an open reservoir
+struct Reservoir
+{
+    struct ReservoirShared *shared;     // blocks in memory shared across processes
+    pid_t refill_pid;                   // process that keeps the blocks full
+};
+
+/**
+ * Creates an empty reservoir in shared memory and starts a process that
+ * fills it with key symbols and refills blocks as they are used up.
+ * The process exits when the server does.
+ * Must be called before forking so every connection shares the reservoir.
+ * 
+ * @param  reservoir reservoir to open
+ * 
+ * @return true if the reservoir was opened, else false
+ */
+bool open_reservoir(struct Reservoir *);
+
+/**
+ * Takes key symbols from the reservoir. Each symbol is handed out once and
+ * then erased from the reservoir. If the reservoir runs dry, the rest of the
+ * key is generated by the calling process.
+ * 
+ * @param  reservoir reservoir to draw from
+ * @param  key buffer to hold the key
+ * @param  length number of symbols to draw
+ * 
+ * @return true if the key was filled, else false
+ */
+bool draw_key_symbols(struct Reservoir *, char *, long long);
+
+#endif
\ No newline at end of file
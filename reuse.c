@@ -0,0 +1,243 @@
+/**
+ * @file reuse.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the key reuse detector. Blocks of 16 key symbols are hashed and
+ * recorded in a blocked Bloom filter in shared memory: every block at the
+ * start of a chunk, and sampled blocks of the rest. Each block sets
+ * three bits for its key and three for its key and input together, all in
+ * one 64-bit word, so recording a block is one atomic OR that never takes a
+ * lock. The filter keeps two generations, with each word of one beside the
+ * matching word of the other, so a lookup in both is one cache miss. The
+ * older generation is cleared whenever the current one fills up or has been
+ * collecting for a whole time window, so memory stays bounded and old
+ * fingerprints decay instead of saturating the filter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+
+#include "reuse.h"
+#include "util.h"
+
+// Number of blocks hashed and prefetched before their lines are probed
+#define PROBE_BATCH_SIZE 32
+
+// Number of bits of a hash used to pick a line, a bucket within it, and each bit within a word
+#define LINE_INDEX_BITS 20
+#define BUCKET_INDEX_BITS 2
+#define BIT_INDEX_BITS 6
+
+// Multiplier used to mix hashed words (2^64 divided by the golden ratio)
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+bool open_reuse_detector(struct ReuseDetector *detector)
+{
+    // Create filter shared by every process forked from this one
+    detector->shared = mmap(NULL, sizeof(struct ReuseShared), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (detector->shared == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map reuse filter\n");
+        return false;
+    }
+
+    // Back the filter with huge pages where the system allows it, since probes are random
+    madvise(detector->shared, sizeof(struct ReuseShared), MADV_HUGEPAGE);
+
+    // Write every page now: populating shared memory leaves its pages to fault on their first write,
+    // which would otherwise cost a new key's probes far more than the cache miss
+    memset(detector->shared->lines, 0, sizeof(detector->shared->lines));
+    detector->shared->started_ns = monotonic_ns();
+    return true;
+}
+
+/**
+ * Hashes one block of key and the input at the same position in one pass.
+ * Four independent lanes, two for the key and two for the input, keep the
+ * multiplies from waiting on each other.
+ * 
+ * @param  key key symbols to hash
+ * @param  input input symbols to hash
+ * @param  key_hash set to the 64-bit hash of the key
+ * @param  pair_hash set to the 64-bit hash of the key and input together
+ */
+static inline void hash_block(const char *key, const char *input, unsigned long long *key_hash,
+                              unsigned long long *pair_hash)
+{
+    unsigned long long lane_1 = 0, lane_2 = ~0ULL;
+    unsigned long long lane_3 = HASH_MULTIPLIER, lane_4 = ~HASH_MULTIPLIER;
+    for (int i = 0; i < REUSE_BLOCK_SIZE; i += 16)
+    {
+        unsigned long long word_1, word_2, word_3, word_4;
+        memcpy(&word_1, key + i, sizeof(word_1));
+        memcpy(&word_2, key + i + 8, sizeof(word_2));
+        memcpy(&word_3, input + i, sizeof(word_3));
+        memcpy(&word_4, input + i + 8, sizeof(word_4));
+        lane_1 = (lane_1 ^ word_1) * HASH_MULTIPLIER;
+        lane_2 = (lane_2 ^ word_2) * HASH_MULTIPLIER;
+        lane_3 = (lane_3 ^ word_3) * HASH_MULTIPLIER;
+        lane_4 = (lane_4 ^ word_4) * HASH_MULTIPLIER;
+        lane_1 ^= lane_1 >> 32;
+        lane_2 ^= lane_2 >> 29;
+        lane_3 ^= lane_3 >> 32;
+        lane_4 ^= lane_4 >> 29;
+    }
+    unsigned long long hash = (lane_1 ^ (lane_2 << 1 | lane_2 >> 63)) * HASH_MULTIPLIER;
+    *key_hash = hash ^ hash >> 31;
+    hash = (*key_hash ^ lane_3 ^ (lane_4 << 1 | lane_4 >> 63)) * HASH_MULTIPLIER;
+    *pair_hash = hash ^ hash >> 31;
+}
+
+/**
+ * Gets the position of the next block of a chunk to fingerprint: the next
+ * of the chunk's dense blocks, or after them, the next block whose position
+ * in the key is a multiple of the sample interval
+ * 
+ * @param  position position of the current block within the chunk
+ * @param  key_offset position of the chunk within the key
+ * 
+ * @return position of the next block within the chunk
+ */
+static inline long long next_block(long long position, long long key_offset)
+{
+    long long interval = REUSE_BLOCK_SIZE * REUSE_SAMPLE_INTERVAL;
+    long long next = position + REUSE_BLOCK_SIZE;
+    if (next < REUSE_BLOCK_SIZE * REUSE_DENSE_BLOCKS)
+        return next;
+    return (key_offset + next + interval - 1) / interval * interval - key_offset;
+}
+
+/**
+ * Gets the bucket a block's fingerprint lives in: a line, picked by the
+ * lowest bits of the key's hash, and a bucket within it, by the next bits
+ * 
+ * @param  shared filter holding the bucket
+ * @param  hash hash of the block's key
+ * 
+ * @return the bucket's two words, indexed by generation
+ */
+static inline unsigned long long *find_bucket(struct ReuseShared *shared, unsigned long long hash)
+{
+    unsigned long long *line = shared->lines[hash & (REUSE_FILTER_LINES - 1)];
+    return line + 2 * (hash >> LINE_INDEX_BITS & (REUSE_LINE_WORDS / 2 - 1));
+}
+
+/**
+ * Picks three bits of a word with a hash
+ * 
+ * @param  hash hash picking the bits, used from its lowest bit
+ * 
+ * @return word with the bits set
+ */
+static inline unsigned long long pick_bits(unsigned long long hash)
+{
+    unsigned long long bits = 0;
+    for (int i = 0; i < 3; i++, hash >>= BIT_INDEX_BITS)
+        bits |= 1ULL << (hash & 63);
+    return bits;
+}
+
+/**
+ * Starts a new generation if the current one is full or has been collecting
+ * for a whole time window, clearing the older generation to hold it.
+ * Whichever process first notices does the clearing; fingerprints other
+ * processes insert while it clears may be lost.
+ * 
+ * @param  shared filter to rotate
+ * 
+ * @return index of the current generation
+ */
+static int rotate_generations(struct ReuseShared *shared)
+{
+    long long now = monotonic_ns();
+    long long window_ns = REUSE_WINDOW_SECONDS * 1000000000LL;
+    long long generation = __atomic_load_n(&shared->generation, __ATOMIC_ACQUIRE);
+    long long started_ns = __atomic_load_n(&shared->started_ns, __ATOMIC_RELAXED);
+
+    if (now - started_ns < window_ns &&
+        __atomic_load_n(&shared->n_fingerprints, __ATOMIC_RELAXED) < REUSE_GENERATION_CAPACITY)
+        return generation % 2;
+
+    if (__atomic_compare_exchange_n(&shared->generation, &generation, generation + 1, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        // Clear the older generation's word of every bucket, or if the previous generation is also older
+        // than a window, the whole filter
+        if (now - started_ns >= 2 * window_ns)
+            memset(shared->lines, 0, sizeof(shared->lines));
+        else
+        {
+            unsigned long long *words = &shared->lines[0][0];
+            for (long long i = (generation + 1) % 2; i < REUSE_FILTER_LINES * REUSE_LINE_WORDS; i += 2)
+                words[i] = 0;
+        }
+
+        __atomic_store_n(&shared->n_fingerprints, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&shared->started_ns, now, __ATOMIC_RELEASE);
+        generation++;
+    }
+    return generation % 2;
+}
+
+int check_key_reuse(struct ReuseDetector *detector, const char *input, const char *key,
+                    long long key_offset, long long length)
+{
+    struct ReuseShared *shared = detector->shared;
+    int current = rotate_generations(shared);
+
+    // Find the first block that starts within the chunk
+    long long position = (key_offset + REUSE_BLOCK_SIZE - 1) / REUSE_BLOCK_SIZE * REUSE_BLOCK_SIZE - key_offset;
+
+    int n_suspicious = 0;
+    long long n_fingerprints = 0;
+    unsigned long long *buckets[PROBE_BATCH_SIZE];
+    unsigned long long key_bits[PROBE_BATCH_SIZE];
+    unsigned long long pair_bits[PROBE_BATCH_SIZE];
+    while (position + REUSE_BLOCK_SIZE <= length)
+    {
+        // Hash a batch of blocks and prefetch their buckets so the probes' cache misses overlap
+        int n_blocks = 0;
+        for (; n_blocks < PROBE_BATCH_SIZE && position + REUSE_BLOCK_SIZE <= length;
+             n_blocks++, position = next_block(position, key_offset))
+        {
+            unsigned long long key_hash, pair_hash;
+            hash_block(key + position, input + position, &key_hash, &pair_hash);
+            buckets[n_blocks] = find_bucket(shared, key_hash);
+            key_bits[n_blocks] = pick_bits(key_hash >> (LINE_INDEX_BITS + BUCKET_INDEX_BITS));
+            pair_bits[n_blocks] = pick_bits(pair_hash);
+            __builtin_prefetch(buckets[n_blocks], 1);
+        }
+
+        // Record each block, counting key that was seen before but not with this input. The word is only
+        // written when a bit is missing, so a retransmission never takes a locked instruction.
+        for (int i = 0; i < n_blocks; i++)
+        {
+            unsigned long long bits = key_bits[i] | pair_bits[i];
+            unsigned long long seen = __atomic_load_n(&buckets[i][current], __ATOMIC_RELAXED);
+            if ((seen & bits) != bits)
+            {
+                seen = __atomic_fetch_or(&buckets[i][current], bits, __ATOMIC_RELAXED);
+                seen |= __atomic_load_n(&buckets[i][1 - current], __ATOMIC_RELAXED);
+            }
+            if ((seen & key_bits[i]) == key_bits[i] && (seen & pair_bits[i]) != pair_bits[i])
+                n_suspicious++;
+        }
+        n_fingerprints += n_blocks;
+    }
+    __atomic_fetch_add(&shared->n_fingerprints, n_fingerprints, __ATOMIC_RELAXED);
+
+    // Report reuse once enough blocks match to rule out a false positive, or every block of a short chunk
+    if (n_suspicious == 0 || (n_suspicious < REUSE_MIN_MATCHES && n_suspicious < n_fingerprints))
+        return 0;
+    __atomic_fetch_add(&shared->n_suspected, 1, __ATOMIC_RELAXED);
+    return n_suspicious;
+}
\ No newline at end of file
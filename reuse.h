@@ -0,0 +1,100 @@
+/**
+ * @file reuse.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for reuse.c
+ */
+
+#ifndef REUSE
+#define REUSE
+
+// Number of key symbols in each fingerprinted block; 16 random symbols are as likely
+// to recur by chance as a 76-bit key
+#define REUSE_BLOCK_SIZE 16
+
+// Number of blocks at the start of a chunk that are all fingerprinted, so short messages are checked
+#define REUSE_DENSE_BLOCKS 32
+
+// Number of blocks between the blocks fingerprinted after a chunk's dense blocks; only blocks
+// whose position in the key is a multiple of this many blocks are fingerprinted
+#define REUSE_SAMPLE_INTERVAL 512
+
+// Number of 64-bit words in each line of the filter. A line holds REUSE_LINE_WORDS / 2 buckets,
+// each a word of the current generation beside a word of the previous one, and a fingerprint's
+// bits all lie in one bucket, so a block costs one cache miss and one atomic OR.
+#define REUSE_LINE_WORDS 8
+
+// Number of lines in the filter (64 MiB, half of it for each generation)
+#define REUSE_FILTER_LINES 1048576
+
+// Number of blocks a generation collects before it is retired; at a sixteenth of a block
+// per bucket, a block's key is falsely seen about once in half a million blocks
+#define REUSE_GENERATION_CAPACITY (REUSE_FILTER_LINES / 4)
+
+// Number of seconds a generation collects fingerprints before it is retired
+#define REUSE_WINDOW_SECONDS 3600
+
+// Number of suspicious blocks in one request needed to report reuse,
+// so a lone false positive is not reported; a request with fewer blocks
+// needs all of them. A range of key reused at the same position is always
+// reported if it holds this many of either request's dense blocks, or
+// spans one more than this many sample intervals.
+#define REUSE_MIN_MATCHES 2
+
+// Filter state shared by every process forked from the server.
+// Fingerprints are inserted into the current generation and looked up
+// in both it and the previous generation, whose words are interleaved.
+struct ReuseShared
+{
+    long long generation;       // number of the current generation
+    long long started_ns;       // time the current generation started
+    long long n_fingerprints;   // number of blocks recorded in the current generation
+    long long n_suspected;      // number of requests reported as reusing key
+    char padding[REUSE_LINE_WORDS * sizeof(long long) - 4 * sizeof(long long)];
+    unsigned long long lines[REUSE_FILTER_LINES][REUSE_LINE_WORDS];
+};
+
+// Object to hold an open reuse detector
+struct ReuseDetector
+{
+    struct ReuseShared *shared;     // filter in memory shared across processes
+};
+
+/**
+ * Creates an empty filter in shared memory.
+ * Must be called before forking so every process shares the filter.
+ * 
+ * @param  detector detector to open
+ * 
+ * @return true if the detector was opened, else false
+ */
+bool open_reuse_detector(struct ReuseDetector *);
+
+/**
+ * Fingerprints the key of a chunk and records the fingerprints in the filter.
+ * A block of key counts as suspicious if it has been seen before with
+ * different input; the same key with the same input is a retransmission,
+ * which reveals nothing new. Blocks are aligned to their position in the
+ * key so a range reused at the same position always produces the same
+ * fingerprints, whatever chunk boundaries the requests used. Every block
+ * of the chunk's first REUSE_DENSE_BLOCKS is fingerprinted, so short messages
+ * are checked too.
+ * 
+ * @param  detector detector to check against
+ * @param  input input chunk
+ * @param  key key for the input chunk
+ * @param  key_offset position of the key within the key file or pad
+ * @param  length number of symbols in the chunk
+ * 
+ * @return number of suspicious blocks if there are enough to report reuse,
+ *         else 0; possibly a false positive, but a block that really was
+ *         reused is always counted while its fingerprint remains in the filter
+ */
+int check_key_reuse(struct ReuseDetector *, const char *, const char *, long long, long long);
+
+#endif
\ No newline at end of file
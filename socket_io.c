@@ -15,10 +15,15 @@
 #include <string.h>
 #include <sys/types.h>  
 #include <sys/socket.h> 
+#include <sys/time.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
 
 #include "socket_io.h"
+#include "util.h"
 
 int connect_to_server(int port)
 {
@@ -36,9 +41,29 @@ int connect_to_server(int port)
     if ( connect(socket_fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) )
         return -1;
 
+    // Send a request's header and payload as soon as they are written, rather than holding the payload
+    // back until the header is acknowledged
+    int no_delay = 1;
+    setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
     return socket_fd; 
 }
 
+void set_receive_deadline(int socket_fd, long long deadline_ns)
+{
+    if (deadline_ns == 0)
+        return;
+
+    // Wait at least a millisecond, since a zero timeout would wait forever
+    long long remaining_ms = (deadline_ns - monotonic_ns()) / 1000000;
+    if (remaining_ms < 1)
+        remaining_ms = 1;
+    struct timeval limit;
+    limit.tv_sec = remaining_ms / 1000;
+    limit.tv_usec = (remaining_ms % 1000) * 1000;
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+}
+
 bool setup_client_socket_addr(struct sockaddr_in *address, int port)
 {
     // Zero out address struct
@@ -105,7 +130,199 @@ void send_string(char *string_to_send, int socket_fd)
     } while (total_written < msg_len); // Iterate until entire message has been sent
 }
 
-int setup_listen_socket(int port)
+bool send_bytes(const char *bytes, long long n, int socket_fd)
+{
+    long long total_written = 0;    // Total number of bytes written
+
+    // Iterate until every byte has been sent
+    while (total_written < n)
+    {
+        // Send the unsent portion of the buffer
+        ssize_t n_written = send(socket_fd, bytes + total_written, n - total_written, MSG_NOSIGNAL);
+        if (n_written < 0)
+        {
+            // Retry if interrupted by a signal
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error: failed to write to socket\n");
+            return false;
+        }
+
+        // Keep track of total number of bytes sent
+        total_written += n_written;
+    }
+    return true;
+}
+
+void init_reader(struct Reader *reader, int socket_fd)
+{
+    reader->socket_fd = socket_fd;
+    reader->buffer = (char *) malloc(BUFFER_SIZE);
+    reader->start = 0;
+    reader->end = 0;
+    reader->deadline_ns = 0;
+    reader->timed_out = false;
+}
+
+void set_reader_deadline(struct Reader *reader, long long deadline_ns)
+{
+    reader->deadline_ns = deadline_ns;
+    reader->timed_out = false;
+}
+
+void free_reader(struct Reader *reader)
+{
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+/**
+ * Waits until the reader's socket has bytes to read or its deadline passes
+ * 
+ * @param  reader reader to wait on
+ * 
+ * @return true if the socket is readable, or the reader has no deadline;
+ *         false if the deadline passed, marking the reader timed out
+ */
+static bool wait_for_bytes(struct Reader *reader)
+{
+    if (reader->deadline_ns == 0)
+        return true;
+
+    struct pollfd poll_fd;
+    poll_fd.fd = reader->socket_fd;
+    poll_fd.events = POLLIN;
+    while (true)
+    {
+        // Wait no longer than the time left, rounded up to a whole millisecond
+        long long remaining_ns = reader->deadline_ns - monotonic_ns();
+        if (remaining_ns <= 0)
+            break;
+        int n_ready = poll(&poll_fd, 1, (int) ((remaining_ns + 999999) / 1000000));
+        if (n_ready > 0)
+            return true;
+        if (n_ready < 0 && errno != EINTR)
+            return true;
+    }
+    reader->timed_out = true;
+    return false;
+}
+
+/**
+ * Refills the reader's buffer with a single recv(), waiting no longer than its deadline
+ * 
+ * @param  reader reader to refill; must have no unconsumed bytes
+ * 
+ * @return true if at least one byte was received, else false
+ */
+static bool refill_reader(struct Reader *reader)
+{
+    ssize_t n_read;
+    if (!wait_for_bytes(reader))
+        return false;
+
+    // Retry the read if interrupted by a signal
+    do
+        n_read = recv(reader->socket_fd, reader->buffer, BUFFER_SIZE, 0);
+    while (n_read < 0 && errno == EINTR);
+
+    // A return of 0 means the peer closed the connection
+    if (n_read < 0)
+        fprintf(stderr, "Error: failed to read from socket\n");
+    if (n_read <= 0)
+        return false;
+
+    reader->start = 0;
+    reader->end = n_read;
+    return true;
+}
+
+char *read_field(struct Reader *reader, long long max_size)
+{
+    // Create string to store the field
+    int field_size = 64;
+    int field_len = 0;
+    char *field = (char *) malloc(field_size);
+
+    while (true)
+    {
+        // Refill the buffer once it has been consumed
+        if (reader->start == reader->end && !refill_reader(reader))
+        {
+            free(field);
+            return NULL;
+        }
+
+        // Search the buffered bytes for the stop character
+        char *chunk = reader->buffer + reader->start;
+        int chunk_len = reader->end - reader->start;
+        char *stop = memchr(chunk, '@', chunk_len);
+        int n_copy = stop == NULL ? chunk_len : stop - chunk;
+
+        // Give up on a field that cannot fit, rather than buffering whatever the peer sends
+        if (field_len + n_copy + 1 > max_size)
+        {
+            fprintf(stderr, "Error: field longer than %lld bytes\n", max_size - 1);
+            free(field);
+            return NULL;
+        }
+
+        // If the field is larger than the string, resize the string
+        while (field_len + n_copy + 1 > field_size)
+        {
+            field_size *= 2;
+            field = (char *) realloc(field, field_size);
+        }
+
+        // Add the bytes preceding the stop character to the field
+        memcpy(field + field_len, chunk, n_copy);
+        field_len += n_copy;
+        reader->start += n_copy;
+
+        // Consume the stop character and return once it has been found
+        if (stop != NULL)
+        {
+            reader->start++;
+            field[field_len] = '\0';
+            return field;
+        }
+    }
+}
+
+bool read_bytes(struct Reader *reader, char *bytes, long long n)
+{
+    long long total_n_read = 0;     // Total number of bytes read
+
+    // Take any buffered bytes first
+    int n_buffered = reader->end - reader->start;
+    if (n_buffered > 0)
+    {
+        int n_copy = n < n_buffered ? n : n_buffered;
+        memcpy(bytes, reader->buffer + reader->start, n_copy);
+        reader->start += n_copy;
+        total_n_read = n_copy;
+    }
+
+    // Read the remainder directly from the socket
+    while (total_n_read < n)
+    {
+        if (!wait_for_bytes(reader))
+            return false;
+        ssize_t n_read = recv(reader->socket_fd, bytes + total_n_read, n - total_n_read, 0);
+        if (n_read < 0 && errno == EINTR)
+            continue;
+        if (n_read < 0)
+            fprintf(stderr, "Error: failed to read from socket\n");
+        if (n_read <= 0)
+            return false;
+
+        // Keep track of total number of bytes read
+        total_n_read += n_read;
+    }
+    return true;
+}
+
+int setup_listen_socket(int port, int backlog)
 {
     // Create and configure address struct
     struct sockaddr_in server_addr;
@@ -126,8 +343,12 @@ int setup_listen_socket(int port)
         return -1;
     }
     
+    // Send responses without waiting on acknowledgements; accepted sockets inherit the option
+    int no_delay = 1;
+    setsockopt(listen_socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
     // Listen to the socket and return its file descriptor
-    listen(listen_socket, MAX_CONNECTIONS);
+    listen(listen_socket, backlog);
     return listen_socket;
 }
 
@@ -144,5 +365,4 @@ void setup_server_socket_addr(struct sockaddr_in *address, int port)
 
     // Allow connection to any address
     address->sin_addr.s_addr = INADDR_ANY;
-}
-
+}
\ No newline at end of file
@@ -18,6 +18,17 @@
 #define BUFFER_SIZE 81920
 #define MAX_PORT 65535
 
+// Buffered reader over a connected socket
+struct Reader
+{
+    int socket_fd;          // socket to read from
+    char *buffer;           // bytes received but not yet consumed
+    int start;              // index of first unconsumed byte in buffer
+    int end;                // index one past last received byte in buffer
+    long long deadline_ns;  // monotonic time by which reads must complete; 0 for no deadline
+    bool timed_out;         // whether a read gave up because the deadline passed
+};
+
 /**
  * Creates socket and connects to server on localhost at specified port
  * 
@@ -27,6 +38,15 @@
  */
 int connect_to_server(int);
 
+/**
+ * Limits how long a recv() on the specified socket may wait, so that it
+ * returns an error rather than blocking past a deadline
+ * 
+ * @param  socket_fd socket to limit
+ * @param  deadline_ns monotonic time in nanoseconds, as from monotonic_ns(); 0 for no deadline
+ */
+void set_receive_deadline(int, long long);
+
 /**
  * Configures socket address for client for connecting to localhost on specified port
  * 
@@ -45,14 +65,76 @@ bool setup_client_socket_addr(struct sockaddr_in *, int);
  */
 void send_string(char *, int);
 
+/**
+ * Writes exactly n bytes from the specified buffer to the specified socket.
+ * No stop character is appended.
+ * 
+ * @param  bytes buffer to write to socket
+ * @param  n number of bytes to write
+ * @param  socket_fd socket to write bytes to
+ * 
+ * @return true if all bytes were written, else false
+ */
+bool send_bytes(const char *, long long, int);
+
+/**
+ * Initializes a buffered reader for the specified socket
+ * 
+ * @param  reader reader to initialize
+ * @param  socket_fd socket to read from
+ */
+void init_reader(struct Reader *, int);
+
+/**
+ * Sets the time by which a reader's reads must complete. A read still
+ * waiting for bytes when the deadline passes fails and marks the reader timed out.
+ * 
+ * @param  reader reader to set the deadline of
+ * @param  deadline_ns monotonic time in nanoseconds, as from monotonic_ns(); 0 for no deadline
+ */
+void set_reader_deadline(struct Reader *, long long);
+
+/**
+ * Frees memory held by a buffered reader. Does not close the socket.
+ * 
+ * @param  reader reader to free
+ */
+void free_reader(struct Reader *);
+
+/**
+ * Reads from the socket until the stop character ('@') is found.
+ * Bytes following the stop character remain buffered for the next read.
+ * 
+ * @param  reader reader to read from
+ * @param  max_size size of the largest field accepted, counting its terminating null byte
+ * 
+ * @return newly allocated string holding the field without its stop character;
+ *         NULL if the connection was closed, the field grew too long, or an
+ *         error was encountered
+ */
+char *read_field(struct Reader *, long long);
+
+/**
+ * Reads exactly n bytes from the socket into the specified buffer
+ * 
+ * @param  reader reader to read from
+ * @param  bytes buffer to store bytes in
+ * @param  n number of bytes to read
+ * 
+ * @return true if n bytes were read; false if the connection was closed
+ *         or an error was encountered
+ */
+bool read_bytes(struct Reader *, char *, long long);
+
 /**
  * Creates a socket, binds it to specified port, and listens to it
  * 
  * @param  port specified port number
+ * @param  backlog number of connections the kernel holds before they are accepted
  * 
  * @return file descriptor of new listen socket
  */
-int setup_listen_socket(int);
+int setup_listen_socket(int, int);
 
 /**
  * Configures socket address for server for connecting to localhost on specified port
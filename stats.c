@@ -0,0 +1,328 @@
+/**
+ * @file stats.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the statistics the servers publish for otp_stat. A server
+ * creates a POSIX shared-memory segment holding a slot for its main process
+ * and one for each process serving connections. Each slot sits on cache
+ * lines of its own and is only ever written by one process at a time, so
+ * updates need no locks and never contend.
+ * 
+ * Each slot is guarded by a sequence lock: its process makes the sequence
+ * odd before an update and even again after, and a reader copies the slot
+ * and tries again if the sequence was odd or changed meanwhile. Readers
+ * never write to the segment, so they cost the server nothing.
+ * 
+ * Request latencies are counted in log-linear buckets: each power of two of
+ * nanoseconds is split into STATS_SUB_BUCKETS buckets, enough to read
+ * percentiles to within an eighth.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "fairness.h"
+#include "admission.h"
+#include "stats.h"
+#include "util.h"
+
+// Statuses whose responses are counted, in the order of the error counts
+static const char *error_statuses[N_STAT_ERRORS - 1] =
+{
+    STATUS_BAD_REQUEST, STATUS_NO_PAD, STATUS_OUT_OF_RANGE, STATUS_NO_LEDGER, STATUS_EXHAUSTED,
+    STATUS_UNRESERVED, STATUS_KEY_REUSED, STATUS_NO_GENERATOR, STATUS_NO_ALPHABET, STATUS_FORGED,
+    STATUS_TIMEOUT, STATUS_EXPIRED, STATUS_OVERLOADED
+};
+
+// Statistics of this process, whose slot counts the headers it sends
+static struct Stats *sending_stats = NULL;
+
+/**
+ * Builds the name of a server's segment
+ * 
+ * @param  name name of the server
+ * @param  port port the server listens on
+ * @param  path buffer of 64 characters to hold the segment's name
+ */
+static void segment_name(const char *name, int port, char *path)
+{
+    snprintf(path, 64, "/%s.%d", name, port);
+}
+
+bool open_stats(struct Stats *stats, const char *name, int port)
+{
+    stats->segment = NULL;
+    stats->slot = NULL;
+    stats->request_start_ns = 0;
+
+    // Create the segment afresh, replacing one left by an earlier server on the port
+    char path[64];
+    segment_name(name, port, path);
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(struct StatsSegment)) < 0)
+    {
+        fprintf(stderr, "Warning: failed to create statistics segment %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    struct StatsSegment *segment = mmap(NULL, sizeof(struct StatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED)
+    {
+        fprintf(stderr, "Warning: failed to map statistics segment %s\n", path);
+        return false;
+    }
+
+    // The pages start zeroed; describe the segment, then mark it ready
+    segment->version = STATS_VERSION;
+    segment->n_slots = STATS_SLOTS;
+    segment->pid = (int) getpid();
+    segment->start_ns = monotonic_ns();
+    snprintf(segment->name, sizeof(segment->name), "%s", name);
+    __atomic_store_n(&segment->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+
+    stats->segment = segment;
+    stats->slot = &segment->slots[0];
+    return true;
+}
+
+/**
+ * Starts an update of a slot, making its sequence odd. A process killed
+ * partway through an update leaves the sequence odd, so the next process
+ * in its slot moves it on to another odd value.
+ * 
+ * @param  slot slot to update
+ */
+static void begin_update(struct StatsSlot *slot)
+{
+    __atomic_store_n(&slot->sequence, (slot->sequence + 2) | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Finishes an update of a slot, making its sequence even again
+ * 
+ * @param  slot slot updated
+ */
+static void end_update(struct StatsSlot *slot)
+{
+    __atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Adds to a value of a slot being updated. Only the slot's process writes
+ * it, so the store needs no read-modify-write; it is atomic only so readers
+ * never see half of it.
+ * 
+ * @param  value value to add to
+ * @param  n amount to add
+ */
+static void add_value(unsigned long long *value, unsigned long long n)
+{
+    __atomic_store_n(value, *value + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * Counts a header this process sent: the symbols of a successful response,
+ * or the error of any other response. Requests the server sends, which
+ * have no status, are not counted.
+ * 
+ * @param  header header sent
+ */
+static void count_header(const struct Header *header)
+{
+    struct StatsSlot *slot = sending_stats->slot;
+    if (header->status[0] == '\0')
+        return;
+    begin_update(slot);
+    if (strcmp(header->status, STATUS_OK) == 0)
+        add_value(&slot->counters[STAT_SYMBOLS_OUT], header->length);
+    else
+    {
+        int kind = 0;
+        while (kind < N_STAT_ERRORS - 1 && strcmp(header->status, error_statuses[kind]) != 0)
+            kind++;
+        add_value(&slot->errors[kind], 1);
+    }
+    end_update(slot);
+}
+
+void use_stats_slot(struct Stats *stats, int slot)
+{
+    if (stats->segment == NULL)
+        return;
+    stats->slot = &stats->segment->slots[slot];
+    stats->request_start_ns = 0;
+    sending_stats = stats;
+    header_sent = count_header;
+}
+
+void count_connection(struct Stats *stats)
+{
+    if (stats->slot == NULL)
+        return;
+    begin_update(stats->slot);
+    add_value(&stats->slot->counters[STAT_CONNECTIONS], 1);
+    end_update(stats->slot);
+}
+
+void start_request(struct Stats *stats, const struct Header *request)
+{
+    if (stats->slot == NULL)
+        return;
+    stats->request_start_ns = monotonic_ns();
+    begin_update(stats->slot);
+    add_value(&stats->slot->counters[STAT_REQUESTS], 1);
+    add_value(&stats->slot->counters[STAT_SYMBOLS_IN], request->length);
+    end_update(stats->slot);
+}
+
+void finish_request(struct Stats *stats)
+{
+    if (stats->slot == NULL || stats->request_start_ns == 0)
+        return;
+    int bucket = latency_bucket(monotonic_ns() - stats->request_start_ns);
+    stats->request_start_ns = 0;
+    begin_update(stats->slot);
+    add_value(&stats->slot->latency[bucket], 1);
+    end_update(stats->slot);
+}
+
+void publish_admission(struct Stats *stats, const struct Admission *admission)
+{
+    if (stats->slot == NULL)
+        return;
+    struct StatsSlot *slot = stats->slot;
+    begin_update(slot);
+    __atomic_store_n(&slot->counters[STAT_ADMITTED], admission->n_admitted, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->counters[STAT_DELAYED], admission->n_delayed, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->counters[STAT_REJECTED], admission->n_rejected, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->counters[STAT_QUEUED], admission->n_queued, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->counters[STAT_IN_FLIGHT], admission->n_in_flight, __ATOMIC_RELAXED);
+    end_update(slot);
+}
+
+const struct StatsSegment *attach_stats(const char *name, int port)
+{
+    char path[64];
+    segment_name(name, port, path);
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    const struct StatsSegment *segment = mmap(NULL, sizeof(struct StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED)
+        return NULL;
+
+    // Accept only a segment this layout describes
+    if (__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC || segment->version != STATS_VERSION ||
+        segment->n_slots != STATS_SLOTS)
+    {
+        munmap((void *) segment, sizeof(struct StatsSegment));
+        return NULL;
+    }
+    return segment;
+}
+
+bool read_stats_slot(const struct StatsSlot *slot, struct StatsSlot *copy)
+{
+    for (int attempt = 0; attempt < STATS_READ_ATTEMPTS; attempt++)
+    {
+        unsigned long long before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            sched_yield();
+            continue;
+        }
+
+        // Copy every value, then check that no update started meanwhile
+        for (int i = 0; i < N_STAT_COUNTERS; i++)
+            copy->counters[i] = __atomic_load_n(&slot->counters[i], __ATOMIC_RELAXED);
+        for (int i = 0; i < N_STAT_ERRORS; i++)
+            copy->errors[i] = __atomic_load_n(&slot->errors[i], __ATOMIC_RELAXED);
+        for (int i = 0; i < STATS_BUCKETS; i++)
+            copy->latency[i] = __atomic_load_n(&slot->latency[i], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before)
+        {
+            copy->sequence = before;
+            return true;
+        }
+    }
+    return false;
+}
+
+int latency_bucket(long long ns)
+{
+    // Values below STATS_SUB_BUCKETS get a bucket each
+    if (ns < STATS_SUB_BUCKETS)
+        return ns < 0 ? 0 : (int) ns;
+
+    // Otherwise the leading bit picks the power of two, and the bits after it the bucket within it
+    int exponent = 63 - __builtin_clzll((unsigned long long) ns);
+    int sub_bucket = (int) (ns >> (exponent - STATS_SUB_BUCKET_BITS)) & (STATS_SUB_BUCKETS - 1);
+    int bucket = (exponent - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS + sub_bucket;
+    return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+
+long long bucket_floor(int bucket)
+{
+    if (bucket < STATS_SUB_BUCKETS)
+        return bucket;
+    int exponent = bucket / STATS_SUB_BUCKETS + STATS_SUB_BUCKET_BITS - 1;
+    int sub_bucket = bucket % STATS_SUB_BUCKETS;
+    return (1LL << exponent) + ((long long) sub_bucket << (exponent - STATS_SUB_BUCKET_BITS));
+}
+
+const char *stats_error_name(int index)
+{
+    return index < N_STAT_ERRORS - 1 ? error_statuses[index] : "other";
+}
+
+long long find_percentile(const unsigned long long *latency, double fraction)
+{
+    unsigned long long n_requests = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++)
+        n_requests += latency[i];
+    if (n_requests == 0)
+        return -1;
+
+    // Find the first bucket that brings the count to the percentile's rank
+    unsigned long long rank = (unsigned long long) (fraction * n_requests + 0.5);
+    if (rank < 1)
+        rank = 1;
+    unsigned long long n_seen = 0;
+    int bucket = 0;
+    while (bucket < STATS_BUCKETS - 1 && (n_seen += latency[bucket]) < rank)
+        bucket++;
+    return bucket_floor(bucket + 1) - 1;
+}
+
+void format_latency(long long ns, char *string)
+{
+    if (ns < 0)
+        strcpy(string, "-");
+    else if (ns < 1000)
+        snprintf(string, 16, "%lldns", ns);
+    else if (ns < 1000000)
+        snprintf(string, 16, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(string, 16, "%.1fms", ns / 1e6);
+    else
+        snprintf(string, 16, "%.1fs", ns / 1e9);
+}
\ No newline at end of file
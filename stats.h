@@ -0,0 +1,193 @@
+/**
+ * @file stats.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for stats.c
+ */
+
+#ifndef STATS
+#define STATS
+
+// Identifies a statistics segment, and the version of its layout
+#define STATS_MAGIC 0x5354415453505430ULL
+#define STATS_VERSION 1
+
+// Number of slots: one for the server's main process and one for each process serving connections
+#define STATS_SLOTS 257
+
+// Latency histograms have STATS_SUB_BUCKETS buckets per power of two of nanoseconds,
+// so a bucket is at most 1/8 wider than its lower bound
+#define STATS_SUB_BUCKET_BITS 3
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+#define STATS_BUCKETS (40 * STATS_SUB_BUCKETS)
+
+// Counters of a slot. The last two are levels, not counts, and only the main process sets them.
+#define STAT_CONNECTIONS 0      // connections served
+#define STAT_REQUESTS 1         // framed requests read
+#define STAT_SYMBOLS_IN 2       // symbols the requests asked to have transformed
+#define STAT_SYMBOLS_OUT 3      // symbols answered successfully
+#define STAT_ADMITTED 4         // connections served right away
+#define STAT_DELAYED 5          // connections that waited in the queue
+#define STAT_REJECTED 6         // connections turned away as busy
+#define STAT_QUEUED 7           // connections waiting in the queue
+#define STAT_IN_FLIGHT 8        // connections being served
+#define N_STAT_COUNTERS 9
+
+// Responses other than success are counted by status, with any status not listed counted last
+#define N_STAT_ERRORS 14
+
+// Attempts a reader makes to copy a slot before giving up on it
+#define STATS_READ_ATTEMPTS 1000
+
+// Counters and latency histogram of one process, updated by that process alone
+struct StatsSlot
+{
+    unsigned long long sequence;                        // odd while the slot is being updated
+    unsigned long long counters[N_STAT_COUNTERS];       // counts, as the STAT_ values
+    unsigned long long errors[N_STAT_ERRORS];           // responses by error status
+    unsigned long long latency[STATS_BUCKETS];          // requests by time from header read to next request
+} __attribute__((aligned(64)));
+
+// Statistics segment of a server, shared with readers in other processes
+struct StatsSegment
+{
+    unsigned long long magic;                           // STATS_MAGIC once the segment is set up
+    int version;                                        // STATS_VERSION
+    int n_slots;                                        // number of slots
+    int pid;                                            // process ID of the server
+    long long start_ns;                                 // monotonic time the server started
+    char name[32];                                      // name of the server
+    struct StatsSlot slots[STATS_SLOTS];                // slot of each process
+};
+
+// Object to hold a process's view of its server's statistics
+struct Stats
+{
+    struct StatsSegment *segment;                       // segment of the server; NULL if there is none
+    struct StatsSlot *slot;                             // slot this process updates
+    long long request_start_ns;                         // time the current request's header was read; 0 if none
+};
+
+/**
+ * Creates the statistics segment of a server, named /NAME.PORT, and takes its first slot
+ * 
+ * @param  stats object to initialize
+ * @param  name name of the server
+ * @param  port port the server listens on
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool open_stats(struct Stats *, const char *, int);
+
+/**
+ * Makes this process update one of the slots, after it is forked to serve connections.
+ * Every header it sends is then counted by status.
+ * 
+ * @param  stats statistics inherited from the server
+ * @param  slot slot of the process, from 1 to STATS_SLOTS - 1
+ */
+void use_stats_slot(struct Stats *, int);
+
+/**
+ * Counts a connection this process starts serving
+ * 
+ * @param  stats statistics of the process
+ */
+void count_connection(struct Stats *);
+
+/**
+ * Counts a framed request whose header was just read and starts timing it
+ * 
+ * @param  stats statistics of the process
+ * @param  request header of the request
+ */
+void start_request(struct Stats *, const struct Header *);
+
+/**
+ * Records the latency of the request being timed, if any; called once the
+ * response has been sent, before the next request is read
+ * 
+ * @param  stats statistics of the process
+ */
+void finish_request(struct Stats *);
+
+/**
+ * Publishes the admission counts and queue depth of the server, from its main process
+ * 
+ * @param  stats statistics of the server
+ * @param  admission admission control of the server
+ */
+void publish_admission(struct Stats *, const struct Admission *);
+
+/**
+ * Maps the statistics segment of a running server for reading
+ * 
+ * @param  name name of the server
+ * @param  port port the server listens on
+ * 
+ * @return the segment, or NULL if it does not exist or is not a statistics segment
+ */
+const struct StatsSegment *attach_stats(const char *, int);
+
+/**
+ * Copies a slot as it was at one moment, retrying while its process is updating it
+ * 
+ * @param  slot slot to read
+ * @param  copy slot to hold the copy
+ * 
+ * @return true if a consistent copy was made; false if the slot stayed mid-update
+ *         for STATS_READ_ATTEMPTS attempts, as when its process died updating it
+ */
+bool read_stats_slot(const struct StatsSlot *, struct StatsSlot *);
+
+/**
+ * Finds the histogram bucket of a latency
+ * 
+ * @param  ns latency in nanoseconds
+ * 
+ * @return index of the bucket
+ */
+int latency_bucket(long long);
+
+/**
+ * Finds the smallest latency of a histogram bucket
+ * 
+ * @param  bucket index of the bucket
+ * 
+ * @return lower bound of the bucket, in nanoseconds
+ */
+long long bucket_floor(int);
+
+/**
+ * Names the status counted in a slot of the error counts
+ * 
+ * @param  index index of the count
+ * 
+ * @return status of the count; "other" for the last
+ */
+const char *stats_error_name(int);
+
+/**
+ * Finds a percentile of a latency histogram
+ * 
+ * @param  latency counts of the histogram's buckets
+ * @param  fraction fraction of the requests at or below the percentile, such as 0.99
+ * 
+ * @return upper bound of the bucket holding the percentile, in nanoseconds; -1 if the histogram is empty
+ */
+long long find_percentile(const unsigned long long *, double);
+
+/**
+ * Writes a latency in the unit that suits it, such as 870us or 12.5ms
+ * 
+ * @param  ns latency in nanoseconds; -1 for none
+ * @param  string buffer of 16 characters to hold the latency
+ */
+void format_latency(long long, char *);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,167 @@
+/**
+ * @file timeouts.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the deadlines servers hold connections to, so that a slow or
+ * stalled client cannot keep a slot forever. A client must finish its
+ * handshake within the handshake deadline of being accepted, send each
+ * request's payload within the body deadline of its header, and send its
+ * next request within the idle deadline of the last one.
+ * 
+ * Each connection is served by a process of its own, so it only ever waits
+ * on one deadline at a time: every read polls the socket for no longer than
+ * the time left. A connection that misses a deadline gets an error frame
+ * and is closed, and the miss is counted in memory shared by every process.
+ * 
+ * Clients may also give each request the time they will wait for it. Once
+ * that time has passed, the server answers the request as expired instead
+ * of spending more work on a response nobody will read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "timeouts.h"
+#include "util.h"
+
+// Names of the deadlines, for warnings and counts
+static const char *timeout_names[N_TIMEOUT_KINDS] = { "handshake", "body", "idle" };
+
+bool parse_timeouts(struct Timeouts *timeouts, const char *spec)
+{
+    // Read each deadline in turn, separated by colons
+    const char *start = spec;
+    for (int i = 0; i < N_TIMEOUT_KINDS; i++)
+    {
+        char *end;
+        timeouts->limits_ms[i] = strtoll(start, &end, 10);
+        char separator = i < N_TIMEOUT_KINDS - 1 ? ':' : '\0';
+        if (end == start || *end != separator || timeouts->limits_ms[i] < 0)
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+bool open_timeouts(struct Timeouts *timeouts)
+{
+    timeouts->n_expired = mmap(NULL, (N_TIMEOUT_KINDS + 1) * sizeof(unsigned long long), PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (timeouts->n_expired == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map timeout counts\n");
+        return false;
+    }
+    timeouts->n_abandoned = timeouts->n_expired + N_TIMEOUT_KINDS;
+    return true;
+}
+
+void start_deadline(const struct Timeouts *timeouts, struct Reader *reader, int kind, long long start_ns)
+{
+    long long limit_ms = timeouts->limits_ms[kind];
+    set_reader_deadline(reader, limit_ms > 0 ? start_ns + limit_ms * 1000000 : 0);
+}
+
+/**
+ * Sets a socket option limiting how long a send or receive may block to the body deadline
+ * 
+ * @param  timeouts deadlines of the server
+ * @param  socket_fd file descriptor for connected socket
+ * @param  option SO_SNDTIMEO or SO_RCVTIMEO
+ */
+static void limit_socket_wait(const struct Timeouts *timeouts, int socket_fd, int option)
+{
+    long long limit_ms = timeouts->limits_ms[TIMEOUT_BODY];
+    if (limit_ms == 0)
+        return;
+    struct timeval limit;
+    limit.tv_sec = limit_ms / 1000;
+    limit.tv_usec = (limit_ms % 1000) * 1000;
+    setsockopt(socket_fd, SOL_SOCKET, option, &limit, sizeof(limit));
+}
+
+void limit_sends(const struct Timeouts *timeouts, int socket_fd)
+{
+    limit_socket_wait(timeouts, socket_fd, SO_SNDTIMEO);
+}
+
+void limit_receives(const struct Timeouts *timeouts, int socket_fd)
+{
+    limit_socket_wait(timeouts, socket_fd, SO_RCVTIMEO);
+}
+
+void count_timeout(struct Timeouts *timeouts, int kind)
+{
+    if (timeouts->n_expired != NULL)
+        __atomic_add_fetch(&timeouts->n_expired[kind], 1, __ATOMIC_RELAXED);
+    fprintf(stderr, "Warning: closed connection that missed its %s deadline of %lld ms\n",
+            timeout_names[kind], timeouts->limits_ms[kind]);
+}
+
+bool report_timeout(struct Timeouts *timeouts, struct Reader *reader, int kind, long long offset)
+{
+    if (!reader->timed_out)
+        return false;
+    count_timeout(timeouts, kind);
+
+    // Tell the client why the connection is being closed
+    struct Header response;
+    init_header(&response);
+    strcpy(response.status, STATUS_TIMEOUT);
+    response.offset = offset;
+    send_header(&response, reader->socket_fd);
+    return true;
+}
+
+bool read_request_header(struct Timeouts *timeouts, struct Reader *reader, struct Header *request)
+{
+    // The next request must start before the idle deadline
+    start_deadline(timeouts, reader, TIMEOUT_IDLE, monotonic_ns());
+    if (!read_header(reader, request))
+    {
+        report_timeout(timeouts, reader, TIMEOUT_IDLE, 0);
+        return false;
+    }
+
+    // Its payload must arrive before the body deadline
+    start_deadline(timeouts, reader, TIMEOUT_BODY, monotonic_ns());
+    return true;
+}
+
+bool abandon_expired(struct Timeouts *timeouts, int socket_fd, const struct Header *request, long long deadline_ns)
+{
+    if (deadline_ns == 0 || monotonic_ns() < deadline_ns)
+        return false;
+    if (timeouts->n_abandoned != NULL)
+        __atomic_add_fetch(timeouts->n_abandoned, 1, __ATOMIC_RELAXED);
+
+    struct Header response;
+    init_header(&response);
+    strcpy(response.status, STATUS_EXPIRED);
+    response.offset = request->offset;
+    send_header(&response, socket_fd);
+    return true;
+}
+
+void print_timeouts(const struct Timeouts *timeouts, const char *name)
+{
+    fprintf(stderr, "%s: connections closed for missing a deadline: %llu handshake, %llu body, %llu idle\n", name,
+            __atomic_load_n(&timeouts->n_expired[TIMEOUT_HANDSHAKE], __ATOMIC_RELAXED),
+            __atomic_load_n(&timeouts->n_expired[TIMEOUT_BODY], __ATOMIC_RELAXED),
+            __atomic_load_n(&timeouts->n_expired[TIMEOUT_IDLE], __ATOMIC_RELAXED));
+    fprintf(stderr, "%s: %llu requests abandoned after their client's deadline passed\n", name,
+            __atomic_load_n(timeouts->n_abandoned, __ATOMIC_RELAXED));
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+/**
+ * @file timeouts.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for timeouts.c
+ */
+
+#ifndef TIMEOUTS
+#define TIMEOUTS
+
+// Deadlines a connection must meet: the handshake, each request's body, and the idle time between requests
+#define TIMEOUT_HANDSHAKE 0
+#define TIMEOUT_BODY 1
+#define TIMEOUT_IDLE 2
+#define N_TIMEOUT_KINDS 3
+
+// Default deadlines, in milliseconds, as handshake:body:idle
+#define DEFAULT_TIMEOUTS "5000:30000:60000"
+
+// Object to hold a server's deadlines and counts of the connections that missed them
+struct Timeouts
+{
+    long long limits_ms[N_TIMEOUT_KINDS];   // time allowed for each deadline; 0 for none
+    unsigned long long *n_expired;          // connections closed for missing each deadline, shared by every
+                                            // process; NULL if the server does not report them
+    unsigned long long *n_abandoned;        // requests abandoned because the client's deadline passed; shared too
+};
+
+/**
+ * Reads deadlines given as handshake:body:idle in milliseconds, e.g. 5000:30000:60000.
+ * A deadline of 0 is never enforced.
+ * 
+ * @param  timeouts object to hold the deadlines
+ * @param  spec deadlines as given on the command line
+ * 
+ * @return true if spec holds three non-negative numbers, else false
+ */
+bool parse_timeouts(struct Timeouts *, const char *);
+
+/**
+ * Creates the counts of missed deadlines and abandoned requests, shared by every process forked from this one
+ * 
+ * @param  timeouts object holding the deadlines
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool open_timeouts(struct Timeouts *);
+
+/**
+ * Gives a reader's next reads one of the deadlines, counted from a start time
+ * 
+ * @param  timeouts deadlines of the server
+ * @param  reader reader for connected socket
+ * @param  kind deadline to start, one of the TIMEOUT_ values
+ * @param  start_ns monotonic time the deadline is counted from, as from monotonic_ns()
+ */
+void start_deadline(const struct Timeouts *, struct Reader *, int, long long);
+
+/**
+ * Limits how long a send may wait for the client to read, to the body deadline,
+ * so a client that stops reading cannot hold the connection either
+ * 
+ * @param  timeouts deadlines of the server
+ * @param  socket_fd file descriptor for connected socket
+ */
+void limit_sends(const struct Timeouts *, int);
+
+/**
+ * Limits how long a recv() may wait, to the body deadline. Only used by the
+ * original protocol, which reads the socket directly rather than through a reader.
+ * 
+ * @param  timeouts deadlines of the server
+ * @param  socket_fd file descriptor for connected socket
+ */
+void limit_receives(const struct Timeouts *, int);
+
+/**
+ * Counts a missed deadline, if the counts were created, and prints a warning
+ * 
+ * @param  timeouts deadlines of the server
+ * @param  kind deadline that was missed, one of the TIMEOUT_ values
+ */
+void count_timeout(struct Timeouts *, int);
+
+/**
+ * If a read failed because the reader's deadline passed, counts the missed
+ * deadline and sends the client an error frame before the connection is closed
+ * 
+ * @param  timeouts deadlines of the server
+ * @param  reader reader whose read failed
+ * @param  kind deadline the reader was given, one of the TIMEOUT_ values
+ * @param  offset offset of the chunk being read, echoed in the error frame
+ * 
+ * @return true if the read timed out, else false
+ */
+bool report_timeout(struct Timeouts *, struct Reader *, int, long long);
+
+/**
+ * Reads the header of a client's next request, which must arrive before the
+ * idle deadline, then starts the body deadline for the request's payload.
+ * Reports an idle timeout if the header does not arrive in time.
+ * 
+ * @param  timeouts deadlines of the server
+ * @param  reader reader for connected socket
+ * @param  request header to hold the request
+ * 
+ * @return true if a request was read; false if the client closed the
+ *         connection, sent a malformed header, or stayed idle too long
+ */
+bool read_request_header(struct Timeouts *, struct Reader *, struct Header *);
+
+/**
+ * Abandons a request whose client has stopped waiting for it: if the
+ * request's deadline has passed, counts it and answers it as expired
+ * instead of finishing it. The connection stays open for further requests.
+ * 
+ * @param  timeouts deadlines of the server
+ * @param  socket_fd file descriptor for connected socket
+ * @param  request request being served
+ * @param  deadline_ns deadline of the request, as from request_deadline(); 0 for none
+ * 
+ * @return true if the request was abandoned, else false
+ */
+bool abandon_expired(struct Timeouts *, int, const struct Header *, long long);
+
+/**
+ * Prints counts of missed deadlines and abandoned requests to stderr
+ * 
+ * @param  timeouts deadlines of the server
+ * @param  name name of the server
+ */
+void print_timeouts(const struct Timeouts *, const char *);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,412 @@
+/**
+ * @file trace.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the tracing of where a request's time goes. Each process takes
+ * a monotonic timestamp at every phase boundary of a connection and its
+ * requests, and when a request ends, writes a span per phase into a ring of
+ * its own. The rings live in memory shared with the server, and only their
+ * process writes them, so a span is published by bumping the ring's count.
+ * The server dumps every ring in Chrome trace-event format on request; spans
+ * a process overwrites while they are being copied are left out.
+ * 
+ * A request at least as slow as the threshold is also written to the slow
+ * log as a line of JSON with the time of each phase. Each line is written
+ * with one write() to a file opened for appending, so lines from different
+ * processes do not interleave.
+ * 
+ * When profiling, each phase boundary also reads the process's performance
+ * counters, and each phase's share of them is added to its profile.
+ * 
+ * When capturing, every request is written to the capture in the same form,
+ * with the monotonic time it arrived and the connection it arrived on, so
+ * otp_loadgen can replay the requests with the same sizes and timing. Only
+ * metadata is captured: the content of a request never leaves its process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "otp.h"
+#include "profile.h"
+#include "trace.h"
+#include "util.h"
+
+// Names of the phases, as they appear in the slow log and the dump
+static const char *phase_names[N_PHASES] =
+{
+    "accept", "handshake", "receive", "transform", "send", "connect", "read", "wait", "write"
+};
+
+// Names of the payload formats, as the FORMAT_ values
+static const char *format_names[] = { "text", "packed", "binary" };
+
+// Tracing of this process, whose responses end the transform phase
+static struct Trace *sending_trace = NULL;
+
+// Function called with each header sent before tracing hooked in
+static void (*next_header_sent)(const struct Header *) = NULL;
+
+bool open_trace(struct Trace *trace, const char *name, int n_processes, const char *dump_path,
+                const char *slow_log_path, long long slow_ms)
+{
+    memset(trace, 0, sizeof(*trace));
+    trace->name = name;
+    trace->dump_path = dump_path;
+    trace->slow_log_fd = -1;
+    trace->slow_ns = slow_ms * 1000000LL;
+    trace->capture_fd = -1;
+
+    // Keep spans in rings every process shares
+    if (dump_path != NULL)
+    {
+        trace->rings = mmap(NULL, n_processes * sizeof(struct TraceRing), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (trace->rings == MAP_FAILED)
+        {
+            fprintf(stderr, "Error: failed to map trace rings\n");
+            trace->rings = NULL;
+            return false;
+        }
+        trace->n_rings = n_processes;
+        trace->ring = &trace->rings[0];
+    }
+
+    // Append slow requests to the slow log
+    if (slow_log_path != NULL)
+    {
+        trace->slow_log_fd = open(slow_log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (trace->slow_log_fd < 0)
+        {
+            fprintf(stderr, "Error: failed to open slow log \"%s\"\n", slow_log_path);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool open_capture(struct Trace *trace, const char *capture_path)
+{
+    trace->capture_fd = open(capture_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (trace->capture_fd < 0)
+    {
+        fprintf(stderr, "Error: failed to open capture \"%s\"\n", capture_path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Determines whether spans are kept, slow requests logged, or requests captured, so that
+ * timestamps are only taken when they are used
+ * 
+ * @param  trace tracing of the process
+ * 
+ * @return true if tracing is on, else false
+ */
+static bool is_tracing(const struct Trace *trace)
+{
+    return trace->ring != NULL || trace->slow_log_fd >= 0 || trace->profile != NULL || trace->capture_fd >= 0;
+}
+
+/**
+ * Starts a phase of the request being traced now, reading the counters if
+ * profiling
+ * 
+ * @param  trace tracing of the process
+ * @param  phase phase to start
+ */
+static void mark(struct Trace *trace, int phase)
+{
+    trace->marks[phase] = monotonic_ns();
+    if (trace->profile != NULL)
+        read_counters(trace->profile, trace->profile->readings[phase]);
+}
+
+/**
+ * Writes a span into this process's ring, if spans are kept
+ * 
+ * @param  trace tracing of the process
+ * @param  phase phase of the span
+ * @param  start_ns time the phase started
+ * @param  end_ns time the phase ended
+ * @param  offset offset of the request's chunk; -1 for a connection's phases
+ */
+static void write_span(struct Trace *trace, int phase, long long start_ns, long long end_ns, long long offset)
+{
+    struct TraceRing *ring = trace->ring;
+    if (ring == NULL)
+        return;
+
+    // Fill the span, then publish it by counting it
+    unsigned long long n = ring->n_written;
+    struct TraceSpan *span = &ring->spans[n % TRACE_RING_SIZE];
+    span->start_ns = start_ns;
+    span->duration_ns = end_ns - start_ns;
+    span->offset = offset;
+    span->length = offset < 0 ? 0 : trace->length;
+    span->phase = phase;
+    span->pid = (int) getpid();
+    __atomic_store_n(&ring->n_written, n + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Starts the send phase of the request being traced when its header is
+ * sent: a server's response, whose status it notes, or a client's request,
+ * whose chunk it notes
+ * 
+ * @param  header header sent
+ */
+static void trace_header(const struct Header *header)
+{
+    if (next_header_sent != NULL)
+        next_header_sent(header);
+    struct Trace *trace = sending_trace;
+    if ((trace->marks[PHASE_RECEIVE] == 0 && trace->marks[PHASE_READ] == 0) || trace->marks[PHASE_SEND] != 0)
+        return;
+    mark(trace, PHASE_SEND);
+    if (header->status[0] != '\0')
+        snprintf(trace->status, sizeof(trace->status), "%s", header->status);
+    else
+    {
+        trace->offset = header->offset;
+        trace->length = header->length;
+    }
+}
+
+void use_trace_ring(struct Trace *trace, int ring)
+{
+    if (trace->rings != NULL)
+        trace->ring = &trace->rings[ring];
+    sending_trace = trace;
+    next_header_sent = header_sent;
+    header_sent = trace_header;
+}
+
+void start_traced_connection(struct Trace *trace, long long accepted_ns, const char *client)
+{
+    if (!is_tracing(trace))
+        return;
+    long long now_ns = monotonic_ns();
+    snprintf(trace->client, sizeof(trace->client), "%s", client);
+    trace->peer_port = 0;
+    trace->connection_ns[PHASE_ACCEPT] = accepted_ns > 0 ? now_ns - accepted_ns : 0;
+    trace->connection_ns[PHASE_HANDSHAKE] = 0;
+    trace->started_ns = now_ns;
+    trace->first_request = true;
+    if (accepted_ns > 0)
+        write_span(trace, PHASE_ACCEPT, accepted_ns, now_ns, -1);
+}
+
+void finish_handshake(struct Trace *trace)
+{
+    if (!is_tracing(trace))
+        return;
+    long long now_ns = monotonic_ns();
+    trace->connection_ns[PHASE_HANDSHAKE] = now_ns - trace->started_ns;
+    write_span(trace, PHASE_HANDSHAKE, trace->started_ns, now_ns, -1);
+}
+
+void start_traced_request(struct Trace *trace, int phase, long long offset, long long length)
+{
+    if (!is_tracing(trace))
+        return;
+    for (int i = 0; i < N_PHASES; i++)
+        trace->marks[i] = 0;
+    mark(trace, phase);
+    trace->offset = offset;
+    trace->length = length;
+    trace->status[0] = '\0';
+    trace->role = NULL;
+}
+
+void describe_traced_request(struct Trace *trace, const char *role, const struct Header *request, int format,
+                             int socket_fd)
+{
+    if (!is_tracing(trace))
+        return;
+    trace->role = role;
+    trace->format = format;
+    snprintf(trace->operation, sizeof(trace->operation), "%s", request->operation);
+    trace->key_source = strcmp(request->operation, OP_GENERATE) == 0 ? "gen" :
+                        request->pad_id[0] != '\0' ? "pad" : "payload";
+    trace->authenticate = request->authenticate;
+
+    // The client's port tells its connection from others, even once otp_server hands it to another worker
+    if (trace->peer_port == 0 && trace->capture_fd >= 0)
+    {
+        struct sockaddr_in peer;
+        socklen_t peer_size = sizeof(peer);
+        if (getpeername(socket_fd, (struct sockaddr *) &peer, &peer_size) == 0)
+            trace->peer_port = ntohs(peer.sin_port);
+    }
+}
+
+void mark_phase(struct Trace *trace, int phase)
+{
+    if (is_tracing(trace))
+        mark(trace, phase);
+}
+
+/**
+ * Appends a request to the slow log or the capture as a line of JSON
+ * 
+ * @param  trace tracing of the process
+ * @param  fd file to append to
+ * @param  durations time spent in each phase; 0 for phases not reached
+ * @param  start_ns time the request's first phase started
+ * @param  total_ns time from the request's first phase to its end
+ */
+static void write_request(const struct Trace *trace, int fd, const long long *durations, long long start_ns,
+                          long long total_ns)
+{
+    char line[MAX_SLOW_LINE];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int n = snprintf(line, sizeof(line), "{\"time\":%lld.%06ld,\"name\":\"%s\",\"pid\":%d,\"client\":\"%s\","
+                                         "\"offset\":%lld,\"length\":%lld,\"status\":\"%s\",\"total_us\":%.1f",
+                     (long long) now.tv_sec, now.tv_nsec / 1000, trace->name, (int) getpid(), trace->client,
+                     trace->offset, trace->length, trace->status, total_ns / 1e3);
+
+    // Describe what the server was asked for, and when and on which connection it arrived
+    if (trace->role != NULL)
+        n += snprintf(line + n, sizeof(line) - n, ",\"role\":\"%s\",\"op\":\"%s\",\"format\":\"%s\",\"key\":\"%s\","
+                                                  "\"auth\":%s",
+                      trace->role, trace->operation[0] == '\0' ? "chunk" : trace->operation,
+                      format_names[trace->format], trace->key_source, trace->authenticate ? "true" : "false");
+    if (fd == trace->capture_fd)
+        n += snprintf(line + n, sizeof(line) - n, ",\"arrival_ns\":%lld,\"conn\":%d,\"new\":%s", start_ns,
+                      trace->peer_port, trace->first_request && trace->connection_ns[PHASE_HANDSHAKE] > 0 ?
+                      "true" : "false");
+
+    // A connection's first request carries the time the connection took to start
+    if (trace->first_request)
+        n += snprintf(line + n, sizeof(line) - n, ",\"accept_us\":%.1f,\"handshake_us\":%.1f",
+                      trace->connection_ns[PHASE_ACCEPT] / 1e3, trace->connection_ns[PHASE_HANDSHAKE] / 1e3);
+    for (int phase = 0; phase < N_PHASES; phase++)
+    {
+        if (durations[phase] > 0)
+            n += snprintf(line + n, sizeof(line) - n, ",\"%s_us\":%.1f", phase_names[phase], durations[phase] / 1e3);
+    }
+    n += snprintf(line + n, sizeof(line) - n, "}\n");
+    if (n >= (int) sizeof(line))
+        return;
+    if (write(fd, line, n) != n)
+        fprintf(stderr, "Warning: failed to write %s\n", fd == trace->capture_fd ? "capture" : "slow log");
+}
+
+void finish_traced_request(struct Trace *trace)
+{
+    // Find the first phase reached; there is none if no request is being traced
+    long long start_ns = 0;
+    for (int phase = 0; phase < N_PHASES; phase++)
+    {
+        if (trace->marks[phase] > 0 && (start_ns == 0 || trace->marks[phase] < start_ns))
+            start_ns = trace->marks[phase];
+    }
+    if (start_ns == 0)
+        return;
+    long long end_ns = monotonic_ns();
+    long long end_counts[N_COUNTERS];
+    if (trace->profile != NULL)
+        read_counters(trace->profile, end_counts);
+
+    // Each phase reached lasts until the next phase to start after it, or the end
+    long long durations[N_PHASES];
+    for (int phase = 0; phase < N_PHASES; phase++)
+    {
+        durations[phase] = 0;
+        if (trace->marks[phase] == 0)
+            continue;
+        long long phase_end_ns = end_ns;
+        int next_phase = -1;
+        for (int other = 0; other < N_PHASES; other++)
+        {
+            if (trace->marks[other] > trace->marks[phase] && trace->marks[other] < phase_end_ns)
+            {
+                phase_end_ns = trace->marks[other];
+                next_phase = other;
+            }
+        }
+        durations[phase] = phase_end_ns - trace->marks[phase];
+        write_span(trace, phase, trace->marks[phase], phase_end_ns, trace->offset);
+        if (trace->profile != NULL)
+            add_profile(trace->profile, phase, trace->length, trace->profile->readings[phase],
+                        next_phase < 0 ? end_counts : trace->profile->readings[next_phase]);
+    }
+
+    if (trace->slow_log_fd >= 0 && end_ns - start_ns >= trace->slow_ns)
+        write_request(trace, trace->slow_log_fd, durations, start_ns, end_ns - start_ns);
+    if (trace->capture_fd >= 0)
+        write_request(trace, trace->capture_fd, durations, start_ns, end_ns - start_ns);
+    for (int i = 0; i < N_PHASES; i++)
+        trace->marks[i] = 0;
+    trace->first_request = false;
+}
+
+bool dump_trace(const struct Trace *trace)
+{
+    if (trace->rings == NULL)
+        return false;
+    FILE *file = fopen(trace->dump_path, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: failed to open trace dump \"%s\"\n", trace->dump_path);
+        return false;
+    }
+
+    // Copy the spans of each ring, keeping those not overwritten while they were copied
+    static struct TraceSpan spans[TRACE_RING_SIZE];
+    int n_dumped = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (int i = 0; i < trace->n_rings; i++)
+    {
+        const struct TraceRing *ring = &trace->rings[i];
+        unsigned long long n_before = __atomic_load_n(&ring->n_written, __ATOMIC_ACQUIRE);
+        unsigned long long first = n_before > TRACE_RING_SIZE ? n_before - TRACE_RING_SIZE : 0;
+        for (unsigned long long j = first; j < n_before; j++)
+            spans[j % TRACE_RING_SIZE] = ring->spans[j % TRACE_RING_SIZE];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        // The process may be writing span n_after, in place of span n_after - TRACE_RING_SIZE
+        unsigned long long n_after = __atomic_load_n(&ring->n_written, __ATOMIC_RELAXED);
+        if (n_after >= TRACE_RING_SIZE && n_after - TRACE_RING_SIZE + 1 > first)
+            first = n_after - TRACE_RING_SIZE + 1;
+
+        for (unsigned long long j = first; j < n_before; j++)
+        {
+            const struct TraceSpan *span = &spans[j % TRACE_RING_SIZE];
+            fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                    n_dumped++ == 0 ? "" : ",", phase_names[span->phase], span->start_ns / 1e3,
+                    span->duration_ns / 1e3, (int) getpid(), span->pid);
+            if (span->offset >= 0)
+                fprintf(file, ",\"args\":{\"offset\":%lld,\"length\":%lld}", span->offset, span->length);
+            fprintf(file, "}");
+        }
+    }
+    fprintf(file, "\n]}\n");
+    bool success = fclose(file) == 0;
+    fprintf(stderr, "%s: wrote %d trace spans to %s\n", trace->name, n_dumped, trace->dump_path);
+    return success;
+}
+
+void print_traced_profile(const struct Trace *trace)
+{
+    if (trace->profile != NULL)
+        print_profile(trace->profile, phase_names, N_PHASES);
+}
\ No newline at end of file
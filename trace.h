@@ -0,0 +1,195 @@
+/**
+ * @file trace.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for trace.c
+ */
+
+#ifndef TRACE
+#define TRACE
+
+// Spans kept in each process's ring; older spans are overwritten
+#define TRACE_RING_SIZE 4096
+
+// Requests slower than this are written to the slow log unless another threshold is given
+#define DEFAULT_SLOW_MS 100
+
+// Largest line of the slow log or the capture
+#define MAX_SLOW_LINE 768
+
+// Phases a connection's time is split into. The servers use the first five; the clients use
+// handshake, send, and receive, and the last four.
+#define PHASE_ACCEPT 0          // server: accepted or handed back, until a process starts serving it
+#define PHASE_HANDSHAKE 1       // from the start of serving or connecting until the handshake is done
+#define PHASE_RECEIVE 2         // server: header read until payload read; client: response header read until payload read
+#define PHASE_TRANSFORM 3       // server: payload read until response header sent
+#define PHASE_SEND 4            // server: sending the response; client: sending the request
+#define PHASE_CONNECT 5         // client: connecting, including waits for a busy server
+#define PHASE_READ 6            // client: reading input and key files
+#define PHASE_WAIT 7            // client: request sent until response header read
+#define PHASE_WRITE 8           // client: writing output
+#define N_PHASES 9
+
+// Time spent in one phase by one process
+struct TraceSpan
+{
+    long long start_ns;         // monotonic time the phase started
+    long long duration_ns;      // time spent in the phase
+    long long offset;           // offset of the request's chunk; -1 for a connection's phases
+    long long length;           // symbols in the request's chunk
+    int phase;                  // one of the PHASE_ values
+    int pid;                    // process the phase ran in
+};
+
+// Spans of one process, shared so the server can dump them while the process writes them
+struct TraceRing
+{
+    unsigned long long n_written;               // spans ever written; the latest TRACE_RING_SIZE are kept
+    struct TraceSpan spans[TRACE_RING_SIZE];    // span i is kept at index i % TRACE_RING_SIZE
+} __attribute__((aligned(64)));
+
+// Object to hold the tracing of a server or client, and the phases of the request being traced
+struct Trace
+{
+    const char *name;           // name of the server or client
+    struct TraceRing *rings;    // ring of each process; NULL if spans are not kept
+    int n_rings;                // number of rings
+    struct TraceRing *ring;     // ring this process writes
+    const char *dump_path;      // file the rings are dumped to
+    int slow_log_fd;            // slow log; -1 if there is none
+    long long slow_ns;          // requests at least this slow are logged
+    char client[32];            // client of the connection being served
+    long long started_ns;       // time this process started serving the connection
+    long long connection_ns[2]; // time of the connection's accept and handshake, logged with its first request
+    bool first_request;         // whether the request is the connection's first
+    long long marks[N_PHASES];  // time each phase of the request started; 0 if it was not reached
+    long long offset;           // offset of the request's chunk
+    long long length;           // symbols in the request's chunk
+    char status[16];            // status of the request's response
+    struct Profile *profile;    // counters read at each phase of the request; NULL if not profiling
+    int capture_fd;             // capture of every request's metadata; -1 if there is none
+    int peer_port;              // port of the connection's client, which tells its requests from others'; 0 if unknown
+    const char *role;           // role of the request: "enc" or "dec"
+    int format;                 // payload format of the request, one of the FORMAT_ values
+    char operation[16];         // operation of the request; empty for chunk requests
+    const char *key_source;     // where the request's key comes from: "payload", "pad", or "gen"
+    bool authenticate;          // whether the request's ciphertext is authenticated
+};
+
+/**
+ * Sets up tracing. Spans are kept in rings shared by every process if a
+ * dump path is given, and slow requests are logged if a slow log is given.
+ * 
+ * @param  trace object to initialize
+ * @param  name name of the server or client
+ * @param  n_processes number of processes that write spans, each into a ring of its own
+ * @param  dump_path file the spans are dumped to; NULL not to keep spans
+ * @param  slow_log_path file slow requests are appended to; NULL for none
+ * @param  slow_ms requests at least this slow, in milliseconds, are logged
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool open_trace(struct Trace *, const char *, int, const char *, const char *, long long);
+
+/**
+ * Captures the metadata of every request to a file, for otp_loadgen to
+ * replay: when it arrived, its role, operation, format, and size, its
+ * client and connection, and the time of each phase. Content is never
+ * captured.
+ * 
+ * @param  trace tracing of the server, already opened
+ * @param  capture_path file requests are appended to
+ * 
+ * @return true if successful; false if error is encountered
+ */
+bool open_capture(struct Trace *, const char *);
+
+/**
+ * Makes this process write one of the rings, after it is forked to serve
+ * connections. The headers it sends then start the send phase.
+ * 
+ * @param  trace tracing inherited from the server
+ * @param  ring ring of the process: 0 in a client, otherwise from 1 to the number of processes - 1
+ */
+void use_trace_ring(struct Trace *, int);
+
+/**
+ * Starts tracing a connection this process is starting to serve
+ * 
+ * @param  trace tracing of the process
+ * @param  accepted_ns time the connection was accepted or handed back; 0 if unknown
+ * @param  client name of the connection's client
+ */
+void start_traced_connection(struct Trace *, long long, const char *);
+
+/**
+ * Records the handshake of the connection being traced, which started when
+ * the connection did and ends now
+ * 
+ * @param  trace tracing of the process
+ */
+void finish_handshake(struct Trace *);
+
+/**
+ * Starts tracing a request in its first phase
+ * 
+ * @param  trace tracing of the process
+ * @param  phase first phase of the request
+ * @param  offset offset of the request's chunk
+ * @param  length symbols in the request's chunk
+ */
+void start_traced_request(struct Trace *, int, long long, long long);
+
+/**
+ * Notes what a server was asked for in the request being traced, for the
+ * slow log and the capture
+ * 
+ * @param  trace tracing of the process
+ * @param  role role of the request: "enc" or "dec"
+ * @param  request header of the request
+ * @param  format payload format of the connection, one of the FORMAT_ values
+ * @param  socket_fd socket of the connection
+ */
+void describe_traced_request(struct Trace *, const char *, const struct Header *, int, int);
+
+/**
+ * Starts a phase of the request being traced, ending the phase before it
+ * 
+ * @param  trace tracing of the process
+ * @param  phase phase to start
+ */
+void mark_phase(struct Trace *, int);
+
+/**
+ * Records the phases of the request being traced, which ends now, logs the
+ * request if it was slow, and captures it if capturing. Does nothing if no request is being traced.
+ * 
+ * @param  trace tracing of the process
+ */
+void finish_traced_request(struct Trace *);
+
+/**
+ * Writes the spans of every ring to the dump path in Chrome trace-event
+ * format, for chrome://tracing or Perfetto. Spans still being written are
+ * left out.
+ * 
+ * @param  trace tracing of the server or client
+ * 
+ * @return true if the spans were written, else false
+ */
+bool dump_trace(const struct Trace *);
+
+/**
+ * Prints the counters of every process's requests per phase and size
+ * bucket, if profiling
+ * 
+ * @param  trace tracing of the server
+ */
+void print_traced_profile(const struct Trace *);
+
+#endif
\ No newline at end of file
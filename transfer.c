@@ -0,0 +1,1094 @@
+/**
+ * @file transfer.c
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Contains the client side of a chunked transfer. Each chunk is sent as a
+ * framed request carrying its offset, so an interrupted transfer that was
+ * checkpointed can be resumed from the last chunk confirmed written to stdout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <netdb.h>
+
+#include "socket_io.h"
+#include "protocol.h"
+#include "trace.h"
+#include "transfer.h"
+#include "pad_store.h"
+#include "packed.h"
+#include "otp.h"
+#include "alphabet.h"
+#include "compress.h"
+#include "mac.h"
+#include "util.h"
+
+/**
+ * Opens a file and determines the number of symbols it holds,
+ * not counting a trailing newline. A packed file's length is read from its header.
+ * A binary file's length is its size.
+ * 
+ * @param  filename file to open
+ * @param  length value to hold number of symbols in file
+ * @param  packed value to hold whether the file holds packed symbols
+ * @param  binary whether the file holds arbitrary bytes
+ * 
+ * @return file descriptor of the open file; -1 if it could not be opened
+ */
+static int open_symbol_file(const char *filename, long long *length, bool *packed, bool binary)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    // Determine file size
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    *length = st.st_size;
+    *packed = false;
+    if (binary)
+        return fd;
+
+    // A packed file must hold every group its header counts
+    char header[PACKED_HEADER_SIZE];
+    *packed = *length >= PACKED_HEADER_SIZE && pread(fd, header, PACKED_HEADER_SIZE, 0) == PACKED_HEADER_SIZE &&
+              (*length = parse_packed_header(header)) >= 0;
+    if (*packed)
+    {
+        if (PACKED_HEADER_SIZE + packed_size(*length) > st.st_size)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    *length = st.st_size;
+
+    // Do not count a trailing newline
+    char last;
+    if (*length > 0 && pread(fd, &last, 1, *length - 1) == 1 && last == '\n')
+        (*length)--;
+
+    return fd;
+}
+
+/**
+ * Reads exactly n bytes from the specified offset of a file
+ * 
+ * @param  fd file to read from
+ * @param  buffer buffer to store bytes in
+ * @param  n number of bytes to read
+ * @param  offset offset to read from
+ * 
+ * @return true if n bytes were read, else false
+ */
+static bool read_at(int fd, char *buffer, long long n, long long offset)
+{
+    long long total_n_read = 0;
+    while (total_n_read < n)
+    {
+        ssize_t n_read = pread(fd, buffer + total_n_read, n - total_n_read, offset + total_n_read);
+        if (n_read < 0 && errno == EINTR)
+            continue;
+        if (n_read <= 0)
+            return false;
+        total_n_read += n_read;
+    }
+    return true;
+}
+
+/**
+ * Writes exactly n bytes to a file descriptor
+ * 
+ * @param  fd file descriptor to write to
+ * @param  buffer bytes to write
+ * @param  n number of bytes to write
+ * 
+ * @return true if n bytes were written, else false
+ */
+static bool write_all(int fd, const char *buffer, long long n)
+{
+    long long total_written = 0;
+    while (total_written < n)
+    {
+        ssize_t n_written = write(fd, buffer + total_written, n - total_written);
+        if (n_written < 0 && errno == EINTR)
+            continue;
+        if (n_written < 0)
+            return false;
+        total_written += n_written;
+    }
+    return true;
+}
+
+/**
+ * Writes exactly n bytes to the specified offset of a file
+ * 
+ * @param  fd file to write to
+ * @param  buffer bytes to write
+ * @param  n number of bytes to write
+ * @param  offset offset to write to
+ * 
+ * @return true if n bytes were written, else false
+ */
+static bool write_at(int fd, const char *buffer, long long n, long long offset)
+{
+    long long total_written = 0;
+    while (total_written < n)
+    {
+        ssize_t n_written = pwrite(fd, buffer + total_written, n - total_written, offset + total_written);
+        if (n_written < 0 && errno == EINTR)
+            continue;
+        if (n_written < 0)
+            return false;
+        total_written += n_written;
+    }
+    return true;
+}
+
+/**
+ * Gets the position in a symbol file of the symbol at the specified offset.
+ * Offsets into packed files must fall on a group boundary.
+ * 
+ * @param  packed whether the file holds packed symbols
+ * @param  offset offset of the symbol
+ * 
+ * @return position of the symbol in bytes
+ */
+static long long symbol_position(bool packed, long long offset)
+{
+    return packed ? PACKED_HEADER_SIZE + offset / PACKED_GROUP_SYMBOLS * PACKED_GROUP_SIZE : offset;
+}
+
+/**
+ * Determines whether a transfer reads or writes records rather than plain
+ * chunks: compressed records, or chunks followed by their tags
+ * 
+ * @param  transfer object to check
+ * 
+ * @return true if the transfer is made of records, else false
+ */
+static bool has_records(const struct Transfer *transfer)
+{
+    return transfer->compress || transfer->expand || transfer->authenticate;
+}
+
+/**
+ * Converts symbols between the unpacked and packed formats
+ * 
+ * @param  symbols symbols to convert
+ * @param  length number of symbols
+ * @param  from_packed whether the symbols are packed
+ * @param  to_packed whether to pack the symbols
+ * @param  buffer buffer to hold the converted symbols if the formats differ
+ * 
+ * @return the converted symbols; symbols itself if the formats are the same
+ */
+static const char *convert_symbols(const char *symbols, long long length, bool from_packed, bool to_packed, char *buffer)
+{
+    if (from_packed == to_packed)
+        return symbols;
+    if (to_packed)
+        pack_symbols(symbols, length, buffer);
+    else
+        unpack_symbols(symbols, length, buffer);
+    return buffer;
+}
+
+/**
+ * Reads symbols from a symbol file and converts them to the payload format
+ * 
+ * @param  fd file to read from
+ * @param  file_packed whether the file holds packed symbols
+ * @param  wire_packed whether the payload holds packed symbols
+ * @param  buffer buffer to hold the symbols in the payload format
+ * @param  scratch buffer of CHUNK_SIZE bytes used if the formats differ
+ * @param  length number of symbols to read
+ * @param  offset offset of the first symbol
+ * 
+ * @return true if the symbols were read, else false
+ */
+static bool read_symbols(int fd, bool file_packed, bool wire_packed, char *buffer, char *scratch,
+                         long long length, long long offset)
+{
+    char *raw = file_packed == wire_packed ? buffer : scratch;
+    if (!read_at(fd, raw, file_packed ? packed_size(length) : length, symbol_position(file_packed, offset)))
+        return false;
+    if (raw != buffer)
+        convert_symbols(raw, length, file_packed, wire_packed, buffer);
+    return true;
+}
+
+/**
+ * Records the transfer's confirmed offset in its checkpoint file.
+ * The checkpoint is written to a temporary file and renamed into place
+ * so that a crash never leaves a partially written checkpoint. A checkpoint
+ * that cannot be written is warned about, and the transfer carries on.
+ * 
+ * @param  transfer object holding the offset to record
+ */
+static void save_checkpoint(struct Transfer *transfer)
+{
+    // Create name of temporary file
+    int tmp_len = strlen(transfer->checkpoint_filename) + 5;
+    char *tmp_filename = (char *) malloc(tmp_len);
+    snprintf(tmp_filename, tmp_len, "%s.tmp", transfer->checkpoint_filename);
+
+    // Create checkpoint record; record transfers also record their output position and key used
+    char record[192];
+    int record_len = snprintf(record, sizeof(record), "otp-checkpoint %lld %lld %lld %lld %lld",
+                              transfer->offset, transfer->input_length, transfer->key_length, transfer->key_offset,
+                              transfer->token);
+    if (has_records(transfer))
+        record_len += snprintf(record + record_len, sizeof(record) - record_len, " %lld %lld",
+                               transfer->output_position, transfer->key_used);
+    record_len += snprintf(record + record_len, sizeof(record) - record_len, "\n");
+
+    // Write the record, flush it to disk, and move it into place
+    bool success = false;
+    int fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd >= 0)
+    {
+        success = write_all(fd, record, record_len) && fsync(fd) == 0;
+        close(fd);
+        success = success && rename(tmp_filename, transfer->checkpoint_filename) == 0;
+    }
+
+    if (!success)
+        fprintf(stderr, "Warning: failed to write checkpoint file \"%s\"; the transfer carries on but cannot be "
+                        "resumed from here\n", transfer->checkpoint_filename);
+
+    free(tmp_filename);
+}
+
+/**
+ * Parses a key argument of the form pad:ID[:OFFSET] into the transfer
+ * 
+ * @param  transfer object to store pad ID and key offset in
+ * @param  key_spec key argument without its pad: prefix
+ * 
+ * @return true if the key argument is well formed, else false
+ */
+static bool parse_pad_key(struct Transfer *transfer, const char *key_spec)
+{
+    // Split the pad ID from the optional offset
+    const char *separator = strchr(key_spec, ':');
+    int id_len = separator == NULL ? (int) strlen(key_spec) : separator - key_spec;
+    if (id_len >= MAX_PAD_ID_SIZE)
+        return false;
+    memcpy(transfer->pad_id, key_spec, id_len);
+    transfer->pad_id[id_len] = '\0';
+
+    // Convert the offset to an integer, or leave it for the server to reserve
+    transfer->key_offset = 0;
+    if (separator != NULL && strcmp(separator + 1, PAD_KEY_NEXT) == 0)
+        transfer->reserve_key = true;
+    else if (separator != NULL)
+    {
+        char *end;
+        transfer->key_offset = strtoll(separator + 1, &end, 10);
+        if (end == separator + 1 || *end != '\0' || transfer->key_offset < 0)
+            return false;
+    }
+
+    return is_valid_pad_id(transfer->pad_id);
+}
+
+bool open_transfer(struct Transfer *transfer, const char *input_name, char *input_filename, char *key_filename, int format,
+                   const struct Alphabet *alphabet)
+{
+    memset(transfer, '\0', sizeof(*transfer));
+    transfer->output_packed = format == FORMAT_PACKED;
+    transfer->binary = format == FORMAT_BINARY;
+    transfer->alphabet = alphabet;
+    transfer->input_name = input_name;
+    transfer->input_filename = input_filename;
+    transfer->key_filename = key_filename;
+    transfer->key_fd = -1;
+    transfer->key_output_fd = -1;
+    transfer->resumable = false;
+    open_trace(&transfer->trace, input_name, 1, NULL, NULL, 0);
+
+    // Open input file
+    transfer->input_fd = open_symbol_file(input_filename, &transfer->input_length, &transfer->input_packed, transfer->binary);
+    if (transfer->input_fd < 0)
+    {
+        fprintf(stderr, "Error: failed to open %s file \"%s\"\n", input_name, input_filename);
+        return false;
+    }
+    transfer->key_needed = transfer->input_length;
+
+    // Pads and generated keys hold symbols, so a binary input needs a binary key file
+    bool key_is_file = strncmp(key_filename, PAD_KEY_PREFIX, strlen(PAD_KEY_PREFIX)) != 0 &&
+                       strncmp(key_filename, GEN_KEY_PREFIX, strlen(GEN_KEY_PREFIX)) != 0;
+    if (transfer->binary && !key_is_file)
+    {
+        fprintf(stderr, "Error: binary %s needs a key file, not \"%s\"\n", input_name, key_filename);
+        return false;
+    }
+
+    // Pads, generated keys, and packed payloads hold A-Z and space, so other alphabets need
+    // a key file and text payloads
+    if (alphabet != DEFAULT_ALPHABET && (format != FORMAT_TEXT || !key_is_file))
+    {
+        fprintf(stderr, "Error: the %s alphabet needs a key file and cannot be used with --packed or --binary\n",
+                alphabet->name);
+        return false;
+    }
+
+    // A server-resident pad needs no key file; its length is checked by the server
+    if (strncmp(key_filename, PAD_KEY_PREFIX, strlen(PAD_KEY_PREFIX)) == 0)
+    {
+        transfer->key_length = -1;
+        if (!parse_pad_key(transfer, key_filename + strlen(PAD_KEY_PREFIX)))
+        {
+            fprintf(stderr, "Error: invalid pad key \"%s\"; expected pad:ID[:OFFSET]\n", key_filename);
+            return false;
+        }
+    }
+
+    // A generated key is written to the key file as it arrives; it is not truncated
+    // so that a resumed transfer keeps the key of the chunks already confirmed
+    else if (strncmp(key_filename, GEN_KEY_PREFIX, strlen(GEN_KEY_PREFIX)) == 0)
+    {
+        transfer->key_length = -1;
+        transfer->generate_key = true;
+        transfer->key_output_fd = open(key_filename + strlen(GEN_KEY_PREFIX), O_WRONLY | O_CREAT, 0600);
+        if (transfer->key_output_fd < 0)
+        {
+            fprintf(stderr, "Error: failed to open key file \"%s\" for writing\n", key_filename + strlen(GEN_KEY_PREFIX));
+            return false;
+        }
+    }
+
+    // Open key file
+    else
+    {
+        transfer->key_fd = open_symbol_file(key_filename, &transfer->key_length, &transfer->key_packed, transfer->binary);
+        if (transfer->key_fd < 0)
+        {
+            fprintf(stderr, "Error: failed to open key file \"%s\"\n", key_filename);
+            return false;
+        }
+    }
+
+    // Packed files hold A-Z and space
+    if (alphabet != DEFAULT_ALPHABET && (transfer->input_packed || transfer->key_packed))
+    {
+        fprintf(stderr, "Error: the %s alphabet cannot be used with packed files\n", alphabet->name);
+        return false;
+    }
+
+    // Name checkpoint file after input file
+    int checkpoint_len = strlen(input_filename) + strlen(CHECKPOINT_SUFFIX) + 1;
+    transfer->checkpoint_filename = (char *) malloc(checkpoint_len);
+    snprintf(transfer->checkpoint_filename, checkpoint_len, "%s%s", input_filename, CHECKPOINT_SUFFIX);
+
+    return true;
+}
+
+bool enable_compression(struct Transfer *transfer, bool expand)
+{
+    // Records are unpacked A-Z and space, and a generated key would have to be written record by record
+    if (transfer->binary || transfer->output_packed || transfer->input_packed || transfer->key_packed ||
+        transfer->generate_key || transfer->alphabet != DEFAULT_ALPHABET)
+    {
+        fprintf(stderr, "Error: compression needs unpacked A-Z and space %s and a key file or pad\n", transfer->input_name);
+        return false;
+    }
+
+    // The key needed is only known once the input has been validated
+    transfer->compress = !expand;
+    transfer->expand = expand;
+    transfer->key_needed = -1;
+    return true;
+}
+
+bool enable_authentication(struct Transfer *transfer, bool verify)
+{
+    // Tags are written as unpacked symbols, and a generated key would need MAC keys generated with it
+    if (transfer->binary || transfer->output_packed || transfer->input_packed || transfer->key_packed ||
+        transfer->generate_key)
+    {
+        fprintf(stderr, "Error: authentication needs unpacked %s and a key file or pad\n", transfer->input_name);
+        return false;
+    }
+    transfer->authenticate = true;
+    transfer->verify = verify;
+
+    // Compressed records are counted as they are validated
+    if (transfer->compress || transfer->expand)
+        return true;
+
+    // Every chunk needs a MAC key after its key, and when verifying, every chunk of the input
+    // is followed by its tag, so the last chunk must hold more than a tag
+    long long stride = CHUNK_SIZE + (verify ? MAC_TAG_SYMBOLS : 0);
+    long long n_chunks = (transfer->input_length + stride - 1) / stride;
+    if (verify && n_chunks > 0 && transfer->input_length - (n_chunks - 1) * stride <= MAC_TAG_SYMBOLS)
+    {
+        fprintf(stderr, "Error: %s file \"%s\" does not end with a chunk and its tag\n",
+                transfer->input_name, transfer->input_filename);
+        return false;
+    }
+    transfer->key_needed = transfer->input_length + n_chunks * (MAC_KEY_SYMBOLS - (verify ? MAC_TAG_SYMBOLS : 0));
+    return true;
+}
+
+bool enable_tracing(struct Transfer *transfer, const char *name, const char *trace_filename)
+{
+    // The request headers sent mark the end of reading each chunk
+    if (!open_trace(&transfer->trace, name, 1, trace_filename, NULL, 0))
+        return false;
+    use_trace_ring(&transfer->trace, 0);
+    return true;
+}
+
+void set_transfer_deadline(struct Transfer *transfer, long long deadline_ns)
+{
+    transfer->deadline_ns = deadline_ns;
+}
+
+void close_transfer(struct Transfer *transfer)
+{
+    if (transfer->input_fd >= 0)
+        close(transfer->input_fd);
+    if (transfer->key_fd >= 0)
+        close(transfer->key_fd);
+    if (transfer->key_output_fd >= 0)
+        close(transfer->key_output_fd);
+    free(transfer->checkpoint_filename);
+}
+
+bool load_checkpoint(struct Transfer *transfer)
+{
+    // Checkpoint this run, and start from the beginning if there is no checkpoint to resume from
+    transfer->resumable = true;
+    FILE *fp_checkpoint = fopen(transfer->checkpoint_filename, "r");
+    if (fp_checkpoint == NULL)
+    {
+        fprintf(stderr, "No checkpoint found at \"%s\"; starting from the beginning\n", transfer->checkpoint_filename);
+        transfer->offset = 0;
+        return true;
+    }
+
+    // Read checkpoint record
+    bool records = has_records(transfer);
+    long long offset, input_length, key_length, key_offset, token, output_position, key_used;
+    int n_fields = fscanf(fp_checkpoint, "otp-checkpoint %lld %lld %lld %lld %lld %lld %lld",
+                          &offset, &input_length, &key_length, &key_offset, &token, &output_position, &key_used);
+    fclose(fp_checkpoint);
+    if (n_fields != (records ? 7 : 5) || offset < 0 || offset > input_length)
+    {
+        fprintf(stderr, "Error: malformed checkpoint file \"%s\"\n", transfer->checkpoint_filename);
+        return false;
+    }
+
+    // A reserved key offset, and the token to use it with, are only known from the checkpoint
+    if (transfer->reserve_key)
+    {
+        transfer->key_offset = key_offset;
+        transfer->token = token;
+        transfer->key_reserved = true;
+    }
+
+    // Verify that the checkpoint was made for the same input and key
+    if (input_length != transfer->input_length || key_length != transfer->key_length ||
+        key_offset != transfer->key_offset)
+    {
+        fprintf(stderr, "Error: checkpoint \"%s\" does not match %s and key files\n",
+                transfer->checkpoint_filename, transfer->input_name);
+        return false;
+    }
+
+    // If output is a file, discard anything written after the confirmed offset
+    struct stat st;
+    long long position = records ? output_position : symbol_position(transfer->output_packed, offset);
+    if (fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        if (st.st_size < position)
+        {
+            fprintf(stderr, "Error: output holds %lld bytes but checkpoint confirms %lld; "
+                            "append to the original output with >> when resuming\n",
+                    (long long) st.st_size, position);
+            return false;
+        }
+        if (st.st_size > position && ftruncate(STDOUT_FILENO, position) < 0)
+        {
+            fprintf(stderr, "Error: failed to truncate output to checkpoint offset %lld\n", offset);
+            return false;
+        }
+    }
+
+    transfer->offset = offset;
+    if (records)
+    {
+        transfer->output_position = output_position;
+        transfer->key_used = key_used;
+    }
+    return true;
+}
+
+/**
+ * Checks every record of the input from the current offset onward and counts
+ * the key symbols their payloads need
+ * 
+ * @param  transfer object holding the records to validate
+ * 
+ * @return the first-encountered invalid character if one is found;
+ *         EOF if a record could not be read or is malformed;
+ *         0 if every record is valid
+ */
+static char validate_records(struct Transfer *transfer)
+{
+    char *buffer = (char *) malloc(RECORD_HEADER_SIZE + CHUNK_SIZE + MAC_TAG_SYMBOLS);
+    char invalid_char = 0;
+    long long key_needed = transfer->key_used;
+
+    // Authenticated records are followed by a tag, and need a MAC key after their key
+    long long tag_size = transfer->authenticate ? MAC_TAG_SYMBOLS : 0;
+    long long mac_key_size = transfer->authenticate ? MAC_KEY_SYMBOLS : 0;
+
+    // Walk through every record
+    long long offset = transfer->offset;
+    while (offset < transfer->input_length && invalid_char == 0)
+    {
+        // Read the record, checking that its header is well formed and that it ends within the input
+        char method;
+        long long length, payload_length;
+        bool valid = offset + RECORD_HEADER_SIZE <= transfer->input_length &&
+                     read_at(transfer->input_fd, buffer, RECORD_HEADER_SIZE, offset) &&
+                     parse_record_header(buffer, &method, &length, &payload_length) && length <= CHUNK_SIZE &&
+                     offset + RECORD_HEADER_SIZE + payload_length + tag_size <= transfer->input_length &&
+                     read_at(transfer->input_fd, buffer + RECORD_HEADER_SIZE, payload_length + tag_size,
+                             offset + RECORD_HEADER_SIZE);
+        if (!valid)
+        {
+            fprintf(stderr, "Error: malformed record at offset %lld of %s file \"%s\"\n",
+                    offset, transfer->input_name, transfer->input_filename);
+            invalid_char = EOF;
+            break;
+        }
+
+        // A NULL character is reported as '?'
+        const char *invalid = find_invalid_symbol(DEFAULT_ALPHABET, buffer + RECORD_HEADER_SIZE, payload_length + tag_size);
+        if (invalid != NULL)
+            invalid_char = *invalid != '\0' ? *invalid : '?';
+
+        key_needed += payload_length + mac_key_size;
+        offset += RECORD_HEADER_SIZE + payload_length + tag_size;
+    }
+
+    transfer->key_needed = key_needed;
+    free(buffer);
+    return invalid_char;
+}
+
+char validate_input(struct Transfer *transfer)
+{
+    // Every byte is valid in binary input
+    if (transfer->binary)
+        return 0;
+
+    // Records are validated one at a time
+    if (transfer->expand)
+        return validate_records(transfer);
+
+    // Create buffer for reading input; a compressed transfer that reserves a pad range
+    // also compresses each chunk to count the key symbols to reserve
+    char *buffer = (char *) malloc(CHUNK_SIZE + 1);
+    char invalid_char = 0;
+    bool count_key = transfer->compress && transfer->reserve_key && !transfer->key_reserved;
+    char *record = count_key ? (char *) malloc(RECORD_HEADER_SIZE + CHUNK_SIZE) : NULL;
+    long long key_needed = transfer->key_used;
+
+    // Validate the input one chunk at a time, in the format it is stored in
+    for (long long offset = transfer->offset; offset < transfer->input_length && invalid_char == 0; offset += CHUNK_SIZE)
+    {
+        long long n = transfer->input_length - offset < CHUNK_SIZE ? transfer->input_length - offset : CHUNK_SIZE;
+        if (!read_symbols(transfer->input_fd, transfer->input_packed, transfer->input_packed, buffer, NULL, n, offset))
+        {
+            fprintf(stderr, "Error: failed to read %s file \"%s\"\n", transfer->input_name, transfer->input_filename);
+            invalid_char = EOF;
+            break;
+        }
+
+        // A packed symbol above 26 has no character, so it is reported as '?'
+        if (transfer->input_packed)
+            invalid_char = validate_packed(buffer, n) ? 0 : '?';
+        else
+        {
+            // A NULL character is reported as '?'
+            const char *invalid = find_invalid_symbol(transfer->alphabet, buffer, n);
+            if (invalid != NULL)
+                invalid_char = *invalid != '\0' ? *invalid : '?';
+        }
+
+        if (count_key && invalid_char == 0)
+            key_needed += compress_record(buffer, n, record) - RECORD_HEADER_SIZE +
+                          (transfer->authenticate ? MAC_KEY_SYMBOLS : 0);
+    }
+    if (count_key)
+        transfer->key_needed = key_needed;
+
+    free(buffer);
+    free(record);
+    return invalid_char;
+}
+
+/**
+ * Waits to send a request again that the server turned away as overloaded,
+ * unless it has been turned away too often or the deadline would pass first
+ * 
+ * @param  transfer transfer the request belongs to
+ * @param  attempt number of times the request has been turned away
+ * 
+ * @return true if the request should be sent again, else false
+ */
+static bool retry_overloaded(const struct Transfer *transfer, int attempt)
+{
+    if (attempt > MAX_BUSY_RETRIES)
+        return false;
+    if (transfer->deadline_ns > 0 && monotonic_ns() + OVERLOADED_RETRY_MS * 1000000LL >= transfer->deadline_ns)
+        return false;
+    wait_to_retry(attempt, OVERLOADED_RETRY_MS);
+    return true;
+}
+
+/**
+ * Asks the server to reserve a range of the pad as long as the key needed
+ * and stores the reserved offset as the transfer's key offset
+ * 
+ * @param  transfer object holding the pad to reserve from
+ * @param  reader buffered reader for connected socket
+ * 
+ * @return true if the range was reserved, else false
+ */
+static bool reserve_key_range(struct Transfer *transfer, struct Reader *reader)
+{
+    // Send reservation request
+    struct Header request;
+    init_header(&request);
+    strcpy(request.operation, OP_RESERVE);
+    strcpy(request.pad_id, transfer->pad_id);
+    request.length = transfer->key_needed;
+    if (!send_header(&request, reader->socket_fd))
+        return false;
+
+    // Read reserved offset
+    struct Header response;
+    if (!read_header(reader, &response))
+    {
+        fprintf(stderr, "Error: connection closed by server during reservation\n");
+        return false;
+    }
+    if (strcmp(response.status, STATUS_OK) != 0 || response.length != request.length)
+    {
+        fprintf(stderr, "Error: server rejected reservation of pad \"%s\": %s\n",
+                transfer->pad_id, describe_status(response.status));
+        return false;
+    }
+    transfer->key_offset = response.key_offset;
+    transfer->token = response.token;
+    transfer->key_reserved = true;
+
+    // Tell the user which range to decrypt with
+    fprintf(stderr, "Reserved %lld symbols of pad \"%s\"; decrypt with pad:%s:%lld\n",
+            transfer->key_needed, transfer->pad_id, transfer->pad_id, transfer->key_offset);
+
+    // Record the reservation so an interrupted transfer resumes within it
+    if (transfer->resumable && transfer->input_length > CHUNK_SIZE)
+        save_checkpoint(transfer);
+    return true;
+}
+
+/**
+ * Sends the input to the server one record at a time, starting at the current
+ * offset. When compressing, each chunk of input is compressed into a record,
+ * its payload is encrypted, and the record is written to stdout with the
+ * encrypted payload. When expanding, each record's payload is decrypted and
+ * expanded, and the chunk is written to stdout. When authenticating, each
+ * payload is followed by its tag in the ciphertext, and its key by a MAC key.
+ * Either way, each record's key follows the key of the record before it.
+ * 
+ * @param  transfer object holding the input and key to send
+ * @param  reader buffered reader for connected socket
+ * @param  send_key whether key symbols travel in the payload
+ * @param  output_is_file whether stdout can be flushed to disk
+ * 
+ * @return true if the entire input was transformed, else false
+ */
+static bool transfer_records(struct Transfer *transfer, struct Reader *reader, bool send_key, bool output_is_file)
+{
+    // Records have a header if they are compressed, and a tag and MAC key if they are authenticated
+    long long header_size = transfer->compress || transfer->expand ? RECORD_HEADER_SIZE : 0;
+    long long tag_size = transfer->authenticate ? MAC_TAG_SYMBOLS : 0;
+    long long mac_key_size = transfer->authenticate ? MAC_KEY_SYMBOLS : 0;
+    bool decrypting = transfer->expand || transfer->verify;
+
+    // Create buffers for a record followed by its key, and for a chunk of symbols
+    char *record = (char *) malloc(RECORD_HEADER_SIZE + 2 * (long long) CHUNK_SIZE + MAC_KEY_SYMBOLS + MAC_TAG_SYMBOLS);
+    char *symbols = (char *) malloc(CHUNK_SIZE);
+    char *payload = record + header_size;
+    unsigned char tag[MAC_TAG_SIZE];
+
+    bool success = true;
+    int n_overloaded = 0;       // times the current record was turned away as overloaded
+    while (success && transfer->offset < transfer->input_length)
+    {
+        finish_traced_request(&transfer->trace);
+        start_traced_request(&transfer->trace, PHASE_READ, transfer->offset, 0);
+
+        // Compress the next chunk into a record, or read the next record or chunk with its tag
+        char method = RECORD_STORED;
+        long long remaining = transfer->input_length - transfer->offset;
+        long long n, payload_length;
+        if (transfer->compress)
+        {
+            n = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+            success = read_at(transfer->input_fd, symbols, n, transfer->offset);
+            payload_length = success ? compress_record(symbols, n, record) - RECORD_HEADER_SIZE : 0;
+        }
+        else if (transfer->expand)
+        {
+            success = read_at(transfer->input_fd, record, RECORD_HEADER_SIZE, transfer->offset) &&
+                      parse_record_header(record, &method, &n, &payload_length) && n <= CHUNK_SIZE &&
+                      read_at(transfer->input_fd, payload, payload_length + tag_size, transfer->offset + RECORD_HEADER_SIZE);
+        }
+        else
+        {
+            long long available = remaining - (decrypting ? tag_size : 0);
+            n = available < CHUNK_SIZE ? available : CHUNK_SIZE;
+            payload_length = n;
+            success = read_at(transfer->input_fd, payload, payload_length + (decrypting ? tag_size : 0), transfer->offset);
+        }
+
+        // Set the tag aside, since the key is read in its place
+        if (success && transfer->verify && !decode_tag(transfer->alphabet, payload + payload_length, tag))
+        {
+            fprintf(stderr, "Error: malformed tag of the record at offset %lld\n", transfer->offset);
+            success = false;
+            break;
+        }
+
+        // Verify the key holds the record's key and MAC key, and read them after the payload
+        long long key_offset = transfer->key_offset + transfer->key_used;
+        long long key_size = payload_length + mac_key_size;
+        if (success && transfer->key_length >= 0 && key_offset + key_size > transfer->key_length)
+        {
+            fprintf(stderr, "Error: key is too short for the record at offset %lld; %lld key symbols used so far\n",
+                    transfer->offset, transfer->key_used);
+            success = false;
+            break;
+        }
+        if (!success || (send_key && !read_at(transfer->key_fd, payload + payload_length, key_size, key_offset)))
+        {
+            fprintf(stderr, "Error: failed to read %s or key file\n", transfer->input_name);
+            success = false;
+            break;
+        }
+
+        // Send request header and payload; the request's offset is the record's position in the input
+        struct Header request;
+        init_header(&request);
+        request.offset = transfer->offset;
+        request.length = payload_length;
+        if (transfer->alphabet != DEFAULT_ALPHABET)
+            strcpy(request.alphabet, transfer->alphabet->name);
+        request.authenticate = transfer->authenticate;
+        if (transfer->verify)
+            format_tag(tag, request.tag);
+        if (!send_key)
+        {
+            strcpy(request.pad_id, transfer->pad_id);
+            request.key_offset = key_offset;
+            request.token = transfer->token;
+        }
+        if (!stamp_deadline(&request, transfer->deadline_ns))
+        {
+            fprintf(stderr, "Error: deadline passed at offset %lld\n", transfer->offset);
+            success = false;
+            break;
+        }
+        if (!send_header(&request, reader->socket_fd) ||
+            !send_bytes(payload, send_key ? payload_length + key_size : payload_length, reader->socket_fd))
+        {
+            success = false;
+            break;
+        }
+        mark_phase(&transfer->trace, PHASE_WAIT);
+
+        // Read response header and verify that it answers this record
+        struct Header response;
+        if (!read_header(reader, &response))
+        {
+            fprintf(stderr, reader->timed_out ? "Error: deadline passed at offset %lld\n" :
+                            "Error: connection closed by server at offset %lld\n", transfer->offset);
+            success = false;
+            break;
+        }
+        mark_phase(&transfer->trace, PHASE_RECEIVE);
+        if (strcmp(response.status, STATUS_OVERLOADED) == 0 && retry_overloaded(transfer, ++n_overloaded))
+            continue;
+        if (strcmp(response.status, STATUS_OK) != 0 || response.offset != request.offset || response.length != payload_length)
+        {
+            fprintf(stderr, "Error: server rejected record at offset %lld: %s\n", transfer->offset, describe_status(response.status));
+            success = false;
+            break;
+        }
+        n_overloaded = 0;
+        if (transfer->authenticate && !transfer->verify && !parse_tag(response.tag, tag))
+        {
+            fprintf(stderr, "Error: server returned no tag for the record at offset %lld\n", transfer->offset);
+            success = false;
+            break;
+        }
+
+        // Read the transformed payload in place of the original
+        if (!read_bytes(reader, payload, payload_length))
+        {
+            fprintf(stderr, "Error: failed to transfer record at offset %lld\n", transfer->offset);
+            success = false;
+            break;
+        }
+        mark_phase(&transfer->trace, PHASE_WRITE);
+
+        // Write the record with its encrypted payload and tag, or the decrypted chunk, expanding it if compressed
+        long long output_size;
+        if (!decrypting)
+        {
+            if (transfer->authenticate)
+                encode_tag(transfer->alphabet, tag, payload + payload_length);
+            output_size = header_size + payload_length + tag_size;
+            success = write_all(STDOUT_FILENO, record, output_size);
+            transfer->offset += n;
+        }
+        else
+        {
+            output_size = n;
+            if (transfer->expand && !expand_record(method, payload, payload_length, symbols, n))
+            {
+                fprintf(stderr, "Error: failed to expand record at offset %lld; the key may not match\n", transfer->offset);
+                success = false;
+                break;
+            }
+            success = write_all(STDOUT_FILENO, transfer->expand ? symbols : payload, n);
+            transfer->offset += header_size + payload_length + tag_size;
+        }
+        if (!success)
+        {
+            fprintf(stderr, "Error: failed to write output at offset %lld\n", transfer->output_position);
+            break;
+        }
+        transfer->output_position += output_size;
+        transfer->key_used += key_size;
+
+        // Record progress if more records remain
+        if (transfer->resumable && transfer->offset < transfer->input_length)
+        {
+            if (output_is_file)
+                fsync(STDOUT_FILENO);
+            save_checkpoint(transfer);
+        }
+    }
+
+    finish_traced_request(&transfer->trace);
+    free(record);
+    free(symbols);
+    return success;
+}
+
+bool run_transfer(struct Transfer *transfer, int socket_fd)
+{
+    // Key symbols travel in the payload unless the key is a server-resident pad or generated by the server
+    bool send_key = transfer->pad_id[0] == '\0' && !transfer->generate_key;
+
+    // Create buffers for one chunk of payload and output, and for converting between formats;
+    // a generated key is read into the payload buffer ahead of the output
+    char *payload = (char *) malloc(2 * (long long) CHUNK_SIZE);
+    char *output = transfer->generate_key ? payload + CHUNK_SIZE : (char *) malloc(CHUNK_SIZE);
+    char *scratch = (char *) malloc(CHUNK_SIZE);
+
+    // Stop waiting for the server once the deadline passes
+    struct Reader reader;
+    init_reader(&reader, socket_fd);
+    set_reader_deadline(&reader, transfer->deadline_ns);
+
+    // Determine whether stdout can be flushed to disk
+    struct stat st;
+    bool output_is_file = fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode);
+
+    // Reserve a range of the pad before sending the first chunk
+    bool success = true;
+    if (transfer->reserve_key && !transfer->key_reserved)
+        success = reserve_key_range(transfer, &reader);
+
+    // Packed output and a packed generated key start with a header
+    char header[PACKED_HEADER_SIZE];
+    build_packed_header(header, transfer->input_length);
+    if (success && transfer->output_packed && transfer->offset == 0)
+        success = write_all(STDOUT_FILENO, header, PACKED_HEADER_SIZE);
+    if (success && transfer->output_packed && transfer->generate_key)
+        success = write_at(transfer->key_output_fd, header, PACKED_HEADER_SIZE, 0);
+
+    // Compressed and authenticated transfers send records rather than fixed-size chunks
+    bool records = has_records(transfer);
+    if (success && records)
+        success = transfer_records(transfer, &reader, send_key, output_is_file);
+
+    int n_overloaded = 0;       // times the current chunk was turned away as overloaded
+    while (success && !records && transfer->offset < transfer->input_length)
+    {
+        finish_traced_request(&transfer->trace);
+        start_traced_request(&transfer->trace, PHASE_READ, transfer->offset, 0);
+
+        // Determine size of the next chunk, and its size in the payload
+        long long remaining = transfer->input_length - transfer->offset;
+        long long n = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+        long long size = transfer->wire_packed ? packed_size(n) : n;
+
+        // Read input and key for the chunk into the payload
+        if (!read_symbols(transfer->input_fd, transfer->input_packed, transfer->wire_packed, payload, scratch,
+                          n, transfer->offset) ||
+            (send_key && !read_symbols(transfer->key_fd, transfer->key_packed, transfer->wire_packed, payload + size, scratch,
+                                       n, transfer->key_offset + transfer->offset)))
+        {
+            fprintf(stderr, "Error: failed to read %s or key file\n", transfer->input_name);
+            success = false;
+            break;
+        }
+
+        // Send request header and payload
+        struct Header request;
+        init_header(&request);
+        request.offset = transfer->offset;
+        request.length = n;
+        if (transfer->alphabet != DEFAULT_ALPHABET)
+            strcpy(request.alphabet, transfer->alphabet->name);
+        if (transfer->generate_key)
+            strcpy(request.operation, OP_GENERATE);
+        else if (!send_key)
+        {
+            strcpy(request.pad_id, transfer->pad_id);
+            request.key_offset = transfer->key_offset + transfer->offset;
+            request.token = transfer->token;
+        }
+        if (!stamp_deadline(&request, transfer->deadline_ns))
+        {
+            fprintf(stderr, "Error: deadline passed at offset %lld\n", transfer->offset);
+            success = false;
+            break;
+        }
+        if (!send_header(&request, socket_fd) || !send_bytes(payload, send_key ? 2 * size : size, socket_fd))
+        {
+            success = false;
+            break;
+        }
+        mark_phase(&transfer->trace, PHASE_WAIT);
+
+        // Read response header and verify that it answers this chunk
+        struct Header response;
+        if (!read_header(&reader, &response))
+        {
+            fprintf(stderr, reader.timed_out ? "Error: deadline passed at offset %lld\n" :
+                            "Error: connection closed by server at offset %lld\n", transfer->offset);
+            success = false;
+            break;
+        }
+        mark_phase(&transfer->trace, PHASE_RECEIVE);
+        if (strcmp(response.status, STATUS_OVERLOADED) == 0 && retry_overloaded(transfer, ++n_overloaded))
+            continue;
+        if (strcmp(response.status, STATUS_OK) != 0 || response.offset != request.offset || response.length != n)
+        {
+            fprintf(stderr, "Error: server rejected chunk at offset %lld: %s\n", transfer->offset, describe_status(response.status));
+            success = false;
+            break;
+        }
+        n_overloaded = 0;
+
+        // Read the generated key for the chunk and write it to the key file
+        long long output_size = transfer->output_packed ? packed_size(n) : n;
+        if (transfer->generate_key &&
+            (!read_bytes(&reader, payload, size) ||
+             !write_at(transfer->key_output_fd,
+                       convert_symbols(payload, n, transfer->wire_packed, transfer->output_packed, scratch),
+                       output_size, symbol_position(transfer->output_packed, transfer->offset))))
+        {
+            fprintf(stderr, "Error: failed to save generated key at offset %lld\n", transfer->offset);
+            success = false;
+            break;
+        }
+
+        // Read the transformed chunk and write it to stdout
+        success = read_bytes(&reader, output, size);
+        mark_phase(&transfer->trace, PHASE_WRITE);
+        if (!success ||
+            !write_all(STDOUT_FILENO, convert_symbols(output, n, transfer->wire_packed, transfer->output_packed, scratch),
+                       output_size))
+        {
+            fprintf(stderr, "Error: failed to transfer chunk at offset %lld\n", transfer->offset);
+            success = false;
+            break;
+        }
+        transfer->offset += n;
+
+        // Record progress if more chunks remain; a generated key must be durable
+        // before the checkpoint, or its ciphertext could never be decrypted
+        if (transfer->resumable && transfer->offset < transfer->input_length)
+        {
+            if (output_is_file)
+                fsync(STDOUT_FILENO);
+            if (transfer->generate_key && fsync(transfer->key_output_fd) < 0)
+            {
+                fprintf(stderr, "Error: failed to save generated key at offset %lld\n", transfer->offset);
+                success = false;
+                break;
+            }
+            save_checkpoint(transfer);
+        }
+    }
+    finish_traced_request(&transfer->trace);
+
+    // Finish the generated key with a newline unless it is packed,
+    // discarding anything left from an older key
+    if (success && transfer->generate_key)
+    {
+        long long key_size = symbol_position(transfer->output_packed, 0) +
+                             (transfer->output_packed ? packed_size(transfer->input_length) : transfer->input_length);
+        success = ftruncate(transfer->key_output_fd, key_size) == 0 &&
+                  (transfer->output_packed || write_at(transfer->key_output_fd, "\n", 1, key_size)) &&
+                  fsync(transfer->key_output_fd) == 0;
+        if (!success)
+            fprintf(stderr, "Error: failed to save generated key\n");
+    }
+
+    // Finish output with a newline unless it is packed or binary, and discard the checkpoint
+    if (success)
+    {
+        success = transfer->output_packed || transfer->binary || write_all(STDOUT_FILENO, "\n", 1);
+        if (transfer->resumable && unlink(transfer->checkpoint_filename) < 0 && errno != ENOENT)
+            fprintf(stderr, "Error: failed to remove checkpoint file \"%s\"\n", transfer->checkpoint_filename);
+    }
+
+    // Free allocated memory
+    free_reader(&reader);
+    free(payload);
+    if (!transfer->generate_key)
+        free(output);
+    free(scratch);
+    return success;
+}
\ No newline at end of file
@@ -0,0 +1,205 @@
+/**
+ * @file transfer.h
+ * @author Cody Ray <rayc2@oregonstate.edu>
+ * @version 1.0
+ * @section DESCRIPTION
+ *
+ * For OSU CS 344
+ * Assignment 5
+ * 
+ * Definitions for transfer.c
+ */
+
+#ifndef TRANSFER
+#define TRANSFER
+
+// Suffix appended to the input filename to name its checkpoint file
+#define CHECKPOINT_SUFFIX ".ckpt"
+
+// Prefix of a key argument naming a server-resident pad, e.g. pad:ID:OFFSET
+#define PAD_KEY_PREFIX "pad:"
+
+// Pad offset asking the server to reserve a fresh range, e.g. pad:ID:next
+#define PAD_KEY_NEXT "next"
+
+// Prefix of a key argument asking the server to generate the key, e.g. gen:KEYFILE
+#define GEN_KEY_PREFIX "gen:"
+
+// Object to hold the state of a chunked, resumable transfer
+struct Transfer
+{
+    const char *input_name;     // name of the input for error messages, e.g. "plaintext"
+    char *input_filename;       // file holding the input to transform
+    char *key_filename;         // file holding the key, pad:ID[:OFFSET] for a server-resident pad, or gen:KEYFILE
+    char pad_id[MAX_PAD_ID_SIZE];   // server-resident pad to use as key; empty if the key is a file
+    char *checkpoint_filename;  // file recording the number of confirmed output symbols
+    bool resumable;             // whether confirmed offsets are checkpointed so the transfer can be resumed
+    int input_fd;               // descriptor of the open input file
+    int key_fd;                 // descriptor of the open key file
+    long long input_length;     // number of symbols in the input, excluding trailing newline
+    long long key_length;       // number of symbols in the key, excluding trailing newline; -1 if unknown
+    long long key_offset;       // offset of the key symbol that pairs with the first input symbol
+    bool reserve_key;           // whether the key offset is reserved by the server
+    bool key_reserved;          // whether the reservation has been made
+    long long token;            // token of the reservation, sent with each chunk that uses it
+    bool generate_key;          // whether the server generates the key
+    int key_output_fd;          // descriptor of the file the generated key is written to
+    bool input_packed;          // whether the input file holds packed symbols
+    bool key_packed;            // whether the key file holds packed symbols
+    bool output_packed;         // whether output and a generated key are written packed
+    bool wire_packed;           // whether payloads exchanged with the server are packed
+    bool binary;                // whether input, key, payloads, and output hold arbitrary bytes
+    const struct Alphabet *alphabet;    // alphabet of the input and key symbols
+    bool compress;              // whether input chunks are compressed into records before encryption
+    bool expand;                // whether the input is records to expand after decryption
+    bool authenticate;          // whether each chunk's ciphertext is followed by its tag
+    bool verify;                // whether the input holds tags to verify (decryption)
+    long long key_needed;       // number of key symbols the transfer uses; -1 if not yet counted
+    long long output_position;  // number of output bytes confirmed written, in record transfers
+    long long key_used;         // number of key symbols used by confirmed records
+    long long offset;           // number of output symbols confirmed written to stdout
+    long long deadline_ns;      // monotonic time by which the transfer must finish; 0 for none
+    struct Trace trace;         // tracing of the phases of the connection and each chunk
+};
+
+/**
+ * Opens the input and key files and determines their lengths.
+ * A trailing newline in either file is not counted. Either file may hold
+ * packed symbols, recognized by the packed file header. In binary transfers,
+ * both files hold arbitrary bytes, every byte is counted, and the key must be a file.
+ * If the key is given as pad:ID[:OFFSET], no key file is opened; the server
+ * reads the key from its pad store and checks the pad's length itself.
+ * An offset of "next" asks the server to reserve an unused range of the pad.
+ * If the key is given as gen:KEYFILE, the server generates the key and
+ * KEYFILE is opened for writing it.
+ * Alphabets other than the default need unpacked input and key files and
+ * unpacked text payloads, since pads, generated keys, and packed symbols are
+ * A-Z and space.
+ * 
+ * @param  transfer object to initialize
+ * @param  input_name name of the input for error messages
+ * @param  input_filename file holding the input to transform
+ * @param  key_filename file holding the key, pad:ID[:OFFSET], or gen:KEYFILE
+ * @param  format format of the output, one of the FORMAT_ values; FORMAT_PACKED
+ *         also packs a generated key, and FORMAT_BINARY makes the transfer binary
+ * @param  alphabet alphabet of the input and key symbols
+ * 
+ * @return true if both files were opened, else false
+ */
+bool open_transfer(struct Transfer *, const char *, char *, char *, int, const struct Alphabet *);
+
+/**
+ * Makes the transfer compress its input into records before encryption, or
+ * expand its input records after decryption. A record is a header followed
+ * by a payload holding the compressed chunk, and only the payload is sent to
+ * the server and uses key symbols. Records are A-Z and space, one byte per
+ * symbol, and need a key file or a server-resident pad.
+ * 
+ * @param  transfer object to enable compression on
+ * @param  expand true to expand records (decryption), false to compress chunks (encryption)
+ * 
+ * @return true if the transfer can be compressed, else false
+ */
+bool enable_compression(struct Transfer *, bool);
+
+/**
+ * Makes the transfer authenticate its ciphertext. When encrypting, the
+ * server returns a tag for each chunk, which is written after the chunk's
+ * ciphertext. When verifying, each chunk of the input is followed by its tag,
+ * and the server refuses to decrypt a chunk whose tag does not match. Each
+ * chunk's MAC key is the MAC_KEY_SYMBOLS key symbols after the chunk's key.
+ * Tags are written as symbols of the transfer's alphabet, so the input, key,
+ * and payloads must be unpacked text. If the transfer is also compressed,
+ * this must be called after enable_compression(), and each record is
+ * authenticated in place of each chunk.
+ * 
+ * @param  transfer object to enable authentication on
+ * @param  verify true to verify tags (decryption), false to write them (encryption)
+ * 
+ * @return true if the transfer can be authenticated, else false
+ */
+bool enable_authentication(struct Transfer *, bool);
+
+/**
+ * Gives the transfer a deadline. Every request tells the server how long the
+ * client will still wait for it, so the server can abandon chunks once the
+ * deadline passes, and the transfer stops at the first chunk that is not
+ * answered in time. Chunks confirmed before then are checkpointed as usual.
+ * 
+ * @param  transfer object to set the deadline of
+ * @param  deadline_ns monotonic time by which the transfer must finish, as from monotonic_ns(); 0 for none
+ */
+void set_transfer_deadline(struct Transfer *, long long);
+
+/**
+ * Makes the transfer time the phases of its connection and of each chunk:
+ * connecting, the handshake, and reading, sending, waiting for, receiving,
+ * and writing each chunk. The latest phases are kept for dump_trace().
+ * 
+ * @param  transfer object to enable tracing on
+ * @param  name name of the client
+ * @param  trace_filename file the phases are written to in Chrome trace-event format
+ * 
+ * @return true if tracing could be set up, else false
+ */
+bool enable_tracing(struct Transfer *, const char *, const char *);
+
+/**
+ * Closes the files opened by open_transfer() and frees allocated memory
+ * 
+ * @param  transfer object to close
+ */
+void close_transfer(struct Transfer *);
+
+/**
+ * Makes the transfer resumable and restores the offset recorded in its
+ * checkpoint file, if there is one, starting from the beginning otherwise.
+ * The checkpoint must describe the same input and key lengths and key offset.
+ * If the key offset was reserved by the server, the reserved offset is restored.
+ * If stdout is a regular file, it is truncated to the confirmed offset so that
+ * output written after the last checkpoint is regenerated rather than duplicated.
+ * 
+ * @param  transfer object to restore offset into
+ * 
+ * @return true if the transfer can continue from the restored offset, else false
+ */
+bool load_checkpoint(struct Transfer *);
+
+/**
+ * Checks that every character of the input from the current offset onward is valid.
+ * Valid characters are the symbols of the transfer's alphabet.
+ * When expanding, every record header is checked and the key symbols the
+ * records need are counted. When compressing, the key symbols are counted
+ * only if a pad range must be reserved for them, since that compresses the
+ * input twice.
+ * 
+ * @param  transfer object holding the input to validate
+ * 
+ * @return the first-encountered invalid character if one is found;
+ *         EOF if the input could not be read;
+ *         0 if no invalid characters were found
+ */
+char validate_input(struct Transfer *);
+
+/**
+ * Sends the input and key to the server one chunk at a time, starting at the
+ * current offset, and writes each transformed chunk to stdout. If the key
+ * offset is to be reserved, a range as long as the key needed is reserved first. If the transfer
+ * is resumable, the confirmed offset is recorded in the checkpoint file after each chunk that is
+ * not the last, and a key the server generates is synced to the key file before the checkpoint
+ * that confirms it. A checkpoint that cannot be written is only warned about.
+ * Input and key are converted to the payload format as they are read, and
+ * output is converted to the output format as it is written.
+ * With compression enabled, each chunk is sent as the payload of its record,
+ * and records take the place of chunks in the input or output. With
+ * authentication enabled, each chunk or record of ciphertext is followed by its tag.
+ * The checkpoint file is removed once the transfer completes.
+ * 
+ * @param  transfer object holding the input and key to send
+ * @param  socket_fd file descriptor for connected socket
+ * 
+ * @return true if the entire input was transformed, else false
+ */
+bool run_transfer(struct Transfer *, int);
+
+#endif
\ No newline at end of file
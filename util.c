@@ -13,6 +13,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
 
 #include "util.h"
 
@@ -42,27 +45,6 @@ void replace_newline(char *msg)
         msg[msg_len - 1] = '\0';
 }
 
-char validate_message(char *msg)
-{
-    // Walk through all characters in message
-    for (int i = 0; i < strlen(msg); i++)
-    {
-        // Get the character at the current index
-        char ch = msg[i];
-
-        // If character is 0, skip
-        if (ch == 0)
-            continue;
-
-        // If character is not valid, return the character
-        if ( (ch < 'A' && ch != ' ') || ch > 'Z' )
-            return ch;
-    }
-
-    // Return 0 to indicate no invalid characters
-    return 0;
-}
-
 void find_stop_index(char *message, int *stop_idx)
 {
     // stop_idx of -1 indicates stop character has not been found
@@ -109,4 +91,35 @@ int mod(int a, int b)
     // If the remainder is negative, return remainder + b
     // Otherwise return remainder
     return remainder < 0 ? remainder + b : remainder;
+}
+
+long long monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long parse_size(const char *string)
+{
+    // Convert the leading digits
+    char *end;
+    errno = 0;
+    long long size = strtoll(string, &end, 10);
+    if (end == string || size < 0 || errno == ERANGE)
+        return -1;
+
+    // Apply the suffix, if any
+    int shift = 0;
+    switch (*end)
+    {
+        case '\0': break;
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+        default: return -1;
+    }
+    if (*end != '\0' || size > LLONG_MAX >> shift)
+        return -1;
+    return size << shift;
 }
\ No newline at end of file
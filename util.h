@@ -30,18 +30,6 @@ int count_digits(int);
  */
 void replace_newline(char *);
 
-/**
- * Checks that every character in specified message is valid.
- * Valid characters include A-Z and space. If an invalid character
- * is encountered, the invalid character is returned.
- * 
- * @param  msg the message to validate
- * 
- * @return the first-encountered invalid character if one is found;
- *         0 if no invalid characters were found
- */
-char validate_message(char *);
-
 /**
  * Searches through the specified string for the stop character ('@').
  * If the stop character is found, it's index is recorded in stop_idx.
@@ -76,4 +64,22 @@ void find_stop_indices(const char *, int *, int *);
  */
 int mod(int, int);
 
+/**
+ * Gets the current time of the monotonic clock
+ * 
+ * @return nanoseconds since an arbitrary fixed point
+ */
+long long monotonic_ns(void);
+
+/**
+ * Converts a size to a 64-bit integer. The size may end in K, M, or G
+ * (case-insensitive) to multiply it by 2^10, 2^20, or 2^30.
+ * 
+ * @param  string the size to convert
+ * 
+ * @return the size; -1 if it is not a non-negative integer with an optional
+ *         suffix, or does not fit in 64 bits
+ */
+long long parse_size(const char *);
+
 #endif
\ No newline at end of file